@@ -0,0 +1,126 @@
+// ==================================================================
+// Copyright (c) 2019 Alexander Freed. ALL RIGHTS RESERVED.
+// Language: ISO C++14
+//
+// Augmenter class definition.
+// The elastic distortion follows Simard, Steinkraus and Platt, "Best Practices for Convolutional
+// Neural Networks Applied to Visual Document Analysis" (2003): a random displacement field,
+// smoothed with a gaussian and scaled.
+// ==================================================================
+
+#include "Augmenter.h"
+
+#include "Kernels.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+
+namespace fnn {
+
+
+/** Constructor
+@param[in] params The ranges of the distortions.
+*/
+Augmenter::Augmenter(const AugmentParams& params)
+    : m_params(params)
+{
+    m_padded.fill(0);
+    m_dx.fill(0);
+    m_dy.fill(0);
+
+    if (m_params.elasticAlpha > 0 && m_params.elasticSigma > 0)
+    {
+        const int radius = static_cast<int>(std::ceil(2 * m_params.elasticSigma));
+        m_kernel.resize(2 * radius + 1);
+        for (int i = -radius; i <= radius; ++i)
+            m_kernel[i + radius] = std::exp(-0.5 * i * i / (m_params.elasticSigma * m_params.elasticSigma));
+        double sum = 0;
+        for (const double tap : m_kernel)
+            sum += tap;
+        for (double& tap : m_kernel)
+            tap /= sum;
+    }
+}
+
+
+/** Distort one image.
+@param[in]     pSource The source image. 28x28 row-major values.
+@param[out]    pDest   The distorted image. Same layout as the source. Must not overlap it.
+@param[in/out] rng     The random number generator the distortion is drawn from.
+*/
+void Augmenter::Apply(const double* pSource, double* pDest, Rng& rng)
+{
+    // draw the distortion
+    std::uniform_real_distribution<double> uniform(-1.0, 1.0);
+    const double shiftX   = m_params.maxShift * uniform(rng);
+    const double shiftY   = m_params.maxShift * uniform(rng);
+    const double rotation = m_params.maxRotation * uniform(rng) * (3.14159265358979323846 / 180);
+    const double scale    = 1 + m_params.maxScale * uniform(rng);
+    if (!m_kernel.empty())
+        makeDisplacement(rng);
+
+    // the source coordinate of output pixel (x, y) is (a*x + b*y + e + dx, -b*x + a*y + f + dy):
+    // rotation and scale about the centre, after the shift
+    const double centre = (IMAGE_SIZE - 1) / 2.0;
+    const double a = std::cos(rotation) / scale;
+    const double b = std::sin(rotation) / scale;
+    const double e = centre - a * (centre + shiftX) - b * (centre + shiftY);
+    const double f = centre + b * (centre + shiftX) - a * (centre + shiftY);
+
+    // copy the source into the zero border
+    for (int y = 0; y < IMAGE_SIZE; ++y)
+        std::copy_n(pSource + y * IMAGE_SIZE, IMAGE_SIZE, &m_padded[(y + BORDER) * PADDED_STRIDE + BORDER]);
+
+    // sample the output pixels. The coordinates are clamped to the border, short of its last row and column.
+    ResampleBilinear(m_padded.data(), PADDED_STRIDE, BORDER, IMAGE_SIZE, a, b, e, f, m_dx.data(), m_dy.data(), pDest);
+}
+
+
+/** Make a random elastic displacement field in m_dx and m_dy.
+*/
+void Augmenter::makeDisplacement(Rng& rng)
+{
+    std::uniform_real_distribution<double> uniform(-1.0, 1.0);
+    for (auto* pField : { &m_dx, &m_dy })
+    {
+        for (double& d : *pField)
+            d = uniform(rng);
+        blur(*pField);
+        for (double& d : *pField)
+            d *= m_params.elasticAlpha;
+    }
+}
+
+
+/** Smooth a field with the gaussian kernel, horizontally then vertically. Outside the field is 0.
+@param[in/out] field The field.
+*/
+void Augmenter::blur(std::array<double, NUM_PIXELS>& field)
+{
+    const int radius = static_cast<int>(m_kernel.size() / 2);
+    for (int y = 0; y < IMAGE_SIZE; ++y)
+    {
+        for (int x = 0; x < IMAGE_SIZE; ++x)
+        {
+            double sum = 0;
+            for (int k = std::max(-radius, -x); k <= std::min(radius, IMAGE_SIZE - 1 - x); ++k)
+                sum += m_kernel[k + radius] * field[y * IMAGE_SIZE + x + k];
+            m_temp[y * IMAGE_SIZE + x] = sum;
+        }
+    }
+    for (int y = 0; y < IMAGE_SIZE; ++y)
+    {
+        for (int x = 0; x < IMAGE_SIZE; ++x)
+        {
+            double sum = 0;
+            for (int k = std::max(-radius, -y); k <= std::min(radius, IMAGE_SIZE - 1 - y); ++k)
+                sum += m_kernel[k + radius] * m_temp[(y + k) * IMAGE_SIZE + x];
+            field[y * IMAGE_SIZE + x] = sum;
+        }
+    }
+}
+
+
+}
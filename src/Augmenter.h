@@ -0,0 +1,65 @@
+// ==================================================================
+// Copyright (c) 2019 Alexander Freed. ALL RIGHTS RESERVED.
+// Language: ISO C++14
+//
+// Augmenter class declaration.
+// Random distortions of digit images, applied as samples are fed to training.
+// ==================================================================
+
+#pragma once
+
+#include "Random.h"
+
+#include <array>
+#include <vector>
+
+
+namespace fnn {
+
+
+/** The ranges of the random distortions. Each one is drawn uniformly from [-max, max].
+*/
+struct AugmentParams
+{
+    double maxShift     = 2.0;   // pixels
+    double maxRotation  = 10.0;  // degrees
+    double maxScale     = 0.1;   // fraction of the size
+    double elasticAlpha = 34.0;  // the scale of the elastic displacement. 0 for none.
+    double elasticSigma = 4.0;   // pixels. The smoothness of the elastic displacement.
+};
+
+
+/** Distorts 28x28 images with a random shift, rotation, scale and elastic distortion.
+Each output pixel is sampled from the source with bilinear interpolation. Pixels outside the source are 0.
+Holds scratch space, so each thread needs its own.
+*/
+class Augmenter
+{
+public:
+    constexpr static int IMAGE_SIZE = 28;
+
+    explicit Augmenter(const AugmentParams& params = AugmentParams());
+
+    void Apply(const double* pSource, double* pDest, Rng& rng);
+
+private:
+    // the source is copied into a zero border. ResampleBilinear clamps coordinates so their 4 neighbours stay inside it.
+    constexpr static int BORDER        = 2;
+    constexpr static int PADDED_STRIDE = 32;
+    constexpr static int NUM_PIXELS    = IMAGE_SIZE * IMAGE_SIZE;
+
+    void makeDisplacement(Rng& rng);
+    void blur(std::array<double, NUM_PIXELS>& field);
+
+    AugmentParams       m_params;
+    std::vector<double> m_kernel;  // normalized 1D gaussian, 2 * radius + 1 taps
+
+    // scratch
+    std::array<double, PADDED_STRIDE * PADDED_STRIDE> m_padded;
+    std::array<double, NUM_PIXELS>                    m_dx;
+    std::array<double, NUM_PIXELS>                    m_dy;
+    std::array<double, NUM_PIXELS>                    m_temp;
+};
+
+
+}
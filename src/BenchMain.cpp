@@ -0,0 +1,682 @@
+// ==================================================================
+// Copyright (c) 2019 Alexander Freed. ALL RIGHTS RESERVED.
+// Language: ISO C++14
+//
+// Benchmark entry.
+// Times the hot paths of the classifier in isolation, on synthetic MNIST-shaped data,
+// so no data files are needed.
+// ==================================================================
+
+#include "Augmenter.h"
+#include "Benchmark.h"
+#include "Ensemble.h"
+#include "FileIO.h"
+#include "Kernels.h"
+#include "NeuralNet.h"
+#include "Numa.h"
+#include "Optimizer.h"
+#include "Random.h"
+#include "Synthetic.h"
+#include "Trainer.h"
+#include "WorkerTeam.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <numeric>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+using namespace fnn;
+
+
+namespace {
+
+
+// keeps results alive so the timed code is not optimized away
+volatile int g_sink = 0;
+
+
+/** Command-line settings.
+*/
+struct Settings
+{
+    Benchmark::Options    bench;
+    std::vector<unsigned> hiddenSizes = { 20, 100, 400 };
+    std::vector<unsigned> teamSizes;            // of TrainIntraOp and Augment. Empty: 1, 2, 4, ... up to the hardware threads
+    std::vector<unsigned> modelCounts = { 1, 4 }; // of the ensemble benchmarks
+    size_t                numSamples  = 2000;   // samples per call of the network, ensemble and augmentation benchmarks
+    size_t                numRows     = 10000;  // samples in the files of the load benchmarks
+    std::string           tempDir     = ".";
+    std::string           savePath;             // empty: do not save a baseline
+    std::string           comparePath;          // empty: do not compare with a baseline
+    double                threshold   = 5;      // the slowdown, in percent, that fails a comparison
+    std::string           kernelIsa;            // empty: the best the CPU supports
+};
+
+
+/** Convert stored samples to Trainers.
+@param[in] packed The samples in stored form.
+@return The samples.
+*/
+std::vector<Trainer> toTrainers(const FileIO::PackedDataset& packed)
+{
+    std::vector<Trainer> trainers;
+    trainers.reserve(packed.GetNumSamples());
+    for (size_t i = 0; i < packed.GetNumSamples(); ++i)
+        trainers.emplace_back(packed.labels[i], &packed.pixels[i * packed.GetPixelsPerSample()], packed.GetPixelsPerSample());
+    return trainers;
+}
+
+
+/** Get the size of a file.
+@return The size in bytes, or 0 if the file does not exist.
+*/
+size_t fileSize(const std::string& path)
+{
+    std::ifstream fin(path.c_str(), std::ios::binary | std::ios::ate);
+    return fin ? static_cast<size_t>(fin.tellg()) : 0;
+}
+
+
+/** Get the team sizes of the threaded benchmarks.
+@return The sizes given with --threads, or 1, 2, 4, ... up to the hardware threads.
+*/
+std::vector<unsigned> getTeamSizes(const Settings& settings)
+{
+    std::vector<unsigned> teamSizes = settings.teamSizes;
+    if (teamSizes.empty())
+    {
+        const unsigned maxThreads = std::max(2u, std::thread::hardware_concurrency());
+        for (unsigned numThreads = 1; numThreads < maxThreads; numThreads *= 2)
+            teamSizes.push_back(numThreads);
+        teamSizes.push_back(maxThreads);
+    }
+    return teamSizes;
+}
+
+
+// ------------------------------------------------------------------
+// benchmarks
+
+/** Benchmark the network at each hidden layer size: DetermineDigit, TrainFromInput and Evaluate.
+The bytes are the weights an operation must touch: read once to classify, and to train, read once
+forward, then the weights and the weight changes each read and written once by the update.
+*/
+void benchNetwork(Benchmark& bench, const Settings& settings)
+{
+    const std::vector<Trainer> samples = toTrainers(MakeSyntheticDataset(settings.numSamples, SyntheticSplit::TRAIN));
+    std::vector<NeuralNetDigitClassifier::OutputType> targets;
+    for (const Trainer& sample : samples)
+        targets.push_back(NeuralNetDigitClassifier::EncodeTarget(sample.GetTarget()));
+
+    for (const unsigned numHidden : settings.hiddenSizes)
+    {
+        const std::string param = "hidden=" + std::to_string(numHidden);
+        Rng rng(1, MakeStreamId(StreamUse::MAIN, numHidden));
+        NeuralNetDigitClassifier neuralnet(numHidden, rng);
+        const double weightBytes = sizeof(double) * (double(NUM_INPUTS) * numHidden + (numHidden + 1.0) * NeuralNetDigitClassifier::NUM_OUTPUTS);
+        const double inputBytes  = sizeof(double) * double(NUM_INPUTS);
+
+        if (bench.IsSelected("DetermineDigit"))
+        {
+            bench.Run("DetermineDigit", param, double(samples.size()), 1, weightBytes + inputBytes, [&]() {
+                for (const Trainer& sample : samples)
+                    g_sink = g_sink + neuralnet.DetermineDigit(sample.GetInputs());
+            });
+        }
+        if (bench.IsSelected("Evaluate"))
+        {
+            bench.Run("Evaluate", param, 1, double(samples.size()), (weightBytes + inputBytes) * samples.size(), [&]() {
+                g_sink = g_sink + static_cast<int>(Evaluate(neuralnet, samples) * 100);
+            });
+        }
+        if (bench.IsSelected("TrainFromInput"))
+        {
+            Optimizer optimizer;
+            bench.Run("TrainFromInput", param, double(samples.size()), 1, 5 * weightBytes + inputBytes, [&]() {
+                for (size_t i = 0; i < samples.size(); ++i)
+                    neuralnet.TrainFromInput(samples[i].GetInputs(), targets[i], optimizer);
+            });
+        }
+    }
+}
+
+
+/** Benchmark TrainFromInput with each sample's input layer split across a team of threads (see WorkerTeam), at each
+hidden layer size and team size. The bytes are those of TrainFromInput, which the team shares out.
+Each team must give the weights of one thread, bit for bit, so each is first checked on a few samples.
+@return false if a team's weights differ from one thread's.
+*/
+bool benchIntraOp(Benchmark& bench, const Settings& settings)
+{
+    if (!bench.IsSelected("TrainIntraOp"))
+        return true;
+
+    const std::vector<unsigned> teamSizes = getTeamSizes(settings);
+    const std::vector<Trainer> samples = toTrainers(MakeSyntheticDataset(settings.numSamples, SyntheticSplit::TRAIN));
+    std::vector<NeuralNetDigitClassifier::OutputType> targets;
+    for (const Trainer& sample : samples)
+        targets.push_back(NeuralNetDigitClassifier::EncodeTarget(sample.GetTarget()));
+    const size_t numChecked = std::min<size_t>(samples.size(), 20);
+
+    bool success = true;
+    for (const unsigned numHidden : settings.hiddenSizes)
+    {
+        Rng rng(1, MakeStreamId(StreamUse::MAIN, numHidden));
+        const NeuralNetDigitClassifier initial(numHidden, rng);
+        const double weightBytes = sizeof(double) * (double(NUM_INPUTS) * numHidden + (numHidden + 1.0) * NeuralNetDigitClassifier::NUM_OUTPUTS);
+        const double inputBytes  = sizeof(double) * double(NUM_INPUTS);
+
+        NeuralNetDigitClassifier single = initial;
+        Optimizer singleOptimizer;
+        for (size_t i = 0; i < numChecked; ++i)
+            single.TrainFromInput(samples[i].GetInputs(), targets[i], singleOptimizer);
+        const NeuralNetDigitClassifier::WeightsCollection singleWeights = single.GetWeights();
+
+        for (const unsigned numThreads : teamSizes)
+        {
+            const std::string param = "hidden=" + std::to_string(numHidden) + " threads=" + std::to_string(numThreads);
+            WorkerTeam team(numThreads);
+            NeuralNetDigitClassifier neuralnet = initial;
+            Optimizer optimizer;
+            for (size_t i = 0; i < numChecked; ++i)
+                neuralnet.TrainFromInput(samples[i].GetInputs(), targets[i], optimizer, &team);
+            const NeuralNetDigitClassifier::WeightsCollection weights = neuralnet.GetWeights();
+            bool same = true;
+            for (size_t layer = 0; layer < weights.size(); ++layer)
+                same = same && weights[layer] == singleWeights[layer];
+            if (!same)
+            {
+                std::cout << "TrainIntraOp " << param << " does not give the weights of one thread" << std::endl;
+                success = false;
+                continue;
+            }
+
+            bench.Run("TrainIntraOp", param, double(samples.size()), 1, 5 * weightBytes + inputBytes, [&]() {
+                for (size_t i = 0; i < samples.size(); ++i)
+                    neuralnet.TrainFromInput(samples[i].GetInputs(), targets[i], optimizer, &team);
+            });
+        }
+    }
+    return success;
+}
+
+
+/** Benchmark training an ensemble of networks (see EnsembleClassifier) against training its models one after another
+(TrainSeparate), at each hidden layer size and number of models. An operation is a sample, which trains every model,
+and the bytes are those of TrainFromInput once per model. The ensemble must give the separate models' weights up to
+rounding, so each is first checked on a few samples.
+@return false if an ensemble's weights differ from the separate models'.
+*/
+bool benchEnsemble(Benchmark& bench, const Settings& settings)
+{
+    if (!bench.IsSelected("TrainSeparate") && !bench.IsSelected("TrainEnsemble"))
+        return true;
+
+    const std::vector<Trainer> samples = toTrainers(MakeSyntheticDataset(settings.numSamples, SyntheticSplit::TRAIN));
+    std::vector<NeuralNetDigitClassifier::OutputType> targets;
+    for (const Trainer& sample : samples)
+        targets.push_back(NeuralNetDigitClassifier::EncodeTarget(sample.GetTarget()));
+    const size_t numChecked = std::min<size_t>(samples.size(), 20);
+
+    bool success = true;
+    for (const unsigned numHidden : settings.hiddenSizes)
+    {
+        const double weightBytes = sizeof(double) * (double(NUM_INPUTS) * numHidden + (numHidden + 1.0) * NeuralNetDigitClassifier::NUM_OUTPUTS);
+        const double inputBytes  = sizeof(double) * double(NUM_INPUTS);
+
+        for (const unsigned numModels : settings.modelCounts)
+        {
+            const std::string param = "hidden=" + std::to_string(numHidden) + " models=" + std::to_string(numModels);
+            std::vector<NeuralNetDigitClassifier> separate;
+            for (unsigned m = 0; m < numModels; ++m)
+            {
+                Rng rng(1, MakeStreamId(StreamUse::ENSEMBLE, m));
+                separate.emplace_back(numHidden, rng);
+            }
+            EnsembleClassifier ensemble(separate);
+            std::vector<Optimizer> separateOptimizers(numModels);
+            Optimizer optimizer;
+
+            // only the rounding of the wider products may differ
+            for (size_t i = 0; i < numChecked; ++i)
+            {
+                for (unsigned m = 0; m < numModels; ++m)
+                    separate[m].TrainFromInput(samples[i].GetInputs(), targets[i], separateOptimizers[m]);
+                ensemble.TrainFromInput(samples[i].GetInputs(), targets[i], optimizer);
+            }
+            double difference = 0;
+            for (unsigned m = 0; m < numModels; ++m)
+            {
+                const NeuralNetDigitClassifier::WeightsCollection weights         = ensemble.GetModel(m).GetWeights();
+                const NeuralNetDigitClassifier::WeightsCollection separateWeights = separate[m].GetWeights();
+                for (size_t layer = 0; layer < weights.size(); ++layer)
+                    difference = std::max(difference, (weights[layer] - separateWeights[layer]).cwiseAbs().maxCoeff());
+            }
+            if (!(difference <= 1e-6))
+            {
+                std::cout << "TrainEnsemble " << param << " does not match the separate models: " << difference << std::endl;
+                success = false;
+                continue;
+            }
+
+            const double bytesPerSample = numModels * 5 * weightBytes + inputBytes;
+            if (bench.IsSelected("TrainSeparate"))
+            {
+                bench.Run("TrainSeparate", param, double(samples.size()), 1, bytesPerSample, [&]() {
+                    for (unsigned m = 0; m < numModels; ++m)
+                        for (size_t i = 0; i < samples.size(); ++i)
+                            separate[m].TrainFromInput(samples[i].GetInputs(), targets[i], separateOptimizers[m]);
+                });
+            }
+            if (bench.IsSelected("TrainEnsemble"))
+            {
+                bench.Run("TrainEnsemble", param, double(samples.size()), 1, bytesPerSample, [&]() {
+                    for (size_t i = 0; i < samples.size(); ++i)
+                        ensemble.TrainFromInput(samples[i].GetInputs(), targets[i], optimizer);
+                });
+            }
+        }
+    }
+    return success;
+}
+
+
+/** Benchmark the momentum update of the input->hidden weights at each hidden layer size: the fused kernel
+(UpdateFused, see Kernels.h) and the same update written as Eigen expressions (UpdateExpressions).
+The bytes are the minimum traffic: the weights and the weight changes each read and written once.
+The kernel must match the expressions up to rounding, so it is first checked on a few updates.
+@return false if the kernel does not match the expressions.
+*/
+bool benchUpdate(Benchmark& bench, const Settings& settings)
+{
+    if (!bench.IsSelected("UpdateExpressions") && !bench.IsSelected("UpdateFused"))
+        return true;
+
+    const double learningRate = 0.1;
+    const double momentum     = 0.9;
+    const unsigned numChecked = 20;
+
+    bool success = true;
+    for (const unsigned numHidden : settings.hiddenSizes)
+    {
+        const std::string param = "hidden=" + std::to_string(numHidden);
+        Rng rng(1, MakeStreamId(StreamUse::MAIN, numHidden));
+        std::uniform_real_distribution<double> distribution(-0.05, 0.05);
+        const auto random = [&]() { return distribution(rng); };
+        const Eigen::MatrixXd    weights = Eigen::MatrixXd::NullaryExpr(NUM_INPUTS, numHidden, random);
+        const Eigen::MatrixXd    delta   = Eigen::MatrixXd::NullaryExpr(NUM_INPUTS, numHidden, random);
+        const Eigen::RowVectorXd x       = Eigen::RowVectorXd::NullaryExpr(NUM_INPUTS, random);
+        const Eigen::RowVectorXd error   = Eigen::RowVectorXd::NullaryExpr(numHidden, random);
+        const double bytes = 4 * sizeof(double) * double(NUM_INPUTS) * numHidden;
+
+        Eigen::MatrixXd expressionWeights = weights;
+        Eigen::MatrixXd expressionDelta   = delta;
+        const auto expressionUpdate = [&]() {
+            expressionDelta = learningRate * x.transpose() * error + momentum * expressionDelta;
+            expressionWeights += expressionDelta;
+        };
+        Eigen::MatrixXd fusedWeights = weights;
+        Eigen::MatrixXd fusedDelta   = delta;
+        const auto fusedUpdate = [&]() {
+            MomentumRank1Update(fusedWeights.data(), fusedDelta.data(), NUM_INPUTS, numHidden, x.data(), error.data(), learningRate, momentum);
+        };
+
+        // only the rounding may differ
+        for (unsigned i = 0; i < numChecked; ++i)
+        {
+            expressionUpdate();
+            fusedUpdate();
+        }
+        const double difference = (fusedWeights - expressionWeights).cwiseAbs().maxCoeff();
+        if (!(difference <= 1e-9 * numChecked))
+        {
+            std::cout << "UpdateFused " << param << " does not match the expressions: " << difference << std::endl;
+            success = false;
+            continue;
+        }
+
+        if (bench.IsSelected("UpdateExpressions"))
+            bench.Run("UpdateExpressions", param, 1, 0, bytes, expressionUpdate);
+        if (bench.IsSelected("UpdateFused"))
+            bench.Run("UpdateFused", param, 1, 0, bytes, fusedUpdate);
+    }
+    return success;
+}
+
+
+/** Benchmark the augmentation (see Augmenter) with the samples shared out between threads, at each team size.
+Each thread distorts an interleaved share with its own augmenter and random stream, as the loader threads do.
+The bytes are the inputs read and the distorted inputs written.
+*/
+void benchAugment(Benchmark& bench, const Settings& settings)
+{
+    if (!bench.IsSelected("Augment"))
+        return;
+
+    const std::vector<Trainer> samples = toTrainers(MakeSyntheticDataset(settings.numSamples, SyntheticSplit::TRAIN));
+    const double bytesPerSample = 2 * sizeof(double) * double(NUM_INPUTS - 1);
+    for (const unsigned numThreads : getTeamSizes(settings))
+    {
+        std::vector<double> firstPixels(numThreads);  // one per thread, so the threads do not share g_sink
+        const auto work = [&](const unsigned first) {
+            Augmenter augmenter;
+            Rng rng(1, MakeStreamId(StreamUse::AUGMENT, 0, first));
+            std::vector<double> dest(NUM_INPUTS - 1);
+            for (size_t i = first; i < samples.size(); i += numThreads)
+                augmenter.Apply(samples[i].GetInputs().data() + 1, dest.data(), rng);
+            firstPixels[first] = dest[0];
+        };
+        bench.Run("Augment", "threads=" + std::to_string(numThreads), 1, double(samples.size()), bytesPerSample * samples.size(), [&]() {
+            std::vector<std::thread> threads;
+            for (unsigned i = 1; i < numThreads; ++i)
+                threads.emplace_back(work, i);
+            work(0);
+            for (auto& thread : threads)
+                thread.join();
+            g_sink = g_sink + static_cast<int>(std::accumulate(firstPixels.begin(), firstPixels.end(), 0.0));
+        });
+    }
+}
+
+
+/** Benchmark reading each NUMA node's memory from each node's CPUs (see Numa.h), through a buffer past the last level
+cache on each node. Each buffer is moved to its node and checked to be there, so a kernel that does not place memory as
+asked fails rather than timing the wrong thing. On a machine without NUMA information this is one node.
+@return false if the kernel refused to move a buffer or pin this thread.
+*/
+bool benchNumaRead(Benchmark& bench)
+{
+    if (!bench.IsSelected("NumaRead"))
+        return true;
+
+    const NumaTopology topology = NumaTopology::Detect();
+    const std::vector<NumaTopology::Node>& nodes = topology.GetNodes();
+    const size_t numDoubles = size_t(64) << 17;  // 64 MB
+    std::vector<std::vector<double>> buffers;
+    for (const NumaTopology::Node& node : nodes)
+    {
+        buffers.emplace_back(numDoubles, 1.0);
+        const bool moved  = MoveMemoryToNode(buffers.back().data(), numDoubles * sizeof(double), node.id);
+        const int  actual = NodeOfMemory(buffers.back().data() + numDoubles / 2);
+        if (!moved || actual != static_cast<int>(node.id))
+        {
+            std::cout << "Unable to move memory to node " << node.id << (moved ? "" : ": ") << (moved ? "" : std::strerror(errno))
+                      << ". It is on node " << actual << "." << std::endl;
+            return false;
+        }
+    }
+
+    const std::vector<unsigned> previousCpus = GetThreadCpus();
+    bool success = true;
+    for (const NumaTopology::Node& cpuNode : nodes)
+    {
+        if (!PinThreadToCpus(cpuNode.cpus))
+        {
+            std::cout << "Unable to pin this thread to node " << cpuNode.id << ": " << std::strerror(errno) << "." << std::endl;
+            success = false;
+            continue;
+        }
+        for (size_t n = 0; n < nodes.size(); ++n)
+        {
+            const std::string param = "cpus=node" + std::to_string(cpuNode.id) + " memory=node" + std::to_string(nodes[n].id);
+            const std::vector<double>& buffer = buffers[n];
+            bench.Run("NumaRead", param, 1, 0, double(numDoubles * sizeof(double)), [&]() {
+                g_sink = g_sink + static_cast<int>(std::accumulate(buffer.begin(), buffer.end(), 0.0));
+            });
+        }
+    }
+    PinThreadToCpus(previousCpus);
+    return success;
+}
+
+
+/** Benchmark the loaders on files of synthetic samples: LoadCsv, Deserialize, and the preprocessing of
+stored samples into Trainers that both finish with. The files are in the page cache, so this is the parsing
+and conversion, not the disk.
+@return false if a file could not be written or loaded.
+*/
+bool benchLoad(Benchmark& bench, const Settings& settings)
+{
+    FileIO::PackedDataset packed = MakeSyntheticDataset(settings.numRows, SyntheticSplit::TRAIN);
+    const std::string param   = "rows=" + std::to_string(settings.numRows);
+    const std::string csvPath = settings.tempDir + "/NeuralNetBench.csv";
+    const std::string binPath = settings.tempDir + "/NeuralNetBench.bin";
+    const double      rows    = double(settings.numRows);
+    bool success = true;
+
+    if (bench.IsSelected("LoadCsv"))
+    {
+        const size_t csvBytes = FileIO::WriteCsv(csvPath, packed) ? fileSize(csvPath) : 0;
+        FileIO::PackedDataset loaded;
+        if (csvBytes == 0 || !FileIO::CheckLoad(std::get<0>(FileIO::LoadCsv(csvPath, settings.numRows, loaded)), &std::cout))
+        {
+            std::cout << "Unable to write or load " << csvPath << std::endl;
+            success = false;
+        }
+        else
+        {
+            bench.Run("LoadCsv", param, 1, rows, double(csvBytes), [&]() {
+                g_sink = g_sink + static_cast<int>(std::get<1>(FileIO::LoadCsv(csvPath, settings.numRows, loaded)).size());
+            });
+        }
+        std::remove(csvPath.c_str());
+    }
+
+    if (bench.IsSelected("Deserialize"))
+    {
+        if (!FileIO::Serialize(binPath, packed) || !FileIO::CheckLoad(std::get<0>(FileIO::Deserialize(binPath)), &std::cout))
+        {
+            std::cout << "Unable to write or load " << binPath << std::endl;
+            success = false;
+        }
+        else
+        {
+            bench.Run("Deserialize", param, 1, rows, double(fileSize(binPath)), [&]() {
+                g_sink = g_sink + static_cast<int>(std::get<1>(FileIO::Deserialize(binPath)).size());
+            });
+        }
+        std::remove(binPath.c_str());
+    }
+
+    if (bench.IsSelected("preprocess"))
+    {
+        // bytes: the stored pixels read and the inputs written
+        const double bytesPerSample = packed.GetPixelsPerSample() + sizeof(double) * double(NUM_INPUTS);
+        bench.Run("preprocess", param, rows, 1, bytesPerSample, [&]() {
+            g_sink = g_sink + static_cast<int>(toTrainers(packed).size());
+        });
+    }
+    return success;
+}
+
+
+// ------------------------------------------------------------------
+// parse args
+
+/** Print the usage.
+*/
+void displayHelp()
+{
+    std::cout << "Usage:\n"
+              << "./NeuralNetBench [options]\n\n"
+              << "Options:\n"
+              << "    --filter=TEXT     - Only run the benchmarks whose name contains TEXT.\n"
+              << "    --hidden=LIST     - The hidden layer sizes of the network, ensemble and update benchmarks. Default: 20,100,400\n"
+              << "    --threads=LIST    - The team sizes of TrainIntraOp and Augment. Default: 1, 2, 4, ... up to the hardware threads\n"
+              << "    --models=LIST     - The numbers of models of the ensemble benchmarks. Default: 1,4\n"
+              << "    --samples=N       - The samples per call of the network, ensemble and augmentation benchmarks. Default: 2000\n"
+              << "    --rows=N          - The samples in the files of the load benchmarks. Default: 10000\n"
+              << "    --reps=N          - Timed repetitions. Default: 7\n"
+              << "    --warmup=N        - Untimed repetitions first. Default: 1\n"
+              << "    --min-time=S      - The shortest repetition in seconds. Default: 0.05\n"
+              << "    --temp-dir=PATH   - Where to write the files of the load benchmarks. Default: .\n"
+              << "    --counters        - Also count hardware events: IPC, and cache and branch misses per sample. Linux only.\n"
+              << "    --save=PATH       - Save the results to PATH as a JSON baseline.\n"
+              << "    --compare=PATH    - Compare the results with the baseline in PATH. Exits with failure if any benchmark\n"
+              << "                        is slower than its baseline by more than the threshold.\n"
+              << "    --threshold=PCT   - The slowdown in percent that --compare fails on. Default: 5\n"
+              << "    --isa=NAME        - Use the kernels built for an instruction set: scalar, sse4.2, avx2 or avx512.\n"
+              << "                        Default: the best one this CPU supports.\n"
+              << std::endl;
+}
+
+
+/** Parse one "--name=value" option.
+@param[in]     arg      The argument, starting with "--".
+@param[in/out] settings The settings to update.
+@return false if the option is unknown or its value could not be parsed.
+*/
+bool parseOption(const std::string& arg, Settings& settings)
+{
+    const size_t equals = arg.find('=');
+    const std::string name  = arg.substr(2, equals == std::string::npos ? std::string::npos : equals - 2);
+    const std::string value = equals == std::string::npos ? std::string() : arg.substr(equals + 1);
+    KernelIsa isa;
+
+    try
+    {
+        if (name == "filter")
+            settings.bench.filter = value;
+        else if (name == "hidden")
+        {
+            settings.hiddenSizes.clear();
+            std::istringstream list(value);
+            std::string size;
+            while (std::getline(list, size, ','))
+            {
+                if (std::stoul(size) == 0)
+                    return false;
+                settings.hiddenSizes.push_back(std::stoul(size));
+            }
+            return !settings.hiddenSizes.empty();
+        }
+        else if (name == "threads")
+        {
+            settings.teamSizes.clear();
+            std::istringstream list(value);
+            std::string size;
+            while (std::getline(list, size, ','))
+            {
+                if (std::stoul(size) == 0)
+                    return false;
+                settings.teamSizes.push_back(std::stoul(size));
+            }
+            return !settings.teamSizes.empty();
+        }
+        else if (name == "models")
+        {
+            settings.modelCounts.clear();
+            std::istringstream list(value);
+            std::string count;
+            while (std::getline(list, count, ','))
+            {
+                if (std::stoul(count) == 0)
+                    return false;
+                settings.modelCounts.push_back(std::stoul(count));
+            }
+            return !settings.modelCounts.empty();
+        }
+        else if (name == "samples" && std::stoul(value) > 0)
+            settings.numSamples = std::stoul(value);
+        else if (name == "rows" && std::stoul(value) > 0)
+            settings.numRows = std::stoul(value);
+        else if (name == "reps" && std::stoul(value) > 0)
+            settings.bench.reps = std::stoul(value);
+        else if (name == "warmup")
+            settings.bench.warmup = std::stoul(value);
+        else if (name == "min-time" && std::stod(value) >= 0)
+            settings.bench.minRepSeconds = std::stod(value);
+        else if (name == "temp-dir" && !value.empty())
+            settings.tempDir = value;
+        else if (arg == "--counters")
+            settings.bench.counters = true;
+        else if (name == "save" && !value.empty())
+            settings.savePath = value;
+        else if (name == "compare" && !value.empty())
+            settings.comparePath = value;
+        else if (name == "threshold" && std::stod(value) >= 0)
+            settings.threshold = std::stod(value);
+        else if (name == "isa" && ParseKernelIsa(value, isa))
+            settings.kernelIsa = value;
+        else
+            return false;
+    }
+    catch (...)
+    {
+        return false;
+    }
+    return true;
+}
+
+
+}  // namespace
+
+
+// ==================================================================
+// main
+
+int main(int argc, char** argv)
+{
+    Settings settings;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (!parseOption(argv[i], settings))
+        {
+            std::cout << "Unable to parse option: " << argv[i] << "\n\n";
+            displayHelp();
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (!SelectKernels(settings.kernelIsa, std::cout))
+        return EXIT_FAILURE;
+
+    // read the baseline first, so a bad path fails before the benchmarks run
+    std::vector<BenchResult> baseline;
+    if (!settings.comparePath.empty() && !Benchmark::ReadBaseline(settings.comparePath, baseline))
+    {
+        std::cout << "Unable to read the baseline " << settings.comparePath << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    Benchmark bench(settings.bench);
+    if (settings.bench.counters && !bench.GetCounters().IsOpen())
+        std::cout << "Hardware counters unavailable: " << bench.GetCounters().GetError() << std::endl;
+    benchNetwork(bench, settings);
+    const bool matched = benchIntraOp(bench, settings);
+    const bool combined = benchEnsemble(bench, settings);
+    const bool updated  = benchUpdate(bench, settings);
+    benchAugment(bench, settings);
+    const bool loaded  = benchLoad(bench, settings);
+    const bool placed  = benchNumaRead(bench);
+
+    std::cout << "\nmedian of " << settings.bench.reps << " repetitions, after " << settings.bench.warmup << " warmup\n";
+    Benchmark::PrintTable(bench.GetResults(), std::cout);
+
+    bool success = matched && combined && updated && loaded && placed;
+    if (!settings.savePath.empty())
+    {
+        if (Benchmark::WriteBaseline(bench.GetResults(), settings.savePath))
+            std::cout << "\nSaved the baseline to " << settings.savePath << std::endl;
+        else
+        {
+            std::cout << "\nUnable to save the baseline to " << settings.savePath << std::endl;
+            success = false;
+        }
+    }
+    if (!settings.comparePath.empty())
+    {
+        std::cout << "\nCompared with " << settings.comparePath << "\n";
+        success = Benchmark::Compare(baseline, bench.GetResults(), settings.threshold, std::cout) && success;
+    }
+    return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
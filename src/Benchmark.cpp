@@ -0,0 +1,406 @@
+// ==================================================================
+// Copyright (c) 2019 Alexander Freed. ALL RIGHTS RESERVED.
+// Language: ISO C++14
+//
+// Benchmark class definition.
+// ==================================================================
+
+#include "Benchmark.h"
+
+#include "Utility.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cctype>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <map>
+#include <ostream>
+#include <sstream>
+
+
+namespace fnn {
+
+
+namespace {
+
+
+/** Get the median of some values.
+@param[in] values The values. At least 1.
+@return The median.
+*/
+double median(std::vector<double> values)
+{
+    std::sort(values.begin(), values.end());
+    const size_t middle = values.size() / 2;
+    return values.size() % 2 != 0 ? values[middle] : (values[middle - 1] + values[middle]) / 2;
+}
+
+
+/** Write a number as a JSON value: null if it is not finite.
+*/
+void writeJsonNumber(std::ostream& out, const double value)
+{
+    if (std::isfinite(value))
+        out << value;
+    else
+        out << "null";
+}
+
+
+/** Parse the next flat JSON object: string, number, true, false and null members, no nesting.
+@param[in]     text       The JSON text.
+@param[in/out] pos        Where to start looking for the object. Moved past it.
+@param[out]    out_fields The members, each value as its text. Strings are unescaped.
+@return false if there are no more objects, or the object could not be parsed.
+*/
+bool parseFlatObject(const std::string& text, size_t& pos, std::map<std::string, std::string>& out_fields)
+{
+    out_fields.clear();
+    const auto skipSpace = [&]() {
+        while (pos < text.size() && std::isspace(static_cast<unsigned char>(text[pos])))
+            ++pos;
+    };
+    const auto parseString = [&](std::string& out_string) {
+        out_string.clear();
+        if (pos >= text.size() || text[pos] != '"')
+            return false;
+        for (++pos; pos < text.size() && text[pos] != '"'; ++pos)
+        {
+            if (text[pos] == '\\' && pos + 1 < text.size())
+                ++pos;
+            out_string += text[pos];
+        }
+        return pos++ < text.size();
+    };
+
+    pos = text.find('{', pos);
+    if (pos == std::string::npos)
+        return false;
+    ++pos;
+    for (;;)
+    {
+        skipSpace();
+        if (pos < text.size() && text[pos] == '}')
+        {
+            ++pos;
+            return true;
+        }
+        std::string key;
+        std::string value;
+        if (!parseString(key))
+            return false;
+        skipSpace();
+        if (pos >= text.size() || text[pos++] != ':')
+            return false;
+        skipSpace();
+        if (pos < text.size() && text[pos] == '"')
+        {
+            if (!parseString(value))
+                return false;
+        }
+        else
+        {
+            const size_t end = text.find_first_of(",}", pos);
+            if (end == std::string::npos)
+                return false;
+            value = text.substr(pos, end - pos);
+            value.erase(value.find_last_not_of(" \t\r\n") + 1);
+            pos = end;
+        }
+        out_fields[key] = value;
+        skipSpace();
+        if (pos < text.size() && text[pos] == ',')
+            ++pos;
+    }
+}
+
+
+/** Convert a JSON number to a double.
+@return The number, or NaN for null or anything that is not a number.
+*/
+double jsonNumber(const std::string& value)
+{
+    try
+    {
+        return std::stod(value);
+    }
+    catch (...)
+    {
+        return std::numeric_limits<double>::quiet_NaN();
+    }
+}
+
+
+}  // namespace
+
+
+/** Constructor
+@param[in] options How to run the benchmarks.
+*/
+Benchmark::Benchmark(const Options& options)
+    : m_options(options)
+{
+    m_options.reps = std::max(m_options.reps, 1u);
+    if (m_options.counters)
+        m_counters.Open();
+}
+
+
+/** Check whether a benchmark passes the filter.
+@param[in] name The name of the benchmark.
+@return true if the benchmark should run.
+*/
+bool Benchmark::IsSelected(const std::string& name) const
+{
+    return name.find(m_options.filter) != std::string::npos;
+}
+
+
+/** Time a benchmark and keep its summary.
+@param[in] name         The name of the benchmark, e.g. "DetermineDigit".
+@param[in] param        The parameters of this run of it, e.g. "hidden=100".
+@param[in] opsPerCall   The number of operations one call does.
+@param[in] samplesPerOp The number of samples an operation processes.
+@param[in] bytesPerOp   The number of bytes an operation reads or writes.
+@param[in] call         The code. Must do the same work on every call.
+@return The summary.
+*/
+BenchResult Benchmark::Run(const std::string& name, const std::string& param, const double opsPerCall, const double samplesPerOp,
+                           const double bytesPerOp, const std::function<void()>& call)
+{
+    using Clock = std::chrono::steady_clock;
+    const auto timeCalls = [&call](const size_t numCalls) {
+        const Clock::time_point start = Clock::now();
+        for (size_t i = 0; i < numCalls; ++i)
+            call();
+        return std::chrono::duration<double>(Clock::now() - start).count();
+    };
+
+    // calibrate: the first call also warms the caches
+    const double oneCall = std::max(timeCalls(1), 1e-9);
+    const size_t callsPerRep = std::max<size_t>(1, static_cast<size_t>(std::ceil(m_options.minRepSeconds / oneCall)));
+    for (unsigned i = 0; i < m_options.warmup; ++i)
+        timeCalls(callsPerRep);
+
+    std::vector<double> nsPerOp;
+    m_counters.Reset();
+    for (unsigned i = 0; i < m_options.reps; ++i)
+    {
+        m_counters.Start();
+        const double seconds = timeCalls(callsPerRep);
+        m_counters.Stop();
+        nsPerOp.push_back(seconds * 1e9 / (callsPerRep * opsPerCall));
+    }
+
+    BenchResult result;
+    result.name     = name;
+    result.param    = param;
+    result.reps     = m_options.reps;
+    result.medianNs = median(nsPerOp);
+    for (double& ns : nsPerOp)
+        ns = std::abs(ns - result.medianNs);
+    result.madNs         = median(nsPerOp);
+    result.samplesPerSec = samplesPerOp * 1e9 / result.medianNs;
+    result.bytesPerSec   = bytesPerOp * 1e9 / result.medianNs;
+    if (m_counters.IsOpen())
+    {
+        const PerfCounters::Values counts = m_counters.Read();
+        const double numSamples = double(m_options.reps) * callsPerRep * opsPerCall * samplesPerOp;
+        result.hasCounters           = true;
+        result.ipc                   = counts.InstructionsPerCycle();
+        result.l1dMissesPerSample    = counts.PerSample(PerfCounters::L1D_MISSES, numSamples);
+        result.llcMissesPerSample    = counts.PerSample(PerfCounters::LLC_MISSES, numSamples);
+        result.branchMissesPerSample = counts.PerSample(PerfCounters::BRANCH_MISSES, numSamples);
+    }
+    m_results.push_back(result);
+    return result;
+}
+
+
+/** Print benchmark summaries as a table.
+The hardware counter columns are printed if any summary has them.
+@param[in] results The summaries.
+@param[in] out     Where to print.
+*/
+void Benchmark::PrintTable(const std::vector<BenchResult>& results, std::ostream& out)
+{
+    const bool counters = std::any_of(results.begin(), results.end(), [](const BenchResult& result) { return result.hasCounters; });
+    const auto printCount = [&out](const double value, const int width) {
+        if (std::isnan(value))
+            out << std::setw(width) << "-";
+        else
+            out << std::setw(width) << value;
+    };
+
+    out << std::left << std::setw(18) << "benchmark" << std::setw(24) << "param"
+        << std::right << std::setw(14) << "ns/op" << std::setw(9) << "MAD %"
+        << std::setw(14) << "samples/s" << std::setw(12) << "MB/s";
+    if (counters)
+        out << std::setw(7) << "IPC" << std::setw(12) << "L1D/sample" << std::setw(12) << "LLC/sample" << std::setw(12) << "br/sample";
+    out << "\n";
+    for (const BenchResult& result : results)
+    {
+        out << std::left << std::setw(18) << result.name << std::setw(24) << result.param << std::right << std::fixed
+            << std::setprecision(1) << std::setw(14) << result.medianNs
+            << std::setw(9) << 100 * result.madNs / result.medianNs
+            << std::setprecision(0) << std::setw(14) << result.samplesPerSec
+            << std::setprecision(1) << std::setw(12) << result.bytesPerSec / 1e6;
+        if (result.hasCounters)
+        {
+            out << std::setprecision(2);
+            printCount(result.ipc, 7);
+            printCount(result.l1dMissesPerSample, 12);
+            printCount(result.llcMissesPerSample, 12);
+            printCount(result.branchMissesPerSample, 12);
+        }
+        out << "\n";
+        out.unsetf(std::ios::floatfield);
+        out << std::setprecision(6);
+    }
+    out.flush();
+}
+
+
+/** Write benchmark summaries to a JSON file, to compare later runs with.
+@param[in] results The summaries.
+@param[in] path    The file to write.
+@return true if successful.
+*/
+bool Benchmark::WriteBaseline(const std::vector<BenchResult>& results, const std::string& path)
+{
+    std::ofstream fout(path.c_str(), std::ios::out | std::ios::trunc);
+    fout << std::setprecision(std::numeric_limits<double>::max_digits10) << "{\"version\":1,\"results\":[\n";
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        const BenchResult& result = results[i];
+        fout << "{\"name\":";
+        WriteJsonString(fout, result.name);
+        fout << ",\"param\":";
+        WriteJsonString(fout, result.param);
+        fout << ",\"reps\":" << result.reps << ",\"medianNs\":";
+        writeJsonNumber(fout, result.medianNs);
+        fout << ",\"madNs\":";
+        writeJsonNumber(fout, result.madNs);
+        fout << ",\"samplesPerSec\":";
+        writeJsonNumber(fout, result.samplesPerSec);
+        fout << ",\"bytesPerSec\":";
+        writeJsonNumber(fout, result.bytesPerSec);
+        fout << "}" << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    fout << "]}\n";
+    fout.close();
+    return !fout.fail();
+}
+
+
+/** Read benchmark summaries written by WriteBaseline.
+@param[in]  path        The file to read.
+@param[out] out_results The summaries. Only the timing fields are read.
+@return false if the file could not be read or parsed.
+*/
+bool Benchmark::ReadBaseline(const std::string& path, std::vector<BenchResult>& out_results)
+{
+    out_results.clear();
+    std::ifstream fin(path.c_str());
+    if (!fin)
+        return false;
+    std::ostringstream contents;
+    contents << fin.rdbuf();
+    const std::string text = contents.str();
+
+    // the results are the objects inside the "results" array
+    size_t pos = text.find("\"results\"");
+    if (pos == std::string::npos || (pos = text.find('[', pos)) == std::string::npos)
+        return false;
+    std::map<std::string, std::string> fields;
+    while (parseFlatObject(text, pos, fields))
+    {
+        BenchResult result;
+        result.name          = fields["name"];
+        result.param         = fields["param"];
+        result.reps          = static_cast<unsigned>(jsonNumber(fields["reps"]));
+        result.medianNs      = jsonNumber(fields["medianNs"]);
+        result.madNs         = jsonNumber(fields["madNs"]);
+        result.samplesPerSec = jsonNumber(fields["samplesPerSec"]);
+        result.bytesPerSec   = jsonNumber(fields["bytesPerSec"]);
+        if (result.name.empty() || !(result.medianNs > 0))
+            return false;
+        out_results.push_back(result);
+    }
+    return true;
+}
+
+
+/** Compare benchmark summaries with a baseline and print the differences as a table.
+Every benchmark is compared on its median time per operation, which also sets its samples and bytes per second.
+A benchmark regresses if it is slower than its baseline by more than the threshold. Benchmarks that are only in
+one of the two are listed, but do not fail the comparison, so a filtered run can be compared with a full baseline.
+@param[in] baseline         The summaries to compare with.
+@param[in] results          The summaries of this run.
+@param[in] thresholdPercent How much slower a benchmark may be before it regresses, in percent. Set it above the noise.
+@param[in] out              Where to print.
+@return false if any benchmark regressed.
+*/
+bool Benchmark::Compare(const std::vector<BenchResult>& baseline, const std::vector<BenchResult>& results, const double thresholdPercent,
+                        std::ostream& out)
+{
+    const auto find = [](const std::vector<BenchResult>& in, const BenchResult& result) {
+        return std::find_if(in.begin(), in.end(), [&result](const BenchResult& other) {
+            return other.name == result.name && other.param == result.param;
+        });
+    };
+    const auto printRow = [&out](const BenchResult& result, const double baselineNs, const double currentNs, const char* status) {
+        out << std::left << std::setw(18) << result.name << std::setw(24) << result.param << std::right << std::fixed << std::setprecision(1);
+        if (baselineNs > 0)
+            out << std::setw(14) << baselineNs;
+        else
+            out << std::setw(14) << "-";
+        if (currentNs > 0)
+            out << std::setw(14) << currentNs;
+        else
+            out << std::setw(14) << "-";
+        if (baselineNs > 0 && currentNs > 0)
+            out << std::showpos << std::setw(10) << 100 * (currentNs - baselineNs) / baselineNs << std::noshowpos;
+        else
+            out << std::setw(10) << "-";
+        if (currentNs > 0)
+            out << std::setw(9) << 100 * result.madNs / result.medianNs;
+        else
+            out << std::setw(9) << "-";
+        out << "  " << status << "\n";
+        out.unsetf(std::ios::floatfield);
+        out << std::setprecision(6);
+    };
+
+    out << std::left << std::setw(18) << "benchmark" << std::setw(24) << "param"
+        << std::right << std::setw(14) << "base ns/op" << std::setw(14) << "ns/op" << std::setw(10) << "change %"
+        << std::setw(9) << "MAD %" << "  status\n";
+    size_t numRegressions = 0;
+    for (const BenchResult& result : results)
+    {
+        const auto base = find(baseline, result);
+        if (base == baseline.end())
+        {
+            printRow(result, 0, result.medianNs, "new");
+            continue;
+        }
+        const double change = 100 * (result.medianNs - base->medianNs) / base->medianNs;
+        const bool   slower = change > thresholdPercent;
+        numRegressions += slower ? 1 : 0;
+        printRow(result, base->medianNs, result.medianNs, slower ? "REGRESSED" : change < -thresholdPercent ? "faster" : "ok");
+    }
+    for (const BenchResult& base : baseline)
+    {
+        if (find(results, base) == results.end())
+            printRow(base, base.medianNs, 0, "not run");
+    }
+
+    out << "\n" << numRegressions << " of " << results.size() << " benchmarks regressed by more than " << thresholdPercent << "%." << std::endl;
+    return numRegressions == 0;
+}
+
+
+}
@@ -0,0 +1,82 @@
+// ==================================================================
+// Copyright (c) 2019 Alexander Freed. ALL RIGHTS RESERVED.
+// Language: ISO C++14
+//
+// Benchmark class declaration.
+// Times a piece of code over repetitions and summarizes them robustly.
+// ==================================================================
+
+#pragma once
+
+#include "PerfCounters.h"
+
+#include <functional>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+
+namespace fnn {
+
+
+/** The summary of one benchmark.
+Times are per operation. What an operation is depends on the benchmark, e.g. one sample, or one file load.
+*/
+struct BenchResult
+{
+    std::string name;
+    std::string param;                      // e.g. "hidden=100"
+    unsigned    reps                  = 0;  // the number of timed repetitions
+    double      medianNs              = 0;  // the median time of an operation over the repetitions
+    double      madNs                 = 0;  // the median absolute deviation from the median
+    double      samplesPerSec         = 0;  // at the median time. 0 if the benchmark has no samples.
+    double      bytesPerSec           = 0;  // at the median time. 0 if the benchmark moves no bytes of interest.
+
+    // hardware counters over all the timed repetitions. Per sample, and NaN if an event was not counted.
+    bool        hasCounters           = false;
+    double      ipc                   = 0;
+    double      l1dMissesPerSample    = 0;
+    double      llcMissesPerSample    = 0;
+    double      branchMissesPerSample = 0;
+};
+
+
+/** Runs benchmarks: calibrates, warms up, repeats and summarizes.
+Each repetition calls the code enough times to last at least the minimum repetition time,
+so short operations are not dominated by the clock.
+*/
+class Benchmark
+{
+public:
+    struct Options
+    {
+        unsigned    warmup        = 1;      // untimed repetitions
+        unsigned    reps          = 7;      // timed repetitions
+        double      minRepSeconds = 0.05;   // the shortest repetition, in seconds
+        std::string filter;                 // only run benchmarks whose name contains this. Empty for all.
+        bool        counters      = false;  // also count hardware events over the timed repetitions
+    };
+
+    explicit Benchmark(const Options& options);
+
+    bool IsSelected(const std::string& name) const;
+    BenchResult Run(const std::string& name, const std::string& param, const double opsPerCall, const double samplesPerOp,
+                    const double bytesPerOp, const std::function<void()>& call);
+
+    const std::vector<BenchResult>& GetResults() const { return m_results; }
+    const PerfCounters& GetCounters() const { return m_counters; }
+    static void PrintTable(const std::vector<BenchResult>& results, std::ostream& out);
+
+    static bool WriteBaseline(const std::vector<BenchResult>& results, const std::string& path);
+    static bool ReadBaseline(const std::string& path, std::vector<BenchResult>& out_results);
+    static bool Compare(const std::vector<BenchResult>& baseline, const std::vector<BenchResult>& results, const double thresholdPercent,
+                        std::ostream& out);
+
+private:
+    Options                  m_options;
+    std::vector<BenchResult> m_results;
+    PerfCounters             m_counters;  // open if the counters were asked for and are available
+};
+
+
+}
@@ -0,0 +1,667 @@
+// ==================================================================
+// Copyright (c) 2019 Alexander Freed. ALL RIGHTS RESERVED.
+// Language: ISO C++14
+//
+// Reading and writing the versioned binary dataset format.
+// ==================================================================
+
+#include "DatasetFile.h"
+
+#include "Endian.h"
+#include "Kernels.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <thread>
+
+
+namespace FileIO {
+
+
+namespace {
+
+
+// header field offsets
+constexpr char   MAGIC[8]                = { 'F', 'N', 'N', 'D', 'S', 'E', 'T', '\0' };
+constexpr size_t OFFSET_VERSION          = 8;
+constexpr size_t OFFSET_ENDIAN           = 12;
+constexpr size_t OFFSET_NUM_SAMPLES      = 16;
+constexpr size_t OFFSET_IMAGE_ROWS       = 24;
+constexpr size_t OFFSET_IMAGE_COLS       = 28;
+constexpr size_t OFFSET_PIXEL_TYPE       = 32;
+constexpr size_t OFFSET_LABEL_TYPE       = 36;
+constexpr size_t OFFSET_LABELS           = 40;
+constexpr size_t OFFSET_PIXELS           = 48;
+constexpr size_t OFFSET_CHECKSUM         = 56;
+constexpr size_t OFFSET_LABEL_CAPACITY   = 64;
+constexpr size_t OFFSET_SOURCE_SIZE      = 72;
+constexpr size_t OFFSET_SOURCE_MTIME     = 80;
+constexpr size_t OFFSET_SOURCE_CHECKSUM  = 88;
+constexpr size_t OFFSET_HEADER_CHECKSUM  = DATASET_HEADER_SIZE - 8;
+
+// checksum parameters
+constexpr size_t        CHECKSUM_LANES      = 16;       // 64 bytes per step
+constexpr size_t        CHECKSUM_BLOCK_SIZE = 1 << 20;  // unit of work for each thread
+constexpr std::uint32_t PRIME32_1           = 0x9E3779B1u;
+constexpr std::uint32_t PRIME32_2           = 0x85EBCA77u;
+constexpr std::uint64_t PRIME64_1           = 0x9E3779B185EBCA87ull;
+constexpr std::uint64_t PRIME64_2           = 0xC2B2AE3D27D4EB4Full;
+
+
+std::uint64_t mix64(std::uint64_t h)
+{
+    h ^= h >> 33;
+    h *= PRIME64_2;
+    h ^= h >> 29;
+    h *= PRIME64_1;
+    h ^= h >> 32;
+    return h;
+}
+
+
+constexpr size_t CHECKSUM_STRIDE = CHECKSUM_LANES * sizeof(std::uint32_t);
+
+
+void initLanes(std::uint32_t (&lanes)[CHECKSUM_LANES])
+{
+    for (size_t i = 0; i < CHECKSUM_LANES; ++i)
+        lanes[i] = PRIME32_1 * std::uint32_t(i + 1);
+}
+
+
+/** Run the lane rounds over every whole stride of the data, with the widest vectors the CPU has.
+All builds of the kernel produce the same result.
+@return The number of bytes consumed. A multiple of CHECKSUM_STRIDE.
+*/
+size_t laneRounds(std::uint32_t (&lanes)[CHECKSUM_LANES], const std::uint8_t* pData, const size_t numBytes)
+{
+    return fnn::ChecksumLaneRounds(lanes, pData, numBytes, PRIME32_1, PRIME32_2);
+}
+
+
+/** Fold the lanes and the leftover bytes of a block into the block hash.
+@param[in] lanes      The lanes after every whole stride of the block.
+@param[in] blockBytes The total length of the block.
+@param[in] pTail      The bytes after the last whole stride.
+@param[in] tailBytes  The number of tail bytes. Less than CHECKSUM_STRIDE.
+*/
+std::uint64_t finishBlock(const std::uint32_t (&lanes)[CHECKSUM_LANES], const size_t blockBytes, const std::uint8_t* pTail, const size_t tailBytes)
+{
+    std::uint64_t hash = blockBytes;
+    for (const std::uint32_t lane : lanes)
+        hash = mix64(hash ^ lane);
+    for (size_t i = 0; i < tailBytes; ++i)
+        hash = (hash ^ pTail[i]) * PRIME64_1;
+    return mix64(hash);
+}
+
+
+/** Hash one block.
+*/
+std::uint64_t checksumBlock(const std::uint8_t* pData, const size_t numBytes)
+{
+    std::uint32_t lanes[CHECKSUM_LANES];
+    initLanes(lanes);
+    const size_t consumed = laneRounds(lanes, pData, numBytes);
+    return finishBlock(lanes, numBytes, pData + consumed, numBytes - consumed);
+}
+
+
+std::uint64_t combineStart(const std::uint64_t totalBytes)
+{
+    return totalBytes * PRIME64_2;
+}
+
+
+std::uint64_t combineBlock(const std::uint64_t hash, const std::uint64_t blockHash)
+{
+    return mix64(hash * PRIME64_1 + blockHash);
+}
+
+
+/** Encode the header, including its own checksum.
+*/
+void encodeHeader(const DatasetHeader& header, std::uint8_t (&out_bytes)[DATASET_HEADER_SIZE])
+{
+    std::fill(std::begin(out_bytes), std::end(out_bytes), std::uint8_t(0));
+    std::memcpy(out_bytes, MAGIC, sizeof(MAGIC));
+    PutLittle(out_bytes + OFFSET_VERSION,     header.version);
+    PutLittle(out_bytes + OFFSET_ENDIAN,      DATASET_ENDIAN_MARKER);
+    PutLittle(out_bytes + OFFSET_NUM_SAMPLES, header.numSamples);
+    PutLittle(out_bytes + OFFSET_IMAGE_ROWS,  header.imageRows);
+    PutLittle(out_bytes + OFFSET_IMAGE_COLS,  header.imageCols);
+    PutLittle(out_bytes + OFFSET_PIXEL_TYPE,  static_cast<std::uint32_t>(header.pixelType));
+    PutLittle(out_bytes + OFFSET_LABEL_TYPE,  static_cast<std::uint32_t>(header.labelType));
+    PutLittle(out_bytes + OFFSET_LABELS,      header.labelsOffset);
+    PutLittle(out_bytes + OFFSET_PIXELS,      header.pixelsOffset);
+    PutLittle(out_bytes + OFFSET_CHECKSUM,    header.checksum);
+    PutLittle(out_bytes + OFFSET_LABEL_CAPACITY,  header.labelCapacity);
+    PutLittle(out_bytes + OFFSET_SOURCE_SIZE,     header.source.size);
+    PutLittle(out_bytes + OFFSET_SOURCE_MTIME,    header.source.mtime);
+    PutLittle(out_bytes + OFFSET_SOURCE_CHECKSUM, header.source.checksum);
+    PutLittle(out_bytes + OFFSET_HEADER_CHECKSUM, Checksum(out_bytes, OFFSET_HEADER_CHECKSUM));
+}
+
+
+/** Writes a dataset file front to back.
+The labels are written on Open, the pixels in any number of Write calls, and the header
+last on Close, so an interrupted write never produces a valid-looking file.
+*/
+class DatasetWriter
+{
+public:
+    /** Create the file and write everything before the pixel section.
+    @param[in] filename The path and filename.
+    @param[in] header   The header. The offsets and checksum are filled in by the writer. The label
+                        capacity is rounded up to fill the padding before the pixel section.
+    @param[in] pLabels  header.numSamples labels.
+    */
+    bool Open(const std::string& filename, const DatasetHeader& header, const std::uint8_t* pLabels)
+    {
+        m_header = header;
+        m_header.version      = DATASET_VERSION;
+        m_header.labelsOffset  = DATASET_HEADER_SIZE;
+        m_header.pixelsOffset  = AlignUp(m_header.labelsOffset + std::max(m_header.labelCapacity, m_header.numSamples));
+        m_header.labelCapacity = m_header.pixelsOffset - m_header.labelsOffset;
+        m_checksum = ChecksumStream(m_header.pixelsOffset - DATASET_HEADER_SIZE + m_header.numSamples * m_header.GetPixelsPerSample() * m_header.GetPixelBytes());
+
+        m_fout.open(filename.c_str(), std::ios::binary | std::ios::out | std::ios::trunc);
+        if (!m_fout)
+            return false;
+
+        // placeholder header. Overwritten when the checksum is known.
+        const std::uint8_t emptyHeader[DATASET_HEADER_SIZE] = {};
+        m_fout.write(reinterpret_cast<const char*>(emptyHeader), sizeof(emptyHeader));
+
+        // labels and the padding up to the pixel section
+        std::vector<std::uint8_t> labels(m_header.pixelsOffset - m_header.labelsOffset, 0);
+        std::copy(pLabels, pLabels + m_header.numSamples, labels.begin());
+        return Write(labels.data(), labels.size());
+    }
+
+    /** Append to the pixel section.
+    */
+    bool Write(const std::uint8_t* pData, const size_t numBytes)
+    {
+        m_checksum.Update(pData, numBytes);
+        m_fout.write(reinterpret_cast<const char*>(pData), numBytes);
+        return !m_fout.fail();
+    }
+
+    /** Write the header and close the file.
+    */
+    bool Close()
+    {
+        m_header.checksum = m_checksum.Finish();
+
+        std::uint8_t headerBytes[DATASET_HEADER_SIZE];
+        encodeHeader(m_header, headerBytes);
+        m_fout.seekp(0);
+        m_fout.write(reinterpret_cast<const char*>(headerBytes), sizeof(headerBytes));
+        m_fout.close();
+        return !m_fout.fail();
+    }
+
+private:
+    std::fstream   m_fout;
+    DatasetHeader  m_header;
+    ChecksumStream m_checksum{ 0 };
+};
+
+
+}  // namespace
+
+
+// ------------------------------------------------------------------
+
+/** Decode and sanity check the header.
+Does not verify the payload checksum.
+@param[in]  pBytes     The start of the file.
+@param[in]  fileBytes  The size of the whole file. At least DATASET_HEADER_SIZE bytes of pBytes must be readable.
+@param[out] out_header The decoded header.
+@return SUCCESS if the header is usable. FILE_BAD_FORMAT if it is damaged, or its images do not have NUM_INPUTS - 1 pixels.
+*/
+LoadResult DecodeHeader(const std::uint8_t* pBytes, const size_t fileBytes, DatasetHeader& out_header)
+{
+    if (fileBytes < DATASET_HEADER_SIZE || std::memcmp(pBytes, MAGIC, sizeof(MAGIC)) != 0)
+        return LoadResult::FILE_BAD_FORMAT;
+    // a byte-swapped marker means the file was written by something that does not follow the format
+    if (GetLittle<std::uint32_t>(pBytes + OFFSET_ENDIAN) != DATASET_ENDIAN_MARKER)
+        return LoadResult::FILE_BAD_FORMAT;
+    if (GetLittle<std::uint32_t>(pBytes + OFFSET_VERSION) != DATASET_VERSION)
+        return LoadResult::FILE_VERSION_MISMATCH;
+    if (GetLittle<std::uint64_t>(pBytes + OFFSET_HEADER_CHECKSUM) != Checksum(pBytes, OFFSET_HEADER_CHECKSUM))
+        return LoadResult::FILE_CORRUPT;
+
+    DatasetHeader header;
+    header.version      = GetLittle<std::uint32_t>(pBytes + OFFSET_VERSION);
+    header.numSamples   = GetLittle<std::uint64_t>(pBytes + OFFSET_NUM_SAMPLES);
+    header.imageRows    = GetLittle<std::uint32_t>(pBytes + OFFSET_IMAGE_ROWS);
+    header.imageCols    = GetLittle<std::uint32_t>(pBytes + OFFSET_IMAGE_COLS);
+    header.pixelType    = static_cast<ElementType>(GetLittle<std::uint32_t>(pBytes + OFFSET_PIXEL_TYPE));
+    header.labelType    = static_cast<ElementType>(GetLittle<std::uint32_t>(pBytes + OFFSET_LABEL_TYPE));
+    header.labelsOffset    = GetLittle<std::uint64_t>(pBytes + OFFSET_LABELS);
+    header.labelCapacity   = GetLittle<std::uint64_t>(pBytes + OFFSET_LABEL_CAPACITY);
+    header.pixelsOffset    = GetLittle<std::uint64_t>(pBytes + OFFSET_PIXELS);
+    header.checksum        = GetLittle<std::uint64_t>(pBytes + OFFSET_CHECKSUM);
+    header.source.size     = GetLittle<std::uint64_t>(pBytes + OFFSET_SOURCE_SIZE);
+    header.source.mtime    = GetLittle<std::int64_t>(pBytes + OFFSET_SOURCE_MTIME);
+    header.source.checksum = GetLittle<std::uint64_t>(pBytes + OFFSET_SOURCE_CHECKSUM);
+
+    // element types
+    if ((header.pixelType != ElementType::UINT8 && header.pixelType != ElementType::FLOAT64) || header.labelType != ElementType::UINT8)
+        return LoadResult::FILE_BAD_FORMAT;
+
+    // every size must fit in the file before it is added or multiplied, so a crafted header cannot wrap the section ends
+    if (header.imageRows == 0 || header.imageCols == 0 || header.imageRows > fileBytes / header.GetPixelBytes() / header.imageCols ||
+        header.labelsOffset > fileBytes || header.labelCapacity > fileBytes - header.labelsOffset ||
+        header.pixelsOffset > fileBytes || header.numSamples > (fileBytes - header.pixelsOffset) / header.GetBytesPerSample())
+    {
+        return LoadResult::FILE_BAD_FORMAT;
+    }
+
+    // samples decode into a RawTrainer, so the images must have its size
+    if (header.GetPixelsPerSample() + 1 != fnn::NUM_INPUTS)
+        return LoadResult::FILE_BAD_FORMAT;
+
+    // sections must be aligned, in order, and inside the file
+    const std::uint64_t labelsEnd = header.labelsOffset + header.labelCapacity;
+    const std::uint64_t pixelsEnd = header.pixelsOffset + header.numSamples * header.GetPixelsPerSample() * header.GetPixelBytes();
+    if (header.labelsOffset % DATASET_ALIGNMENT != 0 || header.pixelsOffset % DATASET_ALIGNMENT != 0 ||
+        header.labelsOffset < DATASET_HEADER_SIZE || header.labelCapacity < header.numSamples ||
+        header.pixelsOffset < labelsEnd || pixelsEnd != fileBytes)
+    {
+        return LoadResult::FILE_BAD_FORMAT;
+    }
+
+    out_header = header;
+    return LoadResult::SUCCESS;
+}
+
+
+/** Check that stored labels are digits. The checksum does not catch a label that was written out of range,
+and labels index the target encoding and the confusion matrix.
+@param[in] pLabels The labels.
+@param[in] count   The number of labels.
+@return true if every label is at most DATASET_MAX_LABEL.
+*/
+bool CheckLabels(const std::uint8_t* pLabels, const size_t count)
+{
+    return std::all_of(pLabels, pLabels + count, [](const std::uint8_t label) { return label <= DATASET_MAX_LABEL; });
+}
+
+
+/** Calculate a fast 64-bit checksum.
+The data is split into fixed-size blocks which are hashed on multiple threads, so the
+result does not depend on the number of threads. Not cryptographic.
+@param[in] pData    The data to checksum.
+@param[in] numBytes The length of the data.
+@return The checksum.
+*/
+std::uint64_t Checksum(const void* pData, const size_t numBytes)
+{
+    const auto* const pBytes = static_cast<const std::uint8_t*>(pData);
+    const size_t numBlocks = std::max<size_t>(1, (numBytes + CHECKSUM_BLOCK_SIZE - 1) / CHECKSUM_BLOCK_SIZE);
+
+    std::vector<std::uint64_t> blockHashes(numBlocks);
+    const auto hashBlocks = [&](const size_t first, const size_t step) {
+        for (size_t block = first; block < numBlocks; block += step)
+        {
+            const size_t begin = block * CHECKSUM_BLOCK_SIZE;
+            blockHashes[block] = checksumBlock(pBytes + begin, std::min(CHECKSUM_BLOCK_SIZE, numBytes - begin));
+        }
+    };
+
+    const size_t numThreads = std::min<size_t>(numBlocks, std::max(1u, std::thread::hardware_concurrency()));
+    std::vector<std::thread> threads;
+    for (size_t t = 1; t < numThreads; ++t)
+        threads.emplace_back(hashBlocks, t, numThreads);
+    hashBlocks(0, numThreads);
+    for (auto& thread : threads)
+        thread.join();
+
+    std::uint64_t hash = combineStart(numBytes);
+    for (const std::uint64_t blockHash : blockHashes)
+        hash = combineBlock(hash, blockHash);
+    return hash;
+}
+
+
+// ------------------------------------------------------------------
+
+/** Constructor.
+@param[in] totalBytes The number of bytes that will be passed to Update in total.
+*/
+ChecksumStream::ChecksumStream(const std::uint64_t totalBytes)
+    : m_totalBytes(totalBytes)
+    , m_hash(combineStart(totalBytes))
+{
+    initLanes(m_lanes);
+}
+
+
+/** Add the next piece of data.
+@param[in] pData    The data.
+@param[in] numBytes The length of the data.
+*/
+void ChecksumStream::Update(const void* pData, size_t numBytes)
+{
+    const auto* pBytes = static_cast<const std::uint8_t*>(pData);
+    m_bytesSeen += numBytes;
+
+    while (numBytes > 0)
+    {
+        size_t consumed = 0;
+        if (m_numPending > 0 || numBytes < CHECKSUM_STRIDE)
+        {
+            // gather a whole stride
+            consumed = std::min(CHECKSUM_STRIDE - m_numPending, numBytes);
+            std::memcpy(m_pending + m_numPending, pBytes, consumed);
+            m_numPending += consumed;
+            if (m_numPending == CHECKSUM_STRIDE)
+            {
+                laneRounds(m_lanes, m_pending, CHECKSUM_STRIDE);
+                m_numPending = 0;
+                m_blockBytes += CHECKSUM_STRIDE;
+            }
+        }
+        else
+        {
+            // whole strides straight from the input, up to the end of the block
+            const size_t wholeStrides = numBytes / CHECKSUM_STRIDE * CHECKSUM_STRIDE;
+            consumed = laneRounds(m_lanes, pBytes, std::min(wholeStrides, CHECKSUM_BLOCK_SIZE - m_blockBytes));
+            m_blockBytes += consumed;
+        }
+        pBytes   += consumed;
+        numBytes -= consumed;
+
+        if (m_blockBytes == CHECKSUM_BLOCK_SIZE)
+        {
+            m_hash = combineBlock(m_hash, finishBlock(m_lanes, CHECKSUM_BLOCK_SIZE, nullptr, 0));
+            initLanes(m_lanes);
+            m_blockBytes = 0;
+            ++m_numBlocks;
+        }
+    }
+}
+
+
+/** Finish the calculation.
+@return The checksum. Equal to Checksum() over the concatenated data.
+*/
+std::uint64_t ChecksumStream::Finish()
+{
+    assert(m_bytesSeen == m_totalBytes);
+
+    // the last partial block. Empty data is hashed as one empty block.
+    if (m_blockBytes + m_numPending > 0 || m_numBlocks == 0)
+    {
+        m_hash = combineBlock(m_hash, finishBlock(m_lanes, m_blockBytes + m_numPending, m_pending, m_numPending));
+        initLanes(m_lanes);
+        m_blockBytes = 0;
+        m_numPending = 0;
+        ++m_numBlocks;
+    }
+    return m_hash;
+}
+
+
+// ------------------------------------------------------------------
+
+/** Decode one sample into a RawTrainer.
+The bias input is set to 1 and the pixels are scaled to the 0..1 range.
+@param[in]  header      The header of the file the sample came from.
+@param[in]  label       The stored label.
+@param[in]  pPixels     The stored pixels of the sample.
+@param[out] out_trainer The decoded sample.
+*/
+void DecodeSample(const DatasetHeader& header, const std::uint8_t label, const std::uint8_t* pPixels, fnn::RawTrainer& out_trainer)
+{
+    assert(header.GetPixelsPerSample() + 1 == out_trainer.m_inputs.size());
+
+    const size_t numPixels = header.GetPixelsPerSample();
+    out_trainer.m_target    = label;
+    out_trainer.m_inputs[0] = 1.0;
+
+    if (header.pixelType == ElementType::UINT8)
+    {
+        fnn::PixelsToInputs(pPixels, numPixels, &out_trainer.m_inputs[1]);
+    }
+    else
+    {
+        for (size_t i = 0; i < numPixels; ++i)
+            out_trainer.m_inputs[i + 1] = GetLittle<double>(pPixels + i * sizeof(double));
+    }
+}
+
+
+/** Decode one sample into a RawTrainer.
+@param[in]  index       The sample index. Must be less than GetNumSamples().
+@param[out] out_trainer The decoded sample.
+*/
+void DatasetView::Decode(const size_t index, fnn::RawTrainer& out_trainer) const
+{
+    assert(index < GetNumSamples());
+    DecodeSample(m_header, GetLabels()[index], GetPixels() + index * m_header.GetBytesPerSample(), out_trainer);
+}
+
+
+/** Map a dataset file into memory and validate it.
+Checks the magic, byte order, version, element types, section layout, both checksums and the labels.
+@param[in] filename The path and filename.
+@return A pair consisting of a load result and the view. The view is empty unless the result is SUCCESS.
+*/
+std::tuple<LoadResult, DatasetView> MapDataset(const std::string& filename)
+{
+    DatasetView view;
+    if (!view.m_file.Open(filename))
+        return std::make_tuple(LoadResult::FILE_NOT_FOUND, DatasetView());
+
+    const std::uint8_t* const pBytes = view.m_file.GetData();
+    const size_t fileBytes = view.m_file.GetSize();
+
+    const LoadResult result = DecodeHeader(pBytes, fileBytes, view.m_header);
+    if (result != LoadResult::SUCCESS)
+        return std::make_tuple(result, DatasetView());
+
+    if (Checksum(pBytes + DATASET_HEADER_SIZE, fileBytes - DATASET_HEADER_SIZE) != view.m_header.checksum)
+        return std::make_tuple(LoadResult::FILE_CORRUPT, DatasetView());
+    if (!CheckLabels(view.GetLabels(), view.GetNumSamples()))
+        return std::make_tuple(LoadResult::FILE_BAD_FORMAT, DatasetView());
+
+    return std::make_tuple(LoadResult::SUCCESS, std::move(view));
+}
+
+
+/** Write samples in the dataset format.
+@param[in] filename The path and filename.
+@param[in] packed   The samples, with 8-bit pixels.
+@return true if successful.
+*/
+bool WriteDataset(const std::string& filename, const PackedDataset& packed)
+{
+    DatasetHeader header;
+    header.numSamples = packed.GetNumSamples();
+    header.imageRows  = packed.imageRows;
+    header.imageCols  = packed.imageCols;
+    header.pixelType  = ElementType::UINT8;
+    header.source     = packed.source;
+    // room to append a quarter more samples in place
+    header.labelCapacity = header.numSamples + header.numSamples / 4;
+    if (packed.pixels.size() != packed.GetNumSamples() * header.GetPixelsPerSample())
+    {
+        assert(false);
+        return false;
+    }
+
+    DatasetWriter writer;
+    return writer.Open(filename, header, packed.labels.data()) &&
+           writer.Write(packed.pixels.data(), packed.pixels.size()) &&
+           writer.Close();
+}
+
+
+/** Add samples to the end of a dataset file and record the new source.
+The labels go into the spare label capacity and the pixels at the end of the file, so the
+existing samples are not rewritten. If there is not enough capacity the whole file is rewritten.
+The file is validated first, so a corrupt file is never extended. If the append is interrupted
+the checksum no longer matches and the file is rejected on the next load.
+@param[in] filename The path and filename of an existing file with 8-bit pixels.
+@param[in] tail     The samples to add. May be empty to only update the source.
+@return true if successful.
+*/
+bool AppendDataset(const std::string& filename, const PackedDataset& tail)
+{
+    DatasetHeader header;
+    {
+        LoadResult result = LoadResult::UNEXPECTED_ERROR;
+        DatasetView view;
+        std::tie(result, view) = MapDataset(filename);
+        if (result != LoadResult::SUCCESS)
+            return false;
+
+        header = view.GetHeader();
+        if (header.pixelType != ElementType::UINT8 || header.imageRows != tail.imageRows || header.imageCols != tail.imageCols ||
+            tail.pixels.size() != tail.GetNumSamples() * tail.GetPixelsPerSample())
+        {
+            return false;
+        }
+
+        // no room for the labels. Rewrite with more.
+        if (header.numSamples + tail.GetNumSamples() > header.labelCapacity)
+        {
+            PackedDataset combined;
+            combined.imageRows = header.imageRows;
+            combined.imageCols = header.imageCols;
+            combined.labels.assign(view.GetLabels(), view.GetLabels() + view.GetNumSamples());
+            combined.labels.insert(combined.labels.end(), tail.labels.begin(), tail.labels.end());
+            combined.pixels.reserve(view.GetNumSamples() * header.GetBytesPerSample() + tail.pixels.size());
+            combined.pixels.assign(view.GetPixels(), view.GetPixels() + view.GetNumSamples() * header.GetBytesPerSample());
+            combined.pixels.insert(combined.pixels.end(), tail.pixels.begin(), tail.pixels.end());
+            combined.source = tail.source;
+
+            view = DatasetView();
+            return WriteDataset(filename, combined);
+        }
+    }
+
+    // the samples
+    {
+        std::fstream file(filename.c_str(), std::ios::binary | std::ios::in | std::ios::out);
+        file.seekp(header.labelsOffset + header.numSamples);
+        file.write(reinterpret_cast<const char*>(tail.labels.data()), tail.labels.size());
+        file.seekp(0, std::ios::end);
+        file.write(reinterpret_cast<const char*>(tail.pixels.data()), tail.pixels.size());
+        file.close();
+        if (file.fail())
+            return false;
+    }
+
+    // the checksum covers the whole payload
+    header.numSamples += tail.GetNumSamples();
+    header.source      = tail.source;
+    {
+        MappedFile mapped;
+        if (!mapped.Open(filename))
+            return false;
+        header.checksum = Checksum(mapped.GetData() + DATASET_HEADER_SIZE, mapped.GetSize() - DATASET_HEADER_SIZE);
+    }
+
+    // the header last
+    std::uint8_t headerBytes[DATASET_HEADER_SIZE];
+    encodeHeader(header, headerBytes);
+    std::fstream file(filename.c_str(), std::ios::binary | std::ios::in | std::ios::out);
+    file.write(reinterpret_cast<const char*>(headerBytes), sizeof(headerBytes));
+    file.close();
+    return !file.fail();
+}
+
+
+/** Copy a contiguous range of samples into a new dataset file.
+@param[in] filename The path and filename of the new file.
+@param[in] source   The dataset to copy from.
+@param[in] first    The index of the first sample to copy.
+@param[in] count    The number of samples to copy.
+@return true if successful.
+*/
+bool WriteDatasetSlice(const std::string& filename, const DatasetView& source, const size_t first, const size_t count)
+{
+    assert(first + count <= source.GetNumSamples());
+
+    DatasetHeader header = source.GetHeader();
+    header.numSamples    = count;
+    header.labelCapacity = count;
+    header.source        = CsvSource();
+
+    DatasetWriter writer;
+    return writer.Open(filename, header, source.GetLabels() + first) &&
+           writer.Write(source.GetPixels() + first * header.GetBytesPerSample(), count * header.GetBytesPerSample()) &&
+           writer.Close();
+}
+
+
+/** The filename of a shard.
+@param[in] prefix The path and filename prefix shared by all shards.
+@param[in] index  The shard index.
+@return prefix.NNN.bin
+*/
+std::string GetShardPath(const std::string& prefix, const size_t index)
+{
+    std::string number = std::to_string(index);
+    if (number.size() < 3)
+        number.insert(0, 3 - number.size(), '0');
+    return prefix + "." + number + ".bin";
+}
+
+
+/** Find the shards of a sharded dataset.
+@param[in] prefix The path and filename prefix shared by all shards.
+@return The paths of shards 0, 1, 2, ... up to the first one that does not exist.
+*/
+std::vector<std::string> FindShards(const std::string& prefix)
+{
+    std::vector<std::string> paths;
+    for (;;)
+    {
+        std::string path = GetShardPath(prefix, paths.size());
+        if (!std::ifstream(path.c_str()))
+            return paths;
+        paths.push_back(std::move(path));
+    }
+}
+
+
+/** Split a dataset into shards of a fixed number of samples.
+Shards left over from a previous split with more shards are deleted.
+@param[in] source          The dataset to split.
+@param[in] prefix          The path and filename prefix for the shards.
+@param[in] samplesPerShard The number of samples in each shard. The last shard may be smaller.
+@return The number of shards written, or 0 on failure.
+*/
+size_t WriteShards(const DatasetView& source, const std::string& prefix, const size_t samplesPerShard)
+{
+    if (samplesPerShard == 0)
+        return 0;
+
+    size_t numShards = 0;
+    for (size_t first = 0; first < source.GetNumSamples(); first += samplesPerShard, ++numShards)
+    {
+        const size_t count = std::min(samplesPerShard, source.GetNumSamples() - first);
+        if (!WriteDatasetSlice(GetShardPath(prefix, numShards), source, first, count))
+            return 0;
+    }
+
+    for (size_t index = numShards; ; ++index)
+    {
+        const std::string stale = GetShardPath(prefix, index);
+        if (!std::ifstream(stale.c_str()) || std::remove(stale.c_str()) != 0)
+            break;
+    }
+    return numShards;
+}
+
+
+}
@@ -0,0 +1,142 @@
+// ==================================================================
+// Copyright (c) 2019 Alexander Freed. ALL RIGHTS RESERVED.
+// Language: ISO C++14
+//
+// The versioned binary dataset format.
+//
+// Layout (all integers little-endian):
+//     [0, 128)           header
+//     labelsOffset       labelCapacity bytes: numSamples labels, then room for more. 64-byte aligned.
+//     pixelsOffset       numSamples * imageRows * imageCols pixels, 64-byte aligned
+// The bias input is not stored. It is always 1.
+// A file built from a CSV records which bytes of the CSV it holds, so that rows appended to the
+// CSV later can be added in place: the labels go into the spare capacity, the pixels at the end.
+// ==================================================================
+
+#pragma once
+
+#include "FileIO.h"
+#include "MappedFile.h"
+#include "Trainer.h"
+
+#include <cstdint>
+#include <string>
+#include <tuple>
+#include <vector>
+
+
+namespace FileIO {
+
+
+// constants
+
+constexpr std::uint32_t DATASET_VERSION       = 2;
+constexpr std::uint32_t DATASET_ENDIAN_MARKER = 0x01020304;
+constexpr size_t        DATASET_HEADER_SIZE   = 128;
+constexpr size_t        DATASET_ALIGNMENT     = 64;
+constexpr std::uint8_t  DATASET_MAX_LABEL     = 9;  // labels are digits
+
+
+/** Round a file offset up to the section alignment.
+*/
+inline size_t AlignUp(const size_t offset)
+{
+    return (offset + DATASET_ALIGNMENT - 1) / DATASET_ALIGNMENT * DATASET_ALIGNMENT;
+}
+
+
+// classes
+
+enum class ElementType : std::uint32_t
+{
+    UINT8   = 1,  // pixels: value * 255. labels: the digit.
+    FLOAT64 = 2   // pixels: IEEE-754 binary64.
+};
+
+
+/** The decoded (native byte order) header of a dataset file.
+*/
+struct DatasetHeader
+{
+    std::uint32_t version       = DATASET_VERSION;
+    std::uint64_t numSamples    = 0;
+    std::uint32_t imageRows     = 28;
+    std::uint32_t imageCols     = 28;
+    ElementType   pixelType     = ElementType::UINT8;
+    ElementType   labelType     = ElementType::UINT8;
+    std::uint64_t labelsOffset  = 0;
+    std::uint64_t labelCapacity = 0;  // labels that fit before the pixel section
+    std::uint64_t pixelsOffset  = 0;
+    std::uint64_t checksum      = 0;  // of every byte after the header
+    CsvSource     source;             // all zero if the file was not built from a CSV
+
+    size_t GetPixelsPerSample() const { return size_t(imageRows) * imageCols; }
+    size_t GetPixelBytes() const { return pixelType == ElementType::UINT8 ? 1 : 8; }
+    size_t GetBytesPerSample() const { return GetPixelsPerSample() * GetPixelBytes(); }
+};
+
+
+/** A read-only view of a memory-mapped dataset file.
+The header and checksum have been validated by MapDataset.
+*/
+class DatasetView
+{
+public:
+    DatasetView() = default;
+
+    const DatasetHeader& GetHeader() const { return m_header; }
+    size_t GetNumSamples() const { return size_t(m_header.numSamples); }
+
+    const std::uint8_t* GetLabels() const { return m_file.GetData() + m_header.labelsOffset; }
+    const std::uint8_t* GetPixels() const { return m_file.GetData() + m_header.pixelsOffset; }
+
+    void Decode(const size_t index, fnn::RawTrainer& out_trainer) const;
+
+private:
+    friend std::tuple<LoadResult, DatasetView> MapDataset(const std::string& filename);
+
+    MappedFile    m_file;
+    DatasetHeader m_header;
+};
+
+
+/** Calculates the same checksum as Checksum() on data that arrives in pieces.
+Single-threaded.
+*/
+class ChecksumStream
+{
+public:
+    explicit ChecksumStream(const std::uint64_t totalBytes);
+
+    void          Update(const void* pData, size_t numBytes);
+    std::uint64_t Finish();
+
+private:
+    std::uint64_t m_totalBytes;
+    std::uint64_t m_bytesSeen  = 0;
+    std::uint64_t m_hash;
+    std::uint32_t m_lanes[16];
+    size_t        m_blockBytes = 0;  // bytes of the current block already run through the lanes
+    size_t        m_numBlocks  = 0;
+    std::uint8_t  m_pending[64];     // a partial stride
+    size_t        m_numPending = 0;
+};
+
+
+// function prototypes
+
+std::uint64_t Checksum(const void* pData, const size_t numBytes);
+LoadResult DecodeHeader(const std::uint8_t* pBytes, const size_t fileBytes, DatasetHeader& out_header);
+bool CheckLabels(const std::uint8_t* pLabels, const size_t count);
+void DecodeSample(const DatasetHeader& header, const std::uint8_t label, const std::uint8_t* pPixels, fnn::RawTrainer& out_trainer);
+std::tuple<LoadResult, DatasetView> MapDataset(const std::string& filename);
+bool WriteDataset(const std::string& filename, const PackedDataset& packed);
+bool AppendDataset(const std::string& filename, const PackedDataset& tail);
+bool WriteDatasetSlice(const std::string& filename, const DatasetView& source, const size_t first, const size_t count);
+
+std::string GetShardPath(const std::string& prefix, const size_t index);
+std::vector<std::string> FindShards(const std::string& prefix);
+size_t WriteShards(const DatasetView& source, const std::string& prefix, const size_t samplesPerShard);
+
+
+}
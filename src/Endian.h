@@ -0,0 +1,60 @@
+// ==================================================================
+// Copyright (c) 2019 Alexander Freed. ALL RIGHTS RESERVED.
+// Language: ISO C++14
+//
+// Byte order helpers for the binary file formats.
+// ==================================================================
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+
+namespace FileIO {
+
+
+inline bool IsLittleEndian()
+{
+    const std::uint16_t probe = 1;
+    std::uint8_t firstByte;
+    std::memcpy(&firstByte, &probe, 1);
+    return firstByte == 1;
+}
+
+
+template <typename T>
+T ByteSwap(T value)
+{
+    std::uint8_t bytes[sizeof(T)];
+    std::memcpy(bytes, &value, sizeof(T));
+    std::reverse(bytes, bytes + sizeof(T));
+    std::memcpy(&value, bytes, sizeof(T));
+    return value;
+}
+
+
+/** Store a value in little-endian byte order.
+*/
+template <typename T>
+void PutLittle(std::uint8_t* pDest, T value)
+{
+    if (!IsLittleEndian())
+        value = ByteSwap(value);
+    std::memcpy(pDest, &value, sizeof(T));
+}
+
+
+/** Load a value stored in little-endian byte order.
+*/
+template <typename T>
+T GetLittle(const std::uint8_t* pSrc)
+{
+    T value;
+    std::memcpy(&value, pSrc, sizeof(T));
+    return IsLittleEndian() ? value : ByteSwap(value);
+}
+
+
+}
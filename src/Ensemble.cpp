@@ -0,0 +1,133 @@
+// ==================================================================
+// Copyright (c) 2019 Alexander Freed. ALL RIGHTS RESERVED.
+// Language: ISO C++14
+//
+// EnsembleClassifier class definition.
+// ==================================================================
+
+#include "Ensemble.h"
+
+#include "Kernels.h"
+
+#include <array>
+#include <cassert>
+
+
+namespace fnn {
+
+
+/** Constructor
+Stacks the weights of the models.
+@param[in] models  The models, all with the same number of hidden nodes. At least 1.
+@param[in] combine How DetermineDigit combines the models.
+*/
+EnsembleClassifier::EnsembleClassifier(const std::vector<NeuralNetDigitClassifier>& models, const Combine combine)
+    : m_numHidden(models.front().GetNumHidden())
+    , m_inputWeights(NUM_INPUTS, models.size() * models.front().GetNumHidden())
+    , m_combine(combine)
+{
+    for (size_t m = 0; m < models.size(); ++m)
+    {
+        assert(models[m].GetNumHidden() == m_numHidden);
+        const auto weights = models[m].GetWeights();
+        m_inputWeights.middleCols(m * m_numHidden, m_numHidden) = weights[0];
+        m_outputWeights.push_back(weights[1]);
+    }
+}
+
+
+/** Take one model out of the ensemble.
+@param[in] model The index of the model.
+@return A network with the model's weights.
+*/
+NeuralNetDigitClassifier EnsembleClassifier::GetModel(const unsigned model) const
+{
+    NeuralNetDigitClassifier::WeightsCollection weights;
+    weights[0] = m_inputWeights.middleCols(model * m_numHidden, m_numHidden);
+    weights[1] = m_outputWeights[model];
+    return NeuralNetDigitClassifier(std::move(weights));
+}
+
+
+/** Activate one model's output layer.
+@param[in]  model                The index of the model.
+@param[in]  hidden               The hidden activations of every model, 1x(N*H).
+@param[out] out_hiddenActivation The model's hidden activations with the bias first, 1x(H+1).
+@return The model's output activations.
+*/
+EnsembleClassifier::OutputType EnsembleClassifier::modelOutput(const unsigned model, const Eigen::RowVectorXd& hidden, Eigen::RowVectorXd& out_hiddenActivation) const
+{
+    out_hiddenActivation.resize(m_numHidden + 1);
+    out_hiddenActivation(0) = 1;
+    out_hiddenActivation.tail(m_numHidden) = hidden.segment(model * m_numHidden, m_numHidden);
+    return (out_hiddenActivation * m_outputWeights[model]).unaryExpr(&sigmoid);
+}
+
+
+/** Feed the input forward through every model and return the combined digit class.
+@param[in] inputs A vector of input values.
+@return The chosen digit 0-9.
+*/
+int EnsembleClassifier::DetermineDigit(const InputRef& inputs) const
+{
+    // every model's hidden layer in one product
+    Eigen::RowVectorXd hidden(m_inputWeights.cols());
+    SigmoidLayer(m_inputWeights.data(), m_inputWeights.rows(), m_inputWeights.cols(), inputs.data(), hidden.data());
+
+    Eigen::RowVectorXd hiddenActivation;
+    OutputType sum = OutputType::Zero();
+    std::array<unsigned, NeuralNetDigitClassifier::NUM_OUTPUTS> votes = {};
+    for (unsigned m = 0; m < GetNumModels(); ++m)
+    {
+        const OutputType output = modelOutput(m, hidden, hiddenActivation);
+        sum += output;
+        int row, col;
+        output.maxCoeff(&row, &col);
+        ++votes[col];
+    }
+
+    int best = 0;
+    for (int digit = 1; digit < static_cast<int>(NeuralNetDigitClassifier::NUM_OUTPUTS); ++digit)
+    {
+        const bool moreVotes = votes[digit] > votes[best] || (votes[digit] == votes[best] && sum(digit) > sum(best));
+        if (m_combine == Combine::VOTE ? moreVotes : sum(digit) > sum(best))
+            best = digit;
+    }
+    return best;
+}
+
+
+/** Train every model on one sample.
+Each model's update is the one NeuralNetDigitClassifier::TrainFromInput makes.
+The input layers are updated together, as one rank-1 update of the stacked weights.
+@param[in]     inputs    One vector of inputs (785)
+@param[in]     targets   A vector of expected activations (10)
+@param[in/out] optimizer The update rule. Layer 0 is the stacked input weights, layer 1+m the output weights of model m.
+*/
+void EnsembleClassifier::TrainFromInput(const InputRef& inputs, const OutputRef& targets, Optimizer& optimizer)
+{
+    const auto sigmoidDerivative = [](const double o) { return o * (1 - o); };  // o is already the output of the sigmoid
+
+    // every model's hidden layer in one product
+    Eigen::RowVectorXd hidden(m_inputWeights.cols());
+    SigmoidLayer(m_inputWeights.data(), m_inputWeights.rows(), m_inputWeights.cols(), inputs.data(), hidden.data());
+    Eigen::RowVectorXd errorHidden(hidden.size());
+
+    optimizer.BeginStep();
+    Eigen::RowVectorXd hiddenActivation;
+    for (unsigned m = 0; m < GetNumModels(); ++m)
+    {
+        const OutputType outputActivation = modelOutput(m, hidden, hiddenActivation);
+        const OutputType errorOutput = (targets - outputActivation).cwiseProduct(outputActivation.unaryExpr(sigmoidDerivative));
+
+        // the hidden errors use the output weights from before this sample's update. The bias node has no error.
+        errorHidden.segment(m * m_numHidden, m_numHidden) = (m_outputWeights[m].bottomRows(m_numHidden) * errorOutput.transpose()).transpose()
+            .cwiseProduct(hiddenActivation.tail(m_numHidden).unaryExpr(sigmoidDerivative));
+
+        optimizer.Update(1 + m, m_outputWeights[m], hiddenActivation.data(), errorOutput.data());
+    }
+    optimizer.Update(0, m_inputWeights, inputs.data(), errorHidden.data());
+}
+
+
+}
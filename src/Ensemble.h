@@ -0,0 +1,63 @@
+// ==================================================================
+// Copyright (c) 2019 Alexander Freed. ALL RIGHTS RESERVED.
+// Language: ISO C++14
+//
+// EnsembleClassifier class declaration.
+// Several networks trained side by side on the same samples, with their input layers fused.
+// ==================================================================
+
+#pragma once
+
+#include "NeuralNet.h"
+#include "Optimizer.h"
+#include "Trainer.h"
+
+#include <vector>
+
+#include <Eigen/Dense>
+
+
+namespace fnn {
+
+
+/** An ensemble of networks with 1 hidden layer each, all the same size.
+The input->hidden weights of the models are stacked side by side into one 785x(N*H) matrix,
+so each sample's inputs are read once and the N input layers are one wide product and one wide update.
+The hidden->output weights are block-diagonal: model m's hidden nodes only feed model m's outputs,
+so they are kept as N separate (H+1)x10 matrices.
+Training a model in the ensemble gives the same weights as training it alone on the same samples.
+*/
+class EnsembleClassifier
+{
+public:
+    // how the models' outputs are combined into one digit
+    enum class Combine
+    {
+        AVERAGE,  // the highest mean activation
+        VOTE,     // the digit most models choose. Ties go to the higher mean activation.
+    };
+
+    using OutputType = NeuralNetDigitClassifier::OutputType;
+    using OutputRef  = NeuralNetDigitClassifier::OutputRef;
+
+    explicit EnsembleClassifier(const std::vector<NeuralNetDigitClassifier>& models, const Combine combine = Combine::AVERAGE);
+
+    int  DetermineDigit(const InputRef& inputs) const;
+    void TrainFromInput(const InputRef& inputs, const OutputRef& targets, Optimizer& optimizer);
+
+    NeuralNetDigitClassifier GetModel(const unsigned model) const;
+    unsigned GetNumModels() const { return static_cast<unsigned>(m_outputWeights.size()); }
+    void     SetCombine(const Combine combine) { m_combine = combine; }
+
+private:
+    static double sigmoid(const double z) { return 1.0 / (1.0 + exp(-z)); };
+    OutputType modelOutput(const unsigned model, const Eigen::RowVectorXd& hidden, Eigen::RowVectorXd& out_hiddenActivation) const;
+
+    unsigned                     m_numHidden;
+    Eigen::MatrixXd              m_inputWeights;   // 785x(N*H). Model m owns columns m*H to (m+1)*H-1.
+    std::vector<Eigen::MatrixXd> m_outputWeights;  // N of (H+1)x10
+    Combine                      m_combine;
+};
+
+
+}
@@ -0,0 +1,318 @@
+// ==================================================================
+// Copyright (c) 2019 Alexander Freed. ALL RIGHTS RESERVED.
+// Language: ISO C++14
+//
+// EpochSampler class definition.
+// ==================================================================
+
+#include "EpochSampler.h"
+
+#include "Trace.h"
+#include "Utility.h"
+
+#include <algorithm>
+#include <cassert>
+#include <functional>
+#include <limits>
+#include <numeric>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+    #include <xmmintrin.h>
+    #define FNN_HAVE_PREFETCH
+#endif
+
+
+namespace fnn {
+
+
+// the definition C++14 needs for std::min to take BATCH_SIZE by reference
+constexpr size_t EpochSampler::BATCH_SIZE;
+
+
+namespace {
+
+
+constexpr size_t CACHE_LINE = 64;
+constexpr size_t NUM_OUTPUTS = NeuralNetDigitClassifier::NUM_OUTPUTS;
+
+static_assert(PADDED_INPUTS * sizeof(double) % CACHE_LINE == 0, "each staged row must start on a cache line");
+
+
+/** Ask the CPU to start loading a row into cache.
+@param[in] pData    The row.
+@param[in] numBytes The length of the row.
+*/
+void prefetchRow(const void* pData, const size_t numBytes)
+{
+#ifdef FNN_HAVE_PREFETCH
+    const char* const pBytes = static_cast<const char*>(pData);
+    for (size_t offset = 0; offset < numBytes; offset += CACHE_LINE)
+        _mm_prefetch(pBytes + offset, _MM_HINT_T0);
+#else
+    (void)pData;
+    (void)numBytes;
+#endif
+}
+
+
+}  // namespace
+
+
+/** Constructor
+The first epoch visits the samples in their stored order. Call Shuffle before each epoch.
+@param[in] dataset    The training set. Must outlive the sampler and not change.
+@param[in] blockSize  The number of consecutive samples shuffled as a block. 0 or 1 to shuffle single samples.
+@param[in] numLoaders The number of loader threads. At least 1 is used.
+*/
+EpochSampler::EpochSampler(const std::vector<Trainer>& dataset, const size_t blockSize, const unsigned numLoaders)
+    : m_pDataset(&dataset)
+    , m_blockSize(blockSize)
+    , m_order(dataset.size())
+    , m_loaders(std::max(numLoaders, 1u))
+    , m_heldBatch(std::numeric_limits<size_t>::max())
+{
+    std::iota(m_order.begin(), m_order.end(), size_t(0));
+
+    // the order is shuffled off the main thread, so it gets its own stream
+    m_rng = Global::stream(StreamUse::SHUFFLE);
+    m_nextOrder = std::async(std::launch::async, &EpochSampler::shuffled, m_order, m_blockSize, std::ref(m_rng));
+
+    // two batches per loader keeps every loader busy while the consumer works through the rest
+    m_ringSize = std::max<size_t>(4, 2 * m_loaders.size());
+    m_ring.reset(new Slot[m_ringSize]);
+
+    // align the start of the storage. Every row is then aligned too. The loaders never write the padding
+    // of a row, so zeroing it here keeps it zero for the network.
+    const size_t slotDoubles = BATCH_SIZE * (PADDED_INPUTS + NUM_OUTPUTS);
+    m_storage.reset(new double[m_ringSize * slotDoubles + CACHE_LINE / sizeof(double)]());
+    const auto address = reinterpret_cast<std::uintptr_t>(m_storage.get());
+    double* const pAligned = m_storage.get() + ((CACHE_LINE - address % CACHE_LINE) % CACHE_LINE) / sizeof(double);
+    for (size_t i = 0; i < m_ringSize; ++i)
+    {
+        m_ring[i].pInputs  = pAligned + i * slotDoubles;
+        m_ring[i].pTargets = m_ring[i].pInputs + BATCH_SIZE * PADDED_INPUTS;
+    }
+}
+
+
+EpochSampler::~EpochSampler()
+{
+    stopPass();
+    if (m_nextOrder.valid())
+        m_nextOrder.wait();
+}
+
+
+/** Distort the samples of every training pass from now on.
+Evaluation passes, the ones not directly after a Shuffle, still see the stored samples.
+@param[in] params The ranges of the distortions.
+*/
+void EpochSampler::EnableAugmentation(const AugmentParams& params)
+{
+    stopPass();
+    m_augmenters.assign(m_loaders.size(), Augmenter(params));
+}
+
+
+/** Switch to the next epoch's order, and start shuffling the one after it in the background.
+Waits if the background shuffle has not finished. The next pass is a training pass.
+*/
+void EpochSampler::Shuffle()
+{
+    // the loaders read the order
+    stopPass();
+    ++m_epoch;
+    m_augmentNextPass = !m_augmenters.empty();
+
+    m_order = m_nextOrder.get();
+    m_nextOrder = std::async(std::launch::async, &EpochSampler::shuffled, m_order, m_blockSize, std::ref(m_rng));
+}
+
+
+/** Start a pass over the samples in the current order.
+Any pass in progress is abandoned.
+*/
+EpochSampler::Iterator EpochSampler::begin()
+{
+    startPass();
+    return Iterator(this, 0);
+}
+
+
+/** Shuffle an order.
+Samples are shuffled from the given order. Blocks always start from the stored order,
+so that each block is consecutive in memory.
+@param[in]     order     The previous order.
+@param[in]     blockSize The number of consecutive samples shuffled as a block. 0 or 1 to shuffle single samples.
+@param[in/out] rng       The random number generator.
+@return The new order.
+*/
+std::vector<size_t> EpochSampler::shuffled(std::vector<size_t> order, const size_t blockSize, Rng& rng)
+{
+    Trace::SetThreadName("shuffler");
+    ScopedTimer timer("shuffle order");
+
+    if (blockSize <= 1)
+    {
+        std::shuffle(order.begin(), order.end(), rng);
+        return order;
+    }
+
+    const size_t numSamples = order.size();
+    std::vector<size_t> blocks((numSamples + blockSize - 1) / blockSize);
+    std::iota(blocks.begin(), blocks.end(), size_t(0));
+    std::shuffle(blocks.begin(), blocks.end(), rng);
+
+    auto out = order.begin();
+    for (const size_t block : blocks)
+    {
+        const size_t first = block * blockSize;
+        const size_t last  = std::min(first + blockSize, numSamples);
+        const auto blockBegin = out;
+        for (size_t i = first; i < last; ++i)
+            *out++ = i;
+        std::shuffle(blockBegin, out, rng);
+    }
+    return order;
+}
+
+
+/** Reset the ring and start the loader threads.
+*/
+void EpochSampler::startPass()
+{
+    stopPass();
+
+    // slot i is free for batch i
+    for (size_t i = 0; i < m_ringSize; ++i)
+        m_ring[i].sequence.store(i, std::memory_order_relaxed);
+    m_heldBatch = std::numeric_limits<size_t>::max();
+    m_augmentPass     = m_augmentNextPass;
+    m_augmentNextPass = false;
+    m_stop.store(false);
+
+    for (size_t i = 0; i < m_loaders.size(); ++i)
+        m_loaders[i] = std::thread(&EpochSampler::load, this, i);
+}
+
+
+/** Stop the loader threads, if they are running.
+*/
+void EpochSampler::stopPass()
+{
+    m_stop.store(true);
+    for (auto& loader : m_loaders)
+    {
+        if (loader.joinable())
+            loader.join();
+    }
+}
+
+
+/** Get a sample, waiting for its batch if needed.
+The previous batch's slot is handed back to the loaders.
+@param[in] position The position in the epoch order.
+*/
+EpochSampler::Sample EpochSampler::get(const size_t position)
+{
+    const size_t batch = position / BATCH_SIZE;
+    Slot& slot = m_ring[batch % m_ringSize];
+    if (batch != m_heldBatch)
+    {
+        if (m_heldBatch != std::numeric_limits<size_t>::max())
+            m_ring[m_heldBatch % m_ringSize].sequence.store(m_heldBatch + m_ringSize, std::memory_order_release);
+
+        while (slot.sequence.load(std::memory_order_acquire) != batch + 1)
+            std::this_thread::yield();
+        m_heldBatch = batch;
+    }
+
+    const size_t row = position - batch * BATCH_SIZE;
+    return Sample(slot.labels[row], slot.pInputs + row * PADDED_INPUTS, slot.pTargets + row * NUM_OUTPUTS);
+}
+
+
+/** A loader thread. Prepares every m_loaders.size()th batch, in order.
+@param[in] firstBatch The first batch to prepare. Also the loader's index.
+*/
+void EpochSampler::load(const size_t firstBatch)
+{
+    if (Trace::IsEnabled())
+        Trace::SetThreadName("loader " + std::to_string(firstBatch));
+    ScopedTimer timer("prepare batches", static_cast<int>(m_epoch));
+
+    Augmenter* const pAugmenter = m_augmentPass ? &m_augmenters[firstBatch] : nullptr;
+    const size_t numBatches = (m_order.size() + BATCH_SIZE - 1) / BATCH_SIZE;
+    const size_t step = m_loaders.size();
+    for (size_t batch = firstBatch; batch < numBatches; batch += step)
+    {
+        Slot& slot = m_ring[batch % m_ringSize];
+        while (slot.sequence.load(std::memory_order_acquire) != batch)
+        {
+            if (m_stop.load(std::memory_order_relaxed))
+                return;
+            std::this_thread::yield();
+        }
+
+        fill(slot, batch, batch + step, pAugmenter);
+        slot.sequence.store(batch + 1, std::memory_order_release);
+    }
+}
+
+
+/** Copy a batch's samples into a slot and encode their targets.
+The samples of this loader's next batch are prefetched as the batch is copied.
+@param[out]    slot       The slot.
+@param[in]     batch      The batch.
+@param[in]     nextBatch  This loader's next batch.
+@param[in/out] pAugmenter The loader's augmenter, or nullptr to copy the samples unchanged.
+*/
+void EpochSampler::fill(Slot& slot, const size_t batch, const size_t nextBatch, Augmenter* pAugmenter) const
+{
+    Rng rng = Global::stream(StreamUse::AUGMENT, static_cast<std::uint32_t>(m_epoch), static_cast<std::uint32_t>(batch));
+
+    const auto& dataset = *m_pDataset;
+    const size_t first = batch * BATCH_SIZE;
+    const size_t count = std::min(BATCH_SIZE, m_order.size() - first);
+    for (size_t i = 0; i < count; ++i)
+    {
+        const size_t next = nextBatch * BATCH_SIZE + i;
+        if (next < m_order.size())
+            prefetchRow(dataset[m_order[next]].GetInputs().data(), NUM_INPUTS * sizeof(double));
+
+        const Trainer& trainer = dataset[m_order[first + i]];
+        assert(trainer.GetInputs().size() == NUM_INPUTS);
+        double* const pRow = slot.pInputs + i * PADDED_INPUTS;
+        if (pAugmenter != nullptr)
+        {
+            // the bias input is not an image pixel
+            pRow[0] = trainer.GetInputs()(0);
+            pAugmenter->Apply(trainer.GetInputs().data() + 1, pRow + 1, rng);
+        }
+        else
+            std::copy_n(trainer.GetInputs().data(), NUM_INPUTS, pRow);
+        Eigen::Map<NeuralNetDigitClassifier::OutputType>(slot.pTargets + i * NUM_OUTPUTS) = NeuralNetDigitClassifier::EncodeTarget(trainer.GetTarget());
+        slot.labels[i] = trainer.GetTarget();
+    }
+}
+
+
+/** Evaluate the neural network on a pass over the sampler, as the generic Evaluate does,
+but with the network reading each staged row in place rather than copying it to pad it.
+@param[in]     neuralnet The neural net object.
+@param[in/out] sampler   The sampler. Starts a new pass.
+@return The ratio of correct answers / total inputs.
+*/
+double Evaluate(const NeuralNetDigitClassifier& neuralnet, EpochSampler& sampler)
+{
+    int correct = 0;
+    for (const EpochSampler::Sample& sample : sampler)
+    {
+        if (neuralnet.DetermineDigit(sample.GetPaddedInputs()) == sample.GetTarget())
+            ++correct;
+    }
+    return correct / static_cast<double>(sampler.size());
+}
+
+
+}
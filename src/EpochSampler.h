@@ -0,0 +1,180 @@
+// ==================================================================
+// Copyright (c) 2019 Alexander Freed. ALL RIGHTS RESERVED.
+// Language: ISO C++14
+//
+// EpochSampler class declaration.
+// Visits an in-memory training set in a shuffled order without moving it.
+// ==================================================================
+
+#pragma once
+
+#include "Augmenter.h"
+#include "NeuralNet.h"
+#include "Random.h"
+#include "Trainer.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <future>
+#include <iterator>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <Eigen/Dense>
+
+
+namespace fnn {
+
+
+/** Visits an immutable training set in a shuffled order, with the batches prepared on loader threads.
+The epoch order is a permutation of indices. Loader threads copy the samples a batch at a time into
+64-byte aligned slots of a bounded ring, and encode their targets, ahead of the consumer. Each slot
+has a sequence number that hands it between its loader and the consumer without locks. Batches are
+consumed in order, so the results do not depend on the number of loader threads.
+The next epoch's order is shuffled on a background thread while the current epoch runs.
+With augmentation enabled, the loaders also distort the samples of the pass after each Shuffle.
+Each batch's distortions come from its own random stream, selected by the epoch and batch, so they are reproducible too.
+In block mode, blocks of consecutive samples are visited in a random order, and the samples of each
+block in a random order. This gives up some randomness for memory locality.
+Iterating starts a new pass, so the sampler can be used anywhere a container of Trainers is iterated.
+*/
+class EpochSampler
+{
+public:
+    // the number of samples in a batch
+    constexpr static size_t BATCH_SIZE = 16;
+
+    /** A prepared sample. Has the same accessors as Trainer, the encoded targets, and the inputs as staged:
+    padded to PADDED_INPUTS with zeros and aligned, so the network can read them in place.
+    Only valid until the iterator moves to the next batch.
+    */
+    class Sample
+    {
+    public:
+        using InputsType  = Eigen::Map<const InputType, Eigen::Aligned64>;
+        using TargetsType = Eigen::Map<const NeuralNetDigitClassifier::OutputType>;
+
+        Sample() = default;
+        Sample(const int target, const double* pInputs, const double* pTargets)
+            : m_target(target), m_pInputs(pInputs), m_pTargets(pTargets) { }
+
+        int         GetTarget() const { return m_target; }
+        InputsType  GetInputs() const { return InputsType(m_pInputs, NUM_INPUTS); }
+        PaddedInput GetPaddedInputs() const { return { m_pInputs }; }
+        TargetsType GetTargets() const { return TargetsType(m_pTargets); }
+
+    private:
+        int           m_target   = 0;
+        const double* m_pInputs  = nullptr;
+        const double* m_pTargets = nullptr;
+    };
+
+    /** Single-pass input iterator. Waits for a batch when it crosses into one.
+    */
+    class Iterator
+    {
+    public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type        = Sample;
+        using difference_type   = std::ptrdiff_t;
+        using pointer           = const Sample*;
+        using reference         = const Sample&;
+
+        Iterator() = default;
+        Iterator(EpochSampler* pSampler, const size_t position)
+            : m_pSampler(pSampler)
+            , m_position(position)
+        {
+            update();
+        }
+
+        reference operator*() const { return m_current; }
+        pointer operator->() const { return &m_current; }
+        Iterator& operator++() { ++m_position; update(); return *this; }
+        bool operator==(const Iterator& other) const { return m_position == other.m_position; }
+        bool operator!=(const Iterator& other) const { return m_position != other.m_position; }
+
+    private:
+        void update()
+        {
+            if (m_position < m_pSampler->size())
+                m_current = m_pSampler->get(m_position);
+        }
+
+        EpochSampler* m_pSampler = nullptr;
+        size_t        m_position = 0;
+        Sample        m_current;
+    };
+
+    EpochSampler(const std::vector<Trainer>& dataset, const size_t blockSize, const unsigned numLoaders);
+    ~EpochSampler();
+
+    EpochSampler(const EpochSampler&) = delete;
+    EpochSampler& operator=(const EpochSampler&) = delete;
+
+    void EnableAugmentation(const AugmentParams& params);
+    void Shuffle();
+
+    Iterator begin();
+    Iterator end() { return Iterator(this, size()); }
+    // named like a container so the sampler can be passed to the generic evaluation code
+    size_t size() const { return m_order.size(); }
+
+private:
+    /** A ring slot. The sequence number is the batch the slot is free for,
+    or one more than the batch it holds once that batch is ready.
+    */
+    struct Slot
+    {
+        std::atomic<std::uint64_t> sequence{ 0 };
+        double*                    pInputs  = nullptr;  // BATCH_SIZE rows of PADDED_INPUTS
+        double*                    pTargets = nullptr;  // BATCH_SIZE rows of NUM_OUTPUTS
+        int                        labels[BATCH_SIZE];
+        // keep neighbouring slots' sequence numbers on different cache lines
+        char                       padding[64];
+    };
+
+    static std::vector<size_t> shuffled(std::vector<size_t> order, const size_t blockSize, Rng& rng);
+
+    void   startPass();
+    void   stopPass();
+    Sample get(const size_t position);
+    void   load(const size_t firstBatch);
+    void   fill(Slot& slot, const size_t batch, const size_t nextBatch, Augmenter* pAugmenter) const;
+
+    const std::vector<Trainer>* m_pDataset;
+    size_t                      m_blockSize;
+    std::vector<size_t>         m_order;
+
+    // the next epoch's order, being shuffled in the background
+    Rng                              m_rng;
+    std::future<std::vector<size_t>> m_nextOrder;
+
+    // ring of prepared batches
+    size_t                    m_ringSize;
+    std::unique_ptr<Slot[]>   m_ring;
+    std::unique_ptr<double[]> m_storage;
+
+    // augmentation. One augmenter per loader thread.
+    std::uint64_t          m_epoch           = 0;
+    std::vector<Augmenter> m_augmenters;
+    bool                   m_augmentNextPass = false;
+    bool                   m_augmentPass     = false;
+
+    // loader threads
+    std::vector<std::thread> m_loaders;
+    std::atomic<bool>        m_stop{ false };
+
+    // consumer only
+    size_t m_heldBatch;
+};
+
+
+// function prototypes
+
+double Evaluate(const NeuralNetDigitClassifier& neuralnet, EpochSampler& sampler);
+
+
+}
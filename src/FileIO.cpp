@@ -7,33 +7,202 @@
 
 #include "FileIO.h"
 
+#include "DatasetFile.h"
+#include "Kernels.h"
+#include "MappedFile.h"
+
+#include <algorithm>
+#include <array>
 #include <fstream>
 #include <cassert>
+#include <cstring>
 #include <iostream>
 
 
 namespace FileIO {
 
 
+namespace {
+
+
+constexpr size_t CSV_BLOCK_SIZE = size_t(1) << 20;
+
+
+/** Check whether a row holds only whitespace.
+*/
+bool isBlank(const char* p, const char* const pEnd)
+{
+    for (; p != pEnd; ++p)
+    {
+        if (*p != ' ' && *p != '\t' && *p != '\r')
+            return false;
+    }
+    return true;
+}
+
+
+/** Skip spaces, tabs and carriage returns.
+*/
+const char* skipSpace(const char* p, const char* const pEnd)
+{
+    while (p != pEnd && (*p == ' ' || *p == '\t' || *p == '\r'))
+        ++p;
+    return p;
+}
+
+
+/** Parse one CSV row of unsigned integers.
+Ranges are not checked here. Numbers are limited to 4 digits, which is enough to tell an
+out-of-range value from a valid one without overflow.
+@param[in]  p          The start of the row.
+@param[in]  pEnd       The end of the row, excluding the newline.
+@param[out] out_fields The parsed values. The row must have exactly this many.
+@return false if the row is malformed.
+*/
+template <size_t N>
+bool parseRow(const char* p, const char* const pEnd, std::array<std::uint16_t, N>& out_fields)
+{
+    for (size_t i = 0; i < N; ++i)
+    {
+        p = skipSpace(p, pEnd);
+        const char* const pStart = p;
+        unsigned value = 0;
+        while (p != pEnd && p - pStart < 4 && static_cast<unsigned>(*p - '0') < 10)
+        {
+            value = value * 10 + static_cast<unsigned>(*p - '0');
+            ++p;
+        }
+        out_fields[i] = static_cast<std::uint16_t>(value);
+
+        p = skipSpace(p, pEnd);
+        if (p == pStart)
+            return false;
+        if (i + 1 < N)
+        {
+            if (p == pEnd || *p != ',')
+                return false;
+            ++p;
+        }
+    }
+    return p == pEnd;
+}
+
+
+/** Parse the next numBytes of a CSV file.
+Rows are appended to out_packed and out_objects. See LoadCsv.
+@param[in]     fin         The file, positioned at the start of a row.
+@param[in]     numBytes    The number of bytes to parse. The last row does not need a newline.
+@param[in/out] checksum    Gets every byte parsed.
+@param[in/out] out_packed  The samples in stored form.
+@param[in/out] out_objects The converted samples.
+@param[in]     pProgress   If not null, print progress here.
+@return SUCCESS, or FILE_BAD_FORMAT if any row is malformed or out of range.
+*/
+LoadResult parseCsv(std::istream& fin, std::uint64_t numBytes, ChecksumStream& checksum, PackedDataset& out_packed, std::vector<fnn::Trainer>& out_objects, std::ostream* pProgress)
+{
+    const size_t numPixels = out_packed.GetPixelsPerSample();
+    assert(numPixels + 1 == fnn::NUM_INPUTS);
+
+    // the label followed by the pixels
+    std::array<std::uint16_t, fnn::NUM_INPUTS> fields;
+
+    // one block at a time. A row that straddles two blocks is carried over.
+    std::vector<char> buffer(CSV_BLOCK_SIZE);
+    size_t carried = 0;
+    for (;;)
+    {
+        // a row longer than the buffer
+        if (carried == buffer.size())
+            buffer.resize(buffer.size() * 2);
+
+        const size_t numRead = static_cast<size_t>(std::min<std::uint64_t>(numBytes, buffer.size() - carried));
+        fin.read(buffer.data() + carried, numRead);
+        if (static_cast<size_t>(fin.gcount()) != numRead)
+            return LoadResult::UNEXPECTED_ERROR;
+        checksum.Update(buffer.data() + carried, numRead);
+        numBytes -= numRead;
+        const bool atEnd = numBytes == 0;
+
+        const char* p = buffer.data();
+        const char* const pEnd = p + carried + numRead;
+        while (p != pEnd)
+        {
+            // the last row of the file does not need a newline
+            const char* pRowEnd = static_cast<const char*>(std::memchr(p, '\n', pEnd - p));
+            if (pRowEnd == nullptr && !atEnd)
+                break;
+            if (pRowEnd == nullptr)
+                pRowEnd = pEnd;
+
+            if (!isBlank(p, pRowEnd))
+            {
+                // should be a target followed by 784 values (comma separated) on each line
+                if (!parseRow(p, pRowEnd, fields) || fields[0] > DATASET_MAX_LABEL)
+                    return LoadResult::FILE_BAD_FORMAT;
+
+                if (pProgress != nullptr && out_objects.size() % 5000 == 0)
+                    *pProgress << "Loaded: " << out_objects.size() << std::endl;
+
+                // pack, then convert while the row is still in cache
+                const size_t offset = out_packed.pixels.size();
+                out_packed.pixels.resize(offset + numPixels);
+                std::uint8_t* const pPixels = &out_packed.pixels[offset];
+                if (!fnn::PackPixelFields(&fields[1], numPixels, pPixels))
+                    return LoadResult::FILE_BAD_FORMAT;
+                out_packed.labels.push_back(static_cast<std::uint8_t>(fields[0]));
+                out_objects.emplace_back(fields[0], pPixels, numPixels);
+            }
+
+            p = pRowEnd == pEnd ? pEnd : pRowEnd + 1;
+        }
+
+        if (atEnd)
+            break;
+
+        carried = static_cast<size_t>(pEnd - p);
+        std::memmove(buffer.data(), p, carried);
+    }
+
+    if (pProgress != nullptr && out_objects.size() % 5000 != 0)
+        *pProgress << "Loaded: " << out_objects.size() << std::endl;
+
+    return LoadResult::SUCCESS;
+}
+
+
+}  // namespace
+
+
 /** Check the load result and print out a helpful message.
 @param[in] result The result to check.
+@param[in] pOut   [default: stdout] Where to print the message.
 @return true if the load result was a success
 */
-bool CheckLoad(const LoadResult& result)
+bool CheckLoad(const LoadResult& result, std::ostream* pOut)
 {
+    std::ostream& out = pOut != nullptr ? *pOut : std::cout;
     switch (result)
     {
     case LoadResult::SUCCESS:
         return true;
         break;
     case LoadResult::FILE_NOT_FOUND:
-        std::cout << "File does not exist.\n";
+        out << "File does not exist.\n";
         break;
     case LoadResult::FILE_BAD_FORMAT:
-        std::cout << "File format did not match expectations.\n";
+        out << "File format did not match expectations.\n";
+        break;
+    case LoadResult::FILE_VERSION_MISMATCH:
+        out << "File was written by a different version of the program.\n";
+        break;
+    case LoadResult::FILE_CORRUPT:
+        out << "File checksum did not match. The file is corrupt.\n";
+        break;
+    case LoadResult::FILE_OUT_OF_DATE:
+        out << "The source file has changed since the cache was built.\n";
         break;
     case LoadResult::UNEXPECTED_ERROR:
-        std::cout << "Unexpected error.\n";
+        out << "Unexpected error.\n";
         break;
     default:
         // option not accounted for
@@ -46,127 +215,145 @@ bool CheckLoad(const LoadResult& result)
 
 /** Load the data from a CSV.
 This is slower than derserializing, but portable.
-@param[in] filename     The path and filename
-@param[in] rowsHint     The expected number of rows. Used to preallocate space.
-@param[in] showProgress [default: false] If true, print to stdout to show progress.
-@return A pair consisting of a load result and a std::vector of RawTrainer objects
+The file is read in one streaming pass. Each row is range checked, packed and converted into a
+Trainer (bias inserted, pixels scaled to 0..1) while it is still in cache. The checksum of the
+file is calculated on the same pass and recorded in out_packed.source.
+Every row must be a label 0..9 followed by 784 integer pixels 0..255, comma separated.
+@param[in]  filename     The path and filename
+@param[in]  rowsHint     The expected number of rows. Used to preallocate space.
+@param[out] out_packed   The samples in stored form, for writing the binary caches.
+@param[in]  pProgress    [default: nullptr] If not null, print progress here.
+@return A pair consisting of a load result and a std::vector of Trainer objects
 */
-std::tuple<LoadResult, std::vector<fnn::RawTrainer>> LoadCsv(const std::string& filename, const size_t rowsHint, bool showProgress)
+std::tuple<LoadResult, std::vector<fnn::Trainer>> LoadCsv(const std::string& filename, const size_t rowsHint, PackedDataset& out_packed, std::ostream* pProgress)
 {
-    // open file
-    std::fstream fin(filename.c_str(), std::ios::in);
-    if (!fin)
+    out_packed = PackedDataset();
+
+    // open file. Rows appended after this are left for the next load.
+    std::ifstream fin(filename.c_str(), std::ios::in | std::ios::binary);
+    FileStatus status;
+    if (!fin || !GetFileStatus(filename, status))
         return { LoadResult::FILE_NOT_FOUND, {} };
 
-    // allocate object array
-    std::vector<fnn::RawTrainer> objects;
+    ChecksumStream checksum(status.size);
+    std::vector<fnn::Trainer> objects;
     objects.reserve(rowsHint);
+    out_packed.labels.reserve(rowsHint);
+    out_packed.pixels.reserve(rowsHint * out_packed.GetPixelsPerSample());
 
-    // begin loading
+    const LoadResult result = parseCsv(fin, status.size, checksum, out_packed, objects, pProgress);
+    if (result != LoadResult::SUCCESS)
+        return { result, {} };
 
-    // create a default-constructed object
-    objects.emplace_back();
-    // read in the target
-    fin >> objects[0].m_target;
-    // read in the comma
-    char delimiter;
-    fin >> delimiter;
-
-    // load from file
-    while (fin && !fin.eof())
-    {
-        if (showProgress && objects.size() % 5000 == 0)
-            std::cout << "Loaded: " << objects.size() << std::endl;
-
-        auto& last = objects.back();
-
-        // read in the inputs
-        for (auto& elem : last.m_inputs)
-        {
-            // skip first element, which is the bias (not saved in the CSV)
-            if (&elem == &last.m_inputs.front())
-                continue;
-
-            if (!fin || fin.eof() || delimiter != ',')
-                break;
+    out_packed.source.size     = status.size;
+    out_packed.source.mtime    = status.mtime;
+    out_packed.source.checksum = checksum.Finish();
+    return { LoadResult::SUCCESS, std::move(objects) };
+}
 
-            fin >> elem;
-            // whitespace for the newline after last element is automatically removed
-            if (&elem != &last.m_inputs.back())
-                fin >> delimiter;
-        }
 
-        // eof should not be triggered yet or the file is the wrong size
-        if (!fin || fin.eof() || delimiter != ',')
-        {
-            // should be a target followed by 784 values (comma separated) on each line
-            assert(false);
-            return { LoadResult::FILE_BAD_FORMAT, {} };
-        }
-
-        
-        // create a default-constructed object
-        objects.emplace_back();
+/** Load the rows appended to a CSV since part of it was parsed.
+The parsed part is read again and checked against its checksum. Any change to it, or a file
+that got shorter, means the rows already loaded can no longer be trusted.
+@param[in]  filename  The path and filename
+@param[in]  parsed    The part of the file that was parsed before.
+@param[out] out_tail  The new samples in stored form. out_tail.source describes the whole file.
+@param[in]  pProgress [default: nullptr] If not null, print progress here.
+@return A pair consisting of a load result and a std::vector of Trainer objects for the new rows.
+        FILE_OUT_OF_DATE if the file changed other than by appending rows.
+*/
+std::tuple<LoadResult, std::vector<fnn::Trainer>> LoadCsvTail(const std::string& filename, const CsvSource& parsed, PackedDataset& out_tail, std::ostream* pProgress)
+{
+    out_tail = PackedDataset();
 
-        // read in the target
-        fin >> objects.back().m_target;
-        // read in the comma
-        fin >> delimiter;
+    std::ifstream fin(filename.c_str(), std::ios::in | std::ios::binary);
+    FileStatus status;
+    if (!fin || !GetFileStatus(filename, status))
+        return { LoadResult::FILE_NOT_FOUND, {} };
+    if (status.size < parsed.size)
+        return { LoadResult::FILE_OUT_OF_DATE, {} };
+
+    // the parsed part must not have changed. It is part of the new checksum too.
+    ChecksumStream checksumParsed(parsed.size);
+    ChecksumStream checksum(status.size);
+    std::vector<char> buffer(CSV_BLOCK_SIZE);
+    char last = '\n';
+    for (std::uint64_t remaining = parsed.size; remaining > 0; )
+    {
+        const size_t numBytes = static_cast<size_t>(std::min<std::uint64_t>(remaining, buffer.size()));
+        if (!fin.read(buffer.data(), numBytes))
+            return { LoadResult::UNEXPECTED_ERROR, {} };
+        checksumParsed.Update(buffer.data(), numBytes);
+        checksum.Update(buffer.data(), numBytes);
+        last = buffer[numBytes - 1];
+        remaining -= numBytes;
     }
-    
-    objects.pop_back();  // get rid of last dummy object
-
-    if (showProgress && objects.size() % 5000 != 0)
-        std::cout << "Loaded: " << objects.size() << std::endl;
-
+    if (checksumParsed.Finish() != parsed.checksum)
+        return { LoadResult::FILE_OUT_OF_DATE, {} };
+
+    // a last row without a newline must not have been continued
+    const int next = fin.peek();
+    if (last != '\n' && next != '\n' && next != '\r' && next != std::char_traits<char>::eof())
+        return { LoadResult::FILE_OUT_OF_DATE, {} };
+
+    std::vector<fnn::Trainer> objects;
+    const LoadResult result = parseCsv(fin, status.size - parsed.size, checksum, out_tail, objects, pProgress);
+    if (result != LoadResult::SUCCESS)
+        return { result, {} };
+
+    out_tail.source.size     = status.size;
+    out_tail.source.mtime    = status.mtime;
+    out_tail.source.checksum = checksum.Finish();
     return { LoadResult::SUCCESS, std::move(objects) };
 }
 
 
 /** Deserialize the data from a file.
-Assumes a binary file containing serialized TrainingSet objects.
-This is faster but very non-portable! A machine should be able to deserialize a file it has serialized itself.
+Expects a file written by Serialize. The header, byte order, version and checksum are all
+validated, so a stale or foreign file is rejected rather than loaded as garbage.
 @param[in] filename The path and filename
-@return A pair consisting of a load result and a std::vector of RawTrainer objects
+@return A pair consisting of a load result and a std::vector of Trainer objects
 */
-std::tuple<LoadResult, std::vector<fnn::RawTrainer>> Deserialize(const std::string& filename)
+std::tuple<LoadResult, std::vector<fnn::Trainer>> Deserialize(const std::string& filename)
 {
-    // open file
-    std::fstream fin(filename.c_str(), std::ios::binary | std::ios::in);
-    if (!fin)
-        return { LoadResult::FILE_NOT_FOUND, {} };
-
-    // calculate necessary number of objects
-    const auto beginPos = fin.tellg();
-    fin.seekg(0, std::ios::end);
-    const std::ios::pos_type fileBytes = fin.tellg() - beginPos;
-    if (fileBytes % sizeof(fnn::RawTrainer) != 0)
-    {
-        assert(false);
-        return { LoadResult::FILE_BAD_FORMAT, {} };
-    }
-    const unsigned numObjects = unsigned(fileBytes / sizeof(fnn::RawTrainer));
-    fin.seekg(0);
+    LoadResult result = LoadResult::UNEXPECTED_ERROR;
+    DatasetView view;
+    std::tie(result, view) = MapDataset(filename);
+    if (result != LoadResult::SUCCESS)
+        return { result, {} };
 
-    // allocate object array
-    std::vector<fnn::RawTrainer> objects(numObjects);
+    return Deserialize(view);
+}
 
-    // peek triggers eof
-    fin.peek();
-    // load from file
-    if (fin && !fin.eof())
-        fin.read(reinterpret_cast<char*>(&objects[0]), numObjects * sizeof(fnn::RawTrainer));
 
-    assert(!fin.eof());
+/** Convert the samples of a mapped dataset file.
+Samples are converted straight from the mapping in one pass.
+@param[in] view The mapped file.
+@return A pair consisting of a load result and a std::vector of Trainer objects
+*/
+std::tuple<LoadResult, std::vector<fnn::Trainer>> Deserialize(const DatasetView& view)
+{
+    // the samples must fit in a Trainer
+    const auto& header = view.GetHeader();
+    const size_t numPixels = header.GetPixelsPerSample();
+    if (numPixels + 1 != fnn::NUM_INPUTS)
+        return { LoadResult::FILE_BAD_FORMAT, {} };
 
-    // peek triggers eof
-    fin.peek();
-    
-    // sanity checks
-    if (fin.fail() || !fin.eof())
+    std::vector<fnn::Trainer> objects;
+    objects.reserve(view.GetNumSamples());
+    if (header.pixelType == ElementType::UINT8)
     {
-        assert(false);
-        return { LoadResult::UNEXPECTED_ERROR, {} };
+        for (size_t i = 0; i < view.GetNumSamples(); ++i)
+            objects.emplace_back(view.GetLabels()[i], view.GetPixels() + i * numPixels, numPixels);
+    }
+    else
+    {
+        fnn::RawTrainer raw;
+        for (size_t i = 0; i < view.GetNumSamples(); ++i)
+        {
+            view.Decode(i, raw);
+            objects.emplace_back(raw);
+        }
     }
 
     return { LoadResult::SUCCESS, std::move(objects) };
@@ -174,29 +361,79 @@ std::tuple<LoadResult, std::vector<fnn::RawTrainer>> Deserialize(const std::stri
 
 
 /** Serialize the data.
-Creates a binary file containing serialized TrainingSet objects.
-The binary file is faster to load than a CSV, but this is very non-portable! However, a machine should be able to deserialize a file it has serialized itself.
+Creates a binary file in the versioned dataset format (see DatasetFile.h).
+The file is portable between compilers and architectures.
 @param[in] filename The path and filename
-@param[in] objects  A std::vector of objects to serialize
+@param[in] packed   The samples to serialize, as produced by LoadCsv
 @return true if successful
 */
-bool Serialize(const std::string& filename, const std::vector<fnn::RawTrainer>& objects)
+bool Serialize(const std::string& filename, const PackedDataset& packed)
 {
-    // open file
-    std::fstream fout(filename.c_str(), std::ios::binary | std::ios::out);
+    return WriteDataset(filename, packed);
+}
+
+
+/** Write samples as an MNIST CSV: per row, the label then the pixels, comma separated.
+The file is written in blocks, and its checksum calculated on the same pass, so out_packed.source
+describes the file and the binary caches written from out_packed are up to date with it.
+@param[in]     filename   The path and filename
+@param[in/out] out_packed The samples to write. Its source is set to the written file.
+@return true if successful
+*/
+bool WriteCsv(const std::string& filename, PackedDataset& out_packed)
+{
+    const size_t pixelsPerSample = out_packed.GetPixelsPerSample();
+    const auto numDigits = [](const unsigned value) { return value < 10 ? 1 : value < 100 ? 2 : 3; };
+
+    // the checksum needs the size up front
+    std::uint64_t numBytes = 0;
+    for (const std::uint8_t label : out_packed.labels)
+        numBytes += numDigits(label) + 1;  // + newline
+    for (const std::uint8_t pixel : out_packed.pixels)
+        numBytes += numDigits(pixel) + 1;  // + comma
+
+    std::ofstream fout(filename.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
     if (!fout)
         return false;
 
-    // write to file
-    fout.write(reinterpret_cast<const char*>(&objects[0]), objects.size() * sizeof(fnn::RawTrainer));
-
-    // sanity checks
-    if (fout.fail())
+    ChecksumStream checksum(numBytes);
+    std::vector<char> buffer;
+    buffer.reserve(CSV_BLOCK_SIZE + 4 * (pixelsPerSample + 1));
+    const auto appendNumber = [&buffer](const unsigned value) {
+        if (value >= 100)
+            buffer.push_back(static_cast<char>('0' + value / 100));
+        if (value >= 10)
+            buffer.push_back(static_cast<char>('0' + value / 10 % 10));
+        buffer.push_back(static_cast<char>('0' + value % 10));
+    };
+    const auto flush = [&]() {
+        checksum.Update(buffer.data(), buffer.size());
+        fout.write(buffer.data(), buffer.size());
+        buffer.clear();
+    };
+
+    for (size_t i = 0; i < out_packed.GetNumSamples(); ++i)
     {
-        assert(false);
-        return false;
+        appendNumber(out_packed.labels[i]);
+        const std::uint8_t* const pPixels = &out_packed.pixels[i * pixelsPerSample];
+        for (size_t p = 0; p < pixelsPerSample; ++p)
+        {
+            buffer.push_back(',');
+            appendNumber(pPixels[p]);
+        }
+        buffer.push_back('\n');
+        if (buffer.size() >= CSV_BLOCK_SIZE)
+            flush();
     }
+    flush();
+    fout.close();
 
+    FileStatus status;
+    if (fout.fail() || !GetFileStatus(filename, status) || status.size != numBytes)
+        return false;
+    out_packed.source.size     = status.size;
+    out_packed.source.mtime    = status.mtime;
+    out_packed.source.checksum = checksum.Finish();
     return true;
 }
 
@@ -9,6 +9,9 @@
 
 #include "Trainer.h"
 
+#include <cstdint>
+#include <iosfwd>
+#include <string>
 #include <vector>
 #include <tuple>
 
@@ -16,6 +19,9 @@
 namespace FileIO {
 
 
+class DatasetView;
+
+
 // classes
 
 enum LoadResult
@@ -23,16 +29,48 @@ enum LoadResult
     SUCCESS,
     FILE_NOT_FOUND,
     FILE_BAD_FORMAT,
+    FILE_VERSION_MISMATCH,
+    FILE_CORRUPT,
+    FILE_OUT_OF_DATE,
     UNEXPECTED_ERROR
 };
 
 
+/** Identifies the part of a CSV file that a cache was built from.
+*/
+struct CsvSource
+{
+    std::uint64_t size     = 0;  // bytes parsed, from the start of the file
+    std::int64_t  mtime    = 0;  // modification time when parsed. Nanoseconds since the Unix epoch.
+    std::uint64_t checksum = 0;  // Checksum() of the parsed bytes
+};
+
+
+/** Samples in their stored form: one byte per label and one byte per pixel, sample after sample.
+Produced by LoadCsv alongside the Trainers and used to write the binary caches.
+*/
+struct PackedDataset
+{
+    std::uint32_t             imageRows = 28;
+    std::uint32_t             imageCols = 28;
+    std::vector<std::uint8_t> labels;
+    std::vector<std::uint8_t> pixels;
+    CsvSource                 source;
+
+    size_t GetPixelsPerSample() const { return size_t(imageRows) * imageCols; }
+    size_t GetNumSamples() const { return labels.size(); }
+};
+
+
 // function prototypes
 
-bool CheckLoad(const LoadResult& result);
-std::tuple<LoadResult, std::vector<fnn::RawTrainer>> LoadCsv(const std::string& filename, const size_t rowsHint, bool showProgress=false);
-std::tuple<LoadResult, std::vector<fnn::RawTrainer>> Deserialize(const std::string& filename);
-bool Serialize(const std::string& filename, const std::vector<fnn::RawTrainer>& objects);
+bool CheckLoad(const LoadResult& result, std::ostream* pOut=nullptr);
+std::tuple<LoadResult, std::vector<fnn::Trainer>> LoadCsv(const std::string& filename, const size_t rowsHint, PackedDataset& out_packed, std::ostream* pProgress=nullptr);
+std::tuple<LoadResult, std::vector<fnn::Trainer>> LoadCsvTail(const std::string& filename, const CsvSource& parsed, PackedDataset& out_tail, std::ostream* pProgress=nullptr);
+std::tuple<LoadResult, std::vector<fnn::Trainer>> Deserialize(const std::string& filename);
+std::tuple<LoadResult, std::vector<fnn::Trainer>> Deserialize(const DatasetView& view);
+bool Serialize(const std::string& filename, const PackedDataset& packed);
+bool WriteCsv(const std::string& filename, PackedDataset& out_packed);
 void savePlotData(const std::vector<double>& plotData);
 
 
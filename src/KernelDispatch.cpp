@@ -0,0 +1,314 @@
+// ==================================================================
+// Copyright (c) 2019 Alexander Freed. ALL RIGHTS RESERVED.
+// Language: ISO C++14
+//
+// Chooses the build of the kernels for this CPU, and calls through it.
+// ==================================================================
+
+#include "KernelTable.h"
+
+#include <atomic>
+#include <ostream>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+    #define FNN_X86
+    #if defined(_MSC_VER)
+        #include <intrin.h>
+    #else
+        #include <cpuid.h>
+    #endif
+#endif
+
+
+namespace fnn {
+
+
+namespace {
+
+
+// the selected build. Null until the first kernel call or selection.
+std::atomic<const KernelTable*> g_pTable(nullptr);
+
+
+/** Get the build of the kernels for an instruction set.
+@return The build, or null if it was not compiled in.
+*/
+const KernelTable* tableOf(const KernelIsa isa)
+{
+    switch (isa)
+    {
+#ifdef FNN_HAVE_KERNELS_AVX512
+    case KernelIsa::AVX512: return &avx512::GetKernelTable();
+#endif
+#ifdef FNN_HAVE_KERNELS_AVX2
+    case KernelIsa::AVX2:   return &avx2::GetKernelTable();
+#endif
+#ifdef FNN_HAVE_KERNELS_SSE42
+    case KernelIsa::SSE42:  return &sse42::GetKernelTable();
+#endif
+    case KernelIsa::SCALAR: return &scalar::GetKernelTable();
+    default:                return nullptr;
+    }
+}
+
+
+#ifdef FNN_X86
+/** Run cpuid.
+@param[in]  leaf     The leaf (eax).
+@param[in]  subleaf  The subleaf (ecx).
+@param[out] out_regs eax, ebx, ecx and edx. Zeros if the leaf is not supported.
+*/
+void cpuid(const unsigned leaf, const unsigned subleaf, unsigned (&out_regs)[4])
+{
+#if defined(_MSC_VER)
+    int regs[4];
+    __cpuidex(regs, static_cast<int>(leaf), static_cast<int>(subleaf));
+    for (int i = 0; i < 4; ++i)
+        out_regs[i] = static_cast<unsigned>(regs[i]);
+#else
+    if (!__get_cpuid_count(leaf, subleaf, &out_regs[0], &out_regs[1], &out_regs[2], &out_regs[3]))
+        out_regs[0] = out_regs[1] = out_regs[2] = out_regs[3] = 0;
+#endif
+}
+
+
+/** Get the register state the OS saves on a context switch (XCR0). Only call if the CPU has OSXSAVE.
+*/
+unsigned long long xgetbv0()
+{
+#if defined(_MSC_VER)
+    return _xgetbv(0);
+#else
+    unsigned eax, edx;
+    __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return (static_cast<unsigned long long>(edx) << 32) | eax;
+#endif
+}
+#endif
+
+
+/** Check whether the CPU and the OS support an instruction set.
+A vector register width needs both: the CPU to have the instructions, and the OS to save the registers.
+*/
+bool cpuSupports(const KernelIsa isa)
+{
+    if (isa == KernelIsa::SCALAR)
+        return true;
+#ifdef FNN_X86
+    unsigned leaf0[4], leaf1[4], leaf7[4];
+    cpuid(0, 0, leaf0);
+    cpuid(1, 0, leaf1);
+    if (leaf0[0] >= 7)
+        cpuid(7, 0, leaf7);
+    else
+        leaf7[0] = leaf7[1] = leaf7[2] = leaf7[3] = 0;
+
+    const bool sse42   = (leaf1[2] & (1u << 20)) != 0;
+    const bool osxsave = (leaf1[2] & (1u << 27)) != 0;
+    const bool fma     = (leaf1[2] & (1u << 12)) != 0;
+    const bool avx2    = (leaf7[1] & (1u << 5))  != 0;
+    const bool avx512f = (leaf7[1] & (1u << 16)) != 0;
+    const unsigned long long xcr0 = osxsave ? xgetbv0() : 0;
+    const bool ymmState = (xcr0 & 0x6) == 0x6;    // SSE and AVX state
+    const bool zmmState = (xcr0 & 0xE6) == 0xE6;  // and the opmask and upper ZMM state
+
+    switch (isa)
+    {
+    case KernelIsa::SSE42:  return sse42;
+    case KernelIsa::AVX2:   return avx2 && fma && ymmState;
+    case KernelIsa::AVX512: return avx512f && avx2 && fma && zmmState;
+    default:                return false;
+    }
+#else
+    return false;
+#endif
+}
+
+
+/** Get the selected build, selecting the best on first use.
+*/
+const KernelTable& table()
+{
+    const KernelTable* pTable = g_pTable.load(std::memory_order_acquire);
+    if (pTable == nullptr)
+    {
+        pTable = tableOf(DetectKernelIsa());
+        const KernelTable* pExpected = nullptr;
+        // another thread may have selected first. Keep its choice.
+        if (!g_pTable.compare_exchange_strong(pExpected, pTable))
+            pTable = pExpected;
+    }
+    return *pTable;
+}
+
+
+}  // namespace
+
+
+/** Get the best instruction set the kernels were built for and this CPU supports.
+*/
+KernelIsa DetectKernelIsa()
+{
+    for (const KernelIsa isa : { KernelIsa::AVX512, KernelIsa::AVX2, KernelIsa::SSE42 })
+    {
+        if (IsKernelIsaAvailable(isa))
+            return isa;
+    }
+    return KernelIsa::SCALAR;
+}
+
+
+/** Get the instruction set of the kernels in use. Selects the best available one if none was selected.
+*/
+KernelIsa GetKernelIsa()
+{
+    return table().isa;
+}
+
+
+/** Check whether the kernels of an instruction set can be used: built, and supported by this CPU.
+*/
+bool IsKernelIsaAvailable(const KernelIsa isa)
+{
+    return tableOf(isa) != nullptr && cpuSupports(isa);
+}
+
+
+/** Use the kernels of an instruction set from now on, e.g. to compare them. Call before any training starts.
+@param[in] isa The instruction set.
+@return false, and nothing changes, if the kernels are not available. See IsKernelIsaAvailable.
+*/
+bool SelectKernelIsa(const KernelIsa isa)
+{
+    if (!IsKernelIsaAvailable(isa))
+        return false;
+    g_pTable.store(tableOf(isa), std::memory_order_release);
+    return true;
+}
+
+
+/** Get the name of an instruction set.
+@param[in] isa The instruction set.
+@return The name, as accepted by ParseKernelIsa.
+*/
+const char* KernelIsaName(const KernelIsa isa)
+{
+    switch (isa)
+    {
+    case KernelIsa::SCALAR: return "scalar";
+    case KernelIsa::SSE42:  return "sse4.2";
+    case KernelIsa::AVX2:   return "avx2";
+    case KernelIsa::AVX512: return "avx512";
+    }
+    return "unknown";
+}
+
+
+/** Parse the name of an instruction set.
+@param[in]  name    "scalar", "sse4.2", "avx2" or "avx512".
+@param[out] out_isa The instruction set.
+@return false if the name is unknown.
+*/
+bool ParseKernelIsa(const std::string& name, KernelIsa& out_isa)
+{
+    for (const KernelIsa isa : { KernelIsa::SCALAR, KernelIsa::SSE42, KernelIsa::AVX2, KernelIsa::AVX512 })
+    {
+        if (name == KernelIsaName(isa))
+        {
+            out_isa = isa;
+            return true;
+        }
+    }
+    return false;
+}
+
+
+/** Select the kernels named on the command line, or the best this CPU supports, and print which.
+@param[in] name The instruction set, as accepted by ParseKernelIsa. Empty for the best available.
+@param[in] out  The stream to print to.
+@return false if this CPU cannot run the kernels asked for.
+*/
+bool SelectKernels(const std::string& name, std::ostream& out)
+{
+    const KernelIsa best = DetectKernelIsa();
+    KernelIsa isa = best;
+    if (!name.empty() && (!ParseKernelIsa(name, isa) || !SelectKernelIsa(isa)))
+    {
+        out << "The " << name << " kernels were not built or this CPU does not support them. The best available are " << KernelIsaName(best) << "." << std::endl;
+        return false;
+    }
+    out << "Kernels: " << KernelIsaName(GetKernelIsa());
+    if (name.empty())
+        out << " (best available)" << std::endl;
+    else
+        out << " (selected with --isa, best available " << KernelIsaName(best) << ")" << std::endl;
+    return true;
+}
+
+
+// ------------------------------------------------------------------
+// the kernels, through the selected build. See Kernels.cpp for what they do.
+
+void MomentumRank1Update(double* pWeights, double* pDelta, const size_t rows, const size_t cols,
+                         const double* pX, const double* pError, const double learningRate, const double momentum)
+{
+    table().momentumRank1Update(pWeights, pDelta, rows, cols, pX, pError, learningRate, momentum);
+}
+
+
+void NesterovRank1Update(double* pWeights, double* pDelta, const size_t rows, const size_t cols,
+                         const double* pX, const double* pError, const double learningRate, const double momentum)
+{
+    table().nesterovRank1Update(pWeights, pDelta, rows, cols, pX, pError, learningRate, momentum);
+}
+
+
+void RMSPropRank1Update(double* pWeights, double* pMeanSquare, const size_t rows, const size_t cols,
+                        const double* pX, const double* pError, const double learningRate, const double decay, const double epsilon)
+{
+    table().rmsPropRank1Update(pWeights, pMeanSquare, rows, cols, pX, pError, learningRate, decay, epsilon);
+}
+
+
+void AdamRank1Update(double* pWeights, double* pMean, double* pMeanSquare, const size_t rows, const size_t cols,
+                     const double* pX, const double* pError, const double stepSize, const double beta1, const double beta2,
+                     const double squareCorrection, const double epsilon)
+{
+    table().adamRank1Update(pWeights, pMean, pMeanSquare, rows, cols, pX, pError, stepSize, beta1, beta2, squareCorrection, epsilon);
+}
+
+
+void SigmoidLayer(const double* pWeights, const size_t rows, const size_t cols, const double* pX, double* pOut)
+{
+    table().sigmoidLayer(pWeights, rows, cols, pX, pOut);
+}
+
+
+void PixelsToInputs(const std::uint8_t* pPixels, const size_t numPixels, double* pInputs)
+{
+    table().pixelsToInputs(pPixels, numPixels, pInputs);
+}
+
+
+bool PackPixelFields(const std::uint16_t* pFields, const size_t numPixels, std::uint8_t* pPixels)
+{
+    return table().packPixelFields(pFields, numPixels, pPixels);
+}
+
+
+size_t ChecksumLaneRounds(std::uint32_t* pLanes, const std::uint8_t* pData, const size_t numBytes,
+                          const std::uint32_t prime1, const std::uint32_t prime2)
+{
+    return table().checksumLaneRounds(pLanes, pData, numBytes, prime1, prime2);
+}
+
+
+void ResampleBilinear(const double* pPadded, const int stride, const int border, const int size,
+                      const double a, const double b, const double e, const double f,
+                      const double* pDx, const double* pDy, double* pDest)
+{
+    table().resampleBilinear(pPadded, stride, border, size, a, b, e, f, pDx, pDy, pDest);
+}
+
+
+}
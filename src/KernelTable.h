@@ -0,0 +1,42 @@
+// ==================================================================
+// Copyright (c) 2019 Alexander Freed. ALL RIGHTS RESERVED.
+// Language: ISO C++14
+//
+// KernelTable declaration. Internal to the kernels.
+// Kernels.cpp is compiled once per instruction set, each copy in its own namespace, and each copy
+// fills one table. KernelDispatch.cpp picks the table the functions of Kernels.h call through.
+// ==================================================================
+
+#pragma once
+
+#include "Kernels.h"
+
+
+namespace fnn {
+
+
+/** One build of the kernels.
+*/
+struct KernelTable
+{
+    KernelIsa                          isa;
+    decltype(&MomentumRank1Update)     momentumRank1Update;
+    decltype(&NesterovRank1Update)     nesterovRank1Update;
+    decltype(&RMSPropRank1Update)      rmsPropRank1Update;
+    decltype(&AdamRank1Update)         adamRank1Update;
+    decltype(&SigmoidLayer)            sigmoidLayer;
+    decltype(&PixelsToInputs)          pixelsToInputs;
+    decltype(&PackPixelFields)         packPixelFields;
+    decltype(&ChecksumLaneRounds)      checksumLaneRounds;
+    decltype(&ResampleBilinear)        resampleBilinear;
+};
+
+
+// the builds. Only those the compiler could build are linked in, see FNN_HAVE_KERNELS_* in CMakeLists.txt.
+namespace scalar { const KernelTable& GetKernelTable(); }
+namespace sse42  { const KernelTable& GetKernelTable(); }
+namespace avx2   { const KernelTable& GetKernelTable(); }
+namespace avx512 { const KernelTable& GetKernelTable(); }
+
+
+}
@@ -0,0 +1,654 @@
+// ==================================================================
+// Copyright (c) 2019 Alexander Freed. ALL RIGHTS RESERVED.
+// Language: ISO C++14
+//
+// Hand-vectorized kernels for the hot loops of training, inference, loading and augmentation.
+// This file is compiled once per instruction set, with the flags of that set and one of
+// FNN_KERNELS_AVX512, FNN_KERNELS_AVX2 or FNN_KERNELS_SSE42 defined (none for the scalar build).
+// Each build is in its own namespace and fills one KernelTable. See KernelDispatch.cpp.
+// The kernels are written once, over a small vector wrapper for each instruction set.
+// Only include headers without inline functions here: an inline function emitted by this file
+// could be the copy the linker keeps for the whole program, with instructions older CPUs lack.
+// ==================================================================
+
+#include "KernelTable.h"
+
+#include <cmath>
+#include <cstring>
+
+#if defined(FNN_KERNELS_AVX512) || defined(FNN_KERNELS_AVX2)
+    #include <immintrin.h>
+#elif defined(FNN_KERNELS_SSE42)
+    #include <smmintrin.h>
+#endif
+
+#if defined(FNN_KERNELS_AVX512)
+    #define FNN_KERNELS_NAMESPACE avx512
+#elif defined(FNN_KERNELS_AVX2)
+    #define FNN_KERNELS_NAMESPACE avx2
+#elif defined(FNN_KERNELS_SSE42)
+    #define FNN_KERNELS_NAMESPACE sse42
+#else
+    #define FNN_KERNELS_NAMESPACE scalar
+#endif
+
+
+namespace fnn {
+namespace FNN_KERNELS_NAMESPACE {
+
+
+namespace {
+
+
+// columns updated together, so each chunk of x is loaded once for all of them
+constexpr size_t COLUMN_BLOCK = 4;
+
+
+/** One double. Used for the rows left over after the vectors.
+*/
+struct ScalarVec
+{
+    constexpr static size_t WIDTH = 1;
+    double v;
+
+    static ScalarVec Set(const double a)              { return { a }; }
+    static ScalarVec Load(const double* p)            { return { *p }; }
+    static ScalarVec LoadBytes(const std::uint8_t* p) { return { double(*p) }; }
+    void Store(double* p) const                       { *p = v; }
+    double Sum() const                                { return v; }
+    friend ScalarVec operator+(const ScalarVec a, const ScalarVec b) { return { a.v + b.v }; }
+    friend ScalarVec operator*(const ScalarVec a, const ScalarVec b) { return { a.v * b.v }; }
+    friend ScalarVec operator/(const ScalarVec a, const ScalarVec b) { return { a.v / b.v }; }
+    friend ScalarVec MulAdd(const ScalarVec a, const ScalarVec b, const ScalarVec c) { return { a.v * b.v + c.v }; }
+    friend ScalarVec Sqrt(const ScalarVec a)          { return { std::sqrt(a.v) }; }
+};
+
+
+#if defined(FNN_KERNELS_AVX512)
+/** 8 doubles.
+*/
+struct SimdVec
+{
+    constexpr static size_t WIDTH = 8;
+    __m512d v;
+
+    static SimdVec Set(const double a)      { return { _mm512_set1_pd(a) }; }
+    static SimdVec Load(const double* p)    { return { _mm512_loadu_pd(p) }; }
+    // the masked forms here and in Sqrt, as GCC 12 warns about the undefined source of the unmasked ones
+    static SimdVec LoadBytes(const std::uint8_t* p)
+    {
+        return { _mm512_maskz_cvtepi32_pd(0xFF, _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p)))) };
+    }
+    void Store(double* p) const             { _mm512_storeu_pd(p, v); }
+    double Sum() const
+    {
+        const __m256d half = _mm256_add_pd(_mm512_maskz_extractf64x4_pd(0xF, v, 0), _mm512_maskz_extractf64x4_pd(0xF, v, 1));
+        const __m128d pair = _mm_add_pd(_mm256_castpd256_pd128(half), _mm256_extractf128_pd(half, 1));
+        return _mm_cvtsd_f64(_mm_add_sd(pair, _mm_unpackhi_pd(pair, pair)));
+    }
+    friend SimdVec operator+(const SimdVec a, const SimdVec b) { return { _mm512_add_pd(a.v, b.v) }; }
+    friend SimdVec operator*(const SimdVec a, const SimdVec b) { return { _mm512_mul_pd(a.v, b.v) }; }
+    friend SimdVec operator/(const SimdVec a, const SimdVec b) { return { _mm512_div_pd(a.v, b.v) }; }
+    friend SimdVec MulAdd(const SimdVec a, const SimdVec b, const SimdVec c) { return { _mm512_fmadd_pd(a.v, b.v, c.v) }; }
+    friend SimdVec Sqrt(const SimdVec a)    { return { _mm512_mask_sqrt_pd(_mm512_setzero_pd(), 0xFF, a.v) }; }
+};
+#elif defined(FNN_KERNELS_AVX2)
+/** 4 doubles.
+*/
+struct SimdVec
+{
+    constexpr static size_t WIDTH = 4;
+    __m256d v;
+
+    static SimdVec Set(const double a)      { return { _mm256_set1_pd(a) }; }
+    static SimdVec Load(const double* p)    { return { _mm256_loadu_pd(p) }; }
+    static SimdVec LoadBytes(const std::uint8_t* p)
+    {
+        std::int32_t bytes;
+        std::memcpy(&bytes, p, sizeof(bytes));
+        return { _mm256_cvtepi32_pd(_mm_cvtepu8_epi32(_mm_cvtsi32_si128(bytes))) };
+    }
+    void Store(double* p) const             { _mm256_storeu_pd(p, v); }
+    double Sum() const
+    {
+        const __m128d pair = _mm_add_pd(_mm256_castpd256_pd128(v), _mm256_extractf128_pd(v, 1));
+        return _mm_cvtsd_f64(_mm_add_sd(pair, _mm_unpackhi_pd(pair, pair)));
+    }
+    friend SimdVec operator+(const SimdVec a, const SimdVec b) { return { _mm256_add_pd(a.v, b.v) }; }
+    friend SimdVec operator*(const SimdVec a, const SimdVec b) { return { _mm256_mul_pd(a.v, b.v) }; }
+    friend SimdVec operator/(const SimdVec a, const SimdVec b) { return { _mm256_div_pd(a.v, b.v) }; }
+    friend SimdVec MulAdd(const SimdVec a, const SimdVec b, const SimdVec c) { return { _mm256_fmadd_pd(a.v, b.v, c.v) }; }
+    friend SimdVec Sqrt(const SimdVec a)    { return { _mm256_sqrt_pd(a.v) }; }
+};
+#elif defined(FNN_KERNELS_SSE42)
+/** 2 doubles. There is no fused multiply-add.
+*/
+struct SimdVec
+{
+    constexpr static size_t WIDTH = 2;
+    __m128d v;
+
+    static SimdVec Set(const double a)      { return { _mm_set1_pd(a) }; }
+    static SimdVec Load(const double* p)    { return { _mm_loadu_pd(p) }; }
+    static SimdVec LoadBytes(const std::uint8_t* p)
+    {
+        std::uint16_t bytes;
+        std::memcpy(&bytes, p, sizeof(bytes));
+        return { _mm_cvtepi32_pd(_mm_cvtepu8_epi32(_mm_cvtsi32_si128(bytes))) };
+    }
+    void Store(double* p) const             { _mm_storeu_pd(p, v); }
+    double Sum() const                      { return _mm_cvtsd_f64(_mm_add_sd(v, _mm_unpackhi_pd(v, v))); }
+    friend SimdVec operator+(const SimdVec a, const SimdVec b) { return { _mm_add_pd(a.v, b.v) }; }
+    friend SimdVec operator*(const SimdVec a, const SimdVec b) { return { _mm_mul_pd(a.v, b.v) }; }
+    friend SimdVec operator/(const SimdVec a, const SimdVec b) { return { _mm_div_pd(a.v, b.v) }; }
+    friend SimdVec MulAdd(const SimdVec a, const SimdVec b, const SimdVec c) { return { _mm_add_pd(_mm_mul_pd(a.v, b.v), c.v) }; }
+    friend SimdVec Sqrt(const SimdVec a)    { return { _mm_sqrt_pd(a.v) }; }
+};
+#else
+using SimdVec = ScalarVec;
+#endif
+
+
+/** Run an update rule over rows [first, last) of a block of columns.
+The rule is called with the vector type, the descent direction x * error for the elements,
+and the element offset into the column-major matrices.
+*/
+template <typename Vec, typename Rule>
+size_t updateRows(const size_t first, const size_t last, const size_t rows, const size_t numCols,
+                  const double* pX, const double* pError, const Rule& rule)
+{
+    size_t i = first;
+    for (; i + Vec::WIDTH <= last; i += Vec::WIDTH)
+    {
+        const Vec x = Vec::Load(pX + i);
+        for (size_t c = 0; c < numCols; ++c)
+            rule(x * Vec::Set(pError[c]), c * rows + i);
+    }
+    return i;
+}
+
+
+/** Apply an update rule to every element of a rank-1 update, a block of columns at a time.
+@param[in]     rows   The number of rows, the length of x.
+@param[in]     cols   The number of columns, the length of error.
+@param[in]     pX     The inputs to the layer.
+@param[in]     pError The errors of the layer's outputs.
+@param[in/out] rule   A Matrices with a generic operator()(descent, offset). Offsets are relative to the
+                      block's first column, which is set with SetBlock.
+*/
+template <typename Rule>
+void rank1Update(const size_t rows, const size_t cols, const double* pX, const double* pError, Rule rule)
+{
+    for (size_t first = 0; first < cols; first += COLUMN_BLOCK)
+    {
+        const size_t numCols = cols - first < COLUMN_BLOCK ? cols - first : COLUMN_BLOCK;
+        rule.SetBlock(first * rows);
+        const size_t done = updateRows<SimdVec>(0, rows, rows, numCols, pX, pError + first, rule);
+        updateRows<ScalarVec>(done, rows, rows, numCols, pX, pError + first, rule);
+    }
+}
+
+
+/** Holds the matrix pointers of a rule, offset to the current column block.
+*/
+struct Matrices
+{
+    double* pWeights = nullptr;
+    double* pState0  = nullptr;
+    double* pState1  = nullptr;
+    size_t  offset   = 0;
+
+    void SetBlock(const size_t blockOffset) { offset = blockOffset; }
+    double* W(const size_t i) const  { return pWeights + offset + i; }
+    double* S0(const size_t i) const { return pState0 + offset + i; }
+    double* S1(const size_t i) const { return pState1 + offset + i; }
+};
+
+
+struct MomentumRule : Matrices
+{
+    double learningRate;
+    double momentum;
+
+    template <typename Vec> void operator()(const Vec descent, const size_t i) const
+    {
+        const Vec delta = MulAdd(Vec::Set(momentum), Vec::Load(S0(i)), Vec::Set(learningRate) * descent);
+        delta.Store(S0(i));
+        (Vec::Load(W(i)) + delta).Store(W(i));
+    }
+};
+
+
+struct NesterovRule : Matrices
+{
+    double learningRate;
+    double momentum;
+
+    template <typename Vec> void operator()(const Vec descent, const size_t i) const
+    {
+        const Vec step  = Vec::Set(learningRate) * descent;
+        const Vec delta = MulAdd(Vec::Set(momentum), Vec::Load(S0(i)), step);
+        delta.Store(S0(i));
+        (Vec::Load(W(i)) + MulAdd(Vec::Set(momentum), delta, step)).Store(W(i));
+    }
+};
+
+
+struct RMSPropRule : Matrices
+{
+    double learningRate;
+    double decay;
+    double epsilon;
+
+    template <typename Vec> void operator()(const Vec descent, const size_t i) const
+    {
+        const Vec meanSquare = MulAdd(Vec::Set(decay), Vec::Load(S0(i)), Vec::Set(1 - decay) * descent * descent);
+        meanSquare.Store(S0(i));
+        const Vec step = Vec::Set(learningRate) * descent / (Sqrt(meanSquare) + Vec::Set(epsilon));
+        (Vec::Load(W(i)) + step).Store(W(i));
+    }
+};
+
+
+struct AdamRule : Matrices
+{
+    double stepSize;
+    double beta1;
+    double beta2;
+    double squareCorrection;
+    double epsilon;
+
+    template <typename Vec> void operator()(const Vec descent, const size_t i) const
+    {
+        const Vec mean       = MulAdd(Vec::Set(beta1), Vec::Load(S0(i)), Vec::Set(1 - beta1) * descent);
+        const Vec meanSquare = MulAdd(Vec::Set(beta2), Vec::Load(S1(i)), Vec::Set(1 - beta2) * descent * descent);
+        mean.Store(S0(i));
+        meanSquare.Store(S1(i));
+        const Vec step = Vec::Set(stepSize) * mean / (Sqrt(meanSquare * Vec::Set(squareCorrection)) + Vec::Set(epsilon));
+        (Vec::Load(W(i)) + step).Store(W(i));
+    }
+};
+
+
+/** Dot x with each column of a block of columns.
+@param[in]  pWeights The first column of the block. Column-major, rows apart.
+@param[in]  rows     The length of x and of each column.
+@param[in]  numCols  The number of columns in the block. At most COLUMN_BLOCK.
+@param[in]  pX       x.
+@param[out] out_sums The dot products.
+*/
+void dotColumns(const double* pWeights, const size_t rows, const size_t numCols, const double* pX, double (&out_sums)[COLUMN_BLOCK])
+{
+    SimdVec acc[COLUMN_BLOCK];
+    for (size_t c = 0; c < COLUMN_BLOCK; ++c)
+        acc[c] = SimdVec::Set(0);
+    size_t i = 0;
+    for (; i + SimdVec::WIDTH <= rows; i += SimdVec::WIDTH)
+    {
+        const SimdVec x = SimdVec::Load(pX + i);
+        for (size_t c = 0; c < numCols; ++c)
+            acc[c] = MulAdd(x, SimdVec::Load(pWeights + c * rows + i), acc[c]);
+    }
+    for (size_t c = 0; c < numCols; ++c)
+    {
+        double sum = acc[c].Sum();
+        for (size_t r = i; r < rows; ++r)
+            sum += pX[r] * pWeights[c * rows + r];
+        out_sums[c] = sum;
+    }
+}
+
+
+/** Read a little-endian 32-bit word.
+*/
+std::uint32_t loadLittle32(const std::uint8_t* p)
+{
+    return std::uint32_t(p[0]) | (std::uint32_t(p[1]) << 8) | (std::uint32_t(p[2]) << 16) | (std::uint32_t(p[3]) << 24);
+}
+
+
+}  // namespace
+
+
+/** The momentum SGD update of a weight matrix from one sample, in one pass:
+    delta   = learningRate * x^T * error + momentum * delta
+    weights += delta
+Both matrices are column-major, rows x cols, with no padding between columns. Each element of both is
+read and written once. Columns are updated in blocks that share each load of x.
+@param[in/out] pWeights     The weights.
+@param[in/out] pDelta       The previous weight change. Becomes this weight change.
+@param[in]     rows         The number of rows, the length of x.
+@param[in]     cols         The number of columns, the length of error.
+@param[in]     pX           The inputs to the layer.
+@param[in]     pError       The errors of the layer's outputs.
+@param[in]     learningRate The learning rate.
+@param[in]     momentum     The momentum.
+*/
+void MomentumRank1Update(double* pWeights, double* pDelta, const size_t rows, const size_t cols,
+                         const double* pX, const double* pError, const double learningRate, const double momentum)
+{
+    MomentumRule rule;
+    rule.pWeights     = pWeights;
+    rule.pState0      = pDelta;
+    rule.learningRate = learningRate;
+    rule.momentum     = momentum;
+    rank1Update(rows, cols, pX, pError, rule);
+}
+
+
+/** The Nesterov momentum update, in the form of Sutskever et al. (2013) that only needs the current weights:
+    delta   = learningRate * x^T * error + momentum * delta
+    weights += learningRate * x^T * error + momentum * delta
+Same layout and arguments as MomentumRank1Update.
+*/
+void NesterovRank1Update(double* pWeights, double* pDelta, const size_t rows, const size_t cols,
+                         const double* pX, const double* pError, const double learningRate, const double momentum)
+{
+    NesterovRule rule;
+    rule.pWeights     = pWeights;
+    rule.pState0      = pDelta;
+    rule.learningRate = learningRate;
+    rule.momentum     = momentum;
+    rank1Update(rows, cols, pX, pError, rule);
+}
+
+
+/** The RMSProp update (Tieleman and Hinton, 2012):
+    meanSquare = decay * meanSquare + (1 - decay) * (x^T * error)^2
+    weights   += learningRate * x^T * error / (sqrt(meanSquare) + epsilon)
+@param[in/out] pWeights     The weights.
+@param[in/out] pMeanSquare  The running mean of the squared gradient.
+@param[in]     rows         The number of rows, the length of x.
+@param[in]     cols         The number of columns, the length of error.
+@param[in]     pX           The inputs to the layer.
+@param[in]     pError       The errors of the layer's outputs.
+@param[in]     learningRate The learning rate.
+@param[in]     decay        The decay of the running mean. 0 to 1.
+@param[in]     epsilon      Keeps the step finite where the mean is 0.
+*/
+void RMSPropRank1Update(double* pWeights, double* pMeanSquare, const size_t rows, const size_t cols,
+                        const double* pX, const double* pError, const double learningRate, const double decay, const double epsilon)
+{
+    RMSPropRule rule;
+    rule.pWeights     = pWeights;
+    rule.pState0      = pMeanSquare;
+    rule.learningRate = learningRate;
+    rule.decay        = decay;
+    rule.epsilon      = epsilon;
+    rank1Update(rows, cols, pX, pError, rule);
+}
+
+
+/** The Adam update (Kingma and Ba, 2015):
+    mean       = beta1 * mean + (1 - beta1) * x^T * error
+    meanSquare = beta2 * meanSquare + (1 - beta2) * (x^T * error)^2
+    weights   += stepSize * mean / (sqrt(meanSquare * squareCorrection) + epsilon)
+The caller folds the bias correction of the mean, 1 / (1 - beta1^t), into the step size,
+and passes the bias correction of the mean square, 1 / (1 - beta2^t).
+@param[in/out] pWeights         The weights.
+@param[in/out] pMean            The running mean of the gradient.
+@param[in/out] pMeanSquare      The running mean of the squared gradient.
+@param[in]     rows             The number of rows, the length of x.
+@param[in]     cols             The number of columns, the length of error.
+@param[in]     pX               The inputs to the layer.
+@param[in]     pError           The errors of the layer's outputs.
+@param[in]     stepSize         The learning rate times the mean's bias correction.
+@param[in]     beta1            The decay of the mean.
+@param[in]     beta2            The decay of the mean square.
+@param[in]     squareCorrection The mean square's bias correction.
+@param[in]     epsilon          Keeps the step finite where the mean square is 0.
+*/
+void AdamRank1Update(double* pWeights, double* pMean, double* pMeanSquare, const size_t rows, const size_t cols,
+                     const double* pX, const double* pError, const double stepSize, const double beta1, const double beta2,
+                     const double squareCorrection, const double epsilon)
+{
+    AdamRule rule;
+    rule.pWeights         = pWeights;
+    rule.pState0          = pMean;
+    rule.pState1          = pMeanSquare;
+    rule.stepSize         = stepSize;
+    rule.beta1            = beta1;
+    rule.beta2            = beta2;
+    rule.squareCorrection = squareCorrection;
+    rule.epsilon          = epsilon;
+    rank1Update(rows, cols, pX, pError, rule);
+}
+
+
+/** Feed x forward through a layer of sigmoid units:
+    out = sigmoid(x * weights)
+The weights are column-major, rows x cols, one column per unit. Columns are read in blocks that share each load of x.
+@param[in]  pWeights The weights.
+@param[in]  rows     The number of rows, the length of x.
+@param[in]  cols     The number of columns, the length of out.
+@param[in]  pX       The inputs to the layer.
+@param[out] pOut     The activations of the layer.
+*/
+void SigmoidLayer(const double* pWeights, const size_t rows, const size_t cols, const double* pX, double* pOut)
+{
+    double sums[COLUMN_BLOCK];
+    for (size_t first = 0; first < cols; first += COLUMN_BLOCK)
+    {
+        const size_t numCols = cols - first < COLUMN_BLOCK ? cols - first : COLUMN_BLOCK;
+        dotColumns(pWeights + first * rows, rows, numCols, pX, sums);
+        for (size_t c = 0; c < numCols; ++c)
+            pOut[first + c] = 1.0 / (1.0 + std::exp(-sums[c]));
+    }
+}
+
+
+/** Scale stored pixels to inputs in the 0..1 range: pixel / 255. Every build gives the same bits.
+@param[in]  pPixels   The pixels, 0..255.
+@param[in]  numPixels The number of pixels.
+@param[out] pInputs   The inputs. One per pixel.
+*/
+void PixelsToInputs(const std::uint8_t* pPixels, const size_t numPixels, double* pInputs)
+{
+    size_t i = 0;
+    for (; i + SimdVec::WIDTH <= numPixels; i += SimdVec::WIDTH)
+        (SimdVec::LoadBytes(pPixels + i) / SimdVec::Set(255.0)).Store(pInputs + i);
+    for (; i < numPixels; ++i)
+        pInputs[i] = pPixels[i] / 255.0;
+}
+
+
+/** Narrow the pixels of a parsed CSV row to bytes, and check they are all 0..255.
+A branch-free OR over the row and a plain narrowing loop, which the compiler vectorizes for each build.
+@param[in]  pFields   The parsed pixels.
+@param[in]  numPixels The number of pixels.
+@param[out] pPixels   The pixels as bytes. Written even if out of range.
+@return false if any pixel is over 255.
+*/
+bool PackPixelFields(const std::uint16_t* pFields, const size_t numPixels, std::uint8_t* pPixels)
+{
+    std::uint16_t bits = 0;
+    for (size_t i = 0; i < numPixels; ++i)
+    {
+        bits = static_cast<std::uint16_t>(bits | pFields[i]);
+        pPixels[i] = static_cast<std::uint8_t>(pFields[i]);
+    }
+    return bits <= 255;
+}
+
+
+/** The lane rounds of the dataset checksum (see DatasetFile.cpp), over every whole 64 byte stride of the data.
+Each of the 16 lanes takes the next little-endian word w of its stride:
+    lane = rotl(lane + w * prime2, 13) * prime1
+Every build gives the same lanes.
+@param[in/out] pLanes   The 16 lanes.
+@param[in]     pData    The data.
+@param[in]     numBytes The length of the data.
+@param[in]     prime1   The multiplier after the rotation.
+@param[in]     prime2   The multiplier of the words.
+@return The number of bytes consumed. A multiple of 64.
+*/
+size_t ChecksumLaneRounds(std::uint32_t* pLanes, const std::uint8_t* pData, const size_t numBytes,
+                          const std::uint32_t prime1, const std::uint32_t prime2)
+{
+    constexpr size_t NUM_LANES = 16;
+    constexpr size_t STRIDE    = NUM_LANES * sizeof(std::uint32_t);
+    size_t pos = 0;
+#if defined(FNN_KERNELS_AVX512) || defined(FNN_KERNELS_AVX2)
+    {
+        // x86 is little-endian, so the words can be loaded directly
+        const __m256i prime1V = _mm256_set1_epi32(static_cast<int>(prime1));
+        const __m256i prime2V = _mm256_set1_epi32(static_cast<int>(prime2));
+        const auto round = [&](__m256i acc, const __m256i words) {
+            acc = _mm256_add_epi32(acc, _mm256_mullo_epi32(words, prime2V));
+            acc = _mm256_or_si256(_mm256_slli_epi32(acc, 13), _mm256_srli_epi32(acc, 32 - 13));
+            return _mm256_mullo_epi32(acc, prime1V);
+        };
+
+        __m256i accLow  = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pLanes));
+        __m256i accHigh = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pLanes + 8));
+        for (; pos + STRIDE <= numBytes; pos += STRIDE)
+        {
+            accLow  = round(accLow,  _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pData + pos)));
+            accHigh = round(accHigh, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pData + pos + 32)));
+        }
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(pLanes),     accLow);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(pLanes + 8), accHigh);
+    }
+#elif defined(FNN_KERNELS_SSE42)
+    {
+        const __m128i prime1V = _mm_set1_epi32(static_cast<int>(prime1));
+        const __m128i prime2V = _mm_set1_epi32(static_cast<int>(prime2));
+        __m128i acc[4];
+        for (size_t v = 0; v < 4; ++v)
+            acc[v] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pLanes + 4 * v));
+        for (; pos + STRIDE <= numBytes; pos += STRIDE)
+        {
+            for (size_t v = 0; v < 4; ++v)
+            {
+                const __m128i words = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pData + pos + 16 * v));
+                __m128i a = _mm_add_epi32(acc[v], _mm_mullo_epi32(words, prime2V));
+                a = _mm_or_si128(_mm_slli_epi32(a, 13), _mm_srli_epi32(a, 32 - 13));
+                acc[v] = _mm_mullo_epi32(a, prime1V);
+            }
+        }
+        for (size_t v = 0; v < 4; ++v)
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(pLanes + 4 * v), acc[v]);
+    }
+#endif
+    for (; pos + STRIDE <= numBytes; pos += STRIDE)
+    {
+        for (size_t i = 0; i < NUM_LANES; ++i)
+        {
+            const std::uint32_t lane = pLanes[i] + loadLittle32(pData + pos + i * sizeof(std::uint32_t)) * prime2;
+            pLanes[i] = ((lane << 13) | (lane >> (32 - 13))) * prime1;
+        }
+    }
+    return pos;
+}
+
+
+/** Sample an image at moved coordinates with bilinear interpolation. The source coordinate of output pixel (x, y) is
+    (u, v) = (a*x + b*y + e + dx, -b*x + a*y + f + dy)
+clamped to [-border, stride - border - 2]. The 4 neighbours of a coordinate are it and the pixels one to the right and
+one down, so the clamp keeps all of them inside the padded source, down to its last row and column.
+The AVX2 and AVX-512 builds sample 4 pixels at a time with gathers.
+@param[in]  pPadded The source, size x size, inside a zero border: stride x stride, row-major. Pixel (0, 0) is at (border, border).
+@param[in]  stride  The row length of the padded source. At least size + 2 * border.
+@param[in]  border  The width of the zero border. At least 1.
+@param[in]  size    The width and height of the image.
+@param[in]  a, b    The rotation and scale of the coordinates.
+@param[in]  e, f    The offset of the coordinates.
+@param[in]  pDx     The displacement of each output pixel's x coordinate. size x size, row-major.
+@param[in]  pDy     The displacement of each output pixel's y coordinate.
+@param[out] pDest   The image. size x size, row-major.
+*/
+void ResampleBilinear(const double* pPadded, const int stride, const int border, const int size,
+                      const double a, const double b, const double e, const double f,
+                      const double* pDx, const double* pDy, double* pDest)
+{
+    const double low  = -border;
+    const double high = stride - border - 2;  // the neighbours one right and one down are in the last column and row
+    for (int y = 0; y < size; ++y)
+    {
+        int x = 0;
+#if defined(FNN_KERNELS_AVX512) || defined(FNN_KERNELS_AVX2)
+        {
+            const __m256d lowV    = _mm256_set1_pd(low);
+            const __m256d highV   = _mm256_set1_pd(high);
+            const __m256d aV      = _mm256_set1_pd(a);
+            const __m256d negBV   = _mm256_set1_pd(-b);
+            const __m256d rowU    = _mm256_set1_pd(b * y + e);
+            const __m256d rowV    = _mm256_set1_pd(a * y + f);
+            const __m256d borderV = _mm256_set1_pd(border);
+            const __m256d strideV = _mm256_set1_pd(stride);
+            const __m256d all     = _mm256_castsi256_pd(_mm256_set1_epi64x(-1));
+            const __m256d zero    = _mm256_setzero_pd();
+            const auto gather = [&](const double* pBase, const __m128i index) { return _mm256_mask_i32gather_pd(zero, pBase, index, all, 8); };
+            for (; x + 4 <= size; x += 4)
+            {
+                const int pixel = y * size + x;
+                const __m256d xV = _mm256_add_pd(_mm256_set1_pd(x), _mm256_set_pd(3, 2, 1, 0));
+                __m256d u = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(aV, xV), rowU), _mm256_loadu_pd(pDx + pixel));
+                __m256d v = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(negBV, xV), rowV), _mm256_loadu_pd(pDy + pixel));
+                u = _mm256_min_pd(_mm256_max_pd(u, lowV), highV);
+                v = _mm256_min_pd(_mm256_max_pd(v, lowV), highV);
+
+                const __m256d u0 = _mm256_floor_pd(u);
+                const __m256d v0 = _mm256_floor_pd(v);
+                const __m256d wu = _mm256_sub_pd(u, u0);
+                const __m256d wv = _mm256_sub_pd(v, v0);
+                const __m128i index = _mm256_cvtpd_epi32(_mm256_add_pd(_mm256_mul_pd(_mm256_add_pd(v0, borderV), strideV), _mm256_add_pd(u0, borderV)));
+
+                const __m256d p00 = gather(pPadded, index);
+                const __m256d p01 = gather(pPadded + 1, index);
+                const __m256d p10 = gather(pPadded + stride, index);
+                const __m256d p11 = gather(pPadded + stride + 1, index);
+                const __m256d top    = _mm256_add_pd(p00, _mm256_mul_pd(wu, _mm256_sub_pd(p01, p00)));
+                const __m256d bottom = _mm256_add_pd(p10, _mm256_mul_pd(wu, _mm256_sub_pd(p11, p10)));
+                _mm256_storeu_pd(pDest + pixel, _mm256_add_pd(top, _mm256_mul_pd(wv, _mm256_sub_pd(bottom, top))));
+            }
+        }
+#endif
+        for (; x < size; ++x)
+        {
+            const int pixel = y * size + x;
+            const double u = std::fmin(std::fmax(a * x + b * y + e + pDx[pixel], low), high);
+            const double v = std::fmin(std::fmax(-b * x + a * y + f + pDy[pixel], low), high);
+            const double u0 = std::floor(u);
+            const double v0 = std::floor(v);
+            const double wu = u - u0;
+            const double wv = v - v0;
+            const double* const p = pPadded + (static_cast<int>(v0) + border) * stride + static_cast<int>(u0) + border;
+            const double top    = p[0] + wu * (p[1] - p[0]);
+            const double bottom = p[stride] + wu * (p[stride + 1] - p[stride]);
+            pDest[pixel] = top + wv * (bottom - top);
+        }
+    }
+}
+
+
+/** Get this build of the kernels.
+*/
+const KernelTable& GetKernelTable()
+{
+    static const KernelTable table = {
+#if defined(FNN_KERNELS_AVX512)
+        KernelIsa::AVX512,
+#elif defined(FNN_KERNELS_AVX2)
+        KernelIsa::AVX2,
+#elif defined(FNN_KERNELS_SSE42)
+        KernelIsa::SSE42,
+#else
+        KernelIsa::SCALAR,
+#endif
+        &MomentumRank1Update,
+        &NesterovRank1Update,
+        &RMSPropRank1Update,
+        &AdamRank1Update,
+        &SigmoidLayer,
+        &PixelsToInputs,
+        &PackPixelFields,
+        &ChecksumLaneRounds,
+        &ResampleBilinear,
+    };
+    return table;
+}
+
+
+}
+}
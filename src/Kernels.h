@@ -0,0 +1,60 @@
+// ==================================================================
+// Copyright (c) 2019 Alexander Freed. ALL RIGHTS RESERVED.
+// Language: ISO C++14
+//
+// Hand-vectorized kernels for the hot loops of training, inference, loading and augmentation.
+// Each kernel is built for several instruction sets. The best one the CPU supports is chosen at startup.
+// ==================================================================
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+
+
+namespace fnn {
+
+
+/** The instruction sets the kernels are built for, from the most portable.
+*/
+enum class KernelIsa
+{
+    SCALAR,  // plain C++. Any CPU.
+    SSE42,   // 2 doubles per vector
+    AVX2,    // 4 doubles per vector, with fused multiply-add
+    AVX512,  // 8 doubles per vector (AVX-512F)
+};
+
+
+// function prototypes
+
+KernelIsa   DetectKernelIsa();
+KernelIsa   GetKernelIsa();
+bool        IsKernelIsaAvailable(const KernelIsa isa);
+bool        SelectKernelIsa(const KernelIsa isa);
+const char* KernelIsaName(const KernelIsa isa);
+bool        ParseKernelIsa(const std::string& name, KernelIsa& out_isa);
+bool        SelectKernels(const std::string& name, std::ostream& out);
+
+void MomentumRank1Update(double* pWeights, double* pDelta, const size_t rows, const size_t cols,
+                         const double* pX, const double* pError, const double learningRate, const double momentum);
+void NesterovRank1Update(double* pWeights, double* pDelta, const size_t rows, const size_t cols,
+                         const double* pX, const double* pError, const double learningRate, const double momentum);
+void RMSPropRank1Update(double* pWeights, double* pMeanSquare, const size_t rows, const size_t cols,
+                        const double* pX, const double* pError, const double learningRate, const double decay, const double epsilon);
+void AdamRank1Update(double* pWeights, double* pMean, double* pMeanSquare, const size_t rows, const size_t cols,
+                     const double* pX, const double* pError, const double stepSize, const double beta1, const double beta2,
+                     const double squareCorrection, const double epsilon);
+void SigmoidLayer(const double* pWeights, const size_t rows, const size_t cols, const double* pX, double* pOut);
+void PixelsToInputs(const std::uint8_t* pPixels, const size_t numPixels, double* pInputs);
+bool PackPixelFields(const std::uint16_t* pFields, const size_t numPixels, std::uint8_t* pPixels);
+size_t ChecksumLaneRounds(std::uint32_t* pLanes, const std::uint8_t* pData, const size_t numBytes,
+                          const std::uint32_t prime1, const std::uint32_t prime2);
+void ResampleBilinear(const double* pPadded, const int stride, const int border, const int size,
+                      const double a, const double b, const double e, const double f,
+                      const double* pDx, const double* pDy, double* pDest);
+
+
+}
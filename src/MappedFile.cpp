@@ -0,0 +1,189 @@
+// ==================================================================
+// Copyright (c) 2019 Alexander Freed. ALL RIGHTS RESERVED.
+// Language: ISO C++14
+//
+// MappedFile class definition.
+// Uses mmap on POSIX systems and file mapping objects on Windows.
+// Also the file system helpers.
+// ==================================================================
+
+#include "MappedFile.h"
+
+#include <utility>
+
+#ifdef _WIN32
+    #define WIN32_LEAN_AND_MEAN
+    #define NOMINMAX
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+
+namespace FileIO {
+
+
+MappedFile::~MappedFile()
+{
+    Close();
+}
+
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+    : m_pData(other.m_pData)
+    , m_size(other.m_size)
+{
+    other.m_pData = nullptr;
+    other.m_size  = 0;
+}
+
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept
+{
+    if (this != &other)
+    {
+        Close();
+        std::swap(m_pData, other.m_pData);
+        std::swap(m_size,  other.m_size);
+    }
+    return *this;
+}
+
+
+/** Map a whole file into memory for reading.
+Any previous mapping is released first. Empty files cannot be mapped.
+@param[in] filename The path and filename.
+@return true if the file was mapped.
+*/
+bool MappedFile::Open(const std::string& filename)
+{
+    Close();
+
+#ifdef _WIN32
+    const HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+    {
+        CloseHandle(file);
+        return false;
+    }
+
+    const HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    CloseHandle(file);
+    if (mapping == nullptr)
+        return false;
+
+    void* const pView = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    // the view keeps the mapping alive
+    CloseHandle(mapping);
+    if (pView == nullptr)
+        return false;
+
+    m_pData = static_cast<const std::uint8_t*>(pView);
+    m_size  = static_cast<size_t>(fileSize.QuadPart);
+#else
+    const int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size <= 0)
+    {
+        close(fd);
+        return false;
+    }
+
+    const size_t size = static_cast<size_t>(info.st_size);
+    void* const pView = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    // the mapping keeps the file alive
+    close(fd);
+    if (pView == MAP_FAILED)
+        return false;
+
+    m_pData = static_cast<const std::uint8_t*>(pView);
+    m_size  = size;
+#endif
+
+    return true;
+}
+
+
+/** Release the mapping, if any.
+*/
+void MappedFile::Close()
+{
+    if (m_pData == nullptr)
+        return;
+
+#ifdef _WIN32
+    UnmapViewOfFile(m_pData);
+#else
+    munmap(const_cast<std::uint8_t*>(m_pData), m_size);
+#endif
+
+    m_pData = nullptr;
+    m_size  = 0;
+}
+
+
+/** Ask the OS to drop a file's pages from the page cache, so the next read comes from disk.
+Used to measure cold load times. Only dirty-free pages can be dropped.
+@param[in] filename The path and filename.
+@return true if the request was made. Always false on Windows.
+*/
+bool EvictFromPageCache(const std::string& filename)
+{
+#ifdef _WIN32
+    (void)filename;
+    return false;
+#else
+    const int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    const bool success = posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED) == 0;
+    close(fd);
+    return success;
+#endif
+}
+
+
+/** Get the size and modification time of a file.
+@param[in]  filename   The path and filename.
+@param[out] out_status The status.
+@return false if the file does not exist.
+*/
+bool GetFileStatus(const std::string& filename, FileStatus& out_status)
+{
+#ifdef _WIN32
+    WIN32_FILE_ATTRIBUTE_DATA data;
+    if (!GetFileAttributesExA(filename.c_str(), GetFileExInfoStandard, &data))
+        return false;
+
+    // FILETIME counts 100 ns intervals since 1601
+    constexpr std::int64_t EPOCH_DIFFERENCE = 116444736000000000;
+    const std::int64_t ticks = (std::int64_t(data.ftLastWriteTime.dwHighDateTime) << 32) | data.ftLastWriteTime.dwLowDateTime;
+    out_status.size  = (std::uint64_t(data.nFileSizeHigh) << 32) | data.nFileSizeLow;
+    out_status.mtime = (ticks - EPOCH_DIFFERENCE) * 100;
+#else
+    struct stat info;
+    if (stat(filename.c_str(), &info) != 0)
+        return false;
+
+    out_status.size = static_cast<std::uint64_t>(info.st_size);
+    #ifdef __APPLE__
+        out_status.mtime = std::int64_t(info.st_mtimespec.tv_sec) * 1000000000 + info.st_mtimespec.tv_nsec;
+    #else
+        out_status.mtime = std::int64_t(info.st_mtim.tv_sec) * 1000000000 + info.st_mtim.tv_nsec;
+    #endif
+#endif
+    return true;
+}
+
+
+}
@@ -0,0 +1,60 @@
+// ==================================================================
+// Copyright (c) 2019 Alexander Freed. ALL RIGHTS RESERVED.
+// Language: ISO C++14
+//
+// Class definition for MappedFile, a read-only memory-mapped file, and other file system helpers.
+// ==================================================================
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+
+namespace FileIO {
+
+
+/** A read-only memory mapping of a whole file.
+Move-only. The mapping is released when the object is destroyed.
+*/
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+
+    bool Open(const std::string& filename);
+    void Close();
+
+    bool                IsOpen() const { return m_pData != nullptr; }
+    const std::uint8_t* GetData() const { return m_pData; }
+    size_t              GetSize() const { return m_size; }
+
+private:
+    const std::uint8_t* m_pData = nullptr;
+    size_t              m_size  = 0;
+};
+
+
+/** The size and modification time of a file.
+*/
+struct FileStatus
+{
+    std::uint64_t size  = 0;
+    std::int64_t  mtime = 0;  // nanoseconds since the Unix epoch
+};
+
+
+// function prototypes
+
+bool EvictFromPageCache(const std::string& filename);
+bool GetFileStatus(const std::string& filename, FileStatus& out_status);
+
+
+}
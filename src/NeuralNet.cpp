@@ -7,14 +7,50 @@
 
 #include "NeuralNet.h"
 
+#include "Kernels.h"
 #include "Utility.h"
+#include "WorkerTeam.h"
 
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
 #include <random>
 
 
 namespace fnn {
 
 
+namespace {
+
+
+/** Pad the input->hidden weights to the stored layout.
+@param[in] weights The weights, NUM_INPUTS x numHidden.
+@return The weights, PADDED_INPUTS x numHidden. The rows past NUM_INPUTS are 0.
+*/
+Eigen::MatrixXd padInputWeights(const Eigen::MatrixXd& weights)
+{
+    assert(weights.rows() == NUM_INPUTS);
+    Eigen::MatrixXd padded = Eigen::MatrixXd::Zero(PADDED_INPUTS, weights.cols());
+    padded.topRows(NUM_INPUTS) = weights;
+    return padded;
+}
+
+
+/** Copy the inputs into a buffer of the padded length, the padding zeroed.
+@param[in]  inputs  The inputs, NUM_INPUTS.
+@param[out] pPadded The padded inputs, PADDED_INPUTS.
+*/
+void padInputs(const InputRef& inputs, double* pPadded)
+{
+    assert(inputs.size() == NUM_INPUTS);
+    std::copy_n(inputs.data(), NUM_INPUTS, pPadded);
+    std::fill(pPadded + NUM_INPUTS, pPadded + PADDED_INPUTS, 0.0);
+}
+
+
+}  // namespace
+
+
 /** Argument Constructor
 Sets the number of neurons in the hidden layer.
 Initializes the weights.
@@ -25,6 +61,38 @@ NeuralNetDigitClassifier::NeuralNetDigitClassifier(const unsigned numHidden)
 { }
 
 
+/** Argument Constructor
+Sets the number of neurons in the hidden layer.
+Initializes the weights from a given random number stream instead of Global::rng(),
+so networks can be created on several threads at once.
+@param[in]     numHidden The number of nodes to put in the hidden layer.
+@param[in/out] rng       The random number stream to draw the weights from.
+*/
+NeuralNetDigitClassifier::NeuralNetDigitClassifier(const unsigned numHidden, Rng& rng)
+    : m_numHidden(numHidden)
+    , m_weights(generateWeightsRandom(rng))
+{ }
+
+
+/** Weights Constructor
+Takes existing weights, e.g. a model taken out of an ensemble.
+@param[in] weights The weights. The input->hidden matrix is 785xN and the hidden->output matrix (N+1)x10.
+*/
+NeuralNetDigitClassifier::NeuralNetDigitClassifier(WeightsCollection weights)
+    : m_numHidden(static_cast<unsigned>(weights[0].cols()))
+    , m_weights{ { padInputWeights(weights[0]), std::move(weights[1]) } }
+{ }
+
+
+/** Get the weights, without the padding of the stored layout.
+@return A copy of the weights. The input->hidden matrix is 785xN and the hidden->output matrix (N+1)x10.
+*/
+NeuralNetDigitClassifier::WeightsCollection NeuralNetDigitClassifier::GetWeights() const
+{
+    return { { m_weights[0].topRows(NUM_INPUTS), m_weights[1] } };
+}
+
+
 /** Create weights as a collection of matrices.
 Initializes the weights and bias randomly.
 Didn't want to use Eigen's setRandom() function because it uses old C++ rand.
@@ -32,27 +100,22 @@ Didn't want to use Eigen's setRandom() function because it uses old C++ rand.
 */
 NeuralNetDigitClassifier::WeightsCollection NeuralNetDigitClassifier::generateWeightsRandom() const
 {
-    std::uniform_real_distribution<> distribution(-0.05, 0.05);
-    WeightsCollection weights;
-    // weights for input->hidden.
-    weights[0] = WeightsType::NullaryExpr(NUM_INPUTS,      m_numHidden, [&distribution]() { return distribution(Global::rng()); });
-    // weights for hidden->output
-    weights[1] = WeightsType::NullaryExpr(m_numHidden + 1, NUM_OUTPUTS, [&distribution]() { return distribution(Global::rng()); });
-    return weights;
+    return generateWeightsRandom(Global::rng());
 }
 
 
-/** Create weights as a collection of matrices.
-Initializes the weights and bias to 0.
+/** Create weights as a collection of matrices, drawn from a given random number stream.
+@param[in/out] rng The random number stream.
 @return A set of new matrices of randomly generated weights.
 */
-NeuralNetDigitClassifier::WeightsCollection NeuralNetDigitClassifier::generateWeightsZero() const
+NeuralNetDigitClassifier::WeightsCollection NeuralNetDigitClassifier::generateWeightsRandom(Rng& rng) const
 {
+    std::uniform_real_distribution<> distribution(-0.05, 0.05);
     WeightsCollection weights;
-    // dWeights for input->hidden.
-    weights[0] = WeightsType::Zero(NUM_INPUTS,      m_numHidden);
-    // dWeights for hidden->output
-    weights[1] = WeightsType::Zero(m_numHidden + 1, NUM_OUTPUTS);
+    // weights for input->hidden. Drawn unpadded, so the draws are the same as before the padding.
+    weights[0] = padInputWeights(WeightsType::NullaryExpr(NUM_INPUTS, m_numHidden, [&distribution, &rng]() { return distribution(rng); }));
+    // weights for hidden->output
+    weights[1] = WeightsType::NullaryExpr(m_numHidden + 1, NUM_OUTPUTS, [&distribution, &rng]() { return distribution(rng); });
     return weights;
 }
 
@@ -64,16 +127,56 @@ The digit selected is the output node with the highest activation value.
 @param[in] inputs A vector of input values.
 @param return the chosen digit 0-9.
 */
-int NeuralNetDigitClassifier::DetermineDigit(const InputType& inputs) const
+int NeuralNetDigitClassifier::DetermineDigit(const InputRef& inputs) const
+{
+    alignas(64) double paddedInputs[PADDED_INPUTS];
+    padInputs(inputs, paddedInputs);
+    return DetermineDigit(PaddedInput{ paddedInputs });
+}
+
+
+/** Feed inputs that are already padded forward and return the selected digit class.
+They are read in place.
+@param[in] inputs The padded inputs.
+@param return the chosen digit 0-9.
+*/
+int NeuralNetDigitClassifier::DetermineDigit(const PaddedInput& inputs) const
+{
+    assert(reinterpret_cast<std::uintptr_t>(inputs.pInputs) % 64 == 0);
+
+    // create a place to hold the activation of input->hidden layer
+    Eigen::RowVectorXd hiddenActivation(m_numHidden + 1);
+    // The bias is the first element. 
+    hiddenActivation(0) = 1;
+    // activate input->hidden layer into the rest of the holding space
+    SigmoidLayer(m_weights[0].data(), PADDED_INPUTS, m_numHidden, inputs.pInputs, &hiddenActivation(1));
+
+    // activate hidden->output layer
+    int row, col;
+    (hiddenActivation * m_weights[1]).unaryExpr(&sigmoid).maxCoeff(&row, &col);
+    return col;
+}
+
+
+/** Feed a sparse input forward and return the selected digit class.
+Only the weights of the non-zero inputs are read.
+@param[in] inputs The non-zero inputs.
+@param return the chosen digit 0-9.
+*/
+int NeuralNetDigitClassifier::DetermineDigit(const SparseInput& inputs) const
 {
     // create a place to hold the activation of input->hidden layer
     Eigen::RowVectorXd hiddenActivation(m_numHidden + 1);
     // The bias is the first element. 
     hiddenActivation(0) = 1;
-    //Need to map the activation result onto the rest of the holding space
+    for (unsigned j = 0; j < m_numHidden; ++j)
     {
-        Eigen::Map<Eigen::RowVectorXd> activationMap(&hiddenActivation(1), m_numHidden);
-        activationMap = (inputs * m_weights[0]).unaryExpr(&sigmoid);
+        const double* const pColumn = m_weights[0].col(j).data();
+        // the bias input is always 1
+        double sum = pColumn[0];
+        for (size_t k = 0; k < inputs.numNonZero; ++k)
+            sum += pColumn[inputs.pIndices[k] + 1] * (inputs.pValues[k] / 255.0);
+        hiddenActivation(j + 1) = sigmoid(sum);
     }
 
     // activate hidden->output layer
@@ -86,22 +189,42 @@ int NeuralNetDigitClassifier::DetermineDigit(const InputType& inputs) const
 // ------------------------------------------------------------------
 
 /** Run the inputs over the weights and adjust the weights if necessary.
-@param[in] inputs       One vector of inputs (785)
-@param[in] targets      A vector of expected activations (10)
-@param[in] learningRate The learning rate.
-@param[in] momentum     0 to 1. 0 is equivalent to no momentum. weights += new dWeight + momentum * previous dWeight.
+The inputs are copied to a padded buffer once, and both passes over the input->hidden weights read it.
+@param[in]     inputs    One vector of inputs (785)
+@param[in]     targets   A vector of expected activations (10)
+@param[in/out] optimizer The update rule. Holds its state for this network's weights.
+@param[in]     pTeam     [default: nullptr] The threads to split the input layer across, or null for this thread only.
+*/
+void NeuralNetDigitClassifier::TrainFromInput(const InputRef& inputs, const OutputRef& targets, Optimizer& optimizer, WorkerTeam* pTeam)
+{
+    alignas(64) double paddedInputs[PADDED_INPUTS];
+    padInputs(inputs, paddedInputs);
+    TrainFromInput(PaddedInput{ paddedInputs }, targets, optimizer, pTeam);
+}
+
+
+/** Run inputs that are already padded over the weights and adjust the weights if necessary.
+Both passes over the input->hidden weights read the inputs in place.
+With a team, the input->hidden layer's forward pass and update are split across its threads by hidden node.
+Each thread takes the same columns of the weights, and of the optimizer's state, for both, every sample.
+The hidden->output layer is small, and stays on the calling thread. The result does not depend on the team.
+@param[in]     inputs    The padded inputs.
+@param[in]     targets   A vector of expected activations (10)
+@param[in/out] optimizer The update rule. Holds its state for this network's weights.
+@param[in]     pTeam     [default: nullptr] The threads to split the input layer across, or null for this thread only.
 */
-void NeuralNetDigitClassifier::TrainFromInput(const InputType& inputs, const OutputType& targets, const double learningRate, const double momentum)
+void NeuralNetDigitClassifier::TrainFromInput(const PaddedInput& inputs, const OutputRef& targets, Optimizer& optimizer, WorkerTeam* pTeam)
 {
+    assert(reinterpret_cast<std::uintptr_t>(inputs.pInputs) % 64 == 0);
+
     // create a place to hold the activation of input->hidden layer
     Eigen::RowVectorXd hiddenActivation(m_numHidden + 1);
     // The bias is the first element. 
     hiddenActivation(0) = 1;
-    //Need to map the activation result onto the rest of the holding space
-    {
-        Eigen::Map<Eigen::RowVectorXd> activationMap(&hiddenActivation(1), m_numHidden);
-        activationMap = (inputs * m_weights[0]).unaryExpr(&sigmoid);
-    }
+    // activate input->hidden layer into the rest of the holding space
+    ForEachSlice(pTeam, m_numHidden, [&](const size_t first, const size_t count) {
+        SigmoidLayer(m_weights[0].data() + first * PADDED_INPUTS, PADDED_INPUTS, count, inputs.pInputs, &hiddenActivation(1 + first));
+    });
 
     // activate hidden->output layer
     const OutputType outputActivation = (hiddenActivation * m_weights[1]).unaryExpr(&sigmoid);
@@ -113,13 +236,44 @@ void NeuralNetDigitClassifier::TrainFromInput(const InputType& inputs, const Out
     // calculate error input->hidden
     const Eigen::RowVectorXd errorHidden = (m_weights[1] * errorOutput.transpose()).transpose().cwiseProduct(hiddenActivation.unaryExpr(sigmoidDerivative));
 
-    m_dWeightsPrev[1] = learningRate * hiddenActivation.transpose() * errorOutput + momentum * m_dWeightsPrev[1];
-    m_dWeightsPrev[0] = learningRate * inputs.transpose() * Eigen::Map<const Eigen::RowVectorXd>(&errorHidden(1), m_numHidden) + momentum * m_dWeightsPrev[0];
-    
+    optimizer.BeginStep();
     // adjust hidden->output weights
-    m_weights[1] += m_dWeightsPrev[1];
-    // adjust input->hidden weights
-    m_weights[0] += m_dWeightsPrev[0];
+    optimizer.Update(1, m_weights[1], hiddenActivation.data(), errorOutput.data());
+    // adjust input->hidden weights. The bias node of the hidden layer has no input weights.
+    optimizer.PrepareLayer(0, m_weights[0]);
+    ForEachSlice(pTeam, m_numHidden, [&](const size_t first, const size_t count) {
+        optimizer.UpdateColumns(0, m_weights[0], inputs.pInputs, &errorHidden(1), first, count);
+    });
+}
+
+
+/** Move each member of a team's columns of the input->hidden weights, and of the optimizer's state for them,
+to the member's NUMA node: the columns TrainFromInput gives it. Does nothing for a team without a topology.
+Call it again if the weights or the optimizer are replaced.
+@param[in]     team      The team TrainFromInput will be given.
+@param[in/out] optimizer The optimizer TrainFromInput will be given. Its state for the layer is created if it has none.
+@return false if the kernel refused to move some of the memory.
+*/
+bool NeuralNetDigitClassifier::PlaceInputLayer(const WorkerTeam& team, Optimizer& optimizer) const
+{
+    optimizer.PrepareLayer(0, m_weights[0]);
+    bool placed = team.PlaceSlices(m_weights[0].data(), m_weights[0].rows(), m_numHidden);
+    for (const Eigen::MatrixXd* pState : optimizer.GetLayerState(0))
+        placed = team.PlaceSlices(pState->data(), pState->rows(), m_numHidden) && placed;
+    return placed;
+}
+
+
+/** Encode a digit as the activations the output layer is trained towards.
+@param[in] digit The correct digit 0-9.
+@return 0.9 for the digit's output node, 0.1 for the others.
+*/
+NeuralNetDigitClassifier::OutputType NeuralNetDigitClassifier::EncodeTarget(const int digit)
+{
+    OutputType targets;
+    targets.setConstant(0.1);
+    targets(digit) = 0.9;
+    return targets;
 }
 
 
@@ -7,6 +7,8 @@
 
 #pragma once
 
+#include "Optimizer.h"
+#include "Random.h"
 #include "Trainer.h"
 
 #include <array>
@@ -17,7 +19,14 @@
 namespace fnn {
 
 
+class WorkerTeam;
+
+
 /** A neural network with 1 hidden layer.
+The input->hidden weights are stored for the kernels, not as GetWeights returns them: each hidden node's
+column is padded from NUM_INPUTS to PADDED_INPUTS with zero weights, so every column is a whole number of
+SIMD vectors and starts on a cache line. The inputs are padded with zeros to match, so the padding adds
+nothing to a sum, and its update is always 0.
 */
 class NeuralNetDigitClassifier
 {
@@ -27,26 +36,57 @@ public:
     // public typedefs
     using WeightsType       = Eigen::MatrixXd;
     using OutputType        = Eigen::Matrix<double, 1, NUM_OUTPUTS>;
+    using OutputRef         = Eigen::Ref<const OutputType>;
     using WeightsCollection = std::array<WeightsType, 2>;
 
     // public functions
     NeuralNetDigitClassifier() = default;
     explicit NeuralNetDigitClassifier(const unsigned numHidden);
+    NeuralNetDigitClassifier(const unsigned numHidden, Rng& rng);
+    explicit NeuralNetDigitClassifier(WeightsCollection weights);
+
+    int  DetermineDigit(const InputRef& inputs) const;
+    int  DetermineDigit(const PaddedInput& inputs) const;
+    int  DetermineDigit(const SparseInput& inputs) const;
+    void TrainFromInput(const InputRef& inputs, const OutputRef& targets, Optimizer& optimizer, WorkerTeam* pTeam = nullptr);
+    void TrainFromInput(const PaddedInput& inputs, const OutputRef& targets, Optimizer& optimizer, WorkerTeam* pTeam = nullptr);
+    bool PlaceInputLayer(const WorkerTeam& team, Optimizer& optimizer) const;
 
-    int  DetermineDigit(const InputType& inputs) const;
-    void TrainFromInput(const InputType& inputs, const OutputType& targets, const double learningRate, const double momentum);
+    unsigned          GetNumHidden() const { return m_numHidden; }
+    WeightsCollection GetWeights() const;
+
+    static OutputType EncodeTarget(const int digit);
 
 private:
     // private functions
     static double sigmoid(const double z) { return 1.0 / (1.0 + exp(-z)); };
     WeightsCollection generateWeightsRandom() const;
-    WeightsCollection generateWeightsZero() const;
+    WeightsCollection generateWeightsRandom(Rng& rng) const;
 
     // private data
-    unsigned          m_numHidden    = 20;
-    WeightsCollection m_weights      = generateWeightsRandom();
-    WeightsCollection m_dWeightsPrev = generateWeightsZero();
+    unsigned          m_numHidden = 20;
+    WeightsCollection m_weights   = generateWeightsRandom();  // [0] is PADDED_INPUTS x numHidden
 };
 
 
+/** Evaluate the neural network with a whole collection of training data to check accuracy.
+Calculate the ratio of correct answers / total inputs
+@param[in] neuralnet The neural net object, or an EnsembleClassifier.
+@param[in] data      A standard container of trainers, or a StreamingDataSource.
+@return The ratio of correct answers / total inputs.
+*/
+template <typename Classifier, typename DataContainer>
+double Evaluate(const Classifier& neuralnet, DataContainer& data)
+{
+    int correct = 0;
+    for (auto& trainer : data)
+    {
+        const int answer = neuralnet.DetermineDigit(trainer.GetInputs());
+        if (answer == trainer.GetTarget())
+            ++correct;
+    }
+    return correct / static_cast<double>(data.size());
+}
+
+
 }
@@ -0,0 +1,295 @@
+// ==================================================================
+// Copyright (c) 2019 Alexander Freed. ALL RIGHTS RESERVED.
+// Language: ISO C++14
+//
+// NumaTopology class definition.
+// ==================================================================
+
+#include "Numa.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <ostream>
+#include <thread>
+
+#ifdef __linux__
+    #include <cstdlib>
+    #include <dirent.h>
+    #include <fstream>
+    #include <linux/mempolicy.h>
+    #include <sched.h>
+    #include <sstream>
+    #include <string>
+    #include <sys/syscall.h>
+    #include <unistd.h>
+#endif
+
+
+namespace fnn {
+
+
+namespace {
+
+
+#ifdef __linux__
+
+/** Parse a sysfs CPU list, e.g. "0-3,8-11".
+@param[in]  text     The list.
+@param[out] out_cpus The CPUs, in order.
+@return false if the list could not be parsed.
+*/
+bool parseCpuList(const std::string& text, std::vector<unsigned>& out_cpus)
+{
+    std::vector<unsigned> cpus;
+    std::istringstream list(text);
+    std::string range;
+    while (std::getline(list, range, ','))
+    {
+        if (range.empty() || range == "\n")
+            continue;
+        char* pEnd;
+        const unsigned long first = std::strtoul(range.c_str(), &pEnd, 10);
+        unsigned long last = first;
+        if (*pEnd == '-')
+            last = std::strtoul(pEnd + 1, &pEnd, 10);
+        if (pEnd == range.c_str() || (*pEnd != '\0' && *pEnd != '\n') || last < first)
+            return false;
+        for (unsigned long cpu = first; cpu <= last; ++cpu)
+            cpus.push_back(static_cast<unsigned>(cpu));
+    }
+    out_cpus = std::move(cpus);
+    return true;
+}
+
+
+/** Get the start of the first whole page of a range, and the length of its whole pages.
+mbind works on whole pages, and a page that straddles the range's ends belongs partly to its neighbours.
+@param[in]  p         The start of the range.
+@param[in]  bytes     The length of the range.
+@param[out] out_start The first whole page.
+@param[out] out_bytes The length of the whole pages. 0 if there are none.
+*/
+void wholePages(const void* p, const size_t bytes, void*& out_start, size_t& out_bytes)
+{
+    const std::uintptr_t pageSize = static_cast<std::uintptr_t>(sysconf(_SC_PAGESIZE));
+    const std::uintptr_t begin    = reinterpret_cast<std::uintptr_t>(p);
+    const std::uintptr_t first    = (begin + pageSize - 1) / pageSize * pageSize;
+    const std::uintptr_t last     = (begin + bytes) / pageSize * pageSize;
+    out_start = reinterpret_cast<void*>(first);
+    out_bytes = last > first ? last - first : 0;
+}
+
+#endif
+
+
+}  // namespace
+
+
+/** Read the nodes, and the CPUs of each that the calling thread may run on.
+Call it before pinning the calling thread, which narrows what it may run on.
+@return The topology. One node with the allowed CPUs if sysfs has no nodes.
+*/
+NumaTopology NumaTopology::Detect()
+{
+    NumaTopology topology;
+    const std::vector<unsigned> allowed = GetThreadCpus();
+
+#ifdef __linux__
+    const char* const nodeDir = "/sys/devices/system/node";
+    if (DIR* const pDir = opendir(nodeDir))
+    {
+        while (const dirent* const pEntry = readdir(pDir))
+        {
+            const std::string name = pEntry->d_name;
+            if (name.compare(0, 4, "node") != 0 || name.size() == 4 || name.find_first_not_of("0123456789", 4) != std::string::npos)
+                continue;
+
+            Node node;
+            node.id = static_cast<unsigned>(std::stoul(name.substr(4)));
+            std::ifstream fin(std::string(nodeDir) + "/" + name + "/cpulist");
+            std::string text;
+            std::vector<unsigned> cpus;
+            if (!std::getline(fin, text) || !parseCpuList(text, cpus))
+                continue;
+            // nodes of memory only, or of CPUs outside this process's cpuset, get no threads
+            for (const unsigned cpu : cpus)
+            {
+                if (std::find(allowed.begin(), allowed.end(), cpu) != allowed.end())
+                    node.cpus.push_back(cpu);
+            }
+            if (!node.cpus.empty())
+                topology.m_nodes.push_back(node);
+        }
+        closedir(pDir);
+    }
+    std::sort(topology.m_nodes.begin(), topology.m_nodes.end(), [](const Node& a, const Node& b) { return a.id < b.id; });
+    topology.m_fromSysfs = !topology.m_nodes.empty();
+#endif
+
+    if (topology.m_nodes.empty())
+    {
+        Node node;
+        node.cpus = allowed;
+        if (node.cpus.empty())
+        {
+            for (unsigned cpu = 0; cpu < std::max(std::thread::hardware_concurrency(), 1u); ++cpu)
+                node.cpus.push_back(cpu);
+        }
+        topology.m_nodes.push_back(node);
+    }
+    return topology;
+}
+
+
+/** Get the node a thread of a group runs on.
+@param[in] thread     The index of the thread in the group.
+@param[in] numThreads The number of threads in the group.
+@return The index of the node in GetNodes.
+*/
+size_t NumaTopology::NodeOfThread(const unsigned thread, const unsigned numThreads) const
+{
+    return std::min(size_t(thread) * m_nodes.size() / std::max(numThreads, 1u), m_nodes.size() - 1);
+}
+
+
+/** Get the CPU a thread of a group runs on. The threads of a node take its CPUs in order,
+and share them round robin if there are more threads than CPUs.
+@param[in] thread     The index of the thread in the group.
+@param[in] numThreads The number of threads in the group.
+@return The CPU.
+*/
+unsigned NumaTopology::CpuOfThread(const unsigned thread, const unsigned numThreads) const
+{
+    const size_t node        = NodeOfThread(thread, numThreads);
+    // the first thread of the node: the smallest t with t * numNodes / numThreads == node
+    const size_t firstThread = (node * std::max(numThreads, 1u) + m_nodes.size() - 1) / m_nodes.size();
+    const std::vector<unsigned>& cpus = m_nodes[node].cpus;
+    return cpus[(thread - firstThread) % cpus.size()];
+}
+
+
+/** Print the nodes and their CPUs.
+@param[in] out The stream to print to.
+*/
+void NumaTopology::Describe(std::ostream& out) const
+{
+    if (!m_fromSysfs)
+        out << "No NUMA nodes in /sys/devices/system/node. Treating the machine as one node.\n";
+    for (const Node& node : m_nodes)
+    {
+        out << "node " << node.id << ": " << node.cpus.size() << " CPUs (";
+        // print runs of CPUs as ranges, the way sysfs does
+        for (size_t i = 0; i < node.cpus.size(); )
+        {
+            size_t last = i;
+            while (last + 1 < node.cpus.size() && node.cpus[last + 1] == node.cpus[last] + 1)
+                ++last;
+            out << (i > 0 ? "," : "") << node.cpus[i];
+            if (last > i)
+                out << "-" << node.cpus[last];
+            i = last + 1;
+        }
+        out << ")\n";
+    }
+}
+
+
+// ------------------------------------------------------------------
+
+/** Get the CPUs the calling thread may run on.
+@return The CPUs, in order. Empty if unknown.
+*/
+std::vector<unsigned> GetThreadCpus()
+{
+    std::vector<unsigned> cpus;
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0)
+    {
+        for (unsigned cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+        {
+            if (CPU_ISSET(cpu, &set))
+                cpus.push_back(cpu);
+        }
+    }
+#endif
+    return cpus;
+}
+
+
+/** Restrict the calling thread to some CPUs. Threads it starts afterwards inherit the restriction.
+@param[in] cpus The CPUs.
+@return false if the platform or the kernel refused. The thread then runs where it ran before.
+*/
+bool PinThreadToCpus(const std::vector<unsigned>& cpus)
+{
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (const unsigned cpu : cpus)
+    {
+        if (cpu < CPU_SETSIZE)
+            CPU_SET(cpu, &set);
+    }
+    return CPU_COUNT(&set) > 0 && sched_setaffinity(0, sizeof(set), &set) == 0;
+#else
+    (void)cpus;
+    return false;
+#endif
+}
+
+
+/** Move the whole pages of a range to a node's memory, and prefer the node for them from then on.
+Pages not yet touched are placed on the node when they are, or elsewhere if the node is full.
+The ranges are parts of heap blocks, e.g. Eigen's matrices, and the policy belongs to the pages, not the block:
+it stays after the block is freed, for whatever the allocator puts there next. So the policy is MPOL_PREFERRED,
+which only steers that memory, rather than MPOL_BIND, which would fail its allocations once the node is full.
+@param[in] p     The start of the range.
+@param[in] bytes The length of the range.
+@param[in] node  The kernel's number for the node.
+@return false if the platform or the kernel refused, e.g. a kernel without NUMA support.
+        The pages then stay where they are.
+*/
+bool MoveMemoryToNode(const void* p, const size_t bytes, const unsigned node)
+{
+#ifdef __linux__
+    void*  pStart;
+    size_t length;
+    wholePages(p, bytes, pStart, length);
+    if (length == 0)
+        return true;
+
+    const size_t bitsPerWord = 8 * sizeof(unsigned long);
+    std::vector<unsigned long> nodeMask(node / bitsPerWord + 1, 0);
+    nodeMask[node / bitsPerWord] = 1ul << (node % bitsPerWord);
+    // the kernel reads one bit fewer than maxnode
+    const unsigned long maxNode = nodeMask.size() * bitsPerWord + 1;
+    return syscall(SYS_mbind, pStart, length, MPOL_PREFERRED, nodeMask.data(), maxNode, MPOL_MF_MOVE) == 0;
+#else
+    (void)p;
+    (void)bytes;
+    (void)node;
+    return false;
+#endif
+}
+
+
+/** Get the node whose memory holds the page of an address. Touches the page if it was not yet.
+@param[in] p The address.
+@return The kernel's number for the node, or -1 if unknown.
+*/
+int NodeOfMemory(const void* p)
+{
+#ifdef __linux__
+    int node = -1;
+    if (syscall(SYS_get_mempolicy, &node, nullptr, 0ul, p, static_cast<unsigned long>(MPOL_F_NODE | MPOL_F_ADDR)) == 0)
+        return node;
+#else
+    (void)p;
+#endif
+    return -1;
+}
+
+
+}
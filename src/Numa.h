@@ -0,0 +1,60 @@
+// ==================================================================
+// Copyright (c) 2019 Alexander Freed. ALL RIGHTS RESERVED.
+// Language: ISO C++14
+//
+// NumaTopology class declaration.
+// Where the CPUs and memory of the machine are, and placing threads and memory on them, from Linux sysfs
+// and system calls, without libnuma.
+// ==================================================================
+
+#pragma once
+
+#include <cstddef>
+#include <iosfwd>
+#include <vector>
+
+
+namespace fnn {
+
+
+/** The NUMA nodes of the machine that have CPUs this process may run on.
+Read from /sys/devices/system/node. A machine, kernel or platform without NUMA nodes there is one node
+holding every CPU, so callers need no special case for it.
+Threads are spread over the nodes in blocks: a thread's neighbours in index share its node, and
+each node takes about the same number of threads.
+*/
+class NumaTopology
+{
+public:
+    /** One node.
+    */
+    struct Node
+    {
+        unsigned              id = 0;  // the kernel's number for the node
+        std::vector<unsigned> cpus;    // the CPUs of the node this process may run on
+    };
+
+    static NumaTopology Detect();
+
+    const std::vector<Node>& GetNodes() const { return m_nodes; }
+    size_t                   GetNumNodes() const { return m_nodes.size(); }
+    bool                     IsFromSysfs() const { return m_fromSysfs; }
+
+    size_t   NodeOfThread(const unsigned thread, const unsigned numThreads) const;
+    unsigned CpuOfThread(const unsigned thread, const unsigned numThreads) const;
+
+    void Describe(std::ostream& out) const;
+
+private:
+    std::vector<Node> m_nodes;
+    bool              m_fromSysfs = false;  // false: the single node stands in for a machine without NUMA information
+};
+
+
+std::vector<unsigned> GetThreadCpus();
+bool PinThreadToCpus(const std::vector<unsigned>& cpus);
+bool MoveMemoryToNode(const void* p, const size_t bytes, const unsigned node);
+int  NodeOfMemory(const void* p);
+
+
+}
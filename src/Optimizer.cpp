@@ -0,0 +1,178 @@
+// ==================================================================
+// Copyright (c) 2019 Alexander Freed. ALL RIGHTS RESERVED.
+// Language: ISO C++14
+//
+// Optimizer class definition.
+// ==================================================================
+
+#include "Optimizer.h"
+
+#include "Kernels.h"
+
+
+namespace fnn {
+
+
+/** Get the learning rate a rule is usually started with.
+@param[in] type The rule.
+@return The learning rate.
+*/
+double OptimizerSettings::DefaultLearningRate(const OptimizerType type)
+{
+    switch (type)
+    {
+    case OptimizerType::RMSPROP:
+    case OptimizerType::ADAM:
+        return 0.001;
+    default:
+        return 0.1;
+    }
+}
+
+
+/** Constructor
+@param[in] settings The rule and its hyperparameters.
+*/
+Optimizer::Optimizer(const OptimizerSettings& settings)
+    : m_settings(settings)
+{ }
+
+
+/** Start the updates of one training step. Call once per sample, before updating its layers.
+*/
+void Optimizer::BeginStep()
+{
+    ++m_step;
+    m_beta1Power *= m_settings.beta1;
+    m_beta2Power *= m_settings.beta2;
+}
+
+
+/** Update the weights of a layer from one sample. The gradient descent direction is x^T * error.
+@param[in]     layer   The index of the layer. Selects the state.
+@param[in/out] weights The weights of the layer. Column-major, one row per input and one column per output.
+@param[in]     pX      The inputs to the layer. One per row of the weights.
+@param[in]     pError  The errors of the layer's outputs. One per column of the weights.
+*/
+void Optimizer::Update(const size_t layer, Eigen::MatrixXd& weights, const double* pX, const double* pError)
+{
+    PrepareLayer(layer, weights);
+    UpdateColumns(layer, weights, pX, pError, 0, static_cast<size_t>(weights.cols()));
+}
+
+
+/** Create the state of a layer, as zeros, if it does not have one the size of the weights.
+Update does this itself. Call it before updating a layer with UpdateColumns.
+@param[in] layer   The index of the layer.
+@param[in] weights The weights of the layer.
+*/
+void Optimizer::PrepareLayer(const size_t layer, const Eigen::MatrixXd& weights)
+{
+    if (m_layers.size() <= layer)
+        m_layers.resize(layer + 1);
+    LayerState& state = m_layers[layer];
+    if (state.state0.rows() != weights.rows() || state.state0.cols() != weights.cols())
+    {
+        state.state0 = Eigen::MatrixXd::Zero(weights.rows(), weights.cols());
+        if (m_settings.type == OptimizerType::ADAM)
+            state.state1 = Eigen::MatrixXd::Zero(weights.rows(), weights.cols());
+    }
+}
+
+
+/** Get the state of a layer, e.g. to place its memory.
+@param[in] layer The index of the layer.
+@return The state matrices, each the size of the layer's weights. Empty before the layer's first update or PrepareLayer.
+*/
+std::vector<const Eigen::MatrixXd*> Optimizer::GetLayerState(const size_t layer) const
+{
+    std::vector<const Eigen::MatrixXd*> matrices;
+    if (layer < m_layers.size())
+    {
+        for (const Eigen::MatrixXd* pState : { &m_layers[layer].state0, &m_layers[layer].state1 })
+        {
+            if (pState->size() > 0)
+                matrices.push_back(pState);
+        }
+    }
+    return matrices;
+}
+
+
+/** Update some columns of the weights of a layer from one sample, as Update does for all of them.
+Each column, and its state, is only read and written by the call that updates it, so calls on columns
+that do not overlap may run on different threads at once. Call PrepareLayer first.
+@param[in]     layer    The index of the layer. Selects the state.
+@param[in/out] weights  The weights of the layer.
+@param[in]     pX       The inputs to the layer. One per row of the weights.
+@param[in]     pError   The errors of the layer's outputs. One per column of the weights, all of them.
+@param[in]     firstCol The first column to update.
+@param[in]     numCols  The number of columns to update.
+*/
+void Optimizer::UpdateColumns(const size_t layer, Eigen::MatrixXd& weights, const double* pX, const double* pError,
+                              const size_t firstCol, const size_t numCols)
+{
+    LayerState& state = m_layers[layer];
+    const size_t rows   = static_cast<size_t>(weights.rows());
+    const size_t offset = firstCol * rows;
+    double* const pWeights = weights.data() + offset;
+    double* const pState0  = state.state0.data() + offset;
+    pError += firstCol;
+    const OptimizerSettings& s = m_settings;
+    switch (s.type)
+    {
+    case OptimizerType::MOMENTUM:
+        MomentumRank1Update(pWeights, pState0, rows, numCols, pX, pError, s.learningRate, s.momentum);
+        break;
+    case OptimizerType::NESTEROV:
+        NesterovRank1Update(pWeights, pState0, rows, numCols, pX, pError, s.learningRate, s.momentum);
+        break;
+    case OptimizerType::RMSPROP:
+        RMSPropRank1Update(pWeights, pState0, rows, numCols, pX, pError, s.learningRate, s.decay, s.epsilon);
+        break;
+    case OptimizerType::ADAM:
+        // the bias corrections undo the zero start of the means
+        AdamRank1Update(pWeights, pState0, state.state1.data() + offset, rows, numCols, pX, pError,
+                        s.learningRate / (1 - m_beta1Power), s.beta1, s.beta2, 1 / (1 - m_beta2Power), s.epsilon);
+        break;
+    }
+}
+
+
+/** Parse the name of a rule.
+@param[in]  name     "momentum", "nesterov", "rmsprop" or "adam".
+@param[out] out_type The rule.
+@return false if the name is unknown.
+*/
+bool Optimizer::ParseType(const std::string& name, OptimizerType& out_type)
+{
+    for (const OptimizerType type : { OptimizerType::MOMENTUM, OptimizerType::NESTEROV, OptimizerType::RMSPROP, OptimizerType::ADAM })
+    {
+        if (name == TypeName(type))
+        {
+            out_type = type;
+            return true;
+        }
+    }
+    return false;
+}
+
+
+/** Get the name of a rule.
+@param[in] type The rule.
+@return The name, as accepted by ParseType.
+*/
+const char* Optimizer::TypeName(const OptimizerType type)
+{
+    switch (type)
+    {
+    case OptimizerType::MOMENTUM: return "momentum";
+    case OptimizerType::NESTEROV: return "nesterov";
+    case OptimizerType::RMSPROP:  return "rmsprop";
+    case OptimizerType::ADAM:     return "adam";
+    }
+    return "unknown";
+}
+
+
+}
@@ -0,0 +1,87 @@
+// ==================================================================
+// Copyright (c) 2019 Alexander Freed. ALL RIGHTS RESERVED.
+// Language: ISO C++14
+//
+// Optimizer class declaration.
+// The rules that turn a layer's gradient into a weight change.
+// ==================================================================
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <Eigen/Dense>
+
+
+namespace fnn {
+
+
+/** The update rules.
+*/
+enum class OptimizerType
+{
+    MOMENTUM,  // SGD with classical momentum
+    NESTEROV,  // SGD with Nesterov momentum
+    RMSPROP,   // steps scaled by a running mean of the squared gradient
+    ADAM,      // RMSProp with momentum and bias correction
+};
+
+
+/** The hyperparameters of an optimizer. Each rule reads only the ones it uses.
+*/
+struct OptimizerSettings
+{
+    OptimizerType type         = OptimizerType::MOMENTUM;
+    double        learningRate = 0.1;
+    double        momentum     = 0.9;    // momentum, nesterov
+    double        decay        = 0.9;    // rmsprop: the decay of the mean square
+    double        beta1        = 0.9;    // adam: the decay of the mean
+    double        beta2        = 0.999;  // adam: the decay of the mean square
+    double        epsilon      = 1e-8;   // rmsprop, adam
+
+    static double DefaultLearningRate(const OptimizerType type);
+};
+
+
+/** Applies one update rule to the weights of a network and owns the per-weight state it needs:
+the previous weight changes, or the running means of the gradient.
+The state of each layer is created, as zeros, on its first update.
+*/
+class Optimizer
+{
+public:
+    explicit Optimizer(const OptimizerSettings& settings = OptimizerSettings());
+
+    void BeginStep();
+    void Update(const size_t layer, Eigen::MatrixXd& weights, const double* pX, const double* pError);
+    void PrepareLayer(const size_t layer, const Eigen::MatrixXd& weights);
+    void UpdateColumns(const size_t layer, Eigen::MatrixXd& weights, const double* pX, const double* pError,
+                       const size_t firstCol, const size_t numCols);
+
+    std::vector<const Eigen::MatrixXd*> GetLayerState(const size_t layer) const;
+
+    const OptimizerSettings& GetSettings() const { return m_settings; }
+    void SetLearningRate(const double learningRate) { m_settings.learningRate = learningRate; }
+
+    static bool        ParseType(const std::string& name, OptimizerType& out_type);
+    static const char* TypeName(const OptimizerType type);
+
+private:
+    // the state of one layer. Each matrix is the size of the layer's weights.
+    struct LayerState
+    {
+        Eigen::MatrixXd state0;  // momentum, nesterov: the previous weight change. rmsprop: the mean square. adam: the mean.
+        Eigen::MatrixXd state1;  // adam: the mean square
+    };
+
+    OptimizerSettings       m_settings;
+    std::vector<LayerState> m_layers;
+    std::uint64_t           m_step       = 0;
+    double                  m_beta1Power = 1;  // beta1^step
+    double                  m_beta2Power = 1;  // beta2^step
+};
+
+
+}
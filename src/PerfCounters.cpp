@@ -0,0 +1,250 @@
+// ==================================================================
+// Copyright (c) 2019 Alexander Freed. ALL RIGHTS RESERVED.
+// Language: ISO C++14
+//
+// PerfCounters class definition.
+// ==================================================================
+
+#include "PerfCounters.h"
+
+#include <cmath>
+#include <iomanip>
+#include <limits>
+#include <sstream>
+
+#ifdef __linux__
+    #include <cerrno>
+    #include <cstring>
+    #include <fstream>
+    #include <linux/perf_event.h>
+    #include <sys/ioctl.h>
+    #include <sys/syscall.h>
+    #include <unistd.h>
+#endif
+
+
+namespace fnn {
+
+
+namespace {
+
+
+#ifdef __linux__
+
+/** Set the perf_event_attr type and config of an event.
+@param[in]  event      The event.
+@param[out] out_type   The type.
+@param[out] out_config The config.
+*/
+void eventConfig(const PerfCounters::Event event, __u32& out_type, __u64& out_config)
+{
+    const __u64 readMiss = (__u64(PERF_COUNT_HW_CACHE_OP_READ) << 8) | (__u64(PERF_COUNT_HW_CACHE_RESULT_MISS) << 16);
+    switch (event)
+    {
+    case PerfCounters::CYCLES:        out_type = PERF_TYPE_HARDWARE; out_config = PERF_COUNT_HW_CPU_CYCLES;            break;
+    case PerfCounters::INSTRUCTIONS:  out_type = PERF_TYPE_HARDWARE; out_config = PERF_COUNT_HW_INSTRUCTIONS;          break;
+    case PerfCounters::L1D_MISSES:    out_type = PERF_TYPE_HW_CACHE; out_config = PERF_COUNT_HW_CACHE_L1D | readMiss;  break;
+    case PerfCounters::LLC_MISSES:    out_type = PERF_TYPE_HW_CACHE; out_config = PERF_COUNT_HW_CACHE_LL | readMiss;   break;
+    default:                          out_type = PERF_TYPE_HARDWARE; out_config = PERF_COUNT_HW_BRANCH_MISSES;         break;
+    }
+}
+
+
+/** Open one event of the calling thread, disabled.
+@return The file descriptor, or -1 with errno set.
+*/
+int openEvent(const PerfCounters::Event event)
+{
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size           = sizeof(attr);
+    attr.disabled       = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv     = 1;
+    attr.read_format    = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    eventConfig(event, attr.type, attr.config);
+    return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+}
+
+#endif
+
+
+}  // namespace
+
+
+/** Get the instructions per cycle.
+@return The ratio, or NaN if either was not counted.
+*/
+double PerfCounters::Values::InstructionsPerCycle() const
+{
+    if (!valid[CYCLES] || !valid[INSTRUCTIONS] || counts[CYCLES] == 0)
+        return std::numeric_limits<double>::quiet_NaN();
+    return counts[INSTRUCTIONS] / counts[CYCLES];
+}
+
+
+/** Get the count of an event per sample.
+@param[in] event      The event.
+@param[in] numSamples The number of samples counted over.
+@return The count per sample, or NaN if the event was not counted.
+*/
+double PerfCounters::Values::PerSample(const Event event, const double numSamples) const
+{
+    if (!valid[event] || numSamples <= 0)
+        return std::numeric_limits<double>::quiet_NaN();
+    return counts[event] / numSamples;
+}
+
+
+PerfCounters::~PerfCounters()
+{
+#ifdef __linux__
+    for (const int fd : m_fds)
+    {
+        if (fd >= 0)
+            close(fd);
+    }
+#endif
+}
+
+
+/** Open the counters, stopped and at zero.
+@return true if at least one event can be counted. If not, GetError says why.
+*/
+bool PerfCounters::Open()
+{
+#ifdef __linux__
+    std::string firstError;
+    for (int event = 0; event < NUM_EVENTS; ++event)
+    {
+        if (m_fds[event] < 0)
+            m_fds[event] = openEvent(static_cast<Event>(event));
+        if (m_fds[event] < 0 && firstError.empty())
+            firstError = std::strerror(errno);
+    }
+    if (IsOpen())
+        return true;
+
+    std::ostringstream error;
+    error << "perf_event_open failed: " << firstError;
+    int paranoid = 0;
+    std::ifstream paranoidFile("/proc/sys/kernel/perf_event_paranoid");
+    if (paranoidFile >> paranoid)
+        error << " (perf_event_paranoid is " << paranoid << ")";
+    m_error = error.str();
+    return false;
+#else
+    m_error = "hardware counters are only supported on Linux";
+    return false;
+#endif
+}
+
+
+/** Check whether any event is being counted.
+*/
+bool PerfCounters::IsOpen() const
+{
+    for (const int fd : m_fds)
+    {
+        if (fd >= 0)
+            return true;
+    }
+    return false;
+}
+
+
+/** Set the counts to zero.
+*/
+void PerfCounters::Reset()
+{
+#ifdef __linux__
+    for (const int fd : m_fds)
+    {
+        if (fd >= 0)
+            ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+    }
+#endif
+}
+
+
+/** Start counting.
+*/
+void PerfCounters::Start()
+{
+#ifdef __linux__
+    for (const int fd : m_fds)
+    {
+        if (fd >= 0)
+            ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+#endif
+}
+
+
+/** Stop counting. The counts are kept until Reset.
+*/
+void PerfCounters::Stop()
+{
+#ifdef __linux__
+    for (const int fd : m_fds)
+    {
+        if (fd >= 0)
+            ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+    }
+#endif
+}
+
+
+/** Read the counts.
+@return The counts since the last Reset, scaled for the time each event was actually counted.
+*/
+PerfCounters::Values PerfCounters::Read() const
+{
+    Values values;
+#ifdef __linux__
+    for (int event = 0; event < NUM_EVENTS; ++event)
+    {
+        std::uint64_t data[3] = {};  // value, time enabled, time running
+        if (m_fds[event] < 0 || read(m_fds[event], data, sizeof(data)) != sizeof(data))
+            continue;
+        // an event that never got a hardware counter was not counted at all
+        if (data[2] == 0)
+        {
+            values.valid[event] = data[1] == 0;
+            continue;
+        }
+        values.counts[event] = double(data[0]) * double(data[1]) / double(data[2]);
+        values.valid[event]  = true;
+    }
+#endif
+    return values;
+}
+
+
+/** Describe counts in one line: the instructions per cycle, and the misses per sample.
+@param[in] values     The counts.
+@param[in] numSamples The number of samples counted over.
+@return e.g. "IPC 2.31, L1D misses/sample 12.3, LLC misses/sample 0.41, branch misses/sample 0.12". n/a for events not counted.
+*/
+std::string PerfCounters::Describe(const Values& values, const double numSamples)
+{
+    std::ostringstream out;
+    const auto print = [&out](const double value) {
+        if (std::isnan(value))
+            out << "n/a";
+        else
+            out << value;
+    };
+    out << std::setprecision(3) << "IPC ";
+    print(values.InstructionsPerCycle());
+    out << ", L1D misses/sample ";
+    print(values.PerSample(L1D_MISSES, numSamples));
+    out << ", LLC misses/sample ";
+    print(values.PerSample(LLC_MISSES, numSamples));
+    out << ", branch misses/sample ";
+    print(values.PerSample(BRANCH_MISSES, numSamples));
+    return out.str();
+}
+
+
+}
@@ -0,0 +1,71 @@
+// ==================================================================
+// Copyright (c) 2019 Alexander Freed. ALL RIGHTS RESERVED.
+// Language: ISO C++14
+//
+// PerfCounters class declaration.
+// Hardware performance counters of the calling thread, through Linux perf_event_open.
+// ==================================================================
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string>
+
+
+namespace fnn {
+
+
+/** Counts hardware events of the calling thread, in user space only.
+Each event is opened on its own, so a CPU or kernel that lacks one still counts the others.
+Counts are scaled up if the kernel had to share the hardware counters between events.
+On other platforms, or if the kernel refuses (see /proc/sys/kernel/perf_event_paranoid), Open fails
+with a reason and nothing is counted.
+*/
+class PerfCounters
+{
+public:
+    enum Event
+    {
+        CYCLES,
+        INSTRUCTIONS,
+        L1D_MISSES,     // level 1 data cache read misses
+        LLC_MISSES,     // last level cache read misses
+        BRANCH_MISSES,
+        NUM_EVENTS
+    };
+
+    /** Counts since the last Reset.
+    */
+    struct Values
+    {
+        std::array<double, NUM_EVENTS> counts = {};
+        std::array<bool, NUM_EVENTS>   valid  = {};  // false if the event could not be counted
+
+        double InstructionsPerCycle() const;
+        double PerSample(const Event event, const double numSamples) const;
+    };
+
+    PerfCounters() = default;
+    ~PerfCounters();
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    bool Open();
+    bool IsOpen() const;
+    const std::string& GetError() const { return m_error; }
+
+    void Reset();
+    void Start();
+    void Stop();
+    Values Read() const;
+
+    static std::string Describe(const Values& values, const double numSamples);
+
+private:
+    std::array<int, NUM_EVENTS> m_fds = { -1, -1, -1, -1, -1 };
+    std::string                 m_error;
+};
+
+
+}
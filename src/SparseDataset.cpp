@@ -0,0 +1,260 @@
+// ==================================================================
+// Copyright (c) 2019 Alexander Freed. ALL RIGHTS RESERVED.
+// Language: ISO C++14
+//
+// Reading and writing the sparse (CSR) binary dataset format.
+// ==================================================================
+
+#include "SparseDataset.h"
+
+#include "DatasetFile.h"
+#include "Endian.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <numeric>
+
+
+namespace FileIO {
+
+
+namespace {
+
+
+// header field offsets
+constexpr char   MAGIC[8]                    = { 'F', 'N', 'N', 'C', 'S', 'R', '\0', '\0' };
+constexpr size_t OFFSET_VERSION              = 8;
+constexpr size_t OFFSET_ENDIAN               = 12;
+constexpr size_t OFFSET_NUM_SAMPLES          = 16;
+constexpr size_t OFFSET_NUM_NON_ZERO         = 24;
+constexpr size_t OFFSET_IMAGE_ROWS           = 32;
+constexpr size_t OFFSET_IMAGE_COLS           = 36;
+constexpr size_t OFFSET_LABELS               = 40;
+constexpr size_t OFFSET_ROW_OFFSETS          = 48;
+constexpr size_t OFFSET_INDICES              = 56;
+constexpr size_t OFFSET_VALUES               = 64;
+constexpr size_t OFFSET_CHECKSUM             = 72;
+constexpr size_t OFFSET_HEADER_CHECKSUM      = DATASET_HEADER_SIZE - 8;
+
+
+/** Encode the header, including its own checksum.
+*/
+void encodeHeader(const SparseDatasetHeader& header, std::uint8_t* pBytes)
+{
+    std::fill(pBytes, pBytes + DATASET_HEADER_SIZE, std::uint8_t(0));
+    std::memcpy(pBytes, MAGIC, sizeof(MAGIC));
+    PutLittle(pBytes + OFFSET_VERSION,      header.version);
+    PutLittle(pBytes + OFFSET_ENDIAN,       DATASET_ENDIAN_MARKER);
+    PutLittle(pBytes + OFFSET_NUM_SAMPLES,  header.numSamples);
+    PutLittle(pBytes + OFFSET_NUM_NON_ZERO, header.numNonZero);
+    PutLittle(pBytes + OFFSET_IMAGE_ROWS,   header.imageRows);
+    PutLittle(pBytes + OFFSET_IMAGE_COLS,   header.imageCols);
+    PutLittle(pBytes + OFFSET_LABELS,       header.labelsOffset);
+    PutLittle(pBytes + OFFSET_ROW_OFFSETS,  header.rowOffsetsOffset);
+    PutLittle(pBytes + OFFSET_INDICES,      header.indicesOffset);
+    PutLittle(pBytes + OFFSET_VALUES,       header.valuesOffset);
+    PutLittle(pBytes + OFFSET_CHECKSUM,     header.checksum);
+    PutLittle(pBytes + OFFSET_HEADER_CHECKSUM, Checksum(pBytes, OFFSET_HEADER_CHECKSUM));
+}
+
+
+/** Decode and sanity check the header.
+Does not verify the payload checksum.
+*/
+LoadResult decodeHeader(const std::uint8_t* pBytes, const size_t fileBytes, SparseDatasetHeader& out_header)
+{
+    if (fileBytes < DATASET_HEADER_SIZE || std::memcmp(pBytes, MAGIC, sizeof(MAGIC)) != 0)
+        return LoadResult::FILE_BAD_FORMAT;
+    if (GetLittle<std::uint32_t>(pBytes + OFFSET_ENDIAN) != DATASET_ENDIAN_MARKER)
+        return LoadResult::FILE_BAD_FORMAT;
+    if (GetLittle<std::uint32_t>(pBytes + OFFSET_VERSION) != SPARSE_DATASET_VERSION)
+        return LoadResult::FILE_VERSION_MISMATCH;
+    if (GetLittle<std::uint64_t>(pBytes + OFFSET_HEADER_CHECKSUM) != Checksum(pBytes, OFFSET_HEADER_CHECKSUM))
+        return LoadResult::FILE_CORRUPT;
+
+    SparseDatasetHeader header;
+    header.version          = GetLittle<std::uint32_t>(pBytes + OFFSET_VERSION);
+    header.numSamples       = GetLittle<std::uint64_t>(pBytes + OFFSET_NUM_SAMPLES);
+    header.numNonZero       = GetLittle<std::uint64_t>(pBytes + OFFSET_NUM_NON_ZERO);
+    header.imageRows        = GetLittle<std::uint32_t>(pBytes + OFFSET_IMAGE_ROWS);
+    header.imageCols        = GetLittle<std::uint32_t>(pBytes + OFFSET_IMAGE_COLS);
+    header.labelsOffset     = GetLittle<std::uint64_t>(pBytes + OFFSET_LABELS);
+    header.rowOffsetsOffset = GetLittle<std::uint64_t>(pBytes + OFFSET_ROW_OFFSETS);
+    header.indicesOffset    = GetLittle<std::uint64_t>(pBytes + OFFSET_INDICES);
+    header.valuesOffset     = GetLittle<std::uint64_t>(pBytes + OFFSET_VALUES);
+    header.checksum         = GetLittle<std::uint64_t>(pBytes + OFFSET_CHECKSUM);
+
+    // pixel indices address the network's inputs, so the images must have its size
+    if (header.imageRows == 0 || header.imageCols == 0 || header.numSamples > fileBytes ||
+        size_t(header.imageRows) * header.imageCols + 1 != fnn::NUM_INPUTS)
+    {
+        return LoadResult::FILE_BAD_FORMAT;
+    }
+
+    // sections must be aligned, in order, and inside the file. Each count must fit in the file after its offset
+    // before it is multiplied and added, so a crafted header cannot wrap the section ends.
+    const std::uint64_t sectionOffsets[]  = { header.labelsOffset, header.rowOffsetsOffset, header.indicesOffset, header.valuesOffset };
+    const std::uint64_t sectionCounts[]   = { header.numSamples, header.numSamples + 1, header.numNonZero, header.numNonZero };
+    const std::uint64_t sectionElements[] = { 1, sizeof(std::uint32_t), sizeof(std::uint16_t), 1 };
+    std::uint64_t previousEnd = DATASET_HEADER_SIZE;
+    for (size_t i = 0; i < 4; ++i)
+    {
+        if (sectionOffsets[i] % DATASET_ALIGNMENT != 0 || sectionOffsets[i] < previousEnd || sectionOffsets[i] > fileBytes ||
+            sectionCounts[i] > (fileBytes - sectionOffsets[i]) / sectionElements[i])
+        {
+            return LoadResult::FILE_BAD_FORMAT;
+        }
+        previousEnd = sectionOffsets[i] + sectionCounts[i] * sectionElements[i];
+    }
+    if (previousEnd != fileBytes || header.numNonZero > std::numeric_limits<std::uint32_t>::max())
+        return LoadResult::FILE_BAD_FORMAT;
+
+    out_header = header;
+    return LoadResult::SUCCESS;
+}
+
+
+/** Append a section to the payload, padded so it starts on an aligned offset.
+@param[in/out] payload The bytes after the header.
+@param[in]     numBytes The size of the new section.
+@return The file offset of the new section.
+*/
+size_t addSection(std::vector<std::uint8_t>& payload, const size_t numBytes)
+{
+    const size_t offset = AlignUp(DATASET_HEADER_SIZE + payload.size());
+    payload.resize(offset + numBytes - DATASET_HEADER_SIZE, 0);
+    return offset;
+}
+
+
+}  // namespace
+
+
+// ------------------------------------------------------------------
+
+/** Map a sparse dataset file into memory and validate it.
+Checks the header, both checksums, and that every label, row offset and pixel index is in range,
+so that rows can be used afterwards without any checks.
+@param[in] filename The path and filename.
+@return A pair consisting of a load result and the view. The view is empty unless the result is SUCCESS.
+*/
+std::tuple<LoadResult, SparseDatasetView> MapSparseDataset(const std::string& filename)
+{
+    // the view hands out pointers into the file, so the host must use the file's byte order
+    if (!IsLittleEndian())
+        return std::make_tuple(LoadResult::FILE_BAD_FORMAT, SparseDatasetView());
+
+    SparseDatasetView view;
+    if (!view.m_file.Open(filename))
+        return std::make_tuple(LoadResult::FILE_NOT_FOUND, SparseDatasetView());
+
+    const std::uint8_t* const pBytes = view.m_file.GetData();
+    const size_t fileBytes = view.m_file.GetSize();
+
+    const LoadResult result = decodeHeader(pBytes, fileBytes, view.m_header);
+    if (result != LoadResult::SUCCESS)
+        return std::make_tuple(result, SparseDatasetView());
+
+    if (Checksum(pBytes + DATASET_HEADER_SIZE, fileBytes - DATASET_HEADER_SIZE) != view.m_header.checksum)
+        return std::make_tuple(LoadResult::FILE_CORRUPT, SparseDatasetView());
+
+    if (!CheckLabels(view.GetLabels(), view.GetNumSamples()))
+        return std::make_tuple(LoadResult::FILE_BAD_FORMAT, SparseDatasetView());
+
+    // row offsets must be ascending from 0 to numNonZero
+    const std::uint32_t* const pOffsets = view.GetRowOffsets();
+    if (pOffsets[0] != 0 || pOffsets[view.GetNumSamples()] != view.GetNumNonZero() ||
+        !std::is_sorted(pOffsets, pOffsets + view.GetNumSamples() + 1))
+    {
+        return std::make_tuple(LoadResult::FILE_BAD_FORMAT, SparseDatasetView());
+    }
+
+    // pixel indices must be inside the image
+    const std::uint16_t* const pIndices = view.GetIndices();
+    const std::uint16_t maxIndex = std::accumulate(pIndices, pIndices + view.GetNumNonZero(), std::uint16_t(0),
+                                                   [](const std::uint16_t a, const std::uint16_t b) { return std::max(a, b); });
+    if (view.GetNumNonZero() > 0 && size_t(maxIndex) >= size_t(view.m_header.imageRows) * view.m_header.imageCols)
+        return std::make_tuple(LoadResult::FILE_BAD_FORMAT, SparseDatasetView());
+
+    return std::make_tuple(LoadResult::SUCCESS, std::move(view));
+}
+
+
+/** Write samples in the sparse dataset format.
+@param[in] filename The path and filename.
+@param[in] packed   The samples, with 8-bit pixels.
+@return true if successful.
+*/
+bool WriteSparseDataset(const std::string& filename, const PackedDataset& packed)
+{
+    SparseDatasetHeader header;
+    header.numSamples = packed.GetNumSamples();
+    header.imageRows  = packed.imageRows;
+    header.imageCols  = packed.imageCols;
+    const size_t numPixels = packed.GetPixelsPerSample();
+    if (packed.pixels.size() != packed.GetNumSamples() * numPixels)
+    {
+        assert(false);
+        return false;
+    }
+
+    // compress the rows
+    std::vector<std::uint32_t> rowOffsets(1, 0);
+    std::vector<std::uint16_t> indices;
+    std::vector<std::uint8_t>  values;
+    rowOffsets.reserve(packed.GetNumSamples() + 1);
+    for (size_t row = 0; row < packed.GetNumSamples(); ++row)
+    {
+        const std::uint8_t* const pPixels = &packed.pixels[row * numPixels];
+        for (size_t i = 0; i < numPixels; ++i)
+        {
+            if (pPixels[i] != 0)
+            {
+                indices.push_back(static_cast<std::uint16_t>(i));
+                values.push_back(pPixels[i]);
+            }
+        }
+
+        if (values.size() > std::numeric_limits<std::uint32_t>::max())
+            return false;
+        rowOffsets.push_back(static_cast<std::uint32_t>(values.size()));
+    }
+    header.numNonZero = values.size();
+
+    // lay out the sections
+    std::vector<std::uint8_t> payload;
+    header.labelsOffset = addSection(payload, packed.labels.size());
+    std::copy(packed.labels.begin(), packed.labels.end(), payload.begin() + (header.labelsOffset - DATASET_HEADER_SIZE));
+
+    header.rowOffsetsOffset = addSection(payload, rowOffsets.size() * sizeof(std::uint32_t));
+    for (size_t i = 0; i < rowOffsets.size(); ++i)
+        PutLittle(&payload[header.rowOffsetsOffset - DATASET_HEADER_SIZE + i * sizeof(std::uint32_t)], rowOffsets[i]);
+
+    header.indicesOffset = addSection(payload, indices.size() * sizeof(std::uint16_t));
+    for (size_t i = 0; i < indices.size(); ++i)
+        PutLittle(&payload[header.indicesOffset - DATASET_HEADER_SIZE + i * sizeof(std::uint16_t)], indices[i]);
+
+    header.valuesOffset = addSection(payload, values.size());
+    std::copy(values.begin(), values.end(), payload.begin() + (header.valuesOffset - DATASET_HEADER_SIZE));
+
+    header.checksum = Checksum(payload.data(), payload.size());
+
+    // write
+    std::uint8_t headerBytes[DATASET_HEADER_SIZE];
+    encodeHeader(header, headerBytes);
+
+    std::fstream fout(filename.c_str(), std::ios::binary | std::ios::out | std::ios::trunc);
+    if (!fout)
+        return false;
+    fout.write(reinterpret_cast<const char*>(headerBytes), sizeof(headerBytes));
+    fout.write(reinterpret_cast<const char*>(payload.data()), payload.size());
+    fout.close();
+
+    return !fout.fail();
+}
+
+
+}
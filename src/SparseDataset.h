@@ -0,0 +1,134 @@
+// ==================================================================
+// Copyright (c) 2019 Alexander Freed. ALL RIGHTS RESERVED.
+// Language: ISO C++14
+//
+// The sparse (CSR) binary dataset format.
+//
+// Layout (all integers little-endian):
+//     [0, 128)           header
+//     labelsOffset       numSamples uint8 labels
+//     rowOffsetsOffset   numSamples + 1 uint32 offsets into the index and value sections
+//     indicesOffset      numNonZero uint16 pixel indices, ascending within each row
+//     valuesOffset       numNonZero uint8 pixel values
+// Every section starts on a 64-byte boundary. Zero pixels and the bias input are not stored.
+// ==================================================================
+
+#pragma once
+
+#include "FileIO.h"
+#include "MappedFile.h"
+#include "Trainer.h"
+
+#include <cstdint>
+#include <iterator>
+#include <string>
+#include <tuple>
+#include <vector>
+
+
+namespace FileIO {
+
+
+// constants
+
+constexpr std::uint32_t SPARSE_DATASET_VERSION = 1;
+
+
+// classes
+
+/** The decoded (native byte order) header of a sparse dataset file.
+*/
+struct SparseDatasetHeader
+{
+    std::uint32_t version          = SPARSE_DATASET_VERSION;
+    std::uint64_t numSamples       = 0;
+    std::uint64_t numNonZero       = 0;
+    std::uint32_t imageRows        = 28;
+    std::uint32_t imageCols        = 28;
+    std::uint64_t labelsOffset     = 0;
+    std::uint64_t rowOffsetsOffset = 0;
+    std::uint64_t indicesOffset    = 0;
+    std::uint64_t valuesOffset     = 0;
+    std::uint64_t checksum         = 0;  // of every byte after the header
+};
+
+
+/** A read-only view of a memory-mapped sparse dataset file.
+Rows are read straight from the mapping. Only available on little-endian hosts.
+*/
+class SparseDatasetView
+{
+public:
+    /** Forward iterator over the rows.
+    */
+    class Iterator
+    {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type        = fnn::SparseTrainer;
+        using difference_type   = std::ptrdiff_t;
+        using pointer           = const fnn::SparseTrainer*;
+        using reference         = const fnn::SparseTrainer&;
+
+        Iterator() = default;
+        Iterator(const SparseDatasetView* pView, const size_t index)
+            : m_pView(pView)
+            , m_index(index)
+        {
+            if (m_index < m_pView->GetNumSamples())
+                m_current = m_pView->GetRow(m_index);
+        }
+
+        reference operator*() const { return m_current; }
+        pointer operator->() const { return &m_current; }
+        Iterator& operator++() { *this = Iterator(m_pView, m_index + 1); return *this; }
+        bool operator==(const Iterator& other) const { return m_index == other.m_index; }
+        bool operator!=(const Iterator& other) const { return m_index != other.m_index; }
+
+    private:
+        const SparseDatasetView* m_pView = nullptr;
+        size_t                   m_index = 0;
+        fnn::SparseTrainer       m_current;
+    };
+
+    SparseDatasetView() = default;
+
+    const SparseDatasetHeader& GetHeader() const { return m_header; }
+    size_t GetNumSamples() const { return size_t(m_header.numSamples); }
+    size_t GetNumNonZero() const { return size_t(m_header.numNonZero); }
+
+    const std::uint8_t*  GetLabels() const { return m_file.GetData() + m_header.labelsOffset; }
+    const std::uint32_t* GetRowOffsets() const { return reinterpret_cast<const std::uint32_t*>(m_file.GetData() + m_header.rowOffsetsOffset); }
+    const std::uint16_t* GetIndices() const { return reinterpret_cast<const std::uint16_t*>(m_file.GetData() + m_header.indicesOffset); }
+    const std::uint8_t*  GetValues() const { return m_file.GetData() + m_header.valuesOffset; }
+
+    /** Get one row.
+    @param[in] index The row index. Must be less than GetNumSamples().
+    */
+    fnn::SparseTrainer GetRow(const size_t index) const
+    {
+        const std::uint32_t begin = GetRowOffsets()[index];
+        const std::uint32_t end   = GetRowOffsets()[index + 1];
+        return fnn::SparseTrainer(GetLabels()[index], fnn::SparseInput{ end - begin, GetIndices() + begin, GetValues() + begin });
+    }
+
+    Iterator begin() const { return Iterator(this, 0); }
+    Iterator end() const { return Iterator(this, GetNumSamples()); }
+    // named like a container so the view can be passed to the generic evaluation code
+    size_t size() const { return GetNumSamples(); }
+
+private:
+    friend std::tuple<LoadResult, SparseDatasetView> MapSparseDataset(const std::string& filename);
+
+    MappedFile          m_file;
+    SparseDatasetHeader m_header;
+};
+
+
+// function prototypes
+
+std::tuple<LoadResult, SparseDatasetView> MapSparseDataset(const std::string& filename);
+bool WriteSparseDataset(const std::string& filename, const PackedDataset& packed);
+
+
+}
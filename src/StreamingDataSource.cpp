@@ -0,0 +1,322 @@
+// ==================================================================
+// Copyright (c) 2019 Alexander Freed. ALL RIGHTS RESERVED.
+// Language: ISO C++14
+//
+// StreamingDataSource class definition.
+// ==================================================================
+
+#include "StreamingDataSource.h"
+
+#include "Trace.h"
+#include "Utility.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <fstream>
+#include <numeric>
+#include <random>
+
+
+namespace fnn {
+
+
+StreamingDataSource::~StreamingDataSource()
+{
+    stopPass();
+}
+
+
+/** Open the shards and validate their headers.
+The payload checksums are verified while streaming.
+@param[in] shardPaths        The shard files. All must have the same image size and element types.
+@param[in] memoryBudgetBytes The memory available for buffering samples.
+@return SUCCESS if every shard is usable.
+*/
+FileIO::LoadResult StreamingDataSource::Open(const std::vector<std::string>& shardPaths, const size_t memoryBudgetBytes)
+{
+    stopPass();
+    m_shards.clear();
+    m_numSamples = 0;
+
+    if (shardPaths.empty())
+        return FileIO::LoadResult::FILE_NOT_FOUND;
+
+    for (const auto& path : shardPaths)
+    {
+        std::ifstream fin(path.c_str(), std::ios::binary);
+        if (!fin)
+            return FileIO::LoadResult::FILE_NOT_FOUND;
+
+        std::uint8_t headerBytes[FileIO::DATASET_HEADER_SIZE] = {};
+        fin.read(reinterpret_cast<char*>(headerBytes), sizeof(headerBytes));
+        fin.seekg(0, std::ios::end);
+        const auto fileBytes = static_cast<size_t>(fin.tellg());
+
+        Shard shard;
+        shard.path = path;
+        const FileIO::LoadResult result = FileIO::DecodeHeader(headerBytes, fileBytes, shard.header);
+        if (result != FileIO::LoadResult::SUCCESS)
+            return result;
+
+        // every shard must decode the same way
+        const auto& first = m_shards.empty() ? shard.header : m_shards.front().header;
+        if (shard.header.imageRows != first.imageRows || shard.header.imageCols != first.imageCols || shard.header.pixelType != first.pixelType)
+            return FileIO::LoadResult::FILE_BAD_FORMAT;
+
+        m_numSamples += size_t(shard.header.numSamples);
+        m_shards.push_back(std::move(shard));
+    }
+
+    // split the budget: half for the shuffle window, a quarter for each chunk
+    m_bytesPerSample = 1 + m_shards.front().header.GetBytesPerSample();
+    m_windowCapacity = std::max<size_t>(1, memoryBudgetBytes / 2 / m_bytesPerSample);
+    m_chunkSamples   = std::max<size_t>(1, memoryBudgetBytes / 4 / m_bytesPerSample);
+    m_window.assign(m_windowCapacity * m_bytesPerSample, 0);
+
+    return FileIO::LoadResult::SUCCESS;
+}
+
+
+/** Start a new pass over the data.
+@return An iterator to the first sample of the pass.
+*/
+StreamingDataSource::Iterator StreamingDataSource::begin()
+{
+    startPass();
+    return Iterator(this);
+}
+
+
+// ------------------------------------------------------------------
+// consumer
+
+/** Randomize the shard order and start the prefetch thread.
+*/
+void StreamingDataSource::startPass()
+{
+    stopPass();
+
+    for (auto& chunk : m_chunks)
+        chunk.ready = false;
+    m_consumeIndex = 0;
+    m_produceIndex = 0;
+    m_consuming    = false;
+    m_producerDone = false;
+    m_stop         = false;
+    m_streamDone   = false;
+    m_windowCount  = 0;
+    m_error        = FileIO::LoadResult::SUCCESS;
+
+    std::vector<size_t> shardOrder(m_shards.size());
+    std::iota(shardOrder.begin(), shardOrder.end(), size_t(0));
+    std::shuffle(shardOrder.begin(), shardOrder.end(), Global::rng());
+
+    m_thread = std::thread(&StreamingDataSource::prefetch, this, std::move(shardOrder));
+}
+
+
+/** Stop the prefetch thread, if it is running.
+*/
+void StreamingDataSource::stopPass()
+{
+    if (!m_thread.joinable())
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_condition.notify_all();
+    m_thread.join();
+}
+
+
+/** Hand out a random sample from the shuffle window and replace it with the next sample from the stream.
+@return The sample, or nullptr at the end of the pass. Valid until the next call.
+*/
+const Trainer* StreamingDataSource::next()
+{
+    // fill the window
+    while (!m_streamDone && m_windowCount < m_windowCapacity)
+    {
+        if (pullSample(&m_window[m_windowCount * m_bytesPerSample]))
+            ++m_windowCount;
+        else
+            m_streamDone = true;
+    }
+
+    if (m_windowCount == 0)
+    {
+        stopPass();
+        return nullptr;
+    }
+
+    // take a random sample
+    std::uniform_int_distribution<size_t> distribution(0, m_windowCount - 1);
+    std::uint8_t* const pSlot = &m_window[distribution(Global::rng()) * m_bytesPerSample];
+    FileIO::DecodeSample(m_shards.front().header, pSlot[0], pSlot + 1, m_raw);
+    m_current = Trainer(m_raw);
+
+    // replace it
+    if (m_streamDone || !pullSample(pSlot))
+    {
+        m_streamDone = true;
+        --m_windowCount;
+        std::uint8_t* const pLast = &m_window[m_windowCount * m_bytesPerSample];
+        if (pLast != pSlot)
+            std::memcpy(pSlot, pLast, m_bytesPerSample);
+    }
+
+    return &m_current;
+}
+
+
+/** Copy the next sample of the stream, in shard order, into packed form.
+Waits for the prefetch thread if the next chunk is not ready.
+@param[out] pDest Space for one packed sample.
+@return false at the end of the stream.
+*/
+bool StreamingDataSource::pullSample(std::uint8_t* pDest)
+{
+    for (;;)
+    {
+        Chunk& chunk = m_chunks[m_consumeIndex % m_chunks.size()];
+
+        // the consumer owns a ready chunk until it hands it back
+        if (m_consuming && chunk.next < chunk.numSamples)
+        {
+            const size_t pixelBytes = m_bytesPerSample - 1;
+            pDest[0] = chunk.labels[chunk.next];
+            std::memcpy(pDest + 1, &chunk.pixels[chunk.next * pixelBytes], pixelBytes);
+            ++chunk.next;
+            return true;
+        }
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (m_consuming)
+        {
+            // drained. Give the buffer back to the prefetch thread.
+            chunk.ready = false;
+            m_consuming = false;
+            ++m_consumeIndex;
+            lock.unlock();
+            m_condition.notify_all();
+            continue;
+        }
+
+        m_condition.wait(lock, [&]() { return chunk.ready || m_producerDone; });
+        if (!chunk.ready)
+            return false;
+        m_consuming = true;
+    }
+}
+
+
+// ------------------------------------------------------------------
+// producer
+
+/** The prefetch thread.
+@param[in] shardOrder The order in which to read the shards.
+*/
+void StreamingDataSource::prefetch(const std::vector<size_t> shardOrder)
+{
+    Trace::SetThreadName("shard reader");
+    for (const size_t index : shardOrder)
+    {
+        if (!readShard(m_shards[index]))
+            break;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_producerDone = true;
+    }
+    m_condition.notify_all();
+}
+
+
+/** Read one shard into the chunk buffers, verifying its labels and checksum.
+@param[in] shard The shard to read.
+@return false if the pass was stopped or the shard could not be read.
+*/
+bool StreamingDataSource::readShard(const Shard& shard)
+{
+    ScopedTimer timer("read shard");
+    const auto& header = shard.header;
+    const size_t pixelBytes = header.GetBytesPerSample();
+
+    std::ifstream fin(shard.path.c_str(), std::ios::binary);
+    fin.seekg(FileIO::DATASET_HEADER_SIZE);
+    if (!fin)
+    {
+        fail(FileIO::LoadResult::FILE_NOT_FOUND);
+        return false;
+    }
+
+    // everything between the header and the pixels: the labels and their padding
+    FileIO::ChecksumStream checksum(header.pixelsOffset - FileIO::DATASET_HEADER_SIZE + header.numSamples * pixelBytes);
+    std::vector<std::uint8_t> prefix(size_t(header.pixelsOffset) - FileIO::DATASET_HEADER_SIZE);
+    fin.read(reinterpret_cast<char*>(prefix.data()), prefix.size());
+    checksum.Update(prefix.data(), prefix.size());
+    const std::uint8_t* const pLabels = prefix.data() + (header.labelsOffset - FileIO::DATASET_HEADER_SIZE);
+    if (!fin || !FileIO::CheckLabels(pLabels, size_t(header.numSamples)))
+    {
+        fail(fin ? FileIO::LoadResult::FILE_BAD_FORMAT : FileIO::LoadResult::UNEXPECTED_ERROR);
+        return false;
+    }
+
+    for (size_t first = 0; first < header.numSamples; first += m_chunkSamples)
+    {
+        Chunk& chunk = m_chunks[m_produceIndex % m_chunks.size()];
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_condition.wait(lock, [&]() { return m_stop || !chunk.ready; });
+            if (m_stop)
+                return false;
+        }
+
+        // the consumer does not touch a chunk that is not ready
+        const size_t count = std::min<size_t>(m_chunkSamples, size_t(header.numSamples) - first);
+        chunk.labels.assign(pLabels + first, pLabels + first + count);
+        chunk.pixels.resize(count * pixelBytes);
+        fin.read(reinterpret_cast<char*>(chunk.pixels.data()), chunk.pixels.size());
+        if (!fin)
+        {
+            fail(FileIO::LoadResult::UNEXPECTED_ERROR);
+            return false;
+        }
+        checksum.Update(chunk.pixels.data(), chunk.pixels.size());
+
+        // a corrupt shard ends the pass with an error before its last chunk is handed out
+        if (first + count == header.numSamples && checksum.Finish() != header.checksum)
+        {
+            fail(FileIO::LoadResult::FILE_CORRUPT);
+            return false;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            chunk.numSamples = count;
+            chunk.next       = 0;
+            chunk.ready      = true;
+        }
+        m_condition.notify_all();
+        ++m_produceIndex;
+    }
+
+    return true;
+}
+
+
+/** Record an error from the prefetch thread. The pass ends early.
+*/
+void StreamingDataSource::fail(const FileIO::LoadResult error)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_error == FileIO::LoadResult::SUCCESS)
+        m_error = error;
+}
+
+
+}
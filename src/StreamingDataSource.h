@@ -0,0 +1,134 @@
+// ==================================================================
+// Copyright (c) 2019 Alexander Freed. ALL RIGHTS RESERVED.
+// Language: ISO C++14
+//
+// StreamingDataSource class declaration.
+// Streams a sharded dataset from disk with bounded memory.
+// ==================================================================
+
+#pragma once
+
+#include "DatasetFile.h"
+#include "FileIO.h"
+#include "Trainer.h"
+
+#include <array>
+#include <condition_variable>
+#include <cstdint>
+#include <iterator>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+namespace fnn {
+
+
+/** Reads a sharded dataset (see FileIO::WriteShards) in chunks on a background thread.
+Every pass visits the shards in a random order and shuffles the samples within a bounded window.
+Memory use is bounded by the budget given to Open: half goes to the shuffle window and a quarter
+to each of the two chunk buffers. Samples are held in their stored (packed) form until they are handed out.
+Iterating starts a new pass, so the source can be used anywhere a container of Trainers is iterated once.
+*/
+class StreamingDataSource
+{
+public:
+    /** Single-pass input iterator over one pass of the source.
+    */
+    class Iterator
+    {
+    public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type        = Trainer;
+        using difference_type   = std::ptrdiff_t;
+        using pointer           = const Trainer*;
+        using reference         = const Trainer&;
+
+        Iterator() = default;
+        explicit Iterator(StreamingDataSource* pSource) : m_pSource(pSource), m_pCurrent(pSource->next()) { }
+
+        reference operator*() const { return *m_pCurrent; }
+        pointer operator->() const { return m_pCurrent; }
+        Iterator& operator++() { m_pCurrent = m_pSource->next(); return *this; }
+        bool operator==(const Iterator& other) const { return m_pCurrent == other.m_pCurrent; }
+        bool operator!=(const Iterator& other) const { return m_pCurrent != other.m_pCurrent; }
+
+    private:
+        StreamingDataSource* m_pSource  = nullptr;
+        const Trainer*       m_pCurrent = nullptr;
+    };
+
+    StreamingDataSource() = default;
+    ~StreamingDataSource();
+
+    StreamingDataSource(const StreamingDataSource&) = delete;
+    StreamingDataSource& operator=(const StreamingDataSource&) = delete;
+
+    FileIO::LoadResult Open(const std::vector<std::string>& shardPaths, const size_t memoryBudgetBytes);
+
+    Iterator begin();
+    Iterator end() { return Iterator(); }
+    // named like a container so the source can be passed to the generic evaluation code
+    size_t size() const { return m_numSamples; }
+
+    FileIO::LoadResult GetError() const { return m_error; }
+
+private:
+    struct Shard
+    {
+        std::string           path;
+        FileIO::DatasetHeader header;
+    };
+
+    /** A run of consecutive samples from one shard.
+    */
+    struct Chunk
+    {
+        std::vector<std::uint8_t> labels;
+        std::vector<std::uint8_t> pixels;
+        size_t                    numSamples = 0;
+        size_t                    next       = 0;  // the next sample for the consumer
+        bool                      ready      = false;
+    };
+
+    void startPass();
+    void stopPass();
+    const Trainer* next();
+    bool pullSample(std::uint8_t* pDest);
+    void prefetch(const std::vector<size_t> shardOrder);
+    bool readShard(const Shard& shard);
+    void fail(const FileIO::LoadResult error);
+
+    // dataset
+    std::vector<Shard> m_shards;
+    size_t             m_numSamples     = 0;
+    size_t             m_bytesPerSample = 0;  // packed: one label byte followed by the pixels
+    size_t             m_chunkSamples   = 0;
+
+    // double buffer shared with the prefetch thread
+    std::array<Chunk, 2>    m_chunks;
+    size_t                  m_consumeIndex = 0;      // consumer only
+    size_t                  m_produceIndex = 0;      // producer only
+    bool                    m_consuming    = false;  // consumer only. true while it owns m_chunks[m_consumeIndex]
+    bool                    m_producerDone = false;
+    bool                    m_stop         = false;
+    std::mutex              m_mutex;
+    std::condition_variable m_condition;
+    std::thread             m_thread;
+
+    // shuffle window. Packed samples.
+    std::vector<std::uint8_t> m_window;
+    size_t                    m_windowCapacity = 0;
+    size_t                    m_windowCount    = 0;
+    bool                      m_streamDone     = false;
+
+    // the sample most recently handed out
+    RawTrainer m_raw;
+    Trainer    m_current;
+
+    FileIO::LoadResult m_error = FileIO::LoadResult::SUCCESS;
+};
+
+
+}
@@ -0,0 +1,316 @@
+// ==================================================================
+// Copyright (c) 2019 Alexander Freed. ALL RIGHTS RESERVED.
+// Language: ISO C++14
+//
+// Hyperparameter sweep definitions.
+// ==================================================================
+
+#include "Sweep.h"
+
+#include "NeuralNet.h"
+#include "Numa.h"
+#include "Utility.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <mutex>
+#include <numeric>
+#include <random>
+#include <sstream>
+#include <thread>
+
+
+namespace fnn {
+
+
+namespace {
+
+
+/** Draw a value of a hyperparameter.
+@param[in]     axis        The list or range.
+@param[in]     logarithmic true to draw from a range log-uniformly, for scale parameters.
+@param[in/out] rng         The random number stream.
+@return The value.
+*/
+double draw(const SweepAxis& axis, const bool logarithmic, Rng& rng)
+{
+    if (!axis.IsRange())
+        return axis.values[std::uniform_int_distribution<size_t>(0, axis.values.size() - 1)(rng)];
+    if (logarithmic)
+        return std::exp(std::uniform_real_distribution<double>(std::log(axis.low), std::log(axis.high))(rng));
+    return std::uniform_real_distribution<double>(axis.low, axis.high)(rng);
+}
+
+
+/** Train one run.
+The weights and every epoch's order come from streams of the run's index, so a run gives the same result
+whichever thread runs it and whatever else runs beside it.
+@param[in] trainingSet   The training set. Shared, read only.
+@param[in] testSet       The test set. Shared, read only.
+@param[in] run           The configuration.
+@param[in] numEpochs     The most epochs to run.
+@param[in] schedule      The learning rate schedule, relative to the run's learning rate.
+@param[in] earlyStopping When to stop before numEpochs.
+@return The outcome.
+*/
+SweepResult train(const std::vector<Trainer>& trainingSet, const std::vector<Trainer>& testSet, const SweepRun& run,
+                  const unsigned numEpochs, const LearningRateSchedule& schedule, EarlyStopping earlyStopping)
+{
+    using Clock = std::chrono::steady_clock;
+
+    SweepResult result;
+    result.run = run;
+
+    Rng weightsRng = Global::stream(StreamUse::SWEEP, run.index, 0);
+    NeuralNetDigitClassifier neuralnet(run.numHidden, weightsRng);
+
+    OptimizerSettings settings;
+    settings.type     = run.optimizer;
+    settings.momentum = run.momentum;
+    Optimizer optimizer(settings);
+
+    std::vector<size_t> order(trainingSet.size());
+    std::iota(order.begin(), order.end(), size_t(0));
+
+    for (unsigned epoch = 0; epoch < numEpochs && !earlyStopping.ShouldStop(); ++epoch)
+    {
+        const Clock::time_point start = Clock::now();
+        optimizer.SetLearningRate(run.learningRate * schedule.Rate(epoch));
+        Rng orderRng = Global::stream(StreamUse::SWEEP, run.index, epoch + 1);
+        std::shuffle(order.begin(), order.end(), orderRng);
+        for (const size_t i : order)
+            neuralnet.TrainFromInput(trainingSet[i].GetInputs(), NeuralNetDigitClassifier::EncodeTarget(trainingSet[i].GetTarget()), optimizer);
+        result.epochSeconds.push_back(std::chrono::duration<double>(Clock::now() - start).count());
+
+        result.testAccuracy.push_back(Evaluate(neuralnet, testSet));
+        earlyStopping.Update(epoch + 1, result.testAccuracy.back());
+        if (result.testAccuracy.back() > result.bestAccuracy)
+        {
+            result.bestAccuracy = result.testAccuracy.back();
+            result.bestEpoch    = epoch + 1;
+        }
+    }
+    return result;
+}
+
+
+}  // namespace
+
+
+/** Make a hyperparameter that takes one value, e.g. one that is not swept.
+@param[in] value The value.
+@return The axis, a list of the value.
+*/
+SweepAxis SweepAxis::Single(const double value)
+{
+    SweepAxis axis;
+    axis.values.push_back(value);
+    return axis;
+}
+
+
+/** Parse the values of a hyperparameter.
+@param[in]  text     A comma-separated list, "20,50,100", or a range, "0.01:0.5".
+@param[in]  lowest   The smallest value allowed, in a list or a range. The smallest positive double
+                     (std::numeric_limits<double>::denorm_min()) allows any value above 0.
+@param[out] out_axis The values.
+@return false if the text could not be parsed, a range is empty, or a value is below lowest.
+*/
+bool SweepAxis::Parse(const std::string& text, const double lowest, SweepAxis& out_axis)
+{
+    SweepAxis axis;
+    try
+    {
+        const size_t colon = text.find(':');
+        if (colon != std::string::npos)
+        {
+            size_t lowEnd, highEnd;
+            axis.low  = std::stod(text.substr(0, colon), &lowEnd);
+            axis.high = std::stod(text.substr(colon + 1), &highEnd);
+            if (lowEnd != colon || highEnd != text.size() - colon - 1 || !(axis.low >= lowest && axis.low <= axis.high))
+                return false;
+        }
+        else
+        {
+            std::istringstream list(text);
+            std::string value;
+            while (std::getline(list, value, ','))
+            {
+                size_t end;
+                axis.values.push_back(std::stod(value, &end));
+                if (end != value.size() || !(axis.values.back() >= lowest))
+                    return false;
+            }
+            if (axis.values.empty())
+                return false;
+        }
+    }
+    catch (...)
+    {
+        return false;
+    }
+    out_axis = axis;
+    return true;
+}
+
+
+/** Make the runs of a sweep.
+@param[in]     spec     What to sweep.
+@param[in/out] rng      The random number stream of a random search.
+@param[out]    out_runs The runs, indexed in order.
+@return false if a grid has a range, as ranges need a random search.
+*/
+bool MakeSweepRuns(const SweepSpec& spec, Rng& rng, std::vector<SweepRun>& out_runs)
+{
+    std::vector<SweepRun> runs;
+    if (spec.randomRuns > 0)
+    {
+        for (size_t i = 0; i < spec.randomRuns; ++i)
+        {
+            SweepRun run;
+            run.index        = static_cast<unsigned>(i);
+            run.optimizer    = spec.optimizers[std::uniform_int_distribution<size_t>(0, spec.optimizers.size() - 1)(rng)];
+            run.numHidden    = std::max(1u, static_cast<unsigned>(std::lround(draw(spec.numHidden, true, rng))));
+            run.learningRate = draw(spec.learningRate, true, rng);
+            run.momentum     = draw(spec.momentum, false, rng);
+            runs.push_back(run);
+        }
+    }
+    else
+    {
+        if (spec.numHidden.IsRange() || spec.learningRate.IsRange() || spec.momentum.IsRange())
+            return false;
+        for (const OptimizerType optimizer : spec.optimizers)
+            for (const double numHidden : spec.numHidden.values)
+                for (const double learningRate : spec.learningRate.values)
+                    for (const double momentum : spec.momentum.values)
+                        runs.push_back(SweepRun{ static_cast<unsigned>(runs.size()), optimizer,
+                                                 std::max(1u, static_cast<unsigned>(std::lround(numHidden))), learningRate, momentum });
+    }
+    out_runs = std::move(runs);
+    return true;
+}
+
+
+/** Train the runs of a sweep concurrently.
+Each worker thread takes the next run from a shared queue until the queue is empty.
+The queue holds the largest networks first, so the last runs to finish are short ones.
+@param[in] trainingSet   The training set. Shared by every run, read only.
+@param[in] testSet       The test set. Shared by every run, read only.
+@param[in] runs          The runs.
+@param[in] numEpochs     The most epochs of each run.
+@param[in] schedule      The learning rate schedule, relative to each run's learning rate (base rate 1).
+@param[in] earlyStopping When to stop a run before numEpochs. Each run gets its own copy.
+@param[in] numThreads    The number of worker threads. Usually the number of cores.
+@param[in] log           Where to report each finished run.
+@param[in] pTopology     [default: nullptr] If not null, each worker is pinned to a CPU, spread over the nodes, and with
+                         more than one node, each node's workers read a copy of the data sets in the node's own memory.
+                         A run's network and optimizer are made on its worker, so they are in that memory too.
+@return The results, in the order of the runs. The same with or without a topology.
+*/
+std::vector<SweepResult> RunSweep(const std::vector<Trainer>& trainingSet, const std::vector<Trainer>& testSet,
+                                  const std::vector<SweepRun>& runs, const unsigned numEpochs, const LearningRateSchedule& schedule,
+                                  const EarlyStopping& earlyStopping, const unsigned numThreads, std::ostream& log,
+                                  const NumaTopology* pTopology)
+{
+    // the cost of a run is about proportional to its hidden layer
+    std::vector<size_t> queue(runs.size());
+    std::iota(queue.begin(), queue.end(), size_t(0));
+    std::stable_sort(queue.begin(), queue.end(), [&runs](const size_t a, const size_t b) { return runs[a].numHidden > runs[b].numHidden; });
+
+    std::vector<SweepResult> results(runs.size());
+    std::atomic<size_t> next(0);
+    std::mutex logMutex;
+    size_t numFinished = 0;
+
+    const unsigned numWorkers = static_cast<unsigned>(std::max<size_t>(std::min<size_t>(numThreads, runs.size()), 1));
+
+    // copy the data sets for each node with workers, on a thread of the node, so the copy is in its memory
+    const size_t numCopies = pTopology != nullptr && pTopology->GetNumNodes() > 1 ? pTopology->GetNumNodes() : 0;
+    std::vector<std::vector<Trainer>> trainingCopies(numCopies);
+    std::vector<std::vector<Trainer>> testCopies(numCopies);
+    {
+        std::vector<bool> hasWorkers(numCopies, false);
+        for (unsigned worker = 0; worker < numWorkers && numCopies > 0; ++worker)
+            hasWorkers[pTopology->NodeOfThread(worker, numWorkers)] = true;
+        std::vector<std::thread> copiers;
+        for (size_t node = 0; node < numCopies; ++node)
+        {
+            if (!hasWorkers[node])
+                continue;
+            copiers.emplace_back([&, node]() {
+                PinThreadToCpus(pTopology->GetNodes()[node].cpus);
+                trainingCopies[node] = trainingSet;
+                testCopies[node]     = testSet;
+            });
+        }
+        for (auto& copier : copiers)
+            copier.join();
+    }
+
+    const auto work = [&](const unsigned worker) {
+        const std::vector<unsigned> previousCpus = pTopology != nullptr ? GetThreadCpus() : std::vector<unsigned>();
+        if (pTopology != nullptr)
+            PinThreadToCpus({ pTopology->CpuOfThread(worker, numWorkers) });
+        const size_t node = numCopies > 0 ? pTopology->NodeOfThread(worker, numWorkers) : 0;
+        const std::vector<Trainer>& localTrainingSet = numCopies > 0 ? trainingCopies[node] : trainingSet;
+        const std::vector<Trainer>& localTestSet     = numCopies > 0 ? testCopies[node]     : testSet;
+
+        for (size_t i = next++; i < queue.size(); i = next++)
+        {
+            const SweepRun& run = runs[queue[i]];
+            results[queue[i]] = train(localTrainingSet, localTestSet, run, numEpochs, schedule, earlyStopping);
+
+            const SweepResult& result = results[queue[i]];
+            std::lock_guard<std::mutex> lock(logMutex);
+            log << "[" << ++numFinished << "/" << runs.size() << "] run " << run.index << ": "
+                << Optimizer::TypeName(run.optimizer) << ", " << run.numHidden << " hidden, learning rate " << run.learningRate
+                << ", momentum " << run.momentum << " -> " << result.bestAccuracy * 100 << "% at epoch " << result.bestEpoch << std::endl;
+        }
+        // the calling thread is worker 0, and goes back to running where it could before
+        if (!previousCpus.empty())
+            PinThreadToCpus(previousCpus);
+    };
+
+    std::vector<std::thread> threads;
+    for (unsigned worker = 1; worker < numWorkers; ++worker)
+        threads.emplace_back(work, worker);
+    work(0);
+    for (auto& thread : threads)
+        thread.join();
+    return results;
+}
+
+
+/** Write the results of a sweep as a CSV table, one row per run.
+@param[in] path    The file to write.
+@param[in] results The results.
+@return false if the file could not be written.
+*/
+bool WriteSweepTable(const std::string& path, const std::vector<SweepResult>& results)
+{
+    std::ofstream fout(path.c_str());
+    fout << "run,optimizer,hidden,learning_rate,momentum,epochs,final_test_accuracy,best_test_accuracy,best_epoch,"
+            "mean_epoch_seconds,epoch_seconds\n";
+    for (const SweepResult& result : results)
+    {
+        const size_t epochs = result.epochSeconds.size();
+        const double totalSeconds = std::accumulate(result.epochSeconds.begin(), result.epochSeconds.end(), 0.0);
+        fout << result.run.index << ',' << Optimizer::TypeName(result.run.optimizer) << ',' << result.run.numHidden << ','
+             << result.run.learningRate << ',' << result.run.momentum << ',' << epochs << ','
+             << (epochs > 0 ? result.testAccuracy.back() : 0) << ',' << result.bestAccuracy << ',' << result.bestEpoch << ','
+             << (epochs > 0 ? totalSeconds / epochs : 0) << ',';
+        // the epoch times share one column
+        for (size_t i = 0; i < epochs; ++i)
+            fout << (i > 0 ? " " : "") << result.epochSeconds[i];
+        fout << '\n';
+    }
+    fout.flush();
+    return static_cast<bool>(fout);
+}
+
+
+}
@@ -0,0 +1,89 @@
+// ==================================================================
+// Copyright (c) 2019 Alexander Freed. ALL RIGHTS RESERVED.
+// Language: ISO C++14
+//
+// Hyperparameter sweeps.
+// Many networks are trained at once, one per core, from one read-only copy of the data sets, or one per NUMA node.
+// ==================================================================
+
+#pragma once
+
+#include "Optimizer.h"
+#include "Random.h"
+#include "Trainer.h"
+#include "TrainingSchedule.h"
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+
+namespace fnn {
+
+
+class NumaTopology;
+
+
+/** The values of one hyperparameter: a list, or a range to draw from in a random search.
+*/
+struct SweepAxis
+{
+    std::vector<double> values;    // empty for a range
+    double              low  = 0;  // range only
+    double              high = 0;  // range only
+
+    bool IsRange() const { return values.empty(); }
+
+    static SweepAxis Single(const double value);
+    static bool      Parse(const std::string& text, const double lowest, SweepAxis& out_axis);
+};
+
+
+/** What to sweep. A grid runs every combination of the listed values.
+A random search draws each hyperparameter of each run from its list or range.
+*/
+struct SweepSpec
+{
+    std::vector<OptimizerType> optimizers;
+    SweepAxis                  numHidden;
+    SweepAxis                  learningRate;
+    SweepAxis                  momentum;
+    size_t                     randomRuns = 0;  // 0: grid
+};
+
+
+/** The configuration of one run.
+*/
+struct SweepRun
+{
+    unsigned      index;  // selects the run's random streams
+    OptimizerType optimizer;
+    unsigned      numHidden;
+    double        learningRate;
+    double        momentum;
+};
+
+
+/** The outcome of one run.
+*/
+struct SweepResult
+{
+    SweepRun            run;
+    std::vector<double> epochSeconds;  // the training time of each epoch
+    std::vector<double> testAccuracy;  // after each epoch
+    unsigned            bestEpoch    = 0;
+    double              bestAccuracy = 0;
+};
+
+
+// function prototypes
+
+bool MakeSweepRuns(const SweepSpec& spec, Rng& rng, std::vector<SweepRun>& out_runs);
+std::vector<SweepResult> RunSweep(const std::vector<Trainer>& trainingSet, const std::vector<Trainer>& testSet,
+                                  const std::vector<SweepRun>& runs, const unsigned numEpochs, const LearningRateSchedule& schedule,
+                                  const EarlyStopping& earlyStopping, const unsigned numThreads, std::ostream& log,
+                                  const NumaTopology* pTopology = nullptr);
+bool WriteSweepTable(const std::string& path, const std::vector<SweepResult>& results);
+
+
+}
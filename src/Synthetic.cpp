@@ -0,0 +1,206 @@
+// ==================================================================
+// Copyright (c) 2019 Alexander Freed. ALL RIGHTS RESERVED.
+// Language: ISO C++14
+//
+// Synthetic MNIST-shaped datasets.
+// ==================================================================
+
+#include "Synthetic.h"
+
+#include "Random.h"
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cmath>
+#include <random>
+#include <thread>
+#include <vector>
+
+
+namespace fnn {
+
+
+namespace {
+
+
+// constants
+
+constexpr int IMAGE_SIZE = 28;
+
+// the digit counts of the MNIST training set, so the classes are as unbalanced as the real ones
+constexpr std::array<double, 10> DIGIT_COUNTS = { 5923, 6742, 5958, 6131, 5842, 5421, 5918, 6265, 5851, 5949 };
+
+
+// classes
+
+struct Point
+{
+    double x;
+    double y;
+};
+
+
+// The digits as pen strokes, one polyline each, in a unit box. x to the right and y down.
+const std::array<std::vector<Point>, 10> GLYPHS = {{
+    { { 0.5, 0 }, { 0.85, 0.15 }, { 1, 0.5 }, { 0.85, 0.85 }, { 0.5, 1 }, { 0.15, 0.85 }, { 0, 0.5 }, { 0.15, 0.15 }, { 0.5, 0 } },
+    { { 0.3, 0.2 }, { 0.55, 0 }, { 0.55, 1 } },
+    { { 0.05, 0.2 }, { 0.3, 0 }, { 0.75, 0 }, { 0.95, 0.2 }, { 0.9, 0.45 }, { 0, 1 }, { 1, 1 } },
+    { { 0.05, 0.1 }, { 0.4, 0 }, { 0.85, 0.1 }, { 0.9, 0.3 }, { 0.4, 0.48 }, { 0.9, 0.65 }, { 0.9, 0.9 }, { 0.5, 1 }, { 0.05, 0.9 } },
+    { { 0.7, 1 }, { 0.7, 0 }, { 0, 0.7 }, { 1, 0.7 } },
+    { { 0.95, 0 }, { 0.15, 0 }, { 0.1, 0.45 }, { 0.6, 0.4 }, { 0.95, 0.6 }, { 0.9, 0.9 }, { 0.5, 1 }, { 0.05, 0.9 } },
+    { { 0.8, 0 }, { 0.3, 0.3 }, { 0.05, 0.7 }, { 0.2, 0.95 }, { 0.6, 1 }, { 0.9, 0.8 }, { 0.8, 0.55 }, { 0.4, 0.5 }, { 0.1, 0.65 } },
+    { { 0, 0 }, { 1, 0 }, { 0.4, 1 } },
+    { { 0.5, 0.48 }, { 0.15, 0.3 }, { 0.2, 0.05 }, { 0.5, 0 }, { 0.8, 0.05 }, { 0.85, 0.3 }, { 0.5, 0.48 },
+      { 0.1, 0.7 }, { 0.2, 0.95 }, { 0.5, 1 }, { 0.8, 0.95 }, { 0.9, 0.7 }, { 0.5, 0.48 } },
+    { { 0.9, 0.35 }, { 0.6, 0.5 }, { 0.2, 0.45 }, { 0.1, 0.2 }, { 0.4, 0 }, { 0.8, 0.05 }, { 0.9, 0.35 }, { 0.85, 0.7 }, { 0.5, 1 } },
+}};
+
+
+// functions
+
+/** Draw a digit with the MNIST class frequencies.
+@param[in] u A uniform random number in [0, 1).
+@return The digit.
+*/
+int drawDigit(const double u)
+{
+    double total = 0;
+    for (const double count : DIGIT_COUNTS)
+        total += count;
+
+    double cumulative = 0;
+    for (int digit = 0; digit < 9; ++digit)
+    {
+        cumulative += DIGIT_COUNTS[digit] / total;
+        if (u < cumulative)
+            return digit;
+    }
+    return 9;
+}
+
+
+/** Get the distance from a point to a line segment.
+@param[in] p The point.
+@param[in] a One end of the segment.
+@param[in] b The other end.
+@return The distance.
+*/
+double segmentDistance(const Point& p, const Point& a, const Point& b)
+{
+    const double dx = b.x - a.x;
+    const double dy = b.y - a.y;
+    const double lengthSquared = dx * dx + dy * dy;
+    const double t = lengthSquared > 0 ? std::min(std::max(((p.x - a.x) * dx + (p.y - a.y) * dy) / lengthSquared, 0.0), 1.0) : 0.0;
+    const double ex = p.x - (a.x + t * dx);
+    const double ey = p.y - (a.y + t * dy);
+    return std::sqrt(ex * ex + ey * ey);
+}
+
+
+}  // namespace
+
+
+/** Make one sample of a synthetic dataset.
+The digit is drawn with the MNIST class frequencies, then its pen strokes are placed with a random size,
+aspect, slant, rotation, position and wobble, and drawn anti-aliased with a random pen width. Like MNIST,
+the digits fit a 20x20 box in the middle of the 28x28 image, about a fifth of the pixels are non-zero,
+and the strokes are saturated in the middle with grey edges.
+Each sample is drawn from its own random stream, so it depends only on the seed, split and index.
+@param[in]  seed        The seed of the dataset.
+@param[in]  split       The split of the dataset.
+@param[in]  index       The index of the sample in the split.
+@param[out] out_label   The digit 0-9.
+@param[out] out_pPixels The 28x28 pixels 0-255, row by row.
+*/
+void MakeSyntheticSample(const std::uint64_t seed, const SyntheticSplit split, const std::uint32_t index,
+                         std::uint8_t& out_label, std::uint8_t* const out_pPixels)
+{
+    Rng rng(seed, MakeStreamId(StreamUse::SYNTHETIC, static_cast<std::uint32_t>(split), index));
+    std::uniform_real_distribution<double> uniform(0, 1);
+    const auto between = [&](const double low, const double high) { return low + (high - low) * uniform(rng); };
+
+    const int digit = drawDigit(uniform(rng));
+    out_label = static_cast<std::uint8_t>(digit);
+
+    const double height   = between(14, 20);
+    const double width    = height * between(0.5, 0.9);
+    const double slant    = between(-0.3, 0.2);
+    const double angle    = between(-0.3, 0.3);
+    const double centreX  = IMAGE_SIZE / 2.0 + between(-2, 2);
+    const double centreY  = IMAGE_SIZE / 2.0 + between(-2, 2);
+    const double penWidth = between(1.1, 2.3);
+    const double wobble   = 1.8;  // pixels
+
+    // place the strokes
+    std::vector<Point> stroke;
+    Point low  = { IMAGE_SIZE, IMAGE_SIZE };
+    Point high = { 0, 0 };
+    for (const Point& glyphPoint : GLYPHS[digit])
+    {
+        const double x = (glyphPoint.x - 0.5) * width + slant * (0.5 - glyphPoint.y) * height + between(-wobble, wobble);
+        const double y = (glyphPoint.y - 0.5) * height + between(-wobble, wobble);
+        const Point point = { centreX + x * std::cos(angle) - y * std::sin(angle), centreY + x * std::sin(angle) + y * std::cos(angle) };
+        stroke.push_back(point);
+        low  = { std::min(low.x, point.x), std::min(low.y, point.y) };
+        high = { std::max(high.x, point.x), std::max(high.y, point.y) };
+    }
+
+    // draw them. Full intensity within the pen, fading to 0 over a pixel beyond it.
+    std::fill(out_pPixels, out_pPixels + IMAGE_SIZE * IMAGE_SIZE, 0);
+    const double reach = penWidth / 2 + 1;
+    const int firstX = std::max(0, static_cast<int>(std::floor(low.x - reach)));
+    const int lastX  = std::min(IMAGE_SIZE - 1, static_cast<int>(std::ceil(high.x + reach)));
+    const int firstY = std::max(0, static_cast<int>(std::floor(low.y - reach)));
+    const int lastY  = std::min(IMAGE_SIZE - 1, static_cast<int>(std::ceil(high.y + reach)));
+    for (int y = firstY; y <= lastY; ++y)
+    {
+        for (int x = firstX; x <= lastX; ++x)
+        {
+            const Point centre = { x + 0.5, y + 0.5 };
+            double distance = reach;
+            for (size_t i = 1; i < stroke.size(); ++i)
+                distance = std::min(distance, segmentDistance(centre, stroke[i - 1], stroke[i]));
+            const double intensity = std::min(std::max(reach - distance, 0.0), 1.0);
+            out_pPixels[y * IMAGE_SIZE + x] = static_cast<std::uint8_t>(std::lround(255 * intensity));
+        }
+    }
+}
+
+
+/** Make a synthetic dataset. See MakeSyntheticSample.
+Deterministic: the same arguments always give the same samples, however many threads make them,
+and a smaller dataset is the start of a larger one.
+@param[in] numSamples The number of samples. Less than 2^32.
+@param[in] split      The split of the dataset.
+@param[in] seed       [default: SYNTHETIC_SEED] The seed of the dataset.
+@return The samples in stored form.
+*/
+FileIO::PackedDataset MakeSyntheticDataset(const size_t numSamples, const SyntheticSplit split, const std::uint64_t seed)
+{
+    assert(numSamples <= 0xFFFFFFFF);
+
+    FileIO::PackedDataset packed;
+    packed.imageRows = IMAGE_SIZE;
+    packed.imageCols = IMAGE_SIZE;
+    packed.labels.resize(numSamples);
+    packed.pixels.resize(numSamples * packed.GetPixelsPerSample());
+
+    const auto makeSamples = [&](const size_t first, const size_t step) {
+        for (size_t i = first; i < numSamples; i += step)
+            MakeSyntheticSample(seed, split, static_cast<std::uint32_t>(i), packed.labels[i], &packed.pixels[i * packed.GetPixelsPerSample()]);
+    };
+
+    const size_t numThreads = std::min<size_t>(std::max<size_t>(numSamples, 1), std::max(1u, std::thread::hardware_concurrency()));
+    std::vector<std::thread> threads;
+    for (size_t t = 1; t < numThreads; ++t)
+        threads.emplace_back(makeSamples, t, numThreads);
+    makeSamples(0, numThreads);
+    for (auto& thread : threads)
+        thread.join();
+
+    return packed;
+}
+
+
+}
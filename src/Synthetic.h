@@ -0,0 +1,40 @@
+// ==================================================================
+// Copyright (c) 2019 Alexander Freed. ALL RIGHTS RESERVED.
+// Language: ISO C++14
+//
+// Synthetic MNIST-shaped datasets.
+// Stand-ins for the real files in tests and benchmarks, at any size.
+// ==================================================================
+
+#pragma once
+
+#include "FileIO.h"
+
+#include <cstdint>
+
+
+namespace fnn {
+
+
+// constants
+
+constexpr std::uint64_t SYNTHETIC_SEED = 0x4D4E495354;  // the seed of the files --write-synthetic writes
+
+
+/** Which split of a synthetic dataset a sample belongs to. The splits never share a sample.
+*/
+enum class SyntheticSplit : std::uint32_t
+{
+    TRAIN = 0,
+    TEST  = 1
+};
+
+
+// function prototypes
+
+void MakeSyntheticSample(const std::uint64_t seed, const SyntheticSplit split, const std::uint32_t index,
+                         std::uint8_t& out_label, std::uint8_t* const out_pPixels);
+FileIO::PackedDataset MakeSyntheticDataset(const size_t numSamples, const SyntheticSplit split, const std::uint64_t seed = SYNTHETIC_SEED);
+
+
+}
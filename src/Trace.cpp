@@ -0,0 +1,347 @@
+// ==================================================================
+// Copyright (c) 2019 Alexander Freed. ALL RIGHTS RESERVED.
+// Language: ISO C++14
+//
+// Trace class definition.
+// ==================================================================
+
+#include "Trace.h"
+
+#include "Utility.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+
+namespace fnn {
+
+
+std::atomic<bool> Trace::s_enabled(false);
+
+
+namespace {
+
+
+// classes
+
+struct Event
+{
+    const char*   name;
+    int           epoch;
+    int           row;
+    std::uint64_t startNs;
+    std::uint64_t endNs;
+};
+
+
+struct CounterSample
+{
+    const char*   name;
+    double        value;
+    std::uint64_t timeNs;
+};
+
+
+/** The events of one thread. Only that thread appends, but the lock lets the log be read while it runs.
+*/
+struct ThreadLog
+{
+    std::mutex                 mutex;
+    int                        row = -1;  // -1 until named, or until it records unnamed
+    std::vector<Event>         events;
+    std::vector<CounterSample> counters;
+};
+
+
+/** Every thread's log, and the rows they are shown in.
+*/
+struct Registry
+{
+    std::mutex                              mutex;
+    std::vector<std::unique_ptr<ThreadLog>> logs;      // kept after their threads end
+    std::vector<std::string>                rowNames;
+    std::uint64_t                           originNs = 0;
+};
+
+
+// functions
+
+Registry& registry()
+{
+    static Registry instance;
+    return instance;
+}
+
+
+/** Get the row of a thread name, adding it if it is new. Call with the registry locked.
+*/
+int rowOf(Registry& reg, const std::string& name)
+{
+    const auto found = std::find(reg.rowNames.begin(), reg.rowNames.end(), name);
+    if (found != reg.rowNames.end())
+        return static_cast<int>(found - reg.rowNames.begin());
+    reg.rowNames.push_back(name);
+    return static_cast<int>(reg.rowNames.size() - 1);
+}
+
+
+/** Get the calling thread's log, creating it on first use.
+*/
+ThreadLog& threadLog()
+{
+    thread_local ThreadLog* pLog = nullptr;
+    if (pLog == nullptr)
+    {
+        Registry& reg = registry();
+        std::lock_guard<std::mutex> lock(reg.mutex);
+        reg.logs.push_back(std::make_unique<ThreadLog>());
+        pLog = reg.logs.back().get();
+    }
+    return *pLog;
+}
+
+
+/** Copy every thread's events.
+@param[out] out_counters The counter samples.
+@return The events, in start order.
+*/
+std::vector<Event> collectEvents(std::vector<CounterSample>& out_counters)
+{
+    std::vector<Event> events;
+    out_counters.clear();
+    Registry& reg = registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    for (const auto& pLog : reg.logs)
+    {
+        std::lock_guard<std::mutex> logLock(pLog->mutex);
+        events.insert(events.end(), pLog->events.begin(), pLog->events.end());
+        out_counters.insert(out_counters.end(), pLog->counters.begin(), pLog->counters.end());
+    }
+    std::stable_sort(events.begin(), events.end(), [](const Event& a, const Event& b) { return a.startNs < b.startNs; });
+    return events;
+}
+
+
+}  // namespace
+
+
+/** Start recording. Times in the trace are relative to the first call.
+*/
+void Trace::Enable()
+{
+    Registry& reg = registry();
+    {
+        std::lock_guard<std::mutex> lock(reg.mutex);
+        if (reg.originNs == 0)
+            reg.originNs = Now();
+    }
+    s_enabled.store(true);
+}
+
+
+/** Get the time.
+@return Nanoseconds on a monotonic clock. Never 0.
+*/
+std::uint64_t Trace::Now()
+{
+    const auto sinceEpoch = std::chrono::steady_clock::now().time_since_epoch();
+    return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(sinceEpoch).count()) | 1;
+}
+
+
+/** Name the calling thread. Does nothing if tracing is off.
+@param[in] name The name, e.g. "loader 0".
+*/
+void Trace::SetThreadName(const std::string& name)
+{
+    if (!IsEnabled())
+        return;
+    ThreadLog& log = threadLog();
+    Registry& reg = registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    log.row = rowOf(reg, name);
+}
+
+
+/** Record a phase of the calling thread. See ScopedTimer.
+@param[in] name    The phase. Must outlive the trace.
+@param[in] epoch   The epoch the phase belongs to. -1 for none.
+@param[in] startNs When it started, from Now().
+@param[in] endNs   When it ended, from Now().
+*/
+void Trace::Record(const char* name, const int epoch, const std::uint64_t startNs, const std::uint64_t endNs)
+{
+    ThreadLog& log = threadLog();
+    if (log.row < 0)
+    {
+        Registry& reg = registry();
+        std::lock_guard<std::mutex> lock(reg.mutex);
+        log.row = rowOf(reg, "thread " + std::to_string(reg.rowNames.size() + 1));
+    }
+    std::lock_guard<std::mutex> lock(log.mutex);
+    log.events.push_back(Event{ name, epoch, log.row, startNs, endNs });
+}
+
+
+/** Record a value that changes over the run, such as the training throughput. Does nothing if tracing is off.
+@param[in] name  The counter. Must outlive the trace.
+@param[in] value Its value from now on.
+*/
+void Trace::Counter(const char* name, const double value)
+{
+    if (!IsEnabled())
+        return;
+    ThreadLog& log = threadLog();
+    std::lock_guard<std::mutex> lock(log.mutex);
+    log.counters.push_back(CounterSample{ name, value, Now() });
+}
+
+
+/** Print the total time of each phase on each thread, then the time of each phase in each epoch.
+@param[in] out Where to print.
+*/
+void Trace::PrintSummary(std::ostream& out)
+{
+    std::vector<CounterSample> counters;
+    const std::vector<Event> events = collectEvents(counters);
+    std::vector<std::string> rowNames;
+    {
+        std::lock_guard<std::mutex> lock(registry().mutex);
+        rowNames = registry().rowNames;
+    }
+
+    // per thread
+    struct Total
+    {
+        size_t        count = 0;
+        std::uint64_t ns    = 0;
+    };
+    std::map<std::pair<int, std::string>, Total> totals;
+    std::vector<std::pair<int, std::string>> order;  // rows, then phases in the order they first started
+    for (const Event& event : events)
+    {
+        const auto key = std::make_pair(event.row, std::string(event.name));
+        if (totals.find(key) == totals.end())
+            order.push_back(key);
+        totals[key].count += 1;
+        totals[key].ns    += event.endNs - event.startNs;
+    }
+    std::stable_sort(order.begin(), order.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+
+    out << "\nPhase Times\n"
+        << std::left << std::setw(18) << "thread" << std::setw(24) << "phase"
+        << std::right << std::setw(8) << "count" << std::setw(12) << "total s" << std::setw(12) << "mean ms" << "\n";
+    out << std::fixed;
+    for (const auto& key : order)
+    {
+        const Total& total = totals[key];
+        out << std::left << std::setw(18) << rowNames[key.first] << std::setw(24) << key.second << std::right
+            << std::setw(8) << total.count
+            << std::setprecision(3) << std::setw(12) << total.ns * 1e-9
+            << std::setprecision(3) << std::setw(12) << total.ns * 1e-6 / total.count << "\n";
+    }
+
+    // per epoch, over all threads
+    std::vector<std::string> phases;
+    std::map<int, std::map<std::string, std::uint64_t>> epochs;
+    for (const Event& event : events)
+    {
+        if (event.epoch < 0)
+            continue;
+        if (std::find(phases.begin(), phases.end(), event.name) == phases.end())
+            phases.push_back(event.name);
+        epochs[event.epoch][event.name] += event.endNs - event.startNs;
+    }
+    if (!epochs.empty())
+    {
+        out << "\nEpoch Phase Times (s)\n" << std::setw(6) << "epoch";
+        for (const std::string& phase : phases)
+            out << std::setw(std::max<int>(12, static_cast<int>(phase.size()) + 2)) << phase;
+        out << "\n";
+        for (const auto& epoch : epochs)
+        {
+            out << std::setw(6) << epoch.first << std::setprecision(3);
+            for (const std::string& phase : phases)
+            {
+                const auto found = epoch.second.find(phase);
+                out << std::setw(std::max<int>(12, static_cast<int>(phase.size()) + 2));
+                if (found != epoch.second.end())
+                    out << found->second * 1e-9;
+                else
+                    out << "-";
+            }
+            out << "\n";
+        }
+    }
+    out.unsetf(std::ios::floatfield);
+    out << std::setprecision(6);
+    out.flush();
+}
+
+
+/** Write the recorded phases and counters as a Chrome trace_event JSON file.
+It can be opened in chrome://tracing or Perfetto. Each thread name is a row, each phase a complete ("X") event.
+@param[in] path The file to write.
+@return true if successful.
+*/
+bool Trace::WriteChromeTrace(const std::string& path)
+{
+    std::vector<CounterSample> counters;
+    const std::vector<Event> events = collectEvents(counters);
+    std::vector<std::string> rowNames;
+    std::uint64_t originNs = 0;
+    {
+        std::lock_guard<std::mutex> lock(registry().mutex);
+        rowNames = registry().rowNames;
+        originNs = registry().originNs;
+    }
+    const auto microseconds = [originNs](const std::uint64_t ns) { return (double(ns) - double(originNs)) * 1e-3; };
+
+    std::ofstream fout(path.c_str(), std::ios::out | std::ios::trunc);
+    fout << std::fixed << std::setprecision(3) << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    bool first = true;
+    const auto separate = [&]() {
+        if (!first)
+            fout << ",\n";
+        first = false;
+    };
+
+    for (size_t row = 0; row < rowNames.size(); ++row)
+    {
+        separate();
+        fout << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << row << ",\"args\":{\"name\":";
+        WriteJsonString(fout, rowNames[row]);
+        fout << "}}";
+    }
+    for (const Event& event : events)
+    {
+        separate();
+        fout << "{\"name\":";
+        WriteJsonString(fout, event.name);
+        fout << ",\"cat\":\"phase\",\"ph\":\"X\",\"pid\":1,\"tid\":" << event.row
+             << ",\"ts\":" << microseconds(event.startNs) << ",\"dur\":" << (event.endNs - event.startNs) * 1e-3;
+        if (event.epoch >= 0)
+            fout << ",\"args\":{\"epoch\":" << event.epoch << "}";
+        fout << "}";
+    }
+    for (const CounterSample& counter : counters)
+    {
+        separate();
+        fout << "{\"name\":";
+        WriteJsonString(fout, counter.name);
+        fout << ",\"ph\":\"C\",\"pid\":1,\"ts\":" << microseconds(counter.timeNs) << ",\"args\":{\"value\":" << counter.value << "}}";
+    }
+    fout << "\n]}\n";
+    fout.close();
+    return !fout.fail();
+}
+
+
+}
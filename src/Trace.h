@@ -0,0 +1,76 @@
+// ==================================================================
+// Copyright (c) 2019 Alexander Freed. ALL RIGHTS RESERVED.
+// Language: ISO C++14
+//
+// Trace class declaration.
+// Records how long the phases of a run take, on every thread, for a summary or a Chrome trace.
+// ==================================================================
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+
+
+namespace fnn {
+
+
+/** Process-wide recording of timed phases.
+Off until Enable is called. While off, a ScopedTimer costs one relaxed atomic load and records nothing.
+Each thread appends to its own log, so recording threads do not contend.
+Threads are named with SetThreadName. Threads with the same name, such as the loaders restarted every
+pass, share one row of the summary and the trace.
+*/
+class Trace
+{
+public:
+    static void Enable();
+    static bool IsEnabled() { return s_enabled.load(std::memory_order_relaxed); }
+
+    static std::uint64_t Now();
+    static void SetThreadName(const std::string& name);
+    static void Record(const char* name, const int epoch, const std::uint64_t startNs, const std::uint64_t endNs);
+    static void Counter(const char* name, const double value);
+
+    static void PrintSummary(std::ostream& out);
+    static bool WriteChromeTrace(const std::string& path);
+
+private:
+    static std::atomic<bool> s_enabled;
+};
+
+
+/** Records the time from its construction to its destruction as a phase of the current thread.
+*/
+class ScopedTimer
+{
+public:
+    /** Constructor
+    @param[in] name  The phase. Must outlive the trace, e.g. a string literal.
+    @param[in] epoch [default: -1] The epoch the phase belongs to, 0 for before the first. -1 for none.
+    */
+    explicit ScopedTimer(const char* name, const int epoch = -1)
+        : m_name(name)
+        , m_epoch(epoch)
+        , m_startNs(Trace::IsEnabled() ? Trace::Now() : 0)
+    { }
+
+    ~ScopedTimer()
+    {
+        if (m_startNs != 0)
+            Trace::Record(m_name, m_epoch, m_startNs, Trace::Now());
+    }
+
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+private:
+    const char*   m_name;
+    int           m_epoch;
+    std::uint64_t m_startNs;  // 0 if tracing was off
+};
+
+
+}
@@ -7,7 +7,10 @@
 
 #pragma once
 
+#include "Kernels.h"
+
 #include <array>
+#include <cstdint>
 #include <Eigen/Dense>
 
 
@@ -16,8 +19,32 @@ namespace fnn {
 
 // ------------------------------------------------------------------
 
-constexpr unsigned NUM_INPUTS = 785;  // 28*28 = 184. +1 for bias
+constexpr unsigned NUM_INPUTS    = 785;  // 28*28 = 184. +1 for bias
+constexpr unsigned PADDED_INPUTS = (NUM_INPUTS + 7) / 8 * 8;  // NUM_INPUTS rounded up to whole 64-byte lines of doubles: 792
 using InputType = Eigen::RowVectorXd;
+// accepts an InputType or a map of one, e.g. a row of a staging buffer, without copying
+using InputRef  = Eigen::Ref<const InputType>;
+
+
+/** The non-zero pixels of one sample in compressed sparse row form.
+Points into a memory-mapped SparseDatasetView. The bias input is implied.
+Input i+1 of the dense form is pValues[k] / 255 where pIndices[k] == i, or 0 if i is not listed.
+*/
+struct SparseInput
+{
+    size_t               numNonZero;
+    const std::uint16_t* pIndices;  // pixel indices 0..783, ascending
+    const std::uint8_t*  pValues;   // pixel values 1..255
+};
+
+
+/** The inputs of one sample, already padded with zeros from NUM_INPUTS to PADDED_INPUTS, and 64-byte aligned.
+E.g. a row of the EpochSampler's ring, which the network then reads in place.
+*/
+struct PaddedInput
+{
+    const double* pInputs;  // PADDED_INPUTS values, the last PADDED_INPUTS - NUM_INPUTS 0
+};
 
 
 // ------------------------------------------------------------------
@@ -58,6 +85,20 @@ public:
         : Trainer(rawTrainer.m_target, rawTrainer.m_inputs.data(), rawTrainer.m_inputs.size())
     { }
 
+    /** Construct from stored 8-bit pixels.
+    The bias input is set to 1 and the pixels are scaled to the 0..1 range.
+    @param[in] target    The correct answer for the training inputs.
+    @param[in] pPixels   An array of pixels in the range 0..255.
+    @param[in] numPixels The length of the pixel array.
+    */
+    Trainer(const int target, const std::uint8_t* const pPixels, const size_t numPixels)
+        : m_target(target)
+        , m_inputs(numPixels + 1)
+    {
+        m_inputs[0] = 1.0;
+        PixelsToInputs(pPixels, numPixels, m_inputs.data() + 1);
+    }
+
     int GetTarget() const { return m_target; } 
     const InputType& GetInputs() const { return m_inputs; }
 
@@ -67,4 +108,27 @@ private:
 };
 
 
+// ------------------------------------------------------------------
+
+/** A training/test input in sparse form and its expected value.
+Has the same accessors as Trainer so the generic evaluation code can use either.
+*/
+class SparseTrainer
+{
+public:
+    SparseTrainer() = default;
+    SparseTrainer(const int target, const SparseInput& inputs)
+        : m_target(target)
+        , m_inputs(inputs)
+    { }
+
+    int GetTarget() const { return m_target; }
+    const SparseInput& GetInputs() const { return m_inputs; }
+
+private:
+    int         m_target = 0;
+    SparseInput m_inputs = {};
+};
+
+
 }
@@ -0,0 +1,130 @@
+// ==================================================================
+// Copyright (c) 2019 Alexander Freed. ALL RIGHTS RESERVED.
+// Language: ISO C++14
+//
+// LearningRateSchedule and EarlyStopping class definitions.
+// ==================================================================
+
+#include "TrainingSchedule.h"
+
+#include <cmath>
+
+
+namespace fnn {
+
+
+// ------------------------------------------------------------------
+
+/** Constructor
+@param[in] type         The shape of the schedule after the warmup.
+@param[in] baseRate     The learning rate at the end of the warmup.
+@param[in] numEpochs    The number of epochs of the run, including the warmup.
+@param[in] warmupEpochs The number of epochs of linear warmup. 0 for none.
+@param[in] stepEpochs   STEP: the number of epochs between steps. >0.
+@param[in] stepFactor   STEP: what the rate is multiplied by at each step.
+*/
+LearningRateSchedule::LearningRateSchedule(const ScheduleType type, const double baseRate, const unsigned numEpochs,
+                                           const unsigned warmupEpochs, const unsigned stepEpochs, const double stepFactor)
+    : m_type(type)
+    , m_baseRate(baseRate)
+    , m_numEpochs(numEpochs)
+    , m_warmupEpochs(warmupEpochs)
+    , m_stepEpochs(stepEpochs > 0 ? stepEpochs : 1)
+    , m_stepFactor(stepFactor)
+{ }
+
+
+/** Get the learning rate of an epoch.
+@param[in] epoch The epoch, counting from 0.
+@return The learning rate.
+*/
+double LearningRateSchedule::Rate(const unsigned epoch) const
+{
+    // the warmup ends at the base rate, never at 0
+    if (epoch < m_warmupEpochs)
+        return m_baseRate * (epoch + 1) / m_warmupEpochs;
+
+    const unsigned scheduled = epoch - m_warmupEpochs;
+    switch (m_type)
+    {
+    case ScheduleType::STEP:
+        return m_baseRate * std::pow(m_stepFactor, scheduled / m_stepEpochs);
+    case ScheduleType::COSINE:
+    {
+        // epoch 0 of the schedule is at the base rate. The last epoch is the last step before 0.
+        const unsigned length = m_numEpochs > m_warmupEpochs ? m_numEpochs - m_warmupEpochs : 1;
+        return m_baseRate * 0.5 * (1 + std::cos(3.14159265358979323846 * scheduled / length));
+    }
+    default:
+        return m_baseRate;
+    }
+}
+
+
+/** Parse the name of a schedule.
+@param[in]  name     "constant", "step" or "cosine".
+@param[out] out_type The schedule.
+@return false if the name is unknown.
+*/
+bool LearningRateSchedule::ParseType(const std::string& name, ScheduleType& out_type)
+{
+    for (const ScheduleType type : { ScheduleType::CONSTANT, ScheduleType::STEP, ScheduleType::COSINE })
+    {
+        if (name == TypeName(type))
+        {
+            out_type = type;
+            return true;
+        }
+    }
+    return false;
+}
+
+
+/** Get the name of a schedule.
+@param[in] type The schedule.
+@return The name, as accepted by ParseType.
+*/
+const char* LearningRateSchedule::TypeName(const ScheduleType type)
+{
+    switch (type)
+    {
+    case ScheduleType::CONSTANT: return "constant";
+    case ScheduleType::STEP:     return "step";
+    case ScheduleType::COSINE:   return "cosine";
+    }
+    return "unknown";
+}
+
+
+// ------------------------------------------------------------------
+
+/** Constructor
+@param[in] patience The number of epochs without improvement to stop after. 0 never stops.
+@param[in] minDelta The smallest gain in accuracy that counts as an improvement.
+*/
+EarlyStopping::EarlyStopping(const unsigned patience, const double minDelta)
+    : m_patience(patience)
+    , m_minDelta(minDelta)
+{ }
+
+
+/** Record the test accuracy of an epoch.
+@param[in] epoch    The epoch, counting from 1.
+@param[in] accuracy The test accuracy after the epoch.
+@return true if the accuracy is the best so far by more than the minimum gain.
+*/
+bool EarlyStopping::Update(const unsigned epoch, const double accuracy)
+{
+    if (accuracy > m_bestAccuracy + m_minDelta)
+    {
+        m_bestEpoch       = epoch;
+        m_bestAccuracy    = accuracy;
+        m_epochsSinceBest = 0;
+        return true;
+    }
+    ++m_epochsSinceBest;
+    return false;
+}
+
+
+}
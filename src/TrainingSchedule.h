@@ -0,0 +1,80 @@
+// ==================================================================
+// Copyright (c) 2019 Alexander Freed. ALL RIGHTS RESERVED.
+// Language: ISO C++14
+//
+// LearningRateSchedule and EarlyStopping class declarations.
+// Decide the learning rate of each epoch, and when to stop training.
+// ==================================================================
+
+#pragma once
+
+#include <string>
+
+
+namespace fnn {
+
+
+/** The shapes of the learning rate over the epochs.
+*/
+enum class ScheduleType
+{
+    CONSTANT,  // the base rate throughout
+    STEP,      // the base rate, multiplied by a factor every few epochs
+    COSINE,    // the base rate, annealed to 0 along half a cosine by the last epoch
+};
+
+
+/** The learning rate of each epoch. An optional linear warmup comes first:
+over the warmup epochs the rate rises to the base rate, and the schedule starts after them.
+*/
+class LearningRateSchedule
+{
+public:
+    LearningRateSchedule() = default;
+    LearningRateSchedule(const ScheduleType type, const double baseRate, const unsigned numEpochs,
+                         const unsigned warmupEpochs = 0, const unsigned stepEpochs = 10, const double stepFactor = 0.5);
+
+    double Rate(const unsigned epoch) const;
+
+    ScheduleType GetType() const { return m_type; }
+    unsigned     GetWarmupEpochs() const { return m_warmupEpochs; }
+
+    static bool        ParseType(const std::string& name, ScheduleType& out_type);
+    static const char* TypeName(const ScheduleType type);
+
+private:
+    ScheduleType m_type         = ScheduleType::CONSTANT;
+    double       m_baseRate     = 0.1;
+    unsigned     m_numEpochs    = 1;
+    unsigned     m_warmupEpochs = 0;
+    unsigned     m_stepEpochs   = 10;
+    double       m_stepFactor   = 0.5;
+};
+
+
+/** Stops training once the test accuracy has not improved for a number of epochs.
+*/
+class EarlyStopping
+{
+public:
+    explicit EarlyStopping(const unsigned patience = 0, const double minDelta = 0);
+
+    bool Update(const unsigned epoch, const double accuracy);
+
+    bool     IsEnabled() const { return m_patience > 0; }
+    bool     ShouldStop() const { return IsEnabled() && m_epochsSinceBest >= m_patience; }
+    unsigned GetPatience() const { return m_patience; }
+    double   GetMinDelta() const { return m_minDelta; }
+    unsigned GetBestEpoch() const { return m_bestEpoch; }
+    double   GetBestAccuracy() const { return m_bestAccuracy; }
+
+private:
+    unsigned m_patience;            // 0: never stop
+    double   m_minDelta;            // the smallest gain that counts as an improvement
+    unsigned m_bestEpoch       = 0;
+    double   m_bestAccuracy    = -1;
+    unsigned m_epochsSinceBest = 0;
+};
+
+
+}
@@ -7,10 +7,29 @@
 
 #include "UnitTest.h"
 
+#include "Ensemble.h"
+#include "Kernels.h"
 #include "NeuralNet.h"
+#include "Optimizer.h"
+#include "Random.h"
+#include "Sweep.h"
+#include "Synthetic.h"
 #include "Trainer.h"
+#include "TrainingSchedule.h"
+#include "Utility.h"
+#include "WorkerTeam.h"
 
+#include <algorithm>
+#include <array>
 #include <cassert>
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+#include <limits>
+#include <numeric>
+#include <ostream>
+#include <random>
+#include <sstream>
 
 
 // macros
@@ -22,101 +41,666 @@ using namespace fnn;
 
 namespace UnitTest {
 
+
+namespace {
+
+
+/** Check whether a sample is the one the synthetic generator makes.
+@param[in] sample The sample.
+@param[in] split  The split of the synthetic dataset.
+@param[in] index  The index of the sample in the split.
+@return true if it is.
+*/
+bool isSyntheticSample(const Trainer& sample, const SyntheticSplit split, const std::uint32_t index)
+{
+    std::uint8_t label = 0;
+    std::array<std::uint8_t, NUM_INPUTS - 1> pixels;
+    MakeSyntheticSample(SYNTHETIC_SEED, split, index, label, pixels.data());
+    const Trainer expected(label, pixels.data(), pixels.size());
+    return sample.GetTarget() == expected.GetTarget() && sample.GetInputs() == expected.GetInputs();
+}
+
+
+/** Check a data set against the synthetic generator (see --write-synthetic).
+Only the first samples are compared, as rows may have been appended.
+@param[in] sets  The data.
+@param[in] split The split of the synthetic dataset.
+@return true if the test passed
+*/
+bool validateSynthetic(const std::vector<fnn::Trainer>& sets, const SyntheticSplit split)
+{
+    TEST(!sets.empty());
+    const size_t numChecked = std::min<size_t>(sets.size(), 100);
+    for (size_t i = 0; i < numChecked; ++i)
+        TEST(isSyntheticSample(sets[i], split, static_cast<std::uint32_t>(i)));
+    return true;
+}
+
+
+// ------------------------------------------------------------------
+// kernel equivalence
+
+/** The network and its update rules as straightforward Eigen expressions: the reference the optimized paths are
+checked against. The forward pass and the momentum update are the original TrainFromInput, before the fused
+kernels. Keep this frozen. It is meant to be obviously right, not fast.
+*/
+class ReferenceNetwork
+{
+public:
+    using WeightsCollection = NeuralNetDigitClassifier::WeightsCollection;
+    using OutputType        = NeuralNetDigitClassifier::OutputType;
+
+    ReferenceNetwork(WeightsCollection weights, const OptimizerSettings& settings)
+        : m_weights(std::move(weights))
+        , m_settings(settings)
+    {
+        for (size_t layer = 0; layer < m_weights.size(); ++layer)
+        {
+            m_state0[layer] = Eigen::MatrixXd::Zero(m_weights[layer].rows(), m_weights[layer].cols());
+            m_state1[layer] = Eigen::MatrixXd::Zero(m_weights[layer].rows(), m_weights[layer].cols());
+        }
+    }
+
+    int DetermineDigit(const InputType& inputs) const
+    {
+        int row, col;
+        forward(inputs, m_hiddenActivation).maxCoeff(&row, &col);
+        return col;
+    }
+
+    void TrainFromInput(const InputType& inputs, const OutputType& targets)
+    {
+        const OutputType outputActivation = forward(inputs, m_hiddenActivation);
+
+        // calculate error hidden->output
+        const auto sigmoidDerivative = [](const double o) { return o * (1 - o); };
+        const OutputType errorOutput = (targets - outputActivation).cwiseProduct(outputActivation.unaryExpr(sigmoidDerivative));
+
+        // calculate error input->hidden
+        const Eigen::RowVectorXd errorHidden = (m_weights[1] * errorOutput.transpose()).transpose().cwiseProduct(m_hiddenActivation.unaryExpr(sigmoidDerivative));
+
+        ++m_step;
+        update(1, m_hiddenActivation.transpose() * errorOutput);
+        update(0, inputs.transpose() * errorHidden.tail(errorHidden.size() - 1));
+    }
+
+    const WeightsCollection& GetWeights() const { return m_weights; }
+
+private:
+    static double sigmoid(const double z) { return 1.0 / (1.0 + exp(-z)); }
+
+    OutputType forward(const InputType& inputs, Eigen::RowVectorXd& out_hiddenActivation) const
+    {
+        out_hiddenActivation.resize(m_weights[0].cols() + 1);
+        out_hiddenActivation(0) = 1;
+        out_hiddenActivation.tail(m_weights[0].cols()) = (inputs * m_weights[0]).unaryExpr(&sigmoid);
+        return (out_hiddenActivation * m_weights[1]).unaryExpr(&sigmoid);
+    }
+
+    void update(const size_t layer, const Eigen::MatrixXd& descent)
+    {
+        const OptimizerSettings& s = m_settings;
+        Eigen::MatrixXd& weights = m_weights[layer];
+        Eigen::MatrixXd& state0  = m_state0[layer];
+        Eigen::MatrixXd& state1  = m_state1[layer];
+        const auto sqrtPlusEpsilon = [&s](const double x) { return std::sqrt(x) + s.epsilon; };
+        switch (s.type)
+        {
+        case OptimizerType::MOMENTUM:
+            state0 = s.learningRate * descent + s.momentum * state0;
+            weights += state0;
+            break;
+        case OptimizerType::NESTEROV:
+            state0 = s.learningRate * descent + s.momentum * state0;
+            weights += s.learningRate * descent + s.momentum * state0;
+            break;
+        case OptimizerType::RMSPROP:
+            state0 = s.decay * state0 + (1 - s.decay) * descent.cwiseProduct(descent);
+            weights += s.learningRate * descent.cwiseQuotient(state0.unaryExpr(sqrtPlusEpsilon));
+            break;
+        case OptimizerType::ADAM:
+        {
+            state0 = s.beta1 * state0 + (1 - s.beta1) * descent;
+            state1 = s.beta2 * state1 + (1 - s.beta2) * descent.cwiseProduct(descent);
+            const double meanCorrection   = 1 / (1 - std::pow(s.beta1, double(m_step)));
+            const double squareCorrection = 1 / (1 - std::pow(s.beta2, double(m_step)));
+            weights += (s.learningRate * meanCorrection * state0).cwiseQuotient((squareCorrection * state1).unaryExpr(sqrtPlusEpsilon));
+            break;
+        }
+        }
+    }
+
+    WeightsCollection              m_weights;
+    std::array<Eigen::MatrixXd, 2> m_state0;  // the optimizer's state, as in Optimizer::LayerState
+    std::array<Eigen::MatrixXd, 2> m_state1;
+    OptimizerSettings              m_settings;
+    unsigned                       m_step = 0;
+    mutable Eigen::RowVectorXd     m_hiddenActivation;
+};
+
+
+/** How far optimized weights are from the reference.
+*/
+struct Difference
+{
+    double        maxAbs = 0;  // the largest absolute difference
+    std::uint64_t maxUlp = 0;  // the largest distance in units in the last place
+    bool          within = true;
+
+    /** Compare matrices. An element is within tolerance if it is within either the absolute or the ULP tolerance,
+    so elements near zero are held to the absolute one and large elements to the relative one.
+    */
+    void Add(const Eigen::MatrixXd& actual, const Eigen::MatrixXd& expected, const double absTolerance, const std::uint64_t ulpTolerance)
+    {
+        if (actual.rows() != expected.rows() || actual.cols() != expected.cols())
+        {
+            within = false;
+            return;
+        }
+        for (Eigen::Index i = 0; i < actual.size(); ++i)
+        {
+            const double        abs = std::abs(actual(i) - expected(i));
+            const std::uint64_t ulp = ulpDistance(actual(i), expected(i));
+            maxAbs = std::max(maxAbs, abs);
+            maxUlp = std::max(maxUlp, ulp);
+            within = within && (abs <= absTolerance || ulp <= ulpTolerance);
+        }
+    }
+
+private:
+    static std::uint64_t ulpDistance(const double a, const double b)
+    {
+        if (std::isnan(a) || std::isnan(b))
+            return std::numeric_limits<std::uint64_t>::max();
+        // map the doubles to integers that are ordered like them, so adjacent doubles differ by 1
+        const auto ordered = [](const double x) {
+            std::int64_t bits;
+            std::memcpy(&bits, &x, sizeof(bits));
+            return bits < 0 ? std::numeric_limits<std::int64_t>::min() - bits : bits;
+        };
+        const std::int64_t ia = ordered(a);
+        const std::int64_t ib = ordered(b);
+        return ia > ib ? std::uint64_t(ia) - std::uint64_t(ib) : std::uint64_t(ib) - std::uint64_t(ia);
+    }
+};
+
+
+// the tolerances of weights after training. The rounding differs, e.g. fused multiply-adds, but not the math.
+constexpr double        WEIGHT_ABS_TOLERANCE = 1e-12;
+constexpr std::uint64_t WEIGHT_ULP_TOLERANCE = 1 << 16;
+
+
+/** The samples the checks use: synthetic digits, dense and sparse.
+*/
+struct KernelSamples
+{
+    std::vector<Trainer>                              trainers;
+    std::vector<NeuralNetDigitClassifier::OutputType> targets;
+    std::vector<std::vector<std::uint16_t>>           indices;  // the sparse form, as in SparseInput
+    std::vector<std::vector<std::uint8_t>>            values;
+
+    explicit KernelSamples(const size_t numSamples)
+    {
+        const FileIO::PackedDataset packed = MakeSyntheticDataset(numSamples, SyntheticSplit::TRAIN);
+        const size_t numPixels = packed.GetPixelsPerSample();
+        for (size_t i = 0; i < packed.GetNumSamples(); ++i)
+        {
+            const std::uint8_t* const pPixels = &packed.pixels[i * numPixels];
+            trainers.emplace_back(packed.labels[i], pPixels, numPixels);
+            targets.push_back(NeuralNetDigitClassifier::EncodeTarget(packed.labels[i]));
+            indices.emplace_back();
+            values.emplace_back();
+            for (size_t k = 0; k < numPixels; ++k)
+            {
+                if (pPixels[k] != 0)
+                {
+                    indices.back().push_back(static_cast<std::uint16_t>(k));
+                    values.back().push_back(pPixels[k]);
+                }
+            }
+        }
+    }
+
+    SparseInput Sparse(const size_t i) const { return SparseInput{ indices[i].size(), indices[i].data(), values[i].data() }; }
+};
+
+
+/** Print the outcome of one check.
+@return passed
+*/
+bool report(std::ostream& out, const std::string& name, const bool passed, const std::string& detail)
+{
+    out << "    " << std::left << std::setw(34) << name << std::setw(8) << (passed ? "ok" : "FAILED") << detail << std::right << std::endl;
+    return passed;
+}
+
+
+/** Describe a weight difference.
+*/
+std::string describe(const Difference& difference)
+{
+    std::ostringstream detail;
+    detail << "max abs " << difference.maxAbs << ", max ULP " << difference.maxUlp;
+    return detail.str();
+}
+
+
+/** Train a network and the reference on the same samples with one optimizer, and compare the weights.
+Then check both give the same digit for every sample with the same weights.
+*/
+bool checkTraining(std::ostream& out, const KernelSamples& samples, const OptimizerType type, const unsigned numHidden)
+{
+    OptimizerSettings settings;
+    settings.type         = type;
+    settings.learningRate = OptimizerSettings::DefaultLearningRate(type);
+    Rng rng(1, MakeStreamId(StreamUse::MAIN, numHidden));
+    NeuralNetDigitClassifier neuralnet(numHidden, rng);
+    ReferenceNetwork         reference(neuralnet.GetWeights(), settings);
+    Optimizer                optimizer(settings);
+
+    for (size_t i = 0; i < samples.trainers.size(); ++i)
+    {
+        neuralnet.TrainFromInput(samples.trainers[i].GetInputs(), samples.targets[i], optimizer);
+        reference.TrainFromInput(samples.trainers[i].GetInputs(), samples.targets[i]);
+    }
+    Difference difference;
+    const auto weights = neuralnet.GetWeights();
+    for (size_t layer = 0; layer < 2; ++layer)
+        difference.Add(weights[layer], reference.GetWeights()[layer], WEIGHT_ABS_TOLERANCE, WEIGHT_ULP_TOLERANCE);
+    bool passed = report(out, std::string("TrainFromInput ") + Optimizer::TypeName(type) + " h=" + std::to_string(numHidden),
+                         difference.within, describe(difference));
+
+    // the same weights must give the same digits
+    const NeuralNetDigitClassifier sameWeights(reference.GetWeights());
+    size_t mismatches = 0;
+    for (const Trainer& sample : samples.trainers)
+        mismatches += sameWeights.DetermineDigit(sample.GetInputs()) != reference.DetermineDigit(sample.GetInputs()) ? 1 : 0;
+    passed = report(out, std::string("DetermineDigit ") + Optimizer::TypeName(type) + " h=" + std::to_string(numHidden),
+                    mismatches == 0, std::to_string(mismatches) + " of " + std::to_string(samples.trainers.size()) + " differ") && passed;
+    return passed;
+}
+
+
+/** Check the sparse DetermineDigit against the reference on the dense inputs.
+*/
+bool checkSparse(std::ostream& out, const KernelSamples& samples, const unsigned numHidden)
+{
+    Rng rng(2, MakeStreamId(StreamUse::MAIN, numHidden));
+    const NeuralNetDigitClassifier neuralnet(numHidden, rng);
+    const ReferenceNetwork         reference(neuralnet.GetWeights(), OptimizerSettings());
+    size_t mismatches = 0;
+    for (size_t i = 0; i < samples.trainers.size(); ++i)
+        mismatches += neuralnet.DetermineDigit(samples.Sparse(i)) != reference.DetermineDigit(samples.trainers[i].GetInputs()) ? 1 : 0;
+    return report(out, "DetermineDigit sparse h=" + std::to_string(numHidden), mismatches == 0,
+                  std::to_string(mismatches) + " of " + std::to_string(samples.trainers.size()) + " differ");
+}
+
+
+/** Train an ensemble, whose input layers are fused, and a reference per model, and compare each model's weights.
+*/
+bool checkEnsemble(std::ostream& out, const KernelSamples& samples, const OptimizerType type, const unsigned numModels, const unsigned numHidden)
+{
+    OptimizerSettings settings;
+    settings.type         = type;
+    settings.learningRate = OptimizerSettings::DefaultLearningRate(type);
+    std::vector<NeuralNetDigitClassifier> models;
+    std::vector<ReferenceNetwork>         references;
+    for (unsigned m = 0; m < numModels; ++m)
+    {
+        Rng rng(3, MakeStreamId(StreamUse::ENSEMBLE, m));
+        models.emplace_back(numHidden, rng);
+        references.emplace_back(models.back().GetWeights(), settings);
+    }
+    EnsembleClassifier ensemble(models);
+    Optimizer          optimizer(settings);
+
+    for (size_t i = 0; i < samples.trainers.size(); ++i)
+    {
+        ensemble.TrainFromInput(samples.trainers[i].GetInputs(), samples.targets[i], optimizer);
+        for (ReferenceNetwork& reference : references)
+            reference.TrainFromInput(samples.trainers[i].GetInputs(), samples.targets[i]);
+    }
+    Difference difference;
+    for (unsigned m = 0; m < numModels; ++m)
+    {
+        const auto weights = ensemble.GetModel(m).GetWeights();
+        for (size_t layer = 0; layer < 2; ++layer)
+            difference.Add(weights[layer], references[m].GetWeights()[layer], WEIGHT_ABS_TOLERANCE, WEIGHT_ULP_TOLERANCE);
+    }
+    return report(out, std::string("Ensemble ") + Optimizer::TypeName(type) + " x" + std::to_string(numModels) + " h=" + std::to_string(numHidden),
+                  difference.within, describe(difference));
+}
+
+
+/** Train with the input layer split across a team of threads, and check each weight is the one a single thread
+computes, exactly, and the reference's within rounding.
+*/
+bool checkIntraOp(std::ostream& out, const KernelSamples& samples, const OptimizerType type, const unsigned numThreads, const unsigned numHidden)
+{
+    OptimizerSettings settings;
+    settings.type         = type;
+    settings.learningRate = OptimizerSettings::DefaultLearningRate(type);
+    Rng rng(4, MakeStreamId(StreamUse::MAIN, numHidden));
+    NeuralNetDigitClassifier split(numHidden, rng);
+    NeuralNetDigitClassifier single = split;
+    ReferenceNetwork         reference(split.GetWeights(), settings);
+    Optimizer                splitOptimizer(settings);
+    Optimizer                singleOptimizer(settings);
+    WorkerTeam               team(numThreads);
+
+    for (size_t i = 0; i < samples.trainers.size(); ++i)
+    {
+        split.TrainFromInput(samples.trainers[i].GetInputs(), samples.targets[i], splitOptimizer, &team);
+        single.TrainFromInput(samples.trainers[i].GetInputs(), samples.targets[i], singleOptimizer);
+        reference.TrainFromInput(samples.trainers[i].GetInputs(), samples.targets[i]);
+    }
+    Difference difference;
+    bool sameAsSingle = true;
+    const auto splitWeights  = split.GetWeights();
+    const auto singleWeights = single.GetWeights();
+    for (size_t layer = 0; layer < 2; ++layer)
+    {
+        difference.Add(splitWeights[layer], reference.GetWeights()[layer], WEIGHT_ABS_TOLERANCE, WEIGHT_ULP_TOLERANCE);
+        sameAsSingle = sameAsSingle && splitWeights[layer] == singleWeights[layer];
+    }
+    return report(out, std::string("Intra-op ") + std::to_string(numThreads) + " threads " + Optimizer::TypeName(type) + " h=" + std::to_string(numHidden),
+                  difference.within && sameAsSingle, (sameAsSingle ? "same as 1 thread, " : "differs from 1 thread, ") + describe(difference));
+}
+
+
+/** Run a sweep on several threads and check each run against the reference trained the way Sweep.cpp trains it:
+weights and orders from the run's streams. Threads must not change the outcome, so the runs must also match the
+same sweep on one thread exactly.
+*/
+bool checkSweep(std::ostream& out, const KernelSamples& samples, const std::vector<Trainer>& testSet)
+{
+    std::vector<SweepRun> runs;
+    for (const OptimizerType type : { OptimizerType::MOMENTUM, OptimizerType::ADAM })
+        runs.push_back(SweepRun{ static_cast<unsigned>(runs.size()), type, 17, OptimizerSettings::DefaultLearningRate(type), 0.9 });
+    const unsigned numEpochs = 2;
+    const LearningRateSchedule schedule(ScheduleType::CONSTANT, 1.0, numEpochs, 0, 1, 1);
+    std::ostringstream log;
+    const std::vector<SweepResult> threaded = RunSweep(samples.trainers, testSet, runs, numEpochs, schedule, EarlyStopping(0, 0), 2, log);
+    const std::vector<SweepResult> single   = RunSweep(samples.trainers, testSet, runs, numEpochs, schedule, EarlyStopping(0, 0), 1, log);
+
+    bool passed = true;
+    for (const SweepRun& run : runs)
+    {
+        OptimizerSettings settings;
+        settings.type         = run.optimizer;
+        settings.learningRate = run.learningRate;
+        settings.momentum     = run.momentum;
+        Rng weightsRng = Global::stream(StreamUse::SWEEP, run.index, 0);
+        ReferenceNetwork reference(NeuralNetDigitClassifier(run.numHidden, weightsRng).GetWeights(), settings);
+
+        // the reference's test accuracy may differ by a sample at most, where rounding tips a close call
+        std::vector<size_t> order(samples.trainers.size());
+        std::iota(order.begin(), order.end(), size_t(0));
+        double maxAccuracyDifference = 0;
+        for (unsigned epoch = 0; epoch < numEpochs; ++epoch)
+        {
+            Rng orderRng = Global::stream(StreamUse::SWEEP, run.index, epoch + 1);
+            std::shuffle(order.begin(), order.end(), orderRng);
+            for (const size_t i : order)
+                reference.TrainFromInput(samples.trainers[i].GetInputs(), samples.targets[i]);
+            size_t correct = 0;
+            for (const Trainer& sample : testSet)
+                correct += reference.DetermineDigit(sample.GetInputs()) == sample.GetTarget() ? 1 : 0;
+            const double accuracy = correct / static_cast<double>(testSet.size());
+            maxAccuracyDifference = std::max(maxAccuracyDifference, std::abs(threaded[run.index].testAccuracy.at(epoch) - accuracy));
+        }
+        const bool sameAsSingle = threaded[run.index].testAccuracy == single[run.index].testAccuracy;
+        const bool nearReference = maxAccuracyDifference <= 1.0 / testSet.size();
+        std::ostringstream detail;
+        detail << (sameAsSingle ? "same as 1 thread" : "differs from 1 thread") << ", test accuracy within "
+               << maxAccuracyDifference * 100 << "% of the reference";
+        passed = report(out, std::string("Sweep 2 threads ") + Optimizer::TypeName(run.optimizer), sameAsSingle && nearReference, detail.str()) && passed;
+    }
+    return passed;
+}
+
+
+/** Resample random images with the bilinear kernel and with a plain loop, and compare the pixels.
+The moves reach past the border, to run the clamping too, and the last trials push every pixel to the
+bottom, the right, the bottom-right and the top-left edges. The source has no slack past its border, as in the
+augmenter, and is followed by a row of NaNs, so reading past it gives a NaN pixel and fails the check.
+*/
+bool checkResample(std::ostream& out, const int size)
+{
+    const int border = 2;
+    const int stride = size + 2 * border;
+    Rng rng(3, MakeStreamId(StreamUse::AUGMENT, static_cast<std::uint32_t>(size)));
+    std::uniform_real_distribution<double> uniform(-1.0, 1.0);
+    std::vector<double> padded(stride * stride, 0);
+    padded.resize(padded.size() + stride, std::numeric_limits<double>::quiet_NaN());
+    std::vector<double> dx(size * size), dy(size * size), image(size * size);
+    double maxAbs = 0;
+    bool   finite = true;
+    const int numTrials = 20;
+    for (int trial = 0; trial < numTrials; ++trial)
+    {
+        for (int y = 0; y < size; ++y)
+        {
+            for (int x = 0; x < size; ++x)
+                padded[(y + border) * stride + x + border] = 0.5 + 0.5 * uniform(rng);
+        }
+        for (size_t i = 0; i < dx.size(); ++i)
+        {
+            dx[i] = 3 * uniform(rng);
+            dy[i] = 3 * uniform(rng);
+        }
+        double a = 1 + 0.2 * uniform(rng);
+        double b = 0.3 * uniform(rng);
+        double e = size / 4.0 * uniform(rng);
+        double f = size / 4.0 * uniform(rng);
+        const int edge = trial - (numTrials - 4);
+        if (edge >= 0)
+        {
+            // 0: bottom, 1: right, 2: bottom-right, 3: top-left
+            a = 1;
+            b = 0;
+            e = edge == 1 || edge == 2 ? size : edge == 3 ? -size : 0;
+            f = edge == 0 || edge == 2 ? size : edge == 3 ? -size : 0;
+        }
+        ResampleBilinear(padded.data(), stride, border, size, a, b, e, f, dx.data(), dy.data(), image.data());
+
+        for (int y = 0; y < size; ++y)
+        {
+            for (int x = 0; x < size; ++x)
+            {
+                const double u  = std::min(std::max(a * x + b * y + e + dx[y * size + x], double(-border)), double(stride - border - 2));
+                const double v  = std::min(std::max(-b * x + a * y + f + dy[y * size + x], double(-border)), double(stride - border - 2));
+                const int    u0 = static_cast<int>(std::floor(u)) + border;
+                const int    v0 = static_cast<int>(std::floor(v)) + border;
+                const double wu = u - std::floor(u);
+                const double wv = v - std::floor(v);
+                const double expected = (1 - wv) * ((1 - wu) * padded[v0 * stride + u0] + wu * padded[v0 * stride + u0 + 1])
+                                      + wv * ((1 - wu) * padded[(v0 + 1) * stride + u0] + wu * padded[(v0 + 1) * stride + u0 + 1]);
+                const double difference = std::abs(image[y * size + x] - expected);
+                finite = finite && std::isfinite(difference);
+                maxAbs = std::max(maxAbs, difference);
+            }
+        }
+    }
+    std::ostringstream detail;
+    detail << (finite ? "" : "read past the source, ") << "max abs " << maxAbs;
+    return report(out, "ResampleBilinear " + std::to_string(size) + "x" + std::to_string(size), finite && maxAbs <= WEIGHT_ABS_TOLERANCE, detail.str());
+}
+
+
+}  // namespace
+
+
 /** Check a few parts of the data to ensure it was loaded correctly.
 @param[in] trainingSets The vector of training data.
 @param[in] testSets     The vector of test data.
 @return true if the test passed
 */
-bool ValidateLoad(const std::vector<fnn::RawTrainer>& trainingSets, const std::vector<fnn::RawTrainer>& testSets)
+bool ValidateLoad(const std::vector<fnn::Trainer>& trainingSets, const std::vector<fnn::Trainer>& testSets)
+{
+    return ValidateTrainingLoad(trainingSets) && ValidateTestLoad(testSets);
+}
+
+
+/** Check a few parts of the training data to ensure it was loaded correctly.
+Synthetic data (see Synthetic.h) is recognized by its first sample and checked against the generator.
+@param[in] trainingSets The vector of training data.
+@return true if the test passed
+*/
+bool ValidateTrainingLoad(const std::vector<fnn::Trainer>& trainingSets)
 {
+    // synthetic data is checked against the generator, the real files against known values
+    if (!trainingSets.empty() && isSyntheticSample(trainingSets[0], SyntheticSplit::TRAIN, 0))
+        return validateSynthetic(trainingSets, SyntheticSplit::TRAIN);
+
     // training sets
-    TEST(trainingSets.size() == 60000);
+    // rows may have been appended to the original 60000
+    TEST(trainingSets.size() >= 60000);
     {
         auto& first = trainingSets[0];
         // The first input is the bias and should always be 1
-        TEST(first.m_inputs[0] == 1);
+        TEST(first.GetInputs()[0] == 1);
         // Besides the biast, the first inputs should be 0's at the beginning
         for (int i = 1; i < 153; ++i)
-            TEST(first.m_inputs[i] == 0);
+            TEST(first.GetInputs()[i] == 0);
         // First non-zero item
-        TEST(first.m_inputs[153] == 0.011764705882352941);
+        TEST(first.GetInputs()[153] == 0.011764705882352941);
         // target should be 5
-        TEST(first.m_target == 5);
+        TEST(first.GetTarget() == 5);
     }
     {
         auto& second = trainingSets[1];
-        TEST(second.m_inputs[0] == 1);
+        TEST(second.GetInputs()[0] == 1);
         for (int i = 1; i < 128; ++i)
-            TEST(second.m_inputs[i] == 0);
-        TEST(second.m_inputs[128] == 0.20000000000000001);
-        TEST(second.m_target == 0);
+            TEST(second.GetInputs()[i] == 0);
+        TEST(second.GetInputs()[128] == 0.20000000000000001);
+        TEST(second.GetTarget() == 0);
     }
     {
         auto& middle = trainingSets[200];
-        TEST(middle.m_inputs[0] == 1);
+        TEST(middle.GetInputs()[0] == 1);
         for (int i = 1; i < 124; ++i)
-            TEST(middle.m_inputs[i] == 0);
-        TEST(middle.m_inputs[124] == 0.11372549019607843);
-        TEST(middle.m_target == 1);
+            TEST(middle.GetInputs()[i] == 0);
+        TEST(middle.GetInputs()[124] == 0.11372549019607843);
+        TEST(middle.GetTarget() == 1);
     }
     {
         auto& middle = trainingSets[49999];
-        TEST(middle.m_inputs[0] == 1);
+        TEST(middle.GetInputs()[0] == 1);
         for (int i = 1; i < 152; ++i)
-            TEST(middle.m_inputs[i] == 0);
-        TEST(middle.m_inputs[152] == 0.40392156862745099);
-        TEST(middle.m_target == 8);
+            TEST(middle.GetInputs()[i] == 0);
+        TEST(middle.GetInputs()[152] == 0.40392156862745099);
+        TEST(middle.GetTarget() == 8);
     }
     {
         auto& last = trainingSets[59999];
-        TEST(last.m_inputs[0] == 1);
+        TEST(last.GetInputs()[0] == 1);
         for (int i = 1; i < 185; ++i)
-            TEST(last.m_inputs[i] == 0);
-        TEST(last.m_inputs[185] == 0.14901960784313725);
-        TEST(last.m_target == 8);
+            TEST(last.GetInputs()[i] == 0);
+        TEST(last.GetInputs()[185] == 0.14901960784313725);
+        TEST(last.GetTarget() == 8);
     }
 
+    return true;
+}
+
+
+/** Check a few parts of the test data to ensure it was loaded correctly.
+Synthetic data (see Synthetic.h) is recognized by its first sample and checked against the generator.
+@param[in] testSets The vector of test data.
+@return true if the test passed
+*/
+bool ValidateTestLoad(const std::vector<fnn::Trainer>& testSets)
+{
+    if (!testSets.empty() && isSyntheticSample(testSets[0], SyntheticSplit::TEST, 0))
+        return validateSynthetic(testSets, SyntheticSplit::TEST);
+
     // test sets
-    TEST(testSets.size() == 10000);
+    // rows may have been appended to the original 10000
+    TEST(testSets.size() >= 10000);
     {
         auto& first = testSets[0];
         // The first input is the bias and should always be 1
-        TEST(first.m_inputs[0] == 1);
+        TEST(first.GetInputs()[0] == 1);
         // First test set should have 0's at the beginning
         for (int i = 1; i < 203; ++i)
-            TEST(first.m_inputs[i] == 0);
+            TEST(first.GetInputs()[i] == 0);
         // First non-zero item
-        TEST(first.m_inputs[203] == 0.32941176470588235);
+        TEST(first.GetInputs()[203] == 0.32941176470588235);
         // target should be 7
-        TEST(first.m_target == 7);
+        TEST(first.GetTarget() == 7);
     }
     {
         auto& second = testSets[1];
-        TEST(second.m_inputs[0] == 1);
+        TEST(second.GetInputs()[0] == 1);
         for (int i = 1; i < 95; ++i)
-            TEST(second.m_inputs[i] == 0);
-        TEST(second.m_inputs[95] == 0.45490196078431372);
-        TEST(second.m_target == 2);
+            TEST(second.GetInputs()[i] == 0);
+        TEST(second.GetInputs()[95] == 0.45490196078431372);
+        TEST(second.GetTarget() == 2);
     }
     {
         auto& middle = testSets[250];
-        TEST(middle.m_inputs[0] == 1);
+        TEST(middle.GetInputs()[0] == 1);
         for (int i = 1; i < 151; ++i)
-            TEST(middle.m_inputs[i] == 0);
-        TEST(middle.m_inputs[151] == 0.031372549019607843);
-        TEST(middle.m_target == 4);
+            TEST(middle.GetInputs()[i] == 0);
+        TEST(middle.GetInputs()[151] == 0.031372549019607843);
+        TEST(middle.GetTarget() == 4);
     }
     {
         auto& last = testSets[9999];
-        TEST(last.m_inputs[0] == 1);
+        TEST(last.GetInputs()[0] == 1);
         for (int i = 1; i < 74; ++i)
-            TEST(last.m_inputs[i] == 0);
-        TEST(last.m_inputs[74] == 0.031372549019607843);
-        TEST(last.m_target == 6);
+            TEST(last.GetInputs()[i] == 0);
+        TEST(last.GetInputs()[74] == 0.031372549019607843);
+        TEST(last.GetTarget() == 6);
     }
 
     return true;
 }
 
 
+/** Check every optimized path of the network against the reference implementation (see ReferenceNetwork) on seeded
+random networks and synthetic samples: the vectorized update of each optimizer, the sparse inference, the fused
+input layers of an ensemble, the input layer split across threads, a sweep on several threads, and the augmenter's resampling. Weights must match within rounding after training,
+and the same weights must give the same digits.
+@param[in] out Where to print each check.
+@return true if every check passed
+*/
+bool ValidateKernels(std::ostream& out)
+{
+    const KernelSamples samples(300);
+    std::vector<Trainer> testSet;
+    const FileIO::PackedDataset packedTest = MakeSyntheticDataset(200, SyntheticSplit::TEST);
+    for (size_t i = 0; i < packedTest.GetNumSamples(); ++i)
+        testSet.emplace_back(packedTest.labels[i], &packedTest.pixels[i * packedTest.GetPixelsPerSample()], packedTest.GetPixelsPerSample());
+
+    const auto flags = out.flags();
+    const auto precision = out.precision(3);
+    bool passed = true;
+    // the hidden sizes are not multiples of the vector widths, to run the leftover rows and columns too
+    for (const OptimizerType type : { OptimizerType::MOMENTUM, OptimizerType::NESTEROV, OptimizerType::RMSPROP, OptimizerType::ADAM })
+    {
+        for (const unsigned numHidden : { 1u, 13u, 64u })
+            passed = checkTraining(out, samples, type, numHidden) && passed;
+    }
+    for (const unsigned numHidden : { 13u, 64u })
+        passed = checkSparse(out, samples, numHidden) && passed;
+    for (const OptimizerType type : { OptimizerType::MOMENTUM, OptimizerType::ADAM })
+        passed = checkEnsemble(out, samples, type, 3, 13) && passed;
+    // slices of 8 hidden nodes: 3 threads get uneven slices of 21 nodes, and one gets none of 13
+    for (const OptimizerType type : { OptimizerType::MOMENTUM, OptimizerType::ADAM })
+    {
+        passed = checkIntraOp(out, samples, type, 3, 21) && passed;
+        passed = checkIntraOp(out, samples, type, 3, 13) && passed;
+    }
+    passed = checkSweep(out, samples, testSet) && passed;
+    // 28 is the augmenter's size. 13 leaves 1 pixel of each row to the scalar loop.
+    for (const int size : { 28, 13 })
+        passed = checkResample(out, size) && passed;
+    out.flags(flags);
+    out.precision(precision);
+    return passed;
+}
+
+
 }
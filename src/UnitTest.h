@@ -7,18 +7,22 @@
 
 #pragma once
 
+#include <iosfwd>
 #include <vector>
 
 
 namespace fnn {
-    struct RawTrainer;
+    class Trainer;
 }
 
 
 namespace UnitTest {
 
 
-bool ValidateLoad(const std::vector<fnn::RawTrainer>& trainingSets, const std::vector<fnn::RawTrainer>& testSets);
+bool ValidateLoad(const std::vector<fnn::Trainer>& trainingSets, const std::vector<fnn::Trainer>& testSets);
+bool ValidateTrainingLoad(const std::vector<fnn::Trainer>& trainingSets);
+bool ValidateTestLoad(const std::vector<fnn::Trainer>& testSets);
+bool ValidateKernels(std::ostream& out);
 
 
 }
@@ -7,8 +7,12 @@
 
 #pragma once
 
+#include "Random.h"
+
 #include <random>
 #include <chrono>
+#include <ostream>
+#include <string>
 #include <Eigen/Dense>
 
 
@@ -23,16 +27,28 @@ namespace fnn {
 */
 struct Global
 {
-    /** get the random number generator
+    /** get the random number generator. Main thread only.
     @return a reference to the global URBG
     */
-    static std::mt19937_64& rng()
+    static Rng& rng()
     {
         // seed with the current time
-        static std::mt19937_64 rand(get_seed());
+        static Rng rand(get_seed(), MakeStreamId(StreamUse::MAIN));
         return rand; 
     }
 
+    /** get an independent random number stream. Streams are derived from the seed, so they can be
+    used on any thread and give the same numbers however the work is divided between threads.
+    @param[in] use      What the stream is used for.
+    @param[in] index    The first index, e.g. the epoch.
+    @param[in] subIndex The second index, e.g. the batch.
+    @return The stream, at its start.
+    */
+    static Rng stream(const StreamUse use, const std::uint32_t index = 0, const std::uint32_t subIndex = 0)
+    {
+        return Rng(get_seed(), MakeStreamId(use, index, subIndex));
+    }
+
     /** get the seed for the random number generator
     */
     static long long get_seed()
@@ -45,7 +61,7 @@ struct Global
     static void set_seed(const size_t seed)
     {
         get_seed_priv() = seed;
-        rng().seed(seed);
+        rng() = Rng(seed, MakeStreamId(StreamUse::MAIN));
     }
 
     /** set the seed for the random number generator to the default seed.
@@ -80,4 +96,24 @@ void SwapMap(Eigen::Map<T>& left, Eigen::Map<T>& right)
 }
 
 
+/** Write a string as a JSON string literal. Control characters become spaces.
+@param[in] out  The stream to write to.
+@param[in] text The string.
+*/
+inline void WriteJsonString(std::ostream& out, const std::string& text)
+{
+    out << '"';
+    for (const char c : text)
+    {
+        if (c == '"' || c == '\\')
+            out << '\\' << c;
+        else if (static_cast<unsigned char>(c) < 0x20)
+            out << ' ';
+        else
+            out << c;
+    }
+    out << '"';
+}
+
+
 }
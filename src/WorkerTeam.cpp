@@ -0,0 +1,190 @@
+// ==================================================================
+// Copyright (c) 2019 Alexander Freed. ALL RIGHTS RESERVED.
+// Language: ISO C++14
+//
+// WorkerTeam class definition.
+// ==================================================================
+
+#include "WorkerTeam.h"
+
+#include "Numa.h"
+#include "Trace.h"
+
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+    #include <emmintrin.h>
+    #define FNN_CPU_RELAX() _mm_pause()
+#else
+    #define FNN_CPU_RELAX() std::this_thread::yield()
+#endif
+
+
+namespace fnn {
+
+
+namespace {
+
+
+// how long a waiting thread spins before it yields its core, and then how often it yields before it sleeps.
+// Spinning alone would starve the other members when there are more threads than cores.
+constexpr unsigned SPIN_LIMIT  = 200;
+constexpr unsigned YIELD_LIMIT = 2000;
+
+
+}  // namespace
+
+
+/** Constructor
+Starts the members other than the calling thread.
+With a topology, each member is pinned to its CPU, and the caller to the CPUs of its node until the team is destroyed,
+as the caller's threads, e.g. the loaders that feed it, are better on its node than anywhere.
+@param[in] numThreads The number of members, including the caller. At least 1.
+@param[in] pTopology  [default: nullptr] The nodes to spread the members over, or null to leave them to the scheduler.
+*/
+WorkerTeam::WorkerTeam(const unsigned numThreads, const NumaTopology* pTopology)
+    : m_numThreads(std::max(numThreads, 1u))
+{
+    if (pTopology != nullptr)
+    {
+        for (unsigned member = 0; member < m_numThreads; ++member)
+        {
+            m_memberCpus.push_back(pTopology->CpuOfThread(member, m_numThreads));
+            m_memberNodes.push_back(pTopology->GetNodes()[pTopology->NodeOfThread(member, m_numThreads)].id);
+        }
+        m_callerCpus = GetThreadCpus();
+        PinThreadToCpus(pTopology->GetNodes()[pTopology->NodeOfThread(0, m_numThreads)].cpus);
+    }
+    for (unsigned member = 1; member < m_numThreads; ++member)
+        m_threads.emplace_back(&WorkerTeam::work, this, member);
+}
+
+
+/** Destructor
+Stops the members, and lets the caller run where it could before.
+*/
+WorkerTeam::~WorkerTeam()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+        ++m_generation;
+    }
+    m_wake.notify_all();
+    for (std::thread& thread : m_threads)
+        thread.join();
+    if (!m_callerCpus.empty())
+        PinThreadToCpus(m_callerCpus);
+}
+
+
+/** Move each member's slice of the columns of a column-major matrix to its node's memory, for the slices
+ForEachSlice gives it. Pages that straddle two slices stay where they are.
+Does nothing without a topology.
+@param[in] pColumns   The first column.
+@param[in] numRows    The length of a column.
+@param[in] numColumns The number of columns.
+@return false if the kernel refused to move some slice.
+*/
+bool WorkerTeam::PlaceSlices(const double* pColumns, const size_t numRows, const size_t numColumns) const
+{
+    bool placed = true;
+    for (unsigned member = 0; member < m_memberNodes.size(); ++member)
+    {
+        size_t first, count;
+        Slice(numColumns, member, m_numThreads, first, count);
+        if (count > 0)
+            placed = MoveMemoryToNode(pColumns + first * numRows, count * numRows * sizeof(double), m_memberNodes[member]) && placed;
+    }
+    return placed;
+}
+
+
+/** Get a member's slice of a range. The slices are about equal, start on multiples of SLICE_GRANULARITY,
+and cover the range in member order.
+@param[in]  count      The number of items.
+@param[in]  member     The member.
+@param[in]  numMembers The number of members.
+@param[out] out_first  The first item of the slice.
+@param[out] out_count  The number of items in the slice. May be 0.
+*/
+void WorkerTeam::Slice(const size_t count, const unsigned member, const unsigned numMembers, size_t& out_first, size_t& out_count)
+{
+    const size_t numUnits = (count + SLICE_GRANULARITY - 1) / SLICE_GRANULARITY;
+    const size_t first    = std::min(count, numUnits * member / numMembers * SLICE_GRANULARITY);
+    const size_t last     = std::min(count, numUnits * (member + 1) / numMembers * SLICE_GRANULARITY);
+    out_first = first;
+    out_count = last - first;
+}
+
+
+/** Run a task on every member and wait for them.
+@param[in] invoke Calls the task.
+@param[in] pTask  The task.
+*/
+void WorkerTeam::run(const Invoke invoke, const void* pTask)
+{
+    m_invoke = invoke;
+    m_pTask  = pTask;
+    m_numDone.store(0, std::memory_order_relaxed);
+    // publishes the task. Sequentially consistent, so either a member going to sleep sees the new task, or this sees it sleeping.
+    ++m_generation;
+    if (m_numSleeping.load() > 0)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_wake.notify_all();
+    }
+
+    invoke(pTask, 0);
+
+    const unsigned numOthers = m_numThreads - 1;
+    for (unsigned spins = 0; m_numDone.load(std::memory_order_acquire) != numOthers; ++spins)
+    {
+        if (spins < SPIN_LIMIT)
+            FNN_CPU_RELAX();
+        else
+            std::this_thread::yield();
+    }
+}
+
+
+/** The loop of a member other than the caller: wait for a task, run it, and report it done.
+@param[in] member The member.
+*/
+void WorkerTeam::work(const unsigned member)
+{
+    Trace::SetThreadName("worker team");
+    if (!m_memberCpus.empty())
+        PinThreadToCpus({ m_memberCpus[member] });
+    std::uint64_t seen = 0;
+    while (true)
+    {
+        // wait for the next task: spin, then yield, then sleep
+        unsigned waits = 0;
+        std::uint64_t generation;
+        while ((generation = m_generation.load(std::memory_order_acquire)) == seen)
+        {
+            if (waits < SPIN_LIMIT)
+                FNN_CPU_RELAX();
+            else if (waits < SPIN_LIMIT + YIELD_LIMIT)
+                std::this_thread::yield();
+            else
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                ++m_numSleeping;
+                m_wake.wait(lock, [&]() { return m_generation.load() != seen; });
+                --m_numSleeping;
+            }
+            ++waits;
+        }
+        seen = generation;
+        if (m_stop.load())
+            return;
+
+        m_invoke(m_pTask, member);
+        m_numDone.fetch_add(1, std::memory_order_release);
+    }
+}
+
+
+}
@@ -0,0 +1,116 @@
+// ==================================================================
+// Copyright (c) 2019 Alexander Freed. ALL RIGHTS RESERVED.
+// Language: ISO C++14
+//
+// WorkerTeam class declaration.
+// Splits one operation, e.g. one sample's product with a weight matrix, across cores.
+// ==================================================================
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+namespace fnn {
+
+
+class NumaTopology;
+
+
+/** A persistent team of threads that run one task together and wait for each other.
+The calling thread is member 0 and works too. The other members spin between tasks, so starting
+a task costs a cache line transfer instead of a wakeup, which is what makes splitting a single
+sample worthwhile. After a while without a task they sleep until the next one.
+A member always has the same index, so a member that takes the same slice of a matrix every time
+keeps that slice in its core's private cache.
+With a NUMA topology, each member is pinned to a CPU, so it also keeps its slice in its node's memory.
+*/
+class WorkerTeam
+{
+public:
+    // slices start on a multiple of this, one cache line of doubles, so members never write the same line
+    constexpr static size_t SLICE_GRANULARITY = 8;
+
+    explicit WorkerTeam(const unsigned numThreads, const NumaTopology* pTopology = nullptr);
+    ~WorkerTeam();
+
+    WorkerTeam(const WorkerTeam&) = delete;
+    WorkerTeam& operator=(const WorkerTeam&) = delete;
+
+    unsigned GetNumThreads() const { return m_numThreads; }
+
+    /** Run task(member) on every member, the caller as member 0, and wait for all of them to finish.
+    Only one thread may call Run at a time.
+    @param[in] task A callable with the signature void(unsigned member).
+    */
+    template <typename Task>
+    void Run(const Task& task)
+    {
+        run([](const void* pTask, const unsigned member) { (*static_cast<const Task*>(pTask))(member); }, &task);
+    }
+
+    bool PlaceSlices(const double* pColumns, const size_t numRows, const size_t numColumns) const;
+
+    static void Slice(const size_t count, const unsigned member, const unsigned numMembers, size_t& out_first, size_t& out_count);
+
+private:
+    using Invoke = void (*)(const void* pTask, const unsigned member);
+
+    void run(const Invoke invoke, const void* pTask);
+    void work(const unsigned member);
+
+    unsigned                   m_numThreads;
+    Invoke                     m_invoke = nullptr;
+    const void*                m_pTask  = nullptr;
+    // the task number, and the members done with it. On their own cache lines, as every member polls them.
+    char                       m_padding0[64];
+    std::atomic<std::uint64_t> m_generation{ 0 };
+    char                       m_padding1[64];
+    std::atomic<unsigned>      m_numDone{ 0 };
+    char                       m_padding2[64];
+    std::atomic<bool>          m_stop{ false };
+
+    // sleeping members
+    std::mutex                 m_mutex;
+    std::condition_variable    m_wake;
+    std::atomic<unsigned>      m_numSleeping{ 0 };
+
+    std::vector<std::thread>   m_threads;
+
+    // placement. Empty without a topology.
+    std::vector<unsigned>      m_memberCpus;   // the CPU each member is pinned to. The caller's entry is unused.
+    std::vector<unsigned>      m_memberNodes;  // the kernel's number for each member's node
+    std::vector<unsigned>      m_callerCpus;   // the CPUs the caller could run on before it was pinned to its node
+};
+
+
+/** Split [0, count) into one slice per member of a team and run task(first, count) on each member's slice.
+Without a team, runs task(0, count) on this thread.
+@param[in] pTeam The team, or null.
+@param[in] count The number of items, e.g. the columns of a matrix.
+@param[in] task  A callable with the signature void(size_t first, size_t count). Not called for empty slices.
+*/
+template <typename Task>
+void ForEachSlice(WorkerTeam* pTeam, const size_t count, const Task& task)
+{
+    if (pTeam == nullptr || pTeam->GetNumThreads() == 1)
+    {
+        task(size_t(0), count);
+        return;
+    }
+    pTeam->Run([&](const unsigned member) {
+        size_t first, sliceCount;
+        WorkerTeam::Slice(count, member, pTeam->GetNumThreads(), first, sliceCount);
+        if (sliceCount > 0)
+            task(first, sliceCount);
+    });
+}
+
+
+}
@@ -6,18 +6,45 @@
 // Sequences the neural network training.
 // ==================================================================
 
+#include "Augmenter.h"
+#include "DatasetFile.h"
+#include "Ensemble.h"
+#include "EpochSampler.h"
 #include "FileIO.h"
+#include "Kernels.h"
+#include "MappedFile.h"
 #include "NeuralNet.h"
+#include "Numa.h"
+#include "Optimizer.h"
+#include "PerfCounters.h"
+#include "SparseDataset.h"
+#include "StreamingDataSource.h"
+#include "Sweep.h"
+#include "Synthetic.h"
+#include "Trace.h"
+#include "TrainingSchedule.h"
 #include "UnitTest.h"
 #include "Utility.h"
+#include "WorkerTeam.h"
 
+#include <functional>
+#include <future>
+#include <iomanip>
 #include <iostream>
 #include <ios>
+#include <memory>
+#include <sstream>
 #include <string>
+#include <thread>
 #include <tuple>
 #include <vector>
 #include <algorithm>
 #include <cassert>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <limits>
 
 
 using namespace fnn;
@@ -26,144 +53,410 @@ using namespace fnn;
 // ------------------------------------------------------------------
 // loading / saving
 
-/** Do some pre-processing on the data.
-Normalize to a 0..1 range
-set the biases to 1.0
-@param[in/out] trainers The training data to process.
-@return false if any training data failed the range check.
+/** Get the size of a file.
+@return The size in bytes, or 0 if the file does not exist.
 */
-bool preprocess(std::vector<RawTrainer>& trainers)
+size_t fileSize(const std::string& path)
 {
-    // sanity check. Data should be in range [0, 255] inclusive
-    for (auto& trainer : trainers)
+    std::ifstream fin(path.c_str(), std::ios::binary | std::ios::ate);
+    return fin ? static_cast<size_t>(fin.tellg()) : 0;
+}
+
+
+/** Save the sparse (CSR) cache of a data set and report its size against the dense cache.
+@param[in] pathProcessed The dense cache, for comparison.
+@param[in] pathSparse    The sparse cache to write.
+@param[in] packed        The samples in stored form.
+@param[in] out           Where to print progress.
+*/
+void saveSparse(const std::string& pathProcessed, const std::string& pathSparse, const FileIO::PackedDataset& packed, std::ostream& out)
+{
+    out << "Saving sparse data...";
+    out.flush();
+    if (!FileIO::WriteSparseDataset(pathSparse, packed))
     {
-        decltype(trainer.m_inputs)::const_iterator min, max;
-        std::tie(min, max) = std::minmax_element(trainer.m_inputs.begin(), trainer.m_inputs.end());
+        out << "Failed!\nUnable to save sparse data. Program can still continue." << std::endl;
+        return;
+    }
 
-        if (trainer.m_target < 0 || trainer.m_target > 9 || min == trainer.m_inputs.cend() || *min < 0 || *max > 255)
-        {
-            assert(false);
-            return false;
-        }
+    const size_t denseBytes  = fileSize(pathProcessed);
+    const size_t sparseBytes = fileSize(pathSparse);
+    out << "Done. " << sparseBytes / 1e6 << " MB";
+    if (denseBytes > 0)
+        out << " (" << 100.0 * sparseBytes / denseBytes << "% of the " << denseBytes / 1e6 << " MB dense cache)";
+    out << std::endl;
+}
+
+
+/** Write the sparse cache from the dense cache.
+@param[in] pathProcessed The dense cache.
+@param[in] pathSparse    The sparse cache to write.
+@param[in] out           Where to print progress.
+*/
+void saveSparseFromCache(const std::string& pathProcessed, const std::string& pathSparse, std::ostream& out)
+{
+    FileIO::LoadResult result = FileIO::LoadResult::UNEXPECTED_ERROR;
+    FileIO::DatasetView view;
+    std::tie(result, view) = FileIO::MapDataset(pathProcessed);
+    if (result != FileIO::LoadResult::SUCCESS || view.GetHeader().pixelType != FileIO::ElementType::UINT8)
+        return;
+
+    FileIO::PackedDataset packed;
+    packed.imageRows = view.GetHeader().imageRows;
+    packed.imageCols = view.GetHeader().imageCols;
+    packed.labels.assign(view.GetLabels(), view.GetLabels() + view.GetNumSamples());
+    packed.pixels.assign(view.GetPixels(), view.GetPixels() + view.GetNumSamples() * packed.GetPixelsPerSample());
+    saveSparse(pathProcessed, pathSparse, packed, out);
+}
+
+
+/** Load a data set from its binary cache, bringing the cache up to date with the CSV first.
+Rows appended to the CSV since the cache was built are parsed and added to the cache in place.
+A cache whose CSV changed in any other way is not used. If there is no CSV the cache is used as is.
+@param[in]  pathCsv       The CSV.
+@param[in]  pathProcessed The dense cache.
+@param[in]  pathSparse    The sparse cache. Rebuilt if rows were added.
+@param[out] out_set       The loaded data, ready for use.
+@param[in]  out           Where to print progress.
+@return true if out_set was loaded. false if the cache must be rebuilt from the CSV.
+*/
+bool loadCached(const std::string& pathCsv, const std::string& pathProcessed, const std::string& pathSparse, std::vector<Trainer>& out_set, std::ostream& out)
+{
+    FileIO::LoadResult result = FileIO::LoadResult::UNEXPECTED_ERROR;
+    FileIO::DatasetView view;
+    std::tie(result, view) = FileIO::MapDataset(pathProcessed);
+    if (!FileIO::CheckLoad(result, &out))
+        return false;
+    std::tie(result, out_set) = FileIO::Deserialize(view);
+    if (!FileIO::CheckLoad(result, &out))
+        return false;
+
+    // size and modification time identify an unchanged CSV
+    const FileIO::CsvSource source = view.GetHeader().source;
+    FileIO::FileStatus status;
+    if (!FileIO::GetFileStatus(pathCsv, status) || (status.size == source.size && status.mtime == source.mtime))
+    {
+        if (!std::ifstream(pathSparse.c_str()))
+            saveSparseFromCache(pathProcessed, pathSparse, out);
+        return true;
     }
-    
-    // 1) normalize data to a 0..1 range
-    // 2) set bias (first weight) to 1.0
-    std::for_each(trainers.begin(), trainers.end(), 
-        [](RawTrainer& trainer) { 
-            trainer.m_inputs[0] = 1.0;
-            const auto firstWeight = std::next(trainer.m_inputs.begin());  // the first weight is the second element
-            std::transform(firstWeight, trainer.m_inputs.end(), firstWeight, [](const double val) { return val / 255.0; });
-        });
+
+    out << "Checking for rows added to: " << pathCsv << std::endl;
+    FileIO::PackedDataset tail;
+    std::vector<Trainer> tailSet;
+    std::tie(result, tailSet) = FileIO::LoadCsvTail(pathCsv, source, tail, &out);
+    if (!FileIO::CheckLoad(result, &out))
+    {
+        out_set.clear();
+        return false;
+    }
+
+    // release the mapping before writing to the file
+    view = FileIO::DatasetView();
+    out << "Adding " << tail.GetNumSamples() << " rows to the cache...";
+    out.flush();
+    if (FileIO::AppendDataset(pathProcessed, tail))
+        out << "Done." << std::endl;
+    else
+        out << "Failed!\nUnable to update the cache. Program can still continue." << std::endl;
+
+    out_set.insert(out_set.end(), std::make_move_iterator(tailSet.begin()), std::make_move_iterator(tailSet.end()));
+    if (tail.GetNumSamples() > 0 || !std::ifstream(pathSparse.c_str()))
+        saveSparseFromCache(pathProcessed, pathSparse, out);
+    return true;
+}
+
+
+/** Load one data set: from its binary cache if possible, otherwise from the CSV (which also writes the caches).
+Either way the data is read, checked and converted in a single pass.
+@param[in]  basePath The directory holding the files.
+@param[in]  name     The filename without extension. e.g. "mnist_train".
+@param[in]  rowsHint The expected number of rows.
+@param[out] out_set  The loaded data, ready for use.
+@param[in]  out      Where to print progress.
+@return true if load was successful.
+*/
+bool loadSet(const std::string& basePath, const std::string& name, const size_t rowsHint, std::vector<Trainer>& out_set, std::ostream& out)
+{
+    const std::string pathCsv       = basePath + name + ".csv";
+    const std::string pathProcessed = basePath + name + ".bin";
+    const std::string pathSparse    = basePath + name + ".csr";
+
+    // first try to load the preprocessed data. If this is the first time the program is run
+    // on this machine, or the CSV was changed, this will fail.
+    out << "Loading: " << pathProcessed << std::endl;
+    if (loadCached(pathCsv, pathProcessed, pathSparse, out_set, out))
+        return true;
+
+    // if we couldn't load the preprocessed data, load the regular CSV, then save the caches to disk.
+    out << "Unable to load preprocessed data. Must load data from CSV.\n"
+        << "This may take a few seconds.\n"
+        << "A binary file will be generated in the same directory to speed up future loading.\n";
+
+    out << "Loading: " << pathCsv << std::endl;
+    FileIO::LoadResult result = FileIO::LoadResult::UNEXPECTED_ERROR;
+    FileIO::PackedDataset packed;
+    std::tie(result, out_set) = FileIO::LoadCsv(pathCsv, rowsHint, packed, &out);
+    // handle I/O and format errors
+    if (!FileIO::CheckLoad(result, &out))
+    {
+        out << "Unable to load file: " << pathCsv << std::endl;
+        return false;
+    }
+
+    // save the processed data for faster loading next time
+    out << "Saving processed data for faster load next time...";
+    out.flush();
+    if (FileIO::Serialize(pathProcessed, packed))
+        out << "Done." << std::endl;
+    else
+        out << "Failed!\nUnable to save processed data. Program can still continue." << std::endl;
+    saveSparse(pathProcessed, pathSparse, packed, out);
 
     return true;
 }
 
 
-/** load the training and test sets
+/** load the training set.
+@param[in]  basePath        The directory holding the files.
 @param[out] out_trainingSet An output vector of loaded training set data
-@param[out] out_testSet     An output vector of loaded test set data
+@param[in]  out             Where to print progress.
 @param true if load was successful.
 */
-bool load(const std::string& basePath, std::vector<Trainer>& out_trainingSet, std::vector<Trainer>& out_testSet)
+bool loadTrainingSet(const std::string& basePath, std::vector<Trainer>& out_trainingSet, std::ostream& out)
 {
-    // hard-code the filenames
-    const std::string pathTrainingSet       = basePath + "mnist_train.csv";
-    const std::string pathTestSet           = basePath + "mnist_test.csv";
-    const std::string pathTrainingProcessed = basePath + "mnist_train.bin";
-    const std::string pathTestProcessed     = basePath + "mnist_test.bin";
+    if (!loadSet(basePath, "mnist_train", 60000, out_trainingSet, out))
+        return false;
 
+    // validate load
+    out << "Validating load...";
+    out.flush();
+    if (!UnitTest::ValidateTrainingLoad(out_trainingSet))
+    {
+        out << "Failed!\nLoad unsuccessful." << std::endl;
+        return false;
+    }
+    out << "Done." << std::endl;
+
+    return true;
+}
+
+
+/** load the test set.
+@param[in]  basePath    The directory holding the files.
+@param[out] out_testSet An output vector of loaded test set data
+@param[in]  out         Where to print progress.
+@param true if load was successful.
+*/
+bool loadTestSet(const std::string& basePath, std::vector<Trainer>& out_testSet, std::ostream& out)
+{
+    if (!loadSet(basePath, "mnist_test", 10000, out_testSet, out))
+        return false;
+
+    out << "Validating load...";
+    out.flush();
+    if (!UnitTest::ValidateTestLoad(out_testSet))
+    {
+        out << "Failed!\nLoad unsuccessful." << std::endl;
+        return false;
+    }
+    out << "Done." << std::endl;
+
+    return true;
+}
+
+
+/** load the test set from its sparse cache.
+@param[in]  basePath    The directory holding the files.
+@param[out] out_testSet The mapped test set.
+@param[in]  out         Where to print progress.
+@param true if load was successful.
+*/
+bool loadSparseTestSet(const std::string& basePath, FileIO::SparseDatasetView& out_testSet, std::ostream& out)
+{
+    const std::string pathSparse = basePath + "mnist_test.csr";
+    out << "Loading: " << pathSparse << std::endl;
     FileIO::LoadResult result = FileIO::LoadResult::UNEXPECTED_ERROR;
-    std::vector<RawTrainer> rawTrainingSet;
-    std::vector<RawTrainer> rawTestSet;
-    bool mustLoadCsv = false;
+    std::tie(result, out_testSet) = FileIO::MapSparseDataset(pathSparse);
+    return FileIO::CheckLoad(result, &out);
+}
 
-    // first try to load the preprocessed data. If this is the first time the program is run
-    // on this machine, this will fail.
-    std::cout << "Loading preprocessed data.\n";
-    std::cout << "Loading: " << pathTrainingProcessed << std::endl;
-    std::tie(result, rawTrainingSet) = FileIO::Deserialize(pathTrainingProcessed);
-    // handle I/O errors
-    if (!FileIO::CheckLoad(result))
-        mustLoadCsv = true;
-    std::cout << "Loading: " << pathTestProcessed << std::endl;
-    std::tie(result, rawTestSet) = FileIO::Deserialize(pathTestProcessed);
+
+/** A data set loaded on another thread, and what the loader printed.
+*/
+template <typename DataSet>
+struct LoadedSet
+{
+    bool        success = false;
+    DataSet     data;
+    std::string log;
+};
+
+
+/** Run a loader on its own thread.
+Its output is buffered so that it does not interleave with the main thread's.
+@param[in] loader A callable taking (DataSet& out_data, std::ostream& out) and returning true on success.
+@return The future result.
+*/
+template <typename DataSet, typename Loader>
+std::future<LoadedSet<DataSet>> loadAsync(Loader loader)
+{
+    return std::async(std::launch::async, [loader]() {
+        LoadedSet<DataSet> loaded;
+        std::ostringstream log;
+        loaded.success = loader(loaded.data, log);
+        loaded.log     = log.str();
+        return loaded;
+    });
+}
+
+
+/** Split the training set cache into shards for streaming.
+@param[in] basePath        The directory holding the files.
+@param[in] samplesPerShard The number of samples in each shard.
+@return true if successful.
+*/
+bool writeShards(const std::string& basePath, const size_t samplesPerShard)
+{
+    const std::string pathProcessed = basePath + "mnist_train.bin";
+
+    std::cout << "Loading: " << pathProcessed << std::endl;
+    FileIO::LoadResult result = FileIO::LoadResult::UNEXPECTED_ERROR;
+    FileIO::DatasetView view;
+    std::tie(result, view) = FileIO::MapDataset(pathProcessed);
     if (!FileIO::CheckLoad(result))
-        mustLoadCsv = true;
+    {
+        std::cout << "Run once without options to generate the binary file." << std::endl;
+        return false;
+    }
 
-    // if we couldn't load the preprocessed data, load the regular CSV's, process them, then save them to disk.
-    if (!mustLoadCsv)
-        std::cout << "Preprocessed data successfully loaded." << std::endl;
-    else
+    std::cout << "Writing shards...";
+    std::cout.flush();
+    const size_t numShards = FileIO::WriteShards(view, basePath + "mnist_train", samplesPerShard);
+    if (numShards == 0)
     {
-        std::cout << "Unable to load preprocessed data. Must load data from CSV.\n"
-                 <<  "This may take ~30 seconds in a release build and ~4 minutes in a debug build.\n"
-                  << "Binary files will be generated in the same directory to speed up future loading.\n";
+        std::cout << "Failed!" << std::endl;
+        return false;
+    }
+    std::cout << "Done. Wrote " << numShards << " shards." << std::endl;
+    return true;
+}
 
-        std::cout << "Loading: " << pathTrainingSet << std::endl;
-        std::tie(result, rawTrainingSet) = FileIO::LoadCsv(pathTrainingSet, 60000, true);
-        // handle I/O errors
-        if (!FileIO::CheckLoad(result))
-        {
-            std::cout << "Unable to load file: " << pathTrainingSet << std::endl;
-            return false;
-        }
-        std::cout << "Loading: " << pathTestSet << std::endl;
-        std::tie(result, rawTestSet) = FileIO::LoadCsv(pathTestSet, 10000, true);
-        if (!FileIO::CheckLoad(result))
+
+/** Write a synthetic data set in place of the MNIST files: the CSVs and their dense and sparse caches.
+The test set has a sixth as many samples as the training set, like MNIST. See Synthetic.h.
+Existing CSVs are not overwritten.
+@param[in] basePath    The directory to write the files to.
+@param[in] numTraining The number of training samples.
+@return true if successful.
+*/
+bool writeSynthetic(const std::string& basePath, const size_t numTraining)
+{
+    const std::string    names[]  = { "mnist_train", "mnist_test" };
+    const SyntheticSplit splits[] = { SyntheticSplit::TRAIN, SyntheticSplit::TEST };
+    const size_t         sizes[]  = { numTraining, std::max<size_t>(numTraining / 6, 1) };
+
+    for (int i = 0; i < 2; ++i)
+    {
+        if (std::ifstream((basePath + names[i] + ".csv").c_str()))
         {
-            std::cout << "Unable to load file: " << pathTestSet << std::endl;
+            std::cout << basePath << names[i] << ".csv already exists. Use another dataPath." << std::endl;
             return false;
         }
+    }
 
-        // run preprocessing
-        std::cout << "Processing data...";
+    for (int i = 0; i < 2; ++i)
+    {
+        const std::string pathCsv       = basePath + names[i] + ".csv";
+        const std::string pathProcessed = basePath + names[i] + ".bin";
+        const std::string pathSparse    = basePath + names[i] + ".csr";
+
+        std::cout << "Writing " << sizes[i] << " synthetic samples: " << pathCsv << "...";
         std::cout.flush();
-        if (!preprocess(rawTrainingSet) || !preprocess(rawTestSet))
+        FileIO::PackedDataset packed = MakeSyntheticDataset(sizes[i], splits[i]);
+        if (!FileIO::WriteCsv(pathCsv, packed) || !FileIO::Serialize(pathProcessed, packed))
         {
-            std::cout << "Failed!\nData was formatted incorrectly." << std::endl;
+            std::cout << "Failed!" << std::endl;
             return false;
         }
         std::cout << "Done." << std::endl;
-
-        // save the processed training data for faster loading next time
-        std::cout << "Saving processed data for faster load next time...";
-        std::cout.flush();
-        if (FileIO::Serialize(pathTrainingProcessed, rawTrainingSet) &&
-            FileIO::Serialize(pathTestProcessed, rawTestSet))
-        {
-            std::cout << "Done." << std::endl;
-        }
-        else
-            std::cout << "Failed!\nUnable to save processed data. Program can still continue." << std::endl;
+        saveSparse(pathProcessed, pathSparse, packed, std::cout);
     }
+    return true;
+}
 
-    // validate load
-    std::cout << "Validating load...";
-    std::cout.flush();
-    if (!UnitTest::ValidateLoad(rawTrainingSet, rawTestSet))
+
+/** Compare the dense and sparse caches: file size and load time from a cold page cache.
+Loading includes validating the checksum, which reads every byte, and one pass over the samples.
+@param[in] basePath The directory holding the files.
+@return true if all caches could be loaded.
+*/
+bool sparseReport(const std::string& basePath)
+{
+    using Clock = std::chrono::steady_clock;
+    const auto seconds = [](const Clock::time_point start) { return std::chrono::duration<double>(Clock::now() - start).count(); };
+
+    std::cout << "file                size (MB)   cold load (ms)   warm load (ms)\n";
+    for (const std::string name : { "mnist_train", "mnist_test" })
     {
-        std::cout << "Failed!\nLoad unsuccessful." << std::endl;
-        return false;
-    }
-    std::cout << "Done." << std::endl;
+        const std::string pathProcessed = basePath + name + ".bin";
+        const std::string pathSparse    = basePath + name + ".csr";
+        FileIO::LoadResult result = FileIO::LoadResult::UNEXPECTED_ERROR;
 
-    // convert the sets
-    std::cout << "Converting data into internal representation...";
-    std::cout.flush();
-    out_trainingSet.clear();
-    out_testSet.clear();
+        // dense: map, then read every pixel
+        const auto loadDense = [&]() {
+            FileIO::DatasetView view;
+            std::tie(result, view) = FileIO::MapDataset(pathProcessed);
+            size_t sum = 0;
+            const size_t numBytes = view.GetNumSamples() * view.GetHeader().GetBytesPerSample();
+            for (size_t i = 0; i < numBytes; ++i)
+                sum += view.GetPixels()[i];
+            return sum;
+        };
+        // sparse: map, then read every row
+        const auto loadSparse = [&]() {
+            FileIO::SparseDatasetView view;
+            std::tie(result, view) = FileIO::MapSparseDataset(pathSparse);
+            size_t sum = 0;
+            for (const auto& trainer : view)
+            {
+                for (size_t k = 0; k < trainer.GetInputs().numNonZero; ++k)
+                    sum += trainer.GetInputs().pValues[k];
+            }
+            return sum;
+        };
 
-    out_trainingSet.reserve(rawTrainingSet.size());
-    out_testSet.reserve(rawTestSet.size());
+        const std::pair<std::string, std::function<size_t()>> loaders[] = { { pathProcessed, loadDense }, { pathSparse, loadSparse } };
+        size_t checksums[2] = {};
+        for (size_t i = 0; i < 2; ++i)
+        {
+            const std::string& path = loaders[i].first;
+            if (!FileIO::EvictFromPageCache(path))
+                std::cout << "(unable to evict " << path << " from the page cache)\n";
 
-    for (auto& trainer : rawTrainingSet)
-        out_trainingSet.emplace_back(trainer);
-    for (auto& trainer : rawTestSet)
-        out_testSet.emplace_back(trainer);
+            auto start = Clock::now();
+            checksums[i] = loaders[i].second();
+            const double cold = seconds(start);
+            if (!FileIO::CheckLoad(result))
+                return false;
+            start = Clock::now();
+            loaders[i].second();
+            const double warm = seconds(start);
 
-    std::cout << "Done" << std::endl;
+            std::cout << std::left << std::setw(20) << (name + (i == 0 ? ".bin" : ".csr"))
+                      << std::setw(12) << fileSize(path) / 1e6
+                      << std::setw(17) << cold * 1e3
+                      << warm * 1e3 << "\n";
+        }
 
+        // both forms must hold the same pixels
+        if (checksums[0] != checksums[1])
+        {
+            std::cout << "The sparse and dense caches of " << name << " do not match." << std::endl;
+            return false;
+        }
+    }
+    std::cout.flush();
     return true;
 }
 
@@ -171,42 +464,122 @@ bool load(const std::string& basePath, std::vector<Trainer>& out_trainingSet, st
 // ==================================================================
 // training
 
-/** Evaluate the neural network with a whole collection of training data to check accuracy.
-Calculate the ratio of correct answers / total inputs
-@param[in] neuralnet The neural net object.
-@param[in] data      A standard container of trainers.
-@return The ratio of correct answers / total inputs.
+/** A test set that is still loading on another thread.
+Training does not wait for it. Until it arrives, the network is copied at every evaluation
+and the copies are evaluated against the test set once it is ready.
 */
-template <typename DataContainer>
-double Evaluate(const NeuralNetDigitClassifier& neuralnet, const DataContainer& data)
+template <typename TestSet>
+class PendingTestSet
 {
-    int correct = 0;
-    for (auto& trainer : data)
+public:
+    explicit PendingTestSet(std::future<LoadedSet<TestSet>>&& future)
+        : m_future(std::move(future))
+    { }
+
+    /** Evaluate the neural net against the test set, or defer the evaluation if the test set is not ready.
+    @param[in]     neuralnet The neural net object.
+    @param[in]     name      Names the evaluation if it is deferred. e.g. "epoch 1".
+    @param[in/out] plotData  Gets the accuracy appended. A deferred accuracy is filled in later.
+    @return false if the test set failed to load.
+    */
+    bool EvaluateOrDefer(const NeuralNetDigitClassifier& neuralnet, const std::string& name, std::vector<double>& plotData)
     {
-        const int answer = neuralnet.DetermineDigit(trainer.GetInputs());
-        if (answer == trainer.GetTarget())
-            ++correct;
+        plotData.push_back(0);
+        if (!m_ready && m_future.wait_for(std::chrono::seconds(0)) == std::future_status::ready && !receive(plotData))
+            return false;
+
+        if (m_ready)
+        {
+            plotData.back() = evaluate(neuralnet, "Test Set Accuracy     : ");
+            return true;
+        }
+
+        std::cout << "    Test Set Accuracy     : (test set still loading)" << std::endl;
+        m_deferred.push_back(Deferred{ name, plotData.size() - 1, neuralnet });
+        return true;
     }
-    return correct / static_cast<double>(data.size());
-}
+
+    /** Wait for the test set and catch up on the deferred evaluations.
+    @param[in/out] plotData The plot data. Deferred accuracies are filled in.
+    @return false if the test set failed to load.
+    */
+    bool Wait(std::vector<double>& plotData)
+    {
+        return m_ready || receive(plotData);
+    }
+
+    /** Get the test set. Only valid after Wait returns true.
+    */
+    const TestSet& Get() const { return m_testSet; }
+
+private:
+    struct Deferred
+    {
+        std::string              name;
+        size_t                   plotIndex;
+        NeuralNetDigitClassifier neuralnet;
+    };
+
+    /** Take the test set from the loader and run the deferred evaluations.
+    */
+    bool receive(std::vector<double>& plotData)
+    {
+        LoadedSet<TestSet> loaded = m_future.get();
+        std::cout << "\nTest set loaded on a background thread:\n" << loaded.log;
+        if (!loaded.success)
+            return false;
+
+        m_testSet = std::move(loaded.data);
+        m_ready   = true;
+        for (const auto& deferred : m_deferred)
+            plotData[deferred.plotIndex] = evaluate(deferred.neuralnet, "Test Set Accuracy (" + deferred.name + ") : ");
+        m_deferred.clear();
+        std::cout << std::endl;
+        return true;
+    }
+
+    double evaluate(const NeuralNetDigitClassifier& neuralnet, const std::string& label) const
+    {
+        const double accuracy = Evaluate(neuralnet, m_testSet);
+        std::cout << "    " << label << accuracy * 100 << "%" << std::endl;
+        return accuracy;
+    }
+
+    std::future<LoadedSet<TestSet>> m_future;
+    TestSet                         m_testSet;
+    bool                            m_ready = false;
+    std::vector<Deferred>           m_deferred;
+};
 
 
 /** Calls Evaluate on the training data and test data.
 @param[in]     neuralnet   The neural net object.
-@param[in]     trainingSet The vector of training data.
-@param[in]     testSet     The vector of test data.
+@param[in]     trainingSet The training data.
+@param[in/out] testSet     The test data, possibly still loading.
+@param[in]     name        Names the evaluation if the test set part is deferred.
 @param[in/out] plotData    A vector to hold data for plotting later.
+@param[in/out] pCounters   [default: nullptr] If not null, counts the hardware events of the training set evaluation.
+@return false if the test set failed to load.
 */
-template <typename DataContainer>
-void EvaluateWrapper(const NeuralNetDigitClassifier& neuralnet, const DataContainer& trainingSet, const DataContainer& testSet, std::vector<double>& plotData)
+template <typename TrainingContainer, typename TestSet>
+bool EvaluateWrapper(const NeuralNetDigitClassifier& neuralnet, TrainingContainer& trainingSet, PendingTestSet<TestSet>& testSet, const std::string& name, std::vector<double>& plotData,
+                     PerfCounters* pCounters=nullptr)
 {
+    if (pCounters != nullptr)
+    {
+        pCounters->Reset();
+        pCounters->Start();
+    }
     const double accuracyTraining = Evaluate(neuralnet, trainingSet);
     std::cout << "    Training Set Accuracy : " << accuracyTraining * 100 << "%" << std::endl;
-    const double accuracyTest = Evaluate(neuralnet, testSet);
-    std::cout << "    Test Set Accuracy     : " << accuracyTest * 100 << "%" << std::endl;
-
+    if (pCounters != nullptr)
+    {
+        pCounters->Stop();
+        std::cout << "    Evaluate Counters     : " << PerfCounters::Describe(pCounters->Read(), double(trainingSet.size())) << std::endl;
+    }
     plotData.push_back(accuracyTraining);
-    plotData.push_back(accuracyTest);
+
+    return testSet.EvaluateOrDefer(neuralnet, name, plotData);
 }
 
 
@@ -232,132 +605,814 @@ Eigen::MatrixXd BuildConfusionMatrix(const NeuralNetDigitClassifier& neuralnet,
 }
 
 
+/** Prepare an in-memory training set for an epoch by shuffling its visiting order.
+@param[in/out] trainingSet The sampler over the training set.
+@return true
+*/
+bool prepareEpoch(EpochSampler& trainingSet)
+{
+    trainingSet.Shuffle();
+    return true;
+}
+
+
+/** A streaming source shuffles as it reads, so there is nothing to prepare.
+@return true
+*/
+bool prepareEpoch(StreamingDataSource&)
+{
+    return true;
+}
+
+
+/** Check that the last pass over the training set read all of it.
+@return true
+*/
+bool checkEpoch(const EpochSampler&)
+{
+    return true;
+}
+
+
+/** Check that the last pass over a streaming source was not cut short by an I/O error.
+@param[in] trainingSet The streaming source.
+@return true if the pass completed.
+*/
+bool checkEpoch(const StreamingDataSource& trainingSet)
+{
+    if (FileIO::CheckLoad(trainingSet.GetError()))
+        return true;
+    std::cout << "Unable to stream the training set." << std::endl;
+    return false;
+}
+
+
+/** The inputs of a streamed sample, which the network pads.
+@param[in] trainer The sample.
+@return The inputs.
+*/
+const InputType& trainingInputs(const Trainer& trainer)
+{
+    return trainer.GetInputs();
+}
+
+
+/** A sampled sample's inputs were padded by a loader thread, so the network reads them in place.
+@param[in] sample The sample.
+@return The padded inputs.
+*/
+PaddedInput trainingInputs(const EpochSampler::Sample& sample)
+{
+    return sample.GetPaddedInputs();
+}
+
+
+/** Encode the target of a streamed sample.
+@param[in] trainer The sample.
+@return The target activations.
+*/
+NeuralNetDigitClassifier::OutputType encodedTargets(const Trainer& trainer)
+{
+    return NeuralNetDigitClassifier::EncodeTarget(trainer.GetTarget());
+}
+
+
+/** A sampled sample's targets were encoded by a loader thread.
+@param[in] sample The sample.
+@return The target activations.
+*/
+EpochSampler::Sample::TargetsType encodedTargets(const EpochSampler::Sample& sample)
+{
+    return sample.GetTargets();
+}
+
+
 /** Train the neuralnet.
-@param[in] trainingSet    The vector of training data. Pass by move (with std::move) because it gets shuffled.
-@param[in] testSet        The vector of test data. Pass by move (with std::move) because it gets shuffled.
-@param[in] numEpochs      The number of epochs to run.
-@param[in] numHiddenNodes The number of nodes in the hidden layer.
-@param[in] learningRate   The learning rate.
-@param[in] momentum       The momentum. 0 to 1. 0 is equivalent to no momentum.
-@param[in] writePlotData  [default: false] true to save the accuracy data to a file for plotting later.
-*/
-void train(std::vector<Trainer>&& trainingSet, 
-           std::vector<Trainer>&& testSet, 
-           const unsigned numEpochs, 
-           const unsigned numHiddenNodes,
-           const double   learningRate, 
-           const double   momentum, 
-           const bool     writePlotData=false)
+@param[in] trainingSet       The training data. Either an EpochSampler over the in-memory training set, or a StreamingDataSource.
+@param[in] testSet           The test data loading on another thread: a vector, or a SparseDatasetView. Only the test set
+                             evaluations wait for it.
+@param[in] numEpochs         The most epochs to run.
+@param[in] numHiddenNodes    The number of nodes in the hidden layer.
+@param[in] optimizerSettings The update rule and its hyperparameters. The learning rate comes from the schedule.
+@param[in] schedule          The learning rate of each epoch.
+@param[in] earlyStopping     When to stop before numEpochs. If enabled, every epoch's test accuracy is needed,
+                             so the first evaluation waits for the test set, and the best network is kept.
+@param[in] writePlotData     [default: false] true to save the accuracy data to a file for plotting later.
+@param[in] pCounters         [default: nullptr] If not null, counts the hardware events of the training and the training set
+                             evaluation of every epoch on this thread, and prints them per sample.
+@param[in] pTeam             [default: nullptr] If not null, the threads each sample's input layer is split across.
+@return false if the training set could not be read or the test set failed to load.
+*/
+template <typename TrainingSet, typename TestSet>
+bool train(TrainingSet&&                     trainingSet, 
+           std::future<LoadedSet<TestSet>>&& testSet, 
+           const unsigned                    numEpochs, 
+           const unsigned                    numHiddenNodes,
+           const OptimizerSettings&          optimizerSettings,
+           const LearningRateSchedule&       schedule,
+           EarlyStopping                     earlyStopping,
+           const bool                        writePlotData=false,
+           PerfCounters*                     pCounters=nullptr,
+           WorkerTeam*                       pTeam=nullptr)
 {
     // display training params
-    const auto displayParams = [numHiddenNodes, learningRate, momentum]() {
+    const auto displayParams = [numHiddenNodes, &optimizerSettings, &schedule, &earlyStopping, pTeam]() {
         std::cout << "\n"
                   << "Training Parameters:\n"
                   << "    num hidden nodes = " << numHiddenNodes << "\n"
-                  << "    learning rate = " << learningRate << "\n"
-                  << "    momentum = " << momentum << "\n"
-                  << "    random seed = 0x" << std::hex << Global::get_seed() << std::dec << std::endl;
+                  << "    optimizer = " << Optimizer::TypeName(optimizerSettings.type) << "\n"
+                  << "    learning rate = " << optimizerSettings.learningRate << "\n"
+                  << "    learning rate schedule = " << LearningRateSchedule::TypeName(schedule.GetType());
+        if (schedule.GetWarmupEpochs() > 0)
+            std::cout << ", " << schedule.GetWarmupEpochs() << " warmup epochs";
+        std::cout << "\n";
+        if (optimizerSettings.type == OptimizerType::MOMENTUM || optimizerSettings.type == OptimizerType::NESTEROV)
+            std::cout << "    momentum = " << optimizerSettings.momentum << "\n";
+        if (earlyStopping.IsEnabled())
+            std::cout << "    early stopping = after " << earlyStopping.GetPatience() << " epochs without a test accuracy gain over "
+                      << earlyStopping.GetMinDelta() * 100 << "%\n";
+        if (pTeam != nullptr)
+            std::cout << "    intra-op threads = " << pTeam->GetNumThreads() << "\n";
+        std::cout << "    random seed = 0x" << std::hex << Global::get_seed() << std::dec << std::endl;
     };
     displayParams();
 
     // init neural net
     NeuralNetDigitClassifier neuralnet(numHiddenNodes);
+    Optimizer                optimizer(optimizerSettings);
+    // with a NUMA topology, each thread of the team works on columns in its own node's memory
+    if (pTeam != nullptr && !neuralnet.PlaceInputLayer(*pTeam, optimizer))
+        std::cout << "Unable to move the input layer to the NUMA nodes of the intra-op threads: " << std::strerror(errno) << std::endl;
 
     std::vector<double> plotData;
+    PendingTestSet<TestSet> pendingTestSet(std::move(testSet));
+    using Clock = std::chrono::steady_clock;
+    const Clock::time_point runStart = Clock::now();
+
+    // early stopping decides on the test accuracy, so it can't be deferred
+    if (earlyStopping.IsEnabled())
+    {
+        ScopedTimer timer("wait for test set");
+        if (!pendingTestSet.Wait(plotData))
+            return false;
+    }
 
     // check initial accuracy
     std::cout << "\nInitial accuracy evaluation..." << std::endl;
-    EvaluateWrapper(neuralnet, trainingSet, testSet, plotData);
+    {
+        ScopedTimer timer("evaluate", 0);
+        if (!EvaluateWrapper(neuralnet, trainingSet, pendingTestSet, "initial", plotData, pCounters))
+            return false;
+    }
+    NeuralNetDigitClassifier bestNeuralnet = neuralnet;
+    if (earlyStopping.IsEnabled() && earlyStopping.Update(0, plotData.back()))
+        bestNeuralnet = neuralnet;
 
     // for every epoch...
-    for (unsigned epochIndex = 0; epochIndex < numEpochs; ++epochIndex)
+    unsigned epochsRun = 0;
+    while (epochsRun < numEpochs && !earlyStopping.ShouldStop())
     {
+        const unsigned epochIndex = epochsRun++;
+        const int      epoch      = static_cast<int>(epochIndex + 1);
+        const Clock::time_point epochStart = Clock::now();
+        optimizer.SetLearningRate(schedule.Rate(epochIndex));
+
         // shuffle the training set
-        std::shuffle(trainingSet.begin(), trainingSet.end(), Global::rng());
+        {
+            ScopedTimer timer("shuffle", epoch);
+            if (!prepareEpoch(trainingSet))
+                return false;
+        }
 
-        NeuralNetDigitClassifier::OutputType targets(10);
-        
         // for every training input...
-        for (auto& trainer : trainingSet)
+        size_t numSamples = 0;
+        PerfCounters::Values trainCounts;
         {
-            // set the expted target for this input
-            targets.setConstant(0.1);
-            targets(trainer.GetTarget()) = 0.9;
-            // call the neural net training routine
-            neuralnet.TrainFromInput(trainer.GetInputs(), targets, learningRate, momentum);
+            ScopedTimer timer("train", epoch);
+            if (pCounters != nullptr)
+            {
+                pCounters->Reset();
+                pCounters->Start();
+            }
+            for (const auto& trainer : trainingSet)
+            {
+                // call the neural net training routine
+                neuralnet.TrainFromInput(trainingInputs(trainer), encodedTargets(trainer), optimizer, pTeam);
+                ++numSamples;
+            }
+            if (pCounters != nullptr)
+            {
+                pCounters->Stop();
+                trainCounts = pCounters->Read();
+            }
         }
+        if (!checkEpoch(trainingSet))
+            return false;
+        const double epochSeconds = std::chrono::duration<double>(Clock::now() - epochStart).count();
+        Trace::Counter("samples/s", numSamples / epochSeconds);
 
         // evaluate
         std::cout << "\nEnd of Epoch " << epochIndex + 1 << " of " << numEpochs << ". Evaluating accuracy..." << std::endl;
-        EvaluateWrapper(neuralnet, trainingSet, testSet, plotData);
+        std::cout << "    Epoch Training Time   : " << epochSeconds << " s" << std::endl;
+        std::cout << "    Samples per Second    : " << numSamples / epochSeconds << std::endl;
+        if (pCounters != nullptr)
+            std::cout << "    Train Counters        : " << PerfCounters::Describe(trainCounts, double(numSamples)) << std::endl;
+        std::cout << "    Learning Rate         : " << optimizer.GetSettings().learningRate << std::endl;
+        {
+            ScopedTimer timer("evaluate", epoch);
+            if (!EvaluateWrapper(neuralnet, trainingSet, pendingTestSet, "epoch " + std::to_string(epoch), plotData, pCounters))
+                return false;
+        }
+        if (earlyStopping.IsEnabled() && earlyStopping.Update(epochIndex + 1, plotData.back()))
+            bestNeuralnet = neuralnet;
+    }
+    const double runSeconds = std::chrono::duration<double>(Clock::now() - runStart).count();
+
+    // report where the run stopped
+    std::cout << "\nStopped after epoch " << epochsRun << " of " << numEpochs << ", " << runSeconds << " s after training started";
+    if (earlyStopping.ShouldStop())
+        std::cout << ": no test accuracy gain over " << earlyStopping.GetMinDelta() * 100 << "% in " << earlyStopping.GetPatience() << " epochs";
+    std::cout << "." << std::endl;
+    if (earlyStopping.IsEnabled())
+    {
+        std::cout << "Keeping the network of epoch " << earlyStopping.GetBestEpoch() << ", test accuracy " << earlyStopping.GetBestAccuracy() * 100 << "%." << std::endl;
+        neuralnet = bestNeuralnet;
+    }
+
+    // the test set is needed from here on
+    {
+        ScopedTimer timer("wait for test set");
+        if (!pendingTestSet.Wait(plotData))
+            return false;
     }
 
     // save plot data
     if (writePlotData)
+    {
+        ScopedTimer timer("write plot data");
         FileIO::savePlotData(plotData);
+    }
 
     // display training params again
     displayParams();
 
     // display confusion matrix
-    const Eigen::MatrixXd confusionMatrix = BuildConfusionMatrix(neuralnet, testSet);
+    Eigen::MatrixXd confusionMatrix;
+    {
+        ScopedTimer timer("confusion matrix");
+        confusionMatrix = BuildConfusionMatrix(neuralnet, pendingTestSet.Get());
+    }
     std::cout << "\nConfusion Matrix\n"
               << "    y-axis=correct answer\n"
               << "    x-axis=guessed answer\n"
               << confusionMatrix << std::endl;
+
+    return true;
+}
+
+
+/** Train with each optimizer at its default learning rate and compare the training time to reach a test accuracy.
+Every run starts from the same initial weights and visits the samples in the same orders.
+Only the training passes are timed, not the evaluations.
+@param[in] basePath       The directory holding the files.
+@param[in] maxEpochs      The most epochs to run with each optimizer.
+@param[in] numHiddenNodes The number of nodes in the hidden layer.
+@param[in] targetAccuracy The test accuracy to reach. 0 to 1.
+@return true if the data sets could be loaded.
+*/
+bool optimizerReport(const std::string& basePath, const unsigned maxEpochs, const unsigned numHiddenNodes, const double targetAccuracy)
+{
+    std::vector<Trainer> trainingSet;
+    std::vector<Trainer> testSet;
+    if (!loadTrainingSet(basePath, trainingSet, std::cout) || !loadTestSet(basePath, testSet, std::cout))
+        return false;
+
+    using Clock = std::chrono::steady_clock;
+    const long long seed = Global::get_seed();
+
+    std::cout << "\nTime to " << targetAccuracy * 100 << "% test accuracy, " << numHiddenNodes << " hidden nodes, at most " << maxEpochs << " epochs\n"
+              << "optimizer   learning rate   epochs   training time (s)   best accuracy\n";
+    for (const OptimizerType type : { OptimizerType::MOMENTUM, OptimizerType::NESTEROV, OptimizerType::RMSPROP, OptimizerType::ADAM })
+    {
+        OptimizerSettings settings;
+        settings.type         = type;
+        settings.learningRate = OptimizerSettings::DefaultLearningRate(type);
+
+        // the seed fixes the initial weights and the sample orders
+        Global::set_seed(seed);
+        NeuralNetDigitClassifier neuralnet(numHiddenNodes);
+        Optimizer                optimizer(settings);
+        EpochSampler             sampler(trainingSet, 0, 1);
+
+        double   seconds      = 0;
+        double   bestAccuracy = 0;
+        unsigned epochs       = 0;
+        while (epochs < maxEpochs && bestAccuracy < targetAccuracy)
+        {
+            const Clock::time_point start = Clock::now();
+            sampler.Shuffle();
+            for (const auto& sample : sampler)
+                neuralnet.TrainFromInput(sample.GetPaddedInputs(), sample.GetTargets(), optimizer);
+            seconds += std::chrono::duration<double>(Clock::now() - start).count();
+            ++epochs;
+            bestAccuracy = std::max(bestAccuracy, Evaluate(neuralnet, testSet));
+        }
+
+        std::cout << std::left << std::setw(12) << Optimizer::TypeName(type)
+                  << std::setw(16) << settings.learningRate;
+        if (bestAccuracy >= targetAccuracy)
+            std::cout << std::setw(9) << epochs << std::setw(20) << seconds;
+        else
+            std::cout << std::setw(29) << "not reached";
+        std::cout << bestAccuracy * 100 << "%" << std::endl;
+    }
+    return true;
+}
+
+
+/** Run a hyperparameter sweep. The data sets are loaded once and shared by every run.
+Prints the runs by test accuracy and writes the results table.
+@param[in] basePath      The directory holding the files.
+@param[in] spec          What to sweep.
+@param[in] numEpochs     The most epochs of each run.
+@param[in] schedule      The learning rate schedule, relative to each run's learning rate.
+@param[in] earlyStopping When to stop a run before numEpochs.
+@param[in] numThreads    The number of runs to train at once. 0 for one per hardware thread.
+@param[in] outPath       The results table to write.
+@param[in] pTopology     If not null, the NUMA nodes to pin the runs' threads to and copy the data sets to.
+@return true if the data sets could be loaded, the spec is valid and the table was written.
+*/
+bool sweep(const std::string& basePath, const SweepSpec& spec, const unsigned numEpochs, const LearningRateSchedule& schedule,
+           const EarlyStopping& earlyStopping, unsigned numThreads, const std::string& outPath, const NumaTopology* pTopology)
+{
+    Rng rng = Global::stream(StreamUse::SWEEP, 0xFFFFFF);
+    std::vector<SweepRun> runs;
+    if (!MakeSweepRuns(spec, rng, runs))
+    {
+        std::cout << "A grid sweep needs lists of values. Use --sweep-random=N to draw from ranges." << std::endl;
+        return false;
+    }
+
+    std::vector<Trainer> trainingSet;
+    std::vector<Trainer> testSet;
+    if (!loadTrainingSet(basePath, trainingSet, std::cout) || !loadTestSet(basePath, testSet, std::cout))
+        return false;
+
+    if (numThreads == 0)
+        numThreads = std::max(std::thread::hardware_concurrency(), 1u);
+    std::cout << "\nSweeping " << runs.size() << " runs of up to " << numEpochs << " epochs on " << numThreads << " threads";
+    if (pTopology != nullptr)
+        std::cout << ", pinned over " << pTopology->GetNumNodes() << " NUMA node" << (pTopology->GetNumNodes() > 1 ? "s" : "");
+    std::cout << "." << std::endl;
+
+    using Clock = std::chrono::steady_clock;
+    const Clock::time_point start = Clock::now();
+    std::vector<SweepResult> results = RunSweep(trainingSet, testSet, runs, numEpochs, schedule, earlyStopping, numThreads, std::cout, pTopology);
+    const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    std::vector<const SweepResult*> ranked;
+    for (const SweepResult& result : results)
+        ranked.push_back(&result);
+    std::stable_sort(ranked.begin(), ranked.end(), [](const SweepResult* a, const SweepResult* b) { return a->bestAccuracy > b->bestAccuracy; });
+
+    std::cout << "\nrun    optimizer   hidden   learning rate   momentum   epochs   mean epoch (s)   best accuracy\n";
+    for (const SweepResult* pResult : ranked)
+    {
+        const SweepRun& run = pResult->run;
+        double totalSeconds = 0;
+        for (const double epochSeconds : pResult->epochSeconds)
+            totalSeconds += epochSeconds;
+        const size_t epochs = pResult->epochSeconds.size();
+        std::cout << std::left << std::setw(7) << run.index
+                  << std::setw(12) << Optimizer::TypeName(run.optimizer)
+                  << std::setw(9) << run.numHidden
+                  << std::setw(16) << run.learningRate
+                  << std::setw(11) << run.momentum
+                  << std::setw(9) << epochs
+                  << std::setw(17) << (epochs > 0 ? totalSeconds / epochs : 0)
+                  << pResult->bestAccuracy * 100 << "% (epoch " << pResult->bestEpoch << ")\n";
+    }
+    std::cout << "\nSweep time: " << seconds << " s" << std::endl;
+
+    if (!WriteSweepTable(outPath, results))
+    {
+        std::cout << "Unable to write " << outPath << std::endl;
+        return false;
+    }
+    std::cout << "Results written to " << outPath << std::endl;
+    return true;
+}
+
+
+/** Make the models of an ensemble. Each model's weights come from its own random stream.
+@param[in] numModels      The number of models.
+@param[in] numHiddenNodes The number of nodes in each model's hidden layer.
+@return The models.
+*/
+std::vector<NeuralNetDigitClassifier> makeEnsembleModels(const unsigned numModels, const unsigned numHiddenNodes)
+{
+    std::vector<NeuralNetDigitClassifier> models;
+    for (unsigned m = 0; m < numModels; ++m)
+    {
+        Rng rng = Global::stream(StreamUse::ENSEMBLE, m);
+        models.emplace_back(numHiddenNodes, rng);
+    }
+    return models;
+}
+
+
+/** Train an ensemble and report the accuracy of the combined models and of the single models after every epoch.
+@param[in] basePath          The directory holding the files.
+@param[in] numModels         The number of models.
+@param[in] numEpochs         The number of epochs to run.
+@param[in] numHiddenNodes    The number of nodes in each model's hidden layer.
+@param[in] optimizerSettings The update rule and its hyperparameters. The learning rate comes from the schedule.
+@param[in] schedule          The learning rate of each epoch.
+@param[in] blockShuffle      The shuffle block size of the training set. 0 for single samples.
+@param[in] loaderThreads     The number of threads preparing batches.
+@param[in] augment           Whether to distort the training samples every epoch.
+@return true if the data sets could be loaded.
+*/
+bool trainEnsemble(const std::string& basePath, const unsigned numModels, const unsigned numEpochs, const unsigned numHiddenNodes,
+                   const OptimizerSettings& optimizerSettings, const LearningRateSchedule& schedule, const size_t blockShuffle, const unsigned loaderThreads,
+                   const bool augment)
+{
+    std::vector<Trainer> trainingSet;
+    std::vector<Trainer> testSet;
+    if (!loadTrainingSet(basePath, trainingSet, std::cout) || !loadTestSet(basePath, testSet, std::cout))
+        return false;
+
+    std::cout << "\nTraining an ensemble of " << numModels << " models with " << numHiddenNodes << " hidden nodes each, optimizer "
+              << Optimizer::TypeName(optimizerSettings.type) << "." << std::endl;
+    EnsembleClassifier ensemble(makeEnsembleModels(numModels, numHiddenNodes));
+    Optimizer          optimizer(optimizerSettings);
+    EpochSampler       sampler(trainingSet, blockShuffle, loaderThreads);
+    if (augment)
+        sampler.EnableAugmentation(AugmentParams());
+
+    using Clock = std::chrono::steady_clock;
+    for (unsigned epochIndex = 0; epochIndex < numEpochs; ++epochIndex)
+    {
+        const Clock::time_point epochStart = Clock::now();
+        optimizer.SetLearningRate(schedule.Rate(epochIndex));
+        sampler.Shuffle();
+        for (const auto& sample : sampler)
+            ensemble.TrainFromInput(sample.GetInputs(), sample.GetTargets(), optimizer);
+        const double epochSeconds = std::chrono::duration<double>(Clock::now() - epochStart).count();
+
+        std::cout << "\nEnd of Epoch " << epochIndex + 1 << " of " << numEpochs << ". Evaluating accuracy..." << std::endl;
+        std::cout << "    Epoch Training Time   : " << epochSeconds << " s (" << sampler.size() / epochSeconds << " samples/s)" << std::endl;
+        ensemble.SetCombine(EnsembleClassifier::Combine::AVERAGE);
+        std::cout << "    Test Set Accuracy     : " << Evaluate(ensemble, testSet) * 100 << "% averaged, ";
+        ensemble.SetCombine(EnsembleClassifier::Combine::VOTE);
+        std::cout << Evaluate(ensemble, testSet) * 100 << "% voted" << std::endl;
+
+        double meanAccuracy = 0;
+        double bestAccuracy = 0;
+        for (unsigned m = 0; m < numModels; ++m)
+        {
+            const double accuracy = Evaluate(ensemble.GetModel(m), testSet);
+            meanAccuracy += accuracy / numModels;
+            bestAccuracy = std::max(bestAccuracy, accuracy);
+        }
+        std::cout << "    Single Model Accuracy : " << meanAccuracy * 100 << "% mean, " << bestAccuracy * 100 << "% best" << std::endl;
+    }
+    return true;
+}
+
+
+/** Print the NUMA nodes, and where --numa puts the threads of a sweep or a team.
+The bandwidth between the nodes is the NumaRead benchmark of NeuralNetBench.
+@param[in] topology The nodes.
+*/
+void numaReport(const NumaTopology& topology)
+{
+    const std::vector<NumaTopology::Node>& nodes = topology.GetNodes();
+    topology.Describe(std::cout);
+
+    const unsigned numThreads = std::max(std::thread::hardware_concurrency(), 1u);
+    std::cout << "\n" << numThreads << " threads, the default sweep, pinned as\n";
+    for (size_t n = 0; n < nodes.size(); ++n)
+    {
+        std::cout << "node " << nodes[n].id << ":";
+        for (unsigned thread = 0; thread < numThreads; ++thread)
+        {
+            if (topology.NodeOfThread(thread, numThreads) == n)
+                std::cout << " " << thread << "->cpu" << topology.CpuOfThread(thread, numThreads);
+        }
+        std::cout << "\n";
+    }
+    std::cout.flush();
 }
 
 
 // ==================================================================
 // parse args
 
+/** Command-line settings.
+*/
+struct Settings
+{
+    // positional arguments
+    std::string   basePath      = R"(../../data/)";
+    unsigned      numEpochs     = 50;
+    unsigned      numHidden     = 20;
+    double        learningRate  = 0;  // 0: the optimizer's default
+    double        momentum      = 0.9;
+    bool          writePlotData = false;
+
+    // options
+    bool          stream          = false;
+    size_t        memoryBudgetMB  = 256;
+    size_t        shardSize       = 0;  // 0: don't write shards
+    size_t        syntheticSize   = 0;  // 0: don't write a synthetic data set
+    bool          sparse          = false;
+    bool          sparseReport    = false;
+    size_t        blockShuffle    = 0;  // 0: shuffle single samples
+    unsigned      loaderThreads   = 1;
+    bool          augment         = false;
+    OptimizerType optimizer       = OptimizerType::MOMENTUM;
+    bool          optimizerReport = false;
+    double        targetAccuracy  = 0.97;
+    ScheduleType  schedule        = ScheduleType::CONSTANT;
+    unsigned      warmupEpochs    = 0;
+    unsigned      stepEpochs      = 10;
+    double        stepFactor      = 0.5;
+    unsigned      patience        = 0;  // 0: no early stopping
+    double        minDelta        = 0;
+    bool          sweep           = false;
+    std::string   sweepHidden;                  // empty: numHidden
+    std::string   sweepLearningRate;            // empty: learningRate
+    std::string   sweepMomentum;                // empty: momentum
+    std::vector<OptimizerType> sweepOptimizers; // empty: optimizer
+    size_t        sweepRandom     = 0;  // 0: grid
+    unsigned      sweepThreads    = 0;  // 0: one per hardware thread
+    std::string   sweepOut        = "sweep.csv";
+    unsigned      ensemble        = 0;  // 0: train one network
+    unsigned      intraThreads    = 1;  // 1: each sample on one thread
+    bool          profile         = false;
+    std::string   tracePath;                    // empty: no trace file
+    bool          counters        = false;
+    bool          selfTest        = false;
+    std::string   kernelIsa;                    // empty: the best the CPU supports
+    bool          numa            = false;
+    bool          numaReport      = false;
+
+    /** Get the settings of the chosen optimizer.
+    @return The optimizer settings. The learning rate is the optimizer's default unless one was given.
+    */
+    OptimizerSettings GetOptimizerSettings() const
+    {
+        OptimizerSettings optimizerSettings;
+        optimizerSettings.type         = optimizer;
+        optimizerSettings.learningRate = learningRate > 0 ? learningRate : OptimizerSettings::DefaultLearningRate(optimizer);
+        optimizerSettings.momentum     = momentum;
+        return optimizerSettings;
+    }
+
+    // the smallest values of the swept hyperparameters
+    constexpr static double MIN_SWEEP_HIDDEN        = 1;
+    constexpr static double MIN_SWEEP_LEARNING_RATE = std::numeric_limits<double>::denorm_min();  // above 0
+    constexpr static double MIN_SWEEP_MOMENTUM      = 0;
+
+    /** Get the sweep spec. Each hyperparameter that is not swept takes its single value from the other settings.
+    @param[out] out_spec The spec.
+    @return false if a value could not be parsed.
+    */
+    bool GetSweepSpec(SweepSpec& out_spec) const
+    {
+        out_spec.optimizers   = sweepOptimizers.empty() ? std::vector<OptimizerType>{ optimizer } : sweepOptimizers;
+        out_spec.randomRuns   = sweepRandom;
+        out_spec.numHidden    = SweepAxis::Single(numHidden);
+        out_spec.learningRate = SweepAxis::Single(GetOptimizerSettings().learningRate);
+        out_spec.momentum     = SweepAxis::Single(momentum);
+        return (sweepHidden.empty()       || SweepAxis::Parse(sweepHidden,       MIN_SWEEP_HIDDEN,        out_spec.numHidden))
+            && (sweepLearningRate.empty() || SweepAxis::Parse(sweepLearningRate, MIN_SWEEP_LEARNING_RATE, out_spec.learningRate))
+            && (sweepMomentum.empty()     || SweepAxis::Parse(sweepMomentum,     MIN_SWEEP_MOMENTUM,      out_spec.momentum));
+    }
+
+    /** Get the learning rate schedule.
+    @return The schedule, starting from the optimizer's learning rate.
+    */
+    LearningRateSchedule GetSchedule() const
+    {
+        return LearningRateSchedule(schedule, GetOptimizerSettings().learningRate, numEpochs, warmupEpochs, stepEpochs, stepFactor);
+    }
+};
+
+
 /** Print the usage.
 */
 void displayHelp()
 {
     std::cout << "Usage:\n"
-              << "./NeuralNet [dataPath] [numEpochs] [numHidden] [learningRate] [momentum] [defaultSeed] [writePlotData]\n\n" 
+              << "./NeuralNet [dataPath] [numEpochs] [numHidden] [learningRate] [momentum] [defaultSeed] [writePlotData] [options]\n\n" 
               << "    dataPath      - Path to data file directory. Type: string. Default: \"../../data/\"\n"
               << "    numEpochs     - Number of epochs. Type: unsigned. Range: >0. Default: 50\n"
               << "    numHidden     - Number of nodes in the hidden layer. Type: unsigned. Range: >0. Default: 20\n"
-              << "    learningRate  - The learning rate. Type: double. Range: >0. Default: 0.1\n"
+              << "    learningRate  - The learning rate. Type: double. Range: >0. Default: 0.1 (0.001 for rmsprop and adam)\n"
               << "    momentum      - Coefficient of previous weight change. Range: [0, ~0.97]. Default: 0.9\n"
               << "    defaultSeed   - Helps with reproducibility when debugging. 1: use default seed. 0: use clock. Default: 0\n"
               << "    writePlotData - Write plot data to file \"plotdata.csv\". 0: don't write. 1: write. Default: 0\n"
+              << "\n"
+              << "Options (may appear anywhere):\n"
+              << "    --write-shards=N     - Split mnist_train.bin into shards of N samples (mnist_train.NNN.bin) and exit.\n"
+              << "    --write-synthetic=N  - Write a synthetic data set of N training samples, and N/6 test samples, to dataPath\n"
+              << "                           in every file format and exit. Runs --write-shards first if given.\n"
+              << "    --stream             - Stream the training set from its shards instead of loading it into memory.\n"
+              << "    --memory-budget=MB   - Memory for buffering the streamed training set. Default: 256\n"
+              << "    --sparse             - Evaluate the test set from its sparse cache (mnist_test.csr).\n"
+              << "    --sparse-report      - Compare the size and cold load time of the dense and sparse caches and exit.\n"
+              << "    --block-shuffle=N    - Shuffle the in-memory training set in blocks of N consecutive samples. Default: 0 (single samples)\n"
+              << "    --loader-threads=N   - Threads preparing batches of the in-memory training set. Default: 1\n"
+              << "    --augment            - Randomly shift, rotate, scale and elastically distort the in-memory training samples\n"
+              << "                           every epoch.\n"
+              << "    --optimizer=NAME     - The weight update rule: momentum, nesterov, rmsprop or adam. Default: momentum\n"
+              << "    --optimizer-report   - Train with each optimizer from the same initial weights for up to numEpochs epochs,\n"
+              << "                           compare the training time to reach the target test accuracy and exit.\n"
+              << "    --target-accuracy=A  - The target test accuracy of --optimizer-report. Range: (0, 1]. Default: 0.97\n"
+              << "    --lr-schedule=NAME   - The learning rate over the epochs: constant, step or cosine. Default: constant\n"
+              << "    --lr-step=N          - The epochs between the steps of the step schedule. Range: >0. Default: 10\n"
+              << "    --lr-step-factor=F   - What the step schedule multiplies the learning rate by at each step. Default: 0.5\n"
+              << "    --lr-warmup=N        - Raise the learning rate linearly over the first N epochs. Default: 0\n"
+              << "    --patience=N         - Stop after N epochs without a test accuracy gain, keeping the best network. Default: 0 (never)\n"
+              << "    --min-delta=D        - The smallest test accuracy gain that resets the patience. Range: [0, 1). Default: 0\n"
+              << "    --sweep              - Train many networks at once from one copy of the data, write a results table and exit.\n"
+              << "    --sweep-hidden=V     - The hidden layer sizes to sweep: a list \"20,50,100\" or, for --sweep-random, a range \"20:200\".\n"
+              << "    --sweep-lr=V         - The learning rates to sweep. A list or a range. Default: learningRate\n"
+              << "    --sweep-momentum=V   - The momentums to sweep. A list or a range. Default: momentum\n"
+              << "    --sweep-optimizer=L  - The optimizers to sweep, a list \"momentum,adam\". Default: --optimizer\n"
+              << "    --sweep-random=N     - Draw N random runs from the lists and ranges instead of running the grid. Default: 0 (grid)\n"
+              << "    --sweep-threads=N    - The number of runs to train at once. Default: 0 (one per hardware thread)\n"
+              << "    --sweep-out=PATH     - The results table. Default: sweep.csv\n"
+              << "    --ensemble=N         - Train N networks at once with their input layers fused, and report the accuracy\n"
+              << "                           of their averaged and voted outputs. Not with --patience, --min-delta, --sparse, --stream\n"
+              << "                           or --intra-threads.\n"
+              << "    --intra-threads=N    - Split each sample's input layer across N threads, by hidden node. Pays at large hidden\n"
+              << "                           layers, see TrainIntraOp in NeuralNetBench. Default: 1\n"
+              << "    --profile            - Time the phases of the run on every thread and print a summary at the end.\n"
+              << "    --trace=PATH         - Time the phases like --profile and write them to PATH as a Chrome trace (JSON).\n"
+              << "    --counters           - Count hardware events while loading, training and evaluating, and print the instructions\n"
+              << "                           per cycle and the cache and branch misses per sample. Linux only.\n"
+              << "    --self-test          - Check the optimized training and inference paths against the reference implementation and exit.\n"
+              << "    --isa=NAME           - Use the kernels built for an instruction set: scalar, sse4.2, avx2 or avx512.\n"
+              << "                           Default: the best one this CPU supports.\n"
+              << "    --numa               - Place threads and memory by NUMA node, from the topology in sysfs: pin the sweep and\n"
+              << "                           intra-op threads, copy the data sets to each node a sweep runs on, and move each\n"
+              << "                           intra-op thread's share of the input layer to its node. Linux only.\n"
+              << "    --numa-report        - Print the NUMA nodes and the thread placement and exit.\n"
               << std::endl;
 }
 
 
+/** Parse one "--name=value" option.
+@param[in]     arg      The argument, starting with "--".
+@param[in/out] settings The settings to update.
+@return false if the option is unknown or its value could not be parsed.
+*/
+bool parseOption(const std::string& arg, Settings& settings)
+{
+    const size_t equals = arg.find('=');
+    const std::string name  = arg.substr(2, equals == std::string::npos ? std::string::npos : equals - 2);
+    const std::string value = equals == std::string::npos ? std::string() : arg.substr(equals + 1);
+    KernelIsa isa;
+    SweepAxis axis;  // checks a sweep list or range
+
+    try
+    {
+        if (name == "stream" && value.empty())
+            settings.stream = true;
+        else if (name == "memory-budget")
+            settings.memoryBudgetMB = std::stoul(value);
+        else if (name == "write-shards")
+            settings.shardSize = std::stoul(value);
+        else if (name == "write-synthetic" && std::stoul(value) > 0 && std::stoul(value) <= 0xFFFFFFFF)
+            settings.syntheticSize = std::stoul(value);
+        else if (name == "sparse" && value.empty())
+            settings.sparse = true;
+        else if (name == "sparse-report" && value.empty())
+            settings.sparseReport = true;
+        else if (name == "block-shuffle")
+            settings.blockShuffle = std::stoul(value);
+        else if (name == "loader-threads" && std::stoul(value) > 0)
+            settings.loaderThreads = std::stoul(value);
+        else if (name == "augment" && value.empty())
+            settings.augment = true;
+        else if (name == "optimizer")
+            return Optimizer::ParseType(value, settings.optimizer);
+        else if (name == "optimizer-report" && value.empty())
+            settings.optimizerReport = true;
+        else if (name == "target-accuracy" && std::stod(value) > 0 && std::stod(value) <= 1)
+            settings.targetAccuracy = std::stod(value);
+        else if (name == "lr-schedule")
+            return LearningRateSchedule::ParseType(value, settings.schedule);
+        else if (name == "lr-step" && std::stoul(value) > 0)
+            settings.stepEpochs = std::stoul(value);
+        else if (name == "lr-step-factor" && std::stod(value) > 0)
+            settings.stepFactor = std::stod(value);
+        else if (name == "lr-warmup")
+            settings.warmupEpochs = std::stoul(value);
+        else if (name == "patience")
+            settings.patience = std::stoul(value);
+        else if (name == "min-delta" && std::stod(value) >= 0 && std::stod(value) < 1)
+            settings.minDelta = std::stod(value);
+        else if (name == "sweep" && value.empty())
+            settings.sweep = true;
+        else if (name == "sweep-hidden" && SweepAxis::Parse(value, Settings::MIN_SWEEP_HIDDEN, axis))
+            settings.sweepHidden = value;
+        else if (name == "sweep-lr" && SweepAxis::Parse(value, Settings::MIN_SWEEP_LEARNING_RATE, axis))
+            settings.sweepLearningRate = value;
+        else if (name == "sweep-momentum" && SweepAxis::Parse(value, Settings::MIN_SWEEP_MOMENTUM, axis))
+            settings.sweepMomentum = value;
+        else if (name == "sweep-optimizer")
+        {
+            std::istringstream list(value);
+            std::string optimizerName;
+            while (std::getline(list, optimizerName, ','))
+            {
+                OptimizerType type;
+                if (!Optimizer::ParseType(optimizerName, type))
+                    return false;
+                settings.sweepOptimizers.push_back(type);
+            }
+            return !settings.sweepOptimizers.empty();
+        }
+        else if (name == "sweep-random")
+            settings.sweepRandom = std::stoul(value);
+        else if (name == "sweep-threads")
+            settings.sweepThreads = std::stoul(value);
+        else if (name == "sweep-out" && !value.empty())
+            settings.sweepOut = value;
+        else if (name == "ensemble" && std::stoul(value) > 0)
+            settings.ensemble = std::stoul(value);
+        else if (name == "intra-threads" && std::stoul(value) > 0)
+            settings.intraThreads = std::stoul(value);
+        else if (name == "profile" && value.empty())
+            settings.profile = true;
+        else if (name == "trace" && !value.empty())
+            settings.tracePath = value;
+        else if (name == "counters" && value.empty())
+            settings.counters = true;
+        else if (name == "self-test" && value.empty())
+            settings.selfTest = true;
+        else if (name == "isa" && ParseKernelIsa(value, isa))
+            settings.kernelIsa = value;
+        else if (name == "numa" && value.empty())
+            settings.numa = true;
+        else if (name == "numa-report" && value.empty())
+            settings.numaReport = true;
+        else
+            return false;
+    }
+    catch (...)
+    {
+        return false;
+    }
+    return true;
+}
+
+
 /** parse the command line arguments
 @param[in] argc Length of argv.
 @param[in] argv An array of arguments.
-@return A tuple of command-line settings. (basePath, numEpochs, numHidden, learningRate, momentum, writePlotData, valid).
+@return A tuple of command-line settings and whether they were valid.
 */
-std::tuple<std::string, unsigned, unsigned, double, double, bool, bool> parseArgs(int argc, char** argv)
+std::tuple<Settings, bool> parseArgs(int argc, char** argv)
 {
-    // set defaults
-    std::string basePath = R"(../../data/)";
-    unsigned numEpochs   = 50;
-    unsigned numHidden   = 20;
-    double learningRate  = 0.1;
-    double momentum      = 0.9;
-    bool writePlotData   = false;
+    Settings settings;
+    bool valid = true;
 
-    bool valid           = true;
+    // separate the options from the positional arguments
+    std::vector<char*> args;
+    for (int i = 0; i < argc; ++i)
+    {
+        if (i > 0 && std::string(argv[i]).compare(0, 2, "--") == 0)
+        {
+            if (!parseOption(argv[i], settings))
+            {
+                std::cout << "Unable to parse option: " << argv[i] << "\n";
+                valid = false;
+            }
+        }
+        else
+            args.push_back(argv[i]);
+    }
+    argc = static_cast<int>(args.size());
+    argv = args.data();
 
     // path to files
     if (argc > 1)
     {
-        basePath = argv[1];
-        if (basePath.back() != '/' && basePath.back() != '\\')
-            basePath += '/';
+        settings.basePath = argv[1];
+        if (settings.basePath.back() != '/' && settings.basePath.back() != '\\')
+            settings.basePath += '/';
     }
     // number of epochs
     if (argc > 2)
     {
         try
         {
-            numEpochs = std::stoul(argv[2]);
+            settings.numEpochs = std::stoul(argv[2]);
         }
         catch (...)
         {
@@ -370,7 +1425,7 @@ std::tuple<std::string, unsigned, unsigned, double, double, bool, bool> parseArg
     {
         try
         {
-            numHidden = std::stoul(argv[3]);
+            settings.numHidden = std::stoul(argv[3]);
         }
         catch (...)
         {
@@ -383,7 +1438,7 @@ std::tuple<std::string, unsigned, unsigned, double, double, bool, bool> parseArg
     {
         try
         {
-            learningRate = std::stod(argv[4]);
+            settings.learningRate = std::stod(argv[4]);
         }
         catch (...)
         {
@@ -396,7 +1451,7 @@ std::tuple<std::string, unsigned, unsigned, double, double, bool, bool> parseArg
     {
         try
         {
-            momentum = std::stod(argv[5]);
+            settings.momentum = std::stod(argv[5]);
         }
         catch (...)
         {
@@ -424,7 +1479,7 @@ std::tuple<std::string, unsigned, unsigned, double, double, bool, bool> parseArg
     {
         try
         {
-            writePlotData = (std::stoi(argv[7]) != 0);
+            settings.writePlotData = (std::stoi(argv[7]) != 0);
         }
         catch (...)
         {
@@ -433,13 +1488,26 @@ std::tuple<std::string, unsigned, unsigned, double, double, bool, bool> parseArg
         }
     }
 
+    // the loader options work on a training set in memory. A stream shuffles in its window, on its own reader thread.
+    if (settings.stream && (settings.augment || settings.blockShuffle > 0 || settings.loaderThreads != 1))
+    {
+        std::cout << "--augment, --block-shuffle and --loader-threads do not apply to --stream.\n";
+        valid = false;
+    }
+    // an ensemble trains on the in-memory set on one thread, and reports every epoch without keeping a best one
+    if (settings.ensemble > 0 && (settings.patience > 0 || settings.minDelta > 0 || settings.sparse || settings.stream || settings.intraThreads > 1))
+    {
+        std::cout << "--patience, --min-delta, --sparse, --stream and --intra-threads do not apply to --ensemble.\n";
+        valid = false;
+    }
+
     if (!valid)
     {
         std::cout << "\n";
         displayHelp();
     }
 
-    return std::make_tuple(basePath, numEpochs, numHidden, learningRate, momentum, writePlotData, valid);
+    return std::make_tuple(settings, valid);
 }
 
 
@@ -449,28 +1517,175 @@ std::tuple<std::string, unsigned, unsigned, double, double, bool, bool> parseArg
 int main(int argc, char** argv)
 {
     // parse args
-    std::string basePath;
-    unsigned numEpochs;
-    unsigned numHidden;
-    double learningRate;
-    double momentum;
-    bool writePlotData;
+    Settings settings;
     bool validArgs;
-    std::tie(basePath, numEpochs, numHidden, learningRate, momentum, writePlotData, validArgs) = parseArgs(argc, argv);
+    std::tie(settings, validArgs) = parseArgs(argc, argv);
     if (!validArgs)
         return EXIT_FAILURE;
+    if (!SelectKernels(settings.kernelIsa, std::cout))
+        return EXIT_FAILURE;
+
+    // check the math of the optimized paths
+    if (settings.selfTest)
+    {
+        std::cout << "Checking the optimized paths against the reference implementation..." << std::endl;
+        const bool passed = UnitTest::ValidateKernels(std::cout);
+        std::cout << (passed ? "All checks passed." : "Some checks FAILED.") << std::endl;
+        return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    // find the NUMA nodes, before any thread is pinned
+    NumaTopology topology;
+    if (settings.numa || settings.numaReport)
+        topology = NumaTopology::Detect();
+    const NumaTopology* const pTopology = settings.numa ? &topology : nullptr;
+
+    // make a data set
+    if (settings.syntheticSize > 0)
+    {
+        if (!writeSynthetic(settings.basePath, settings.syntheticSize))
+            return EXIT_FAILURE;
+        if (settings.shardSize == 0)
+            return EXIT_SUCCESS;
+    }
+
+    // split the training set
+    if (settings.shardSize > 0)
+        return writeShards(settings.basePath, settings.shardSize) ? EXIT_SUCCESS : EXIT_FAILURE;
+
+    // compare the caches
+    if (settings.sparseReport)
+        return sparseReport(settings.basePath) ? EXIT_SUCCESS : EXIT_FAILURE;
+
+    // compare the optimizers
+    if (settings.optimizerReport)
+        return optimizerReport(settings.basePath, settings.numEpochs, settings.numHidden, settings.targetAccuracy) ? EXIT_SUCCESS : EXIT_FAILURE;
+
+    // tune the hyperparameters
+    if (settings.sweep)
+    {
+        SweepSpec spec;
+        if (!settings.GetSweepSpec(spec))
+        {
+            std::cout << "Unable to parse the sweep values.\n\n";
+            displayHelp();
+            return EXIT_FAILURE;
+        }
+        const LearningRateSchedule relativeSchedule(settings.schedule, 1.0, settings.numEpochs, settings.warmupEpochs, settings.stepEpochs, settings.stepFactor);
+        return sweep(settings.basePath, spec, settings.numEpochs, relativeSchedule, EarlyStopping(settings.patience, settings.minDelta),
+                     settings.sweepThreads, settings.sweepOut, pTopology) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    // train several networks at once
+    if (settings.ensemble > 0)
+    {
+        return trainEnsemble(settings.basePath, settings.ensemble, settings.numEpochs, settings.numHidden, settings.GetOptimizerSettings(),
+                             settings.GetSchedule(), settings.blockShuffle, settings.loaderThreads, settings.augment) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    // place threads and memory by NUMA node
+    if (settings.numaReport)
+    {
+        numaReport(topology);
+        return EXIT_SUCCESS;
+    }
 
-    // load the data
+    // time the phases
+    if (settings.profile || !settings.tracePath.empty())
+    {
+        Trace::Enable();
+        Trace::SetThreadName("main");
+    }
+
+    // count hardware events on this thread. The run goes on without them if they are unavailable.
+    PerfCounters counters;
+    if (settings.counters && !counters.Open())
+        std::cout << "Hardware counters unavailable: " << counters.GetError() << std::endl;
+    PerfCounters* const pCounters = counters.IsOpen() ? &counters : nullptr;
+
+    // load the test set in the background while the training set loads
+    const std::string basePath = settings.basePath;
+    std::future<LoadedSet<std::vector<Trainer>>>      testSet;
+    std::future<LoadedSet<FileIO::SparseDatasetView>> sparseTestSet;
+    if (settings.sparse)
+    {
+        // the sparse test set replaces the dense one
+        sparseTestSet = loadAsync<FileIO::SparseDatasetView>([basePath](FileIO::SparseDatasetView& out_testSet, std::ostream& out) {
+            Trace::SetThreadName("test set loader");
+            ScopedTimer timer("load test set");
+            return loadSparseTestSet(basePath, out_testSet, out);
+        });
+    }
+    else
+    {
+        testSet = loadAsync<std::vector<Trainer>>([basePath](std::vector<Trainer>& out_testSet, std::ostream& out) {
+            Trace::SetThreadName("test set loader");
+            ScopedTimer timer("load test set");
+            return loadTestSet(basePath, out_testSet, out);
+        });
+    }
+
+    // load the training set
     std::vector<Trainer> trainingSet;
-    std::vector<Trainer> testSet;
-    if (!load(basePath, trainingSet, testSet))
+    StreamingDataSource  trainingStream;
     {
-        displayHelp();
+        ScopedTimer timer("load training set");
+        if (settings.stream)
+        {
+            std::cout << "Opening training set shards." << std::endl;
+            const auto shards = FileIO::FindShards(settings.basePath + "mnist_train");
+            if (!FileIO::CheckLoad(trainingStream.Open(shards, settings.memoryBudgetMB << 20)))
+            {
+                std::cout << "Unable to open shards. Create them with --write-shards=N." << std::endl;
+                return EXIT_FAILURE;
+            }
+            std::cout << "Streaming " << trainingStream.size() << " samples from " << shards.size() << " shards." << std::endl;
+        }
+        else
+        {
+            if (pCounters != nullptr)
+                pCounters->Start();
+            if (!loadTrainingSet(settings.basePath, trainingSet, std::cout))
+            {
+                displayHelp();
+                return EXIT_FAILURE;
+            }
+            if (pCounters != nullptr)
+            {
+                pCounters->Stop();
+                std::cout << "Load Counters: " << PerfCounters::Describe(pCounters->Read(), double(trainingSet.size())) << std::endl;
+            }
+        }
+    }
+
+    // train. Starts as soon as the training set is ready.
+    std::unique_ptr<WorkerTeam> pTeam;
+    if (settings.intraThreads > 1)
+        pTeam.reset(new WorkerTeam(settings.intraThreads, pTopology));
+    EpochSampler trainingSampler(trainingSet, settings.blockShuffle, settings.loaderThreads);
+    if (settings.augment)
+        trainingSampler.EnableAugmentation(AugmentParams());
+    const auto trainWith = [&](auto&& pendingTestSet) {
+        if (settings.stream)
+            return train(trainingStream, std::move(pendingTestSet), settings.numEpochs, settings.numHidden, settings.GetOptimizerSettings(),
+                         settings.GetSchedule(), EarlyStopping(settings.patience, settings.minDelta), settings.writePlotData, pCounters, pTeam.get());
+        else
+            return train(trainingSampler, std::move(pendingTestSet), settings.numEpochs, settings.numHidden, settings.GetOptimizerSettings(),
+                         settings.GetSchedule(), EarlyStopping(settings.patience, settings.minDelta), settings.writePlotData, pCounters, pTeam.get());
+    };
+    if (!(settings.sparse ? trainWith(sparseTestSet) : trainWith(testSet)))
         return EXIT_FAILURE;
+
+    // report the phase times
+    if (settings.profile)
+        Trace::PrintSummary(std::cout);
+    if (!settings.tracePath.empty())
+    {
+        if (Trace::WriteChromeTrace(settings.tracePath))
+            std::cout << "\nWrote the trace to " << settings.tracePath << std::endl;
+        else
+            std::cout << "\nUnable to write the trace to " << settings.tracePath << std::endl;
     }
-    
-    // train
-    train(std::move(trainingSet), std::move(testSet), numEpochs, numHidden, learningRate, momentum, writePlotData);
 
     std::cout << "\nEnd of program." << std::endl;
     return EXIT_SUCCESS;